@@ -12,6 +12,9 @@ layout(std140, binding = 1) uniform SceneData
     uniform bool castShadows;
 } sceneData;
 
+//Depth prepass relies on identical depth values for GL_EQUAL
+invariant gl_Position;
+
 void main()
 {
 	gl_Position = sceneData.projViewMat * u_ModelMat * vec4(aPos,1);
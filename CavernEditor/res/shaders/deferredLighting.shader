@@ -0,0 +1,61 @@
+#shader vertex
+#version 460 core
+
+//Fullscreen triangle, no vertex buffer needed
+void main()
+{
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#shader fragment
+#version 460 core
+
+layout(location = 0) out vec4 FragColor;
+layout(location = 1) out int  DrawID;
+
+#include "defs.glsl"
+#include "lightClusters.glsl"
+#include "shadowMapping.glsl"
+#include "lighting.glsl"
+
+uniform sampler2D  u_GAlbedo;
+uniform isampler2D u_GDrawID;
+uniform sampler2D  u_GNormal;
+uniform sampler2D  u_GMaterial;
+uniform sampler2D  u_GDepth;
+
+uniform mat4 u_InvProjViewMat;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(u_GDepth, texel, 0).r;
+    //Nothing was drawn here, keep the cleared background
+    if (depth == 1.0)
+        discard;
+
+    DrawID = texelFetch(u_GDrawID, texel, 0).r;
+    vec4 albedo = texelFetch(u_GAlbedo, texel, 0);
+    if (albedo.a == 0.0)
+    {
+        FragColor = vec4(albedo.rgb, 1.0);
+        return;
+    }
+
+    vec4 ndc = vec4(gl_FragCoord.xy / sceneData.viewportSize * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 worldPos = u_InvProjViewMat * ndc;
+
+    vec4 material = texelFetch(u_GMaterial, texel, 0);
+
+    Surface s;
+    s.position = worldPos.xyz / worldPos.w;
+    vec4 normals = texelFetch(u_GNormal, texel, 0);
+    s.normal = OctDecode(normals.rg);
+    s.geomNormal = OctDecode(normals.ba);
+    s.albedo = albedo.rgb;
+    s.specular = material.rgb;
+    s.shininess = material.a * GBUFFER_MAX_SHININESS;
+
+    FragColor = vec4(ShadeSurface(s, gl_FragCoord.xy), 1.0);
+}
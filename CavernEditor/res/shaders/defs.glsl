@@ -1,5 +1,4 @@
 //? #version 460 core
-//? const int MAX_LIGHTS_COUNT = 16;
 
 struct Light
 {
@@ -19,13 +18,14 @@ struct Light
     int type;
     int mipmaplevel;
     ivec2 atlasoffset;
+    int shadowmode;
+    float radius; //distance past which the light is culled
 };
 
 
-layout(std140, binding = 0) uniform LightData
+layout(std430, binding = 0) readonly buffer LightData
 {
-    Light lights[MAX_LIGHTS_COUNT];
-
+    Light lights[];
 } lightData;
 
 layout(std140, binding = 1) uniform SceneData
@@ -34,6 +34,10 @@ layout(std140, binding = 1) uniform SceneData
     uniform vec3 viewPos;
     uniform int  lightsCount;
     uniform bool castShadows;
+    uniform mat4 viewMat;
+    uniform uvec4 clusterGrid;  //tiles x, tiles y, depth slices, 1 if slices are linear
+    uniform vec4  clusterDepth; //near, far, slices / log(far / near)
+    uniform vec2  viewportSize;
 } sceneData;
 
 
@@ -50,10 +54,52 @@ struct Material
     float shininess;
 };
 
+struct Surface
+{
+    vec3  position;
+    vec3  normal;     //shading normal, may come from a normal map
+    vec3  geomNormal; //used for shadow bias
+    vec3  albedo;
+    vec3  specular;
+    float shininess;
+};
+//Shininess is stored normalized in the G-buffer's material target
+const float GBUFFER_MAX_SHININESS = 256.0;
+
+//Octahedral mapping of a unit vector to two components, so the G-buffer's normal target holds
+//both the shading and the geometric normal.
+vec2 OctEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 p = n.xy;
+    if (n.z < 0.0)
+        p = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return p;
+}
+
+vec3 OctDecode(vec2 p)
+{
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 const uint DIFF_ONLY = 0u;
 const uint DIFF_N_SPEC = 1u;
 const uint DIFF_N_NORMAL = 2u;
+const uint UNLIT_COLOR = 3u;
+
+//Mesh::VertexFormat flags
+const uint VERTEX_TANGENT_FRAME = 1u;
+const uint VERTEX_COLOR = 2u;
+const uint VERTEX_SKINNED = 4u;
+const uint VERTEX_WIDE_BONE_IDS = 8u;
 
 const int DIRECTIONAL_LIGHT = 0;
 const int POINT_LIGHT = 1;
-const int SPOT_LIGHT = 2;
\ No newline at end of file
+const int SPOT_LIGHT = 2;
+
+const int POINT_SHADOW_CUBE = 0;
+const int POINT_SHADOW_DUAL_PARABOLOID = 1;
\ No newline at end of file
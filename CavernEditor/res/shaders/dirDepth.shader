@@ -5,6 +5,9 @@ layout(location = 0) in vec3 aPos;
 uniform mat4 u_LightSpaceMat;
 uniform mat4 u_ModelMat;
 
+//Also used as the camera depth prepass, must match the main pass depth bit for bit.
+invariant gl_Position;
+
 void main()
 {
     gl_Position = u_LightSpaceMat * u_ModelMat * vec4(aPos, 1.0);
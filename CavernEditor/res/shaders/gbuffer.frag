@@ -0,0 +1,44 @@
+#version 460 core
+
+//G-buffer layout, see Renderer's GBuffer framebuffer
+layout(location = 0) out vec4 gAlbedo;   //rgb: albedo, a: 1 if lit
+layout(location = 1) out int  gDrawID;
+layout(location = 2) out vec4 gNormal;   //rg: shading normal, ba: geometric normal, see OctEncode
+layout(location = 3) out vec4 gMaterial; //rgb: specular, a: shininess / GBUFFER_MAX_SHININESS
+
+in VS_OUT
+{
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+
+    //for objects with normal map: tangent to world space
+    mat3 TBN;
+} fs_in;
+
+#include "defs.glsl"
+
+uniform uint u_ObjType;
+uniform int u_DrawId;
+uniform vec4 u_Color;
+
+uniform Material material;
+
+#include "surface.glsl"
+
+void main()
+{
+    gDrawID = u_DrawId;
+    if (u_ObjType == UNLIT_COLOR)
+    {
+        gAlbedo = vec4(u_Color.rgb, 0.0);
+        gNormal = vec4(0.0);
+        gMaterial = vec4(0.0);
+        return;
+    }
+
+    Surface s = GetSurface();
+    gAlbedo = vec4(s.albedo, 1.0);
+    gNormal = vec4(OctEncode(s.normal), OctEncode(normalize(s.geomNormal)));
+    gMaterial = vec4(s.specular, s.shininess / GBUFFER_MAX_SHININESS);
+}
@@ -1,73 +1,78 @@
 #version 460 core
 
+//Packed streams, see Mesh::VertexFormat. Only one of aOctNormal/aQTangent is bound.
 layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
-layout(location = 3) in vec3 aTangent;
-layout(location = 4) in vec3 aBitangent;
+layout(location = 8) in vec2 aOctNormal;
+layout(location = 9) in vec4 aQTangent;
 
-const int MAX_LIGHTS_COUNT = 16;
-const int MAX_DIRNSPOT_LIGHTS = 8;
+//Lighting is done in world space so the fragment shader can handle any number of lights.
 out VS_OUT{
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
 
-    //for objects with normal map
-    vec3 TangentLightPos[MAX_LIGHTS_COUNT];
-    vec3 TangentViewPos;
-    vec3 TangentFragPos;
-
-    //for dir. light shadow mapping
-    vec4 FragPosLightSpace[MAX_DIRNSPOT_LIGHTS];
+    //for objects with normal map: tangent to world space
+    mat3 TBN;
 } vs_out;
 
 #include "defs.glsl"
 
 uniform uint u_ObjType;
+uniform uint u_VertexFormat;
 //uniform uint u_HasTextures;
 
 uniform mat4 u_ModelMat;
 
+//Depth prepass relies on identical depth values for GL_EQUAL
+invariant gl_Position;
+
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+vec3 QuatRotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main()
 {
     vs_out.FragPos = vec3(u_ModelMat * vec4(aPos, 1.0));
     vs_out.TexCoords = aTexCoords;
 
-    int j = 0;
-    for (int i = 0; i < sceneData.lightsCount; ++i)
-    {
-        Light light = lightData.lights[i];
-        if (light.type == POINT_LIGHT)
-            continue;
+    mat3 normalMatrix = transpose(inverse(mat3(u_ModelMat)));
 
-        vs_out.FragPosLightSpace[j] = light.projViewMat * vec4(vs_out.FragPos, 1.0);
-        ++j;
+    vec3 normal, tangent;
+    float handedness = 1.0;
+    if ((u_VertexFormat & VERTEX_TANGENT_FRAME) != 0u)
+    {
+        //QTangent: the quaternion's sign carries the bitangent handedness
+        vec4 q = normalize(aQTangent);
+        handedness = q.w < 0.0 ? -1.0 : 1.0;
+        normal = QuatRotate(q, vec3(0.0, 0.0, 1.0));
+        tangent = QuatRotate(q, vec3(1.0, 0.0, 0.0));
+    }
+    else
+    {
+        normal = OctDecode(aOctNormal);
+        tangent = vec3(0.0);
     }
+    vs_out.Normal = normalMatrix * normal;
 
-    switch (u_ObjType)
+    if (u_ObjType == DIFF_N_NORMAL)
     {
-    case DIFF_ONLY:
-    case DIFF_N_SPEC:
-        vs_out.Normal = transpose(inverse(mat3(u_ModelMat))) * aNormal;
-        break;
-    case DIFF_N_NORMAL:
-        mat3 normalMatrix = transpose(inverse(mat3(u_ModelMat)));
-        vec3 T = normalize(normalMatrix * aTangent);
-        vec3 N = normalize(normalMatrix * aNormal);
+        vec3 T = normalize(mat3(u_ModelMat) * tangent);
+        vec3 N = normalize(vs_out.Normal);
         T = normalize(T - dot(T, N) * N);
-        vec3 B = cross(N, T);
+        vec3 B = cross(N, T) * handedness;
 
-        mat3 TBN = transpose(mat3(T, B, N));
-        for (int i = 0; i < sceneData.lightsCount; ++i)
-        {
-            //if (lightData.lights[i].enabled)
-            vs_out.TangentLightPos[i] = TBN * lightData.lights[i].position;
-        }
-        vs_out.TangentViewPos = TBN * sceneData.viewPos;
-        vs_out.TangentFragPos = TBN * vs_out.FragPos;
-        break;
+        vs_out.TBN = mat3(T, B, N);
     }
 
     gl_Position = sceneData.projViewMat * u_ModelMat * vec4(aPos, 1.0);
-}
\ No newline at end of file
+}
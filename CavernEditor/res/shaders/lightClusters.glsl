@@ -0,0 +1,34 @@
+//? #version 460 core
+//Clustered light lookup. Requires defs.glsl.
+//Clusters are filled on the CPU every frame by Renderer (see BuildLightClusters).
+
+layout(std430, binding = 2) readonly buffer LightClusters
+{
+    uvec2 ranges[]; //x: first entry in lightIndices, y: light count
+} lightClusters;
+
+layout(std430, binding = 3) readonly buffer LightIndices
+{
+    uint indices[];
+} lightIndices;
+
+const uint CLUSTER_SLICES_LINEAR = 1u;
+
+uint GetClusterIndex(vec3 fragPos, vec2 fragCoord)
+{
+    uvec3 grid = sceneData.clusterGrid.xyz;
+    vec2 tile = fragCoord / sceneData.viewportSize * vec2(grid.xy);
+
+    float near = sceneData.clusterDepth.x;
+    float far = sceneData.clusterDepth.y;
+    float depth = -(sceneData.viewMat * vec4(fragPos, 1.0)).z;
+
+    float slice;
+    if (sceneData.clusterGrid.w == CLUSTER_SLICES_LINEAR)
+        slice = (depth - near) / (far - near) * float(grid.z);
+    else
+        slice = log(max(depth, near) / near) * sceneData.clusterDepth.z;
+
+    uvec3 c = uvec3(clamp(ivec3(tile, slice), ivec3(0), ivec3(grid) - 1));
+    return c.x + grid.x * (c.y + grid.y * c.z);
+}
@@ -0,0 +1,79 @@
+//? #version 460 core
+//Light accumulation shared by the forward (general.frag) and deferred (deferredLighting.shader) paths.
+//Requires defs.glsl, lightClusters.glsl and shadowMapping.glsl.
+
+vec3 ShadeSurface(Surface s, vec2 fragCoord)
+{
+    vec3 result = vec3(0.0, 0.0, 0.0);
+
+    vec3 viewDir = normalize(sceneData.viewPos - s.position);
+
+    //Only lights whose range touches this fragment's cluster are visited.
+    uvec2 cluster = lightClusters.ranges[GetClusterIndex(s.position, fragCoord)];
+    for (uint c = 0u; c < cluster.y; ++c)
+    {
+        Light light = lightData.lights[lightIndices.indices[cluster.x + c]];
+
+        vec3 lightDir = normalize(light.position - s.position);
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+
+        float diff = max(dot(s.normal, lightDir), 0.0);
+        float spec = pow(max(dot(s.normal, halfwayDir), 0.0), s.shininess);
+
+        // combine results
+        vec3 ambient  = light.ambient * s.albedo;
+        vec3 diffuse  = light.diffuse * diff * s.albedo;
+        vec3 specular = light.specular * spec * s.specular;
+
+        ambient  *= light.color * light.brightness;
+        diffuse  *= light.color * light.brightness;
+        specular *= light.color * light.brightness;
+
+        // spotlight (soft edges)
+        if (light.type == SPOT_LIGHT)
+        {
+            float theta = dot(lightDir, normalize(-light.direction));
+            float epsilon = (light.cutOff - light.outerCutOff);
+            float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+            diffuse  *= intensity;
+            specular *= intensity;
+        }
+        // attenuation
+        if (light.type != DIRECTIONAL_LIGHT)
+        {
+            float distance = length(light.position - s.position);
+            float attenuation = 1.0 /
+                (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+            //Fade out towards the cull radius so cluster borders don't show up as seams.
+            float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+            attenuation *= window * window;
+
+            ambient *= attenuation;
+            diffuse *= attenuation;
+            specular *= attenuation;
+        }
+
+        float shadow = 0.0;
+        //mipmaplevel is negative when the light got no space in the shadow atlas.
+        if (sceneData.castShadows && light.mipmaplevel >= 0)
+        {
+            switch (light.type)
+            {
+            case SPOT_LIGHT:
+                shadow = SpotShadowCalc(s.geomNormal, s.position,
+                    light.projViewMat * vec4(s.position, 1.0), light.position, light.atlasoffset, light.mipmaplevel);
+                break;
+            case DIRECTIONAL_LIGHT:
+                shadow = DirShadowCalc(s.geomNormal, s.position,
+                    light.projViewMat * vec4(s.position, 1.0), light.position, light.atlasoffset);
+                break;
+            case POINT_LIGHT:
+                shadow = PointShadowCalc(s.position, light.position, light.atlasoffset, light.mipmaplevel, light.shadowmode);
+                break;
+            }
+        }
+        result += ambient + (1.0 - shadow) * (diffuse + specular);
+    }
+    return result;
+}
@@ -0,0 +1,114 @@
+#shader compute
+#version 460 core
+
+//One invocation per meshlet. Meshlets outside the camera frustum or facing away from it are
+//dropped, the rest append their triangles to this draw's range of the frame's index ring and
+//count them in its indirect command.
+layout(local_size_x = 64) in;
+
+#include "defs.glsl"
+
+struct Meshlet
+{
+    vec4 sphere; //xyz: center, w: radius
+    vec4 cone;   //xyz: axis, w: cutoff, 1 if it never culls
+    uint indexOffset;
+    uint indexCount;
+    uint padding[2];
+};
+
+layout(std430, binding = 4) readonly buffer Meshlets
+{
+    Meshlet meshlets[];
+};
+
+//The mesh's own index buffer, 16-bit indices are read two per word.
+layout(std430, binding = 5) readonly buffer SourceIndices
+{
+    uint srcIndices[];
+};
+
+layout(std430, binding = 6) writeonly buffer CulledIndices
+{
+    uint dstIndices[];
+};
+
+struct DrawCommand
+{
+    uint count; //zeroed when the ring starts over
+    uint instanceCount;
+    uint firstIndex;
+    int  baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 7) buffer DrawCommands
+{
+    DrawCommand cmds[];
+};
+
+uniform mat4 u_ModelMat;
+uniform float u_ModelScale; //largest axis scale of u_ModelMat
+uniform uint u_MeshletCount;
+uniform bool u_ShortIndices;
+uniform bool u_ConeCulling; //false under non-uniform scale or mirroring, see below
+uniform uint u_DrawCmd;    //this draw's command in the ring
+uniform uint u_FirstIndex; //start of this draw's range of dstIndices
+
+uint SourceIndex(uint i)
+{
+    if (u_ShortIndices)
+        return (srcIndices[i >> 1] >> ((i & 1u) * 16u)) & 0xFFFFu;
+    return srcIndices[i];
+}
+
+bool InFrustum(vec3 center, float radius)
+{
+    //Rows of the clip matrix give the planes: w +- x, w +- y, w +- z.
+    mat4 m = transpose(sceneData.projViewMat);
+    for (int i = 0; i < 3; ++i)
+    {
+        vec4 lo = m[3] + m[i];
+        vec4 hi = m[3] - m[i];
+        if (dot(lo.xyz, center) + lo.w < -radius * length(lo.xyz) ||
+            dot(hi.xyz, center) + hi.w < -radius * length(hi.xyz))
+            return false;
+    }
+    return true;
+}
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id == 0u)
+    {
+        cmds[u_DrawCmd].instanceCount = 1u;
+        cmds[u_DrawCmd].firstIndex = u_FirstIndex;
+        cmds[u_DrawCmd].baseVertex = 0;
+        cmds[u_DrawCmd].baseInstance = 0u;
+    }
+    if (id >= u_MeshletCount)
+        return;
+
+    Meshlet m = meshlets[id];
+    vec3 center = vec3(u_ModelMat * vec4(m.sphere.xyz, 1.0));
+    float radius = m.sphere.w * u_ModelScale;
+
+    if (!InFrustum(center, radius))
+        return;
+
+    //mat3(u_ModelMat) is a rotation times u_ModelScale whenever cone culling is on. Under any other
+    //matrix it would neither keep the axis normal to the meshlet's triangles nor preserve the
+    //cutoff, so visible meshlets could be dropped.
+    if (u_ConeCulling && m.cone.w < 1.0)
+    {
+        vec3 axis = normalize(mat3(u_ModelMat) * m.cone.xyz);
+        vec3 toCenter = center - sceneData.viewPos;
+        if (dot(toCenter, axis) >= m.cone.w * length(toCenter) + radius)
+            return;
+    }
+
+    uint dst = u_FirstIndex + atomicAdd(cmds[u_DrawCmd].count, m.indexCount);
+    for (uint i = 0u; i < m.indexCount; ++i)
+        dstIndices[dst + i] = SourceIndex(m.indexOffset + i);
+}
@@ -0,0 +1,50 @@
+#shader vertex
+#version 460 core
+layout(location = 0) in vec3 aPos;
+
+out vec4 FragPos;
+
+uniform mat4  u_ModelMat;
+uniform vec3  u_LightPos;
+uniform float u_FarPlane;
+
+void main()
+{
+    FragPos = u_ModelMat * vec4(aPos, 1.0);
+
+    // instance 0 renders the +Z hemisphere into the left half of the frame, instance 1 the -Z one into the right half.
+    // back hemisphere is rotated 180 degrees around Y so both keep the same orientation.
+    vec3 p = FragPos.xyz - u_LightPos;
+    if (gl_InstanceID == 1)
+        p = vec3(-p.x, p.y, -p.z);
+
+    float dist = length(p);
+    vec3 n = p / dist;
+    // clip everything behind the hemisphere's base plane
+    gl_ClipDistance[0] = n.z;
+
+    vec2 uv = n.xy / max(1.0 + n.z, 1e-3);
+    float halfOffset = gl_InstanceID == 0 ? -0.5 : 0.5;
+    gl_Position = vec4(uv.x * 0.5 + halfOffset, uv.y, dist / u_FarPlane * 2.0 - 1.0, 1.0);
+    // vertices past the base plane project far outside the unit disk, so a triangle cut by the first
+    // plane can still reach into the other half. Clip it at the seam too.
+    gl_ClipDistance[1] = gl_InstanceID == 0 ? -gl_Position.x : gl_Position.x;
+}
+
+#shader fragment
+#version 460 core
+in vec4 FragPos;
+
+uniform vec3  u_LightPos;
+uniform float u_FarPlane;
+
+void main()
+{
+    float lightDistance = length(FragPos.xyz - u_LightPos);
+
+    // map to [0;1] range by dividing by far_plane
+    lightDistance = lightDistance / u_FarPlane;
+
+    // write this as modified depth
+    gl_FragDepth = lightDistance;
+}
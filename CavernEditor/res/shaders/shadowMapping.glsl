@@ -5,10 +5,47 @@ vec3 convert_xyz_to_cube_uv(float x, float y, float z);
 uniform int u_SAtlasFramesPerRow; //3
 uniform int u_SFrameSize;
 uniform ivec2 u_SAtlasSize; 
-uniform sampler2D u_SAtlas; //3x2
+uniform sampler2DShadow u_SAtlas; //3x2
 uniform float u_PointLightFarPlane;
 uniform float u_SpotLightFarPlane;
 
+uniform int   u_ShadowPCFSamples;   //1 = single hardware-filtered tap
+uniform float u_ShadowFilterRadius; //Poisson kernel radius in texels
+
+const int MAX_SHADOW_PCF_SAMPLES = 16;
+//First 4 and 8 samples are spread evenly so that lower quality settings use a prefix of the disk.
+const vec2 POISSON_DISK[MAX_SHADOW_PCF_SAMPLES] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2( 0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2( 0.34495938,  0.29387760),
+    vec2(-0.91588581,  0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543,  0.27676845), vec2( 0.97484398,  0.75648379),
+    vec2( 0.44323325, -0.97511554), vec2( 0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2( 0.79197514,  0.19090188),
+    vec2(-0.24188840,  0.99706507), vec2(-0.81409955,  0.91437590),
+    vec2( 0.19984126,  0.78641367), vec2( 0.14383161, -0.14100790)
+);
+
+//Returns the lit fraction [0,1] of a fragment. Each tap is a hardware 2x2 PCF lookup
+//(the atlas sampler has depth compare mode enabled). Taps are clamped one texel inside
+//the atlas tile so neighbouring frames never bleed into the filter footprint.
+float SampleShadowPCF(vec2 uvTexels, vec2 tileOffset, vec2 tileSize, float refDepth)
+{
+    vec2 atlasSize = vec2(u_SAtlasSize);
+    vec2 lo = tileOffset + 1.0;
+    vec2 hi = tileOffset + tileSize - 1.0;
+
+    if (u_ShadowPCFSamples <= 1)
+        return texture(u_SAtlas, vec3(clamp(uvTexels, lo, hi) / atlasSize, refDepth));
+
+    float lit = 0.0;
+    for (int i = 0; i < u_ShadowPCFSamples; ++i)
+    {
+        vec2 uv = clamp(uvTexels + POISSON_DISK[i] * u_ShadowFilterRadius, lo, hi);
+        lit += texture(u_SAtlas, vec3(uv / atlasSize, refDepth));
+    }
+    return lit / float(u_ShadowPCFSamples);
+}
+
 ivec2 GetLightOffsetInAtlas(ivec2 offset, int level, int face)
 {
     for (int i = 0; i < face; ++i)
@@ -50,9 +87,6 @@ float SpotShadowCalc(vec3 normal, vec3 fragPos, vec4 fragPosLightSpace,
     int framesize = u_SFrameSize / int(pow(2, mipmapLevel));
 				
     vec2 uv = atlasoffset + projCoords.xy * framesize;
-    uv /= u_SAtlasSize;
-    float closestDepth = texture(u_SAtlas, uv).r;
-    closestDepth *= u_SpotLightFarPlane;
     // get depth of current fragment from light's perspective
     //vec3 fragToLight = fragPos - lightPos;
     //float currentDepth = length(fragToLight);
@@ -61,8 +95,9 @@ float SpotShadowCalc(vec3 normal, vec3 fragPos, vec4 fragPosLightSpace,
     vec3 norm = normalize(normal);
     vec3 lightDir = normalize(lightPos - fragPos);
     float bias = max(0.05 * (1.0 - dot(norm, lightDir)), 0.005);
-    // check whether current frag pos is in shadow
-    float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
+    // depth is stored divided by far plane, so compare against the scaled reference
+    float refDepth = (currentDepth - bias) / u_SpotLightFarPlane;
+    float shadow = 1.0 - SampleShadowPCF(uv, vec2(atlasoffset), vec2(framesize), refDepth);
 
 
     // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
@@ -82,8 +117,6 @@ float DirShadowCalc(vec3 normal, vec3 fragPos, vec4 fragPosLightSpace,
     // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
     //ivec2 offset = GetLightOffsetInAtlas(lightIndex, u_SAtlasFramesPerRow, u_SFrameSize);
     vec2 uv = atlasoffset + projCoords.xy * u_SFrameSize;
-    uv /= u_SAtlasSize;
-    float closestDepth = texture(u_SAtlas, uv).r;
     // get depth of current fragment from light's perspective
     
     float currentDepth = projCoords.z;
@@ -92,7 +125,7 @@ float DirShadowCalc(vec3 normal, vec3 fragPos, vec4 fragPosLightSpace,
     vec3 lightDir = normalize(lightPos - fragPos);
     float bias = max(0.05 * (1.0 - dot(norm, lightDir)), 0.005);
     // check whether current frag pos is in shadow
-    float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
+    float shadow = 1.0 - SampleShadowPCF(uv, vec2(atlasoffset), vec2(u_SFrameSize), currentDepth - bias);
 
 
     // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
@@ -102,39 +135,48 @@ float DirShadowCalc(vec3 normal, vec3 fragPos, vec4 fragPosLightSpace,
     return shadow;
 }
 
-float PointShadowCalc(vec3 fragPos, vec3 lightPos, ivec2 atlasoffset, int mipmapLevel)
+float PointShadowCalc(vec3 fragPos, vec3 lightPos, ivec2 atlasoffset, int mipmapLevel, int shadowMode)
 {
     // get vector between fragment position and light position
     vec3 fragToLight = fragPos - lightPos;
-    // ise the fragment to light vector to sample from the depth map    
-    //float closestDepth = texture(u_PointLDepthCubemap, fragToLight).r;
-    vec3 result = convert_xyz_to_cube_uv(fragToLight.x, fragToLight.y, fragToLight.z);
-    int face = int(result.z);
-    //ivec2 offset = atlasoffset;
     int framesize = u_SFrameSize / int(pow(2, mipmapLevel));
-    ivec2 offset = GetLightOffsetInAtlas(atlasoffset, mipmapLevel, face);
-    //ivec2 offset = GetLightOffsetInAtlas(lightIndex, u_SAtlasFramesPerRow, u_SFrameSize);
 
-    //offset = ivec2((offset.x + u_SFrameSize * face) % u_SAtlasSize.x,
-	    //offset.y + (offset.x + u_SFrameSize * face) / u_SAtlasSize.x * u_SFrameSize);
+    vec2 uv;
+    vec2 tileOffset;
+    vec2 tileSize;
+    if (shadowMode == POINT_SHADOW_DUAL_PARABOLOID)
+    {
+        // must mirror the projection in pointDepthDP.shader
+        vec3 n = normalize(fragToLight);
+        int hemisphere = n.z >= 0.0 ? 0 : 1;
+        if (hemisphere == 1)
+            n = vec3(-n.x, n.y, -n.z);
+        vec2 p = n.xy / (1.0 + n.z) * 0.5 + 0.5;
+
+        tileSize = vec2(float(framesize) * 0.5, float(framesize));
+        tileOffset = vec2(atlasoffset) + vec2(tileSize.x * float(hemisphere), 0.0);
+        uv = tileOffset + p * tileSize;
+    }
+    else
+    {
+        // ise the fragment to light vector to sample from the depth map    
+        vec3 result = convert_xyz_to_cube_uv(fragToLight.x, fragToLight.y, fragToLight.z);
+        int face = int(result.z);
+        ivec2 offset = GetLightOffsetInAtlas(atlasoffset, mipmapLevel, face);
 
-    //ivec2 offsetInside = ivec2(face % 3, face / 3) * u_SFrameSize;
-    //vec2 uv = atlasoffset + offsetInside;
-    vec2 uv = offset;
-    uv += result.xy * framesize; //
-    uv /= u_SAtlasSize;
+        tileSize = vec2(framesize);
+        tileOffset = vec2(offset);
+        uv = tileOffset + result.xy * framesize;
+    }
 
-    float closestDepth = texture(u_SAtlas, uv).r;
-    // it is currently in linear range between [0,1], let's re-transform it back to original depth value
-    closestDepth *= u_PointLightFarPlane;
     // now get current linear depth as the length between the fragment and light position
     float currentDepth = length(fragToLight);
     // test for shadows
     float biasbase = 0.05f;
     float bias = biasbase + (biasbase * mipmapLevel * 2.f); // we use a much larger bias since depth is now in [near_plane, far_plane] range
-    float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
-    // display closestDepth as debug (to visualize depth cubemap)
-    //FragColor = vec4(vec3(closestDepth / u_PointLightFarPlane), 1.0);
+    // stored depth is in linear [0,1] range, so compare against the reference divided by far plane
+    float refDepth = (currentDepth - bias) / u_PointLightFarPlane;
+    float shadow = 1.0 - SampleShadowPCF(uv, tileOffset, tileSize, refDepth);
 
     return shadow;
 }
@@ -0,0 +1,26 @@
+//? #version 460 core
+//Builds the shading inputs of a mesh fragment from its material.
+//Requires defs.glsl, fs_in (VS_OUT of general.vert), u_ObjType and material uniforms.
+
+Surface GetSurface()
+{
+    Surface s;
+    s.position = fs_in.FragPos;
+    s.geomNormal = fs_in.Normal;
+
+    if (u_ObjType == DIFF_N_NORMAL)
+    {
+        // obtain normal from normal map in range [0,1]
+        vec3 normal = texture(material.normalTex, fs_in.TexCoords).rgb;
+        // transform normal vector to range [-1,1] and out of tangent space
+        s.normal = normalize(fs_in.TBN * normalize(normal * 2.0 - 1.0));
+    }
+    else
+        s.normal = normalize(fs_in.Normal);
+
+    s.albedo = texture(material.diffuseTex, fs_in.TexCoords).rgb;
+    s.specular = u_ObjType == DIFF_N_SPEC ?
+        texture(material.specularTex, fs_in.TexCoords).rgb : vec3(material.specularFloat);
+    s.shininess = material.shininess;
+    return s;
+}
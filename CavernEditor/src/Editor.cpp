@@ -1,5 +1,7 @@
 #include "pch.h"
 #include "Editor.h"
+#include <filesystem>
+#include <ImGuizmo.h>
 #include "scenes/TestScene.h"
 #include "scene/SceneSerializer.h"
 #include "platform/WindowsUtils.h"
@@ -20,12 +22,33 @@ namespace Crave
             Ref<Framebuffer> m_ViewportFramebuffer{};
             Ref<Camera>      m_Camera{};
             Ref<TestScene>   m_ActiveScene{};
+            //Of the .cscene file last saved or loaded.
+            Scope<SceneAutosave> m_Autosave{};
+            Scope<SceneHistory>  m_History{};
+
+            //Waits until every change so far is on disk.
+            void FlushAutosave()
+            {
+                if (!m_Autosave)
+                    return;
+                m_Autosave->Wait();
+                m_Autosave->Save();
+                m_Autosave->Wait();
+            }
+
+            //Saving and loading work on the edited scene.
+            void StopPlay()
+            {
+                if (m_History->IsPlaying())
+                    m_History->EndPlay();
+            }
         }
 
         void Editor::Init()
         {
             Log::Init();
             Input::Init();
+            JobSystem::Init();
 
             Window::Open(WINDOW_WIDTH, WINDOW_HEIGHT, PROJECT_NAME);
             m_Camera = CreateRef<Camera>(glm::vec3(0.f, 15.f, 30.f));
@@ -44,6 +67,7 @@ namespace Crave
             GeoData::Init();
 
             m_ActiveScene = CreateRef<TestScene>(m_Camera);
+            m_History = CreateScope<SceneHistory>(m_ActiveScene);
 
             EditorUI::Init(m_ViewportFramebuffer, m_Camera, m_ActiveScene);
         }
@@ -63,31 +87,90 @@ namespace Crave
                 m_ViewportFramebuffer->ClearIntAttachment(-1);
 
                 m_ActiveScene->OnUpdate(Window::DeltaTime());
+                //What happens in play mode is thrown away, it isn't saved either.
+                if (m_Autosave && !m_History->IsPlaying())
+                    m_Autosave->OnUpdate(Window::DeltaTime());
 
                 EditorUI::Render();
 
+                //A drag is one step. So is an import, its entities come in over many frames.
+                if (!ImGui::IsAnyItemActive() && !ImGuizmo::IsUsing() && m_ActiveScene->PendingImports().empty())
+                    m_History->Commit();
+
                 Window::GLFWSwapBuffers();
             }
+
+            StopPlay();
+            FlushAutosave();
+            m_Autosave.reset();
+            m_History.reset();
+            JobSystem::Shutdown();
         }
 
         void Editor::SaveSceneAs()
         {
-            std::optional<std::string> filepath = WinUtils::SaveFile("Game Scene (*.json)\0*.json\0");
+            std::optional<std::string> filepath = WinUtils::SaveFile("Game Scene (*.cscene)\0*.cscene\0");
+            if (filepath)
+            {
+                StopPlay();
+                //Its first save writes the whole scene, later ones only what changed.
+                m_Autosave.reset();
+                m_Autosave = CreateScope<SceneAutosave>(m_ActiveScene, *filepath);
+            }
+        }
+
+        void Editor::ExportSceneJson()
+        {
+            std::optional<std::string> filepath = WinUtils::SaveFile("Game Scene JSON (*.json)\0*.json\0");
             if (filepath)
             {
+                StopPlay();
                 SceneSerializer ss(m_ActiveScene);
-                ss.SaveScene(*filepath);
+                ss.ExportJson(*filepath);
             }
         }
 
         void Editor::LoadScene()
         {
-            std::optional<std::string> filepath = WinUtils::OpenFile("Game Scene (*.json)\0*.json\0");
+            std::optional<std::string> filepath = WinUtils::OpenFile("Game Scene (*.cscene;*.json)\0*.cscene;*.json\0");
             if (filepath)
             {
+                StopPlay();
+                FlushAutosave();
                 SceneSerializer ss(m_ActiveScene);
-                ss.LoadScene(*filepath);
+                if (ss.LoadScene(*filepath))
+                {
+                    //Undo doesn't go back past a load.
+                    m_History.reset();
+                    m_History = CreateScope<SceneHistory>(m_ActiveScene);
+                    m_Autosave.reset();
+                    if (std::filesystem::path(*filepath).extension() == ".cscene")
+                        m_Autosave = CreateScope<SceneAutosave>(m_ActiveScene, *filepath);
+                }
             }
         }
+
+        void Editor::Undo()
+        {
+            m_History->Undo();
+        }
+
+        void Editor::Redo()
+        {
+            m_History->Redo();
+        }
+
+        void Editor::TogglePlay()
+        {
+            if (m_History->IsPlaying())
+                m_History->EndPlay();
+            else
+                m_History->BeginPlay();
+        }
+
+        const SceneHistory& Editor::History()
+        {
+            return *m_History;
+        }
     }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "imgui/ImguiLayer.h"
 #include "imgui/imgui.h"
 #include "ui/SceneHierarchyPanel.h"
+#include "scene/SceneSnapshot.h"
 
 namespace Crave
 {
@@ -11,6 +12,14 @@ namespace Crave
 		void Init();
 		void Run();
 		void SaveSceneAs();
+		void ExportSceneJson();
 		void LoadScene();
+
+		//Undo steps end once no widget or gizmo is held, see SceneHistory.
+		void Undo();
+		void Redo();
+		//Play mode runs on a fork of the scene, stopping brings the edited scene back.
+		void TogglePlay();
+		const SceneHistory& History();
 	};
 }
\ No newline at end of file
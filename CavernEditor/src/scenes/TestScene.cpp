@@ -1,6 +1,11 @@
 #include "pch.h"
 #include "TestScene.h"
 #include "renderer/MeshManager.h"
+#include "import/ModelImport.h"
+#include "scene/SceneSerializer.h"
+#include "scene/SceneSnapshot.h"
+#include "scene/Prefab.h"
+#include "scene/EntityCommandBuffer.h"
 
 namespace Crave
 {
@@ -13,6 +18,13 @@ namespace Crave
     static glm::ivec2 s_SpotLightsGrid = {3, 3};
     static int s_SpotLightsTotal = s_SpotLightsGrid.x * s_SpotLightsGrid.y;
     static int num = 2;
+
+    //Shading benchmark: every light count is measured on both paths.
+    static const int   BENCH_LIGHT_COUNTS[] = { 16, 64, 256, 1024 };
+    static const int   BENCH_MAX_LIGHTS = 1024;
+    static const int   BENCH_WARMUP_FRAMES = 30;
+    static const int   BENCH_SAMPLE_FRAMES = 120;
+    static const int   BENCH_STEPS = IM_ARRAYSIZE(BENCH_LIGHT_COUNTS) * 2;
     TestScene::TestScene(Ref<Camera> camera)
         : m_Camera(camera),
 
@@ -134,6 +146,69 @@ namespace Crave
 
         Renderer::EndScene();
         m_Camera->SetSpeed(m_CamSpeed);
+
+        if (m_Benchmark.Running)
+            UpdateBenchmark();
+    }
+
+    void TestScene::SetBenchmarkLightCount(int count)
+    {
+        //Small, short-ranged lights spread over the floor so clusters actually get culled.
+        while ((int)m_BenchLights.size() < count)
+        {
+            int i = (int)m_BenchLights.size();
+            Entity bl = CreateEntity("BenchLight_" + std::to_string(i));
+            bl.GetComponent<Transform>().Position = {
+                -20.f + 40.f * (i % 32) / 31.f, -6.f + 2.f * (i / 1024), -20.f + 40.f * (i / 32 % 32) / 31.f };
+
+            auto& l = bl.AddComponent<Light>(LightType::Point, true);
+            l.Data.color = glm::abs(glm::vec3(glm::sin(i * 0.7f), glm::sin(i * 1.3f), glm::sin(i * 2.1f)));
+            l.Data.brightness = 1.f;
+            l.Data.linear = 0.35f;
+            l.Data.quadratic = 0.44f;
+            m_BenchLights.push_back(bl);
+        }
+
+        for (int i = 0; i < (int)m_BenchLights.size(); ++i)
+            m_BenchLights[i].GetComponent<Light>().Enabled = i < count;
+        m_ActiveBenchLights = count;
+    }
+
+    void TestScene::UpdateBenchmark()
+    {
+        auto& b = m_Benchmark;
+        if (b.Frame == 0)
+        {
+            SetBenchmarkLightCount(BENCH_LIGHT_COUNTS[b.Step / 2]);
+            Renderer::SetShadingPath(b.Step % 2 ? ShadingPath::Deferred : ShadingPath::Forward);
+        }
+
+        //GPU timings lag one frame, warmup frames cover that and the light buffers growing.
+        if (b.Frame >= BENCH_WARMUP_FRAMES)
+            b.AccumMs += Renderer::GetFrameStats().OpaquePassMs;
+
+        if (++b.Frame < BENCH_WARMUP_FRAMES + BENCH_SAMPLE_FRAMES)
+            return;
+
+        float avgMs = b.AccumMs / BENCH_SAMPLE_FRAMES;
+        if (b.Step % 2 == 0)
+            b.Results.push_back({ BENCH_LIGHT_COUNTS[b.Step / 2], avgMs, 0.f });
+        else
+        {
+            auto& r = b.Results.back();
+            r.DeferredMs = avgMs;
+            LOG_INFO("Shading benchmark: {} lights, forward {:.3f} ms, deferred {:.3f} ms",
+                r.Lights, r.ForwardMs, r.DeferredMs);
+        }
+
+        b.Frame = 0;
+        b.AccumMs = 0.f;
+        if (++b.Step == BENCH_STEPS)
+        {
+            b.Running = false;
+            SetBenchmarkLightCount(b.PrevLights);
+            Renderer::SetShadingPath(b.PrevPath);
+        }
     }
 
     void TestScene::OnImGuiRender(ImGuiWindowFlags panelFlags)
@@ -148,6 +223,47 @@ namespace Crave
         ImGui::SliderFloat("Light Rot Speed", &LightRotSpeed, min, 300.f);
         ImGui::SliderFloat3("Light Rot Point", glm::value_ptr(RotPoint), -15.f, 15.f);
 
+        ImGui::Separator();
+        static char importPath[256] = "";
+        ImGui::InputText("Model path", importPath, IM_ARRAYSIZE(importPath));
+        ImGui::SameLine();
+        if (ImGui::Button("Import") && importPath[0])
+            ImportModelAsync(importPath);
+        for (auto& import : PendingImports())
+        {
+            ImGui::PushID(import.get());
+            ImGui::ProgressBar(import->Progress(), ImVec2(-80.f, 0.f), import->Path().c_str());
+            ImGui::SameLine();
+            ImGui::BeginDisabled(import->IsDone());
+            if (ImGui::Button("Cancel"))
+                import->Cancel();
+            ImGui::EndDisabled();
+            ImGui::PopID();
+        }
+        //Results go to the log.
+        if (ImGui::Button("Benchmark importers"))
+            Import::Model::BenchmarkImporters();
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark scene format"))
+            SceneSerializer::Benchmark();
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark snapshots"))
+            SceneHistory::Benchmark();
+        //Places copies of the model in the path field.
+        if (ImGui::Button("Benchmark prefab") && importPath[0])
+            Prefab::Benchmark(importPath);
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark spawning"))
+            EntityCommandBuffer::Benchmark();
+        ImGui::SameLine();
+        if (ImGui::Button("Benchmark names"))
+            Scene::BenchmarkNames();
+        if (ImGui::Button("Test autosave deletion"))
+            SceneAutosave::TestDeletion();
+        ImGui::SameLine();
+        if (ImGui::Button("Test autosave order"))
+            SceneAutosave::TestSiblingOrder();
+
         ImGui::End();
 
         MeshManager::OnImGuiRender(panelFlags);
@@ -160,6 +276,33 @@ namespace Crave
         ImGui::Text("Frame Rate:	     ");
         ImGui::SameLine();
         ImGui::Text(std::to_string(1 / DeltaTime).c_str());
+        auto& frameStats = Renderer::GetFrameStats();
+        ImGui::Text("Opaque pass (GPU): %.3f ms", frameStats.OpaquePassMs);
+        ImGui::Text("Shaded fragments: %u (%.2f per pixel)", frameStats.ShadedSamples,
+            frameStats.ViewportPixels ? (float)frameStats.ShadedSamples / frameStats.ViewportPixels : 0.f);
+        //With the prepass on, its fragment count is what the shading pass would have cost without it.
+        if (frameStats.PrepassSamples && frameStats.ShadedSamples)
+            ImGui::Text("Depth prepass fragments: %u (overdraw %.2fx)", frameStats.PrepassSamples,
+                (float)frameStats.PrepassSamples / frameStats.ShadedSamples);
+
+        ImGui::Separator();
+        ImGui::BeginDisabled(m_Benchmark.Running);
+        int benchLights = m_ActiveBenchLights;
+        if (ImGui::SliderInt("Extra lights", &benchLights, 0, BENCH_MAX_LIGHTS))
+            SetBenchmarkLightCount(benchLights);
+        if (ImGui::Button("Run shading benchmark"))
+        {
+            m_Benchmark = ShadingBenchmark{};
+            m_Benchmark.Running = true;
+            m_Benchmark.PrevPath = Renderer::GetShadingPath();
+            m_Benchmark.PrevLights = m_ActiveBenchLights;
+        }
+        ImGui::EndDisabled();
+
+        if (m_Benchmark.Running)
+            ImGui::Text("Running... %d/%d", m_Benchmark.Step + 1, BENCH_STEPS);
+        for (auto& r : m_Benchmark.Results)
+            ImGui::Text("%5d lights: forward %.3f ms, deferred %.3f ms", r.Lights, r.ForwardMs, r.DeferredMs);
 
         ImGui::End();
     }
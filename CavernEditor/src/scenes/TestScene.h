@@ -11,6 +11,26 @@ namespace Crave
 
         void OnUpdate(float deltaTime) override;
         void OnImGuiRender(ImGuiWindowFlags panelFlags) override;
+    private:
+        struct BenchmarkResult
+        {
+            int   Lights;
+            float ForwardMs;
+            float DeferredMs;
+        };
+        struct ShadingBenchmark
+        {
+            bool  Running = false;
+            int   Step = 0;
+            int   Frame = 0;
+            float AccumMs = 0.f;
+            ShadingPath PrevPath = ShadingPath::Forward;
+            int   PrevLights = 0;
+            std::vector<BenchmarkResult> Results{};
+        };
+
+        void SetBenchmarkLightCount(int count);
+        void UpdateBenchmark();
     private:
         Ref<Camera> m_Camera;
         Ref<Mesh> m_CubeMesh;
@@ -22,5 +42,9 @@ namespace Crave
         Entity m_Brickwalls[6];
         Entity m_WorldCenter;
         float m_CamSpeed;
+
+        std::vector<Entity> m_BenchLights{};
+        int m_ActiveBenchLights = 0;
+        ShadingBenchmark m_Benchmark{};
     };
 }
\ No newline at end of file
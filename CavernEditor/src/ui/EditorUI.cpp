@@ -46,6 +46,11 @@ namespace Crave
                     m_GizmoType = ImGuizmo::OPERATION::ROTATE; });
                 Input::KeybindBindAction(Input::KeybindName::GizmoScale,     [&]() {
                     m_GizmoType = ImGuizmo::OPERATION::SCALE; });
+
+                Input::KeybindBindAction(Input::KeybindName::Undo, [&]() {
+                    if (Input::IsKeyDown(Input::Key::LeftCtrl)) Editor::Undo(); });
+                Input::KeybindBindAction(Input::KeybindName::Redo, [&]() {
+                    if (Input::IsKeyDown(Input::Key::LeftCtrl)) Editor::Redo(); });
             }
 
             void UIDrawMenuBar()
@@ -57,6 +62,9 @@ namespace Crave
                         if (ImGui::MenuItem("Save Scene"))
                             Editor::SaveSceneAs();
 
+                        if (ImGui::MenuItem("Export Scene as JSON"))
+                            Editor::ExportSceneJson();
+
                         if (ImGui::MenuItem("Load Scene"))
                             Editor::LoadScene();
 
@@ -65,6 +73,21 @@ namespace Crave
                         ImGui::EndMenu();
                     }
 
+                    if (ImGui::BeginMenu("Edit"))
+                    {
+                        const SceneHistory& history = Editor::History();
+                        if (ImGui::MenuItem("Undo", "Ctrl+Z", false, history.CanUndo()))
+                            Editor::Undo();
+
+                        if (ImGui::MenuItem("Redo", "Ctrl+Y", false, history.CanRedo()))
+                            Editor::Redo();
+
+                        ImGui::Separator();
+                        if (ImGui::MenuItem(history.IsPlaying() ? "Stop" : "Play"))
+                            Editor::TogglePlay();
+                        ImGui::EndMenu();
+                    }
+
                     if (ImGui::BeginMenu("Dockspace"))
                     {
                         if (ImGui::MenuItem("Movable Panels", NULL, &m_PanelsMovable))
@@ -141,6 +164,7 @@ namespace Crave
                         tc.EulerAngles += deltaRotation;
 
                         tc.Scale = scale;
+                        selectedEntity.PatchComponent<Transform>();
                     }
                 }
             }
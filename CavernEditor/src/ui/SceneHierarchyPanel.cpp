@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "SceneHierarchyPanel.h"
+#include <algorithm>
 #include <imgui/imgui_internal.h>
 #include <magic_enum/magic_enum.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
@@ -16,31 +17,28 @@ namespace Crave
 	void SceneHierarchyPanel::SetContext(Ref<Scene> scene)
 	{
 		m_Scene = scene;
+		m_ShownSelection = {};
+		m_Expanded.clear();
+		m_AppliedFilter.clear();
+		m_FilterNames.clear();
+		m_Matches.clear();
+		m_RowsDirty = true;
 	}
 
 	void SceneHierarchyPanel::ReparentTransform(Entity dragged, Entity newParent)
 	{
 		Transform& draggedTr = dragged.GetComponent<Transform>();
-
-		Entity dragParent = draggedTr.Parent;
-		Transform& dragParentTr = dragParent.GetComponent<Transform>();
-		{
-			auto begin = dragParentTr.Children.begin();
-			auto end = dragParentTr.Children.end();
-			auto iter = std::find(begin, end, dragged);
-
-			ASSERT(iter != end, "");
-			dragParentTr.Children.erase(iter);
-		}
 		Transform& newParentTr = newParent.GetComponent<Transform>();
-		newParentTr.Children.push_back(dragged);
+		glm::mat4 worldMat = draggedTr.GetTransform();
+		//Dropping an entity on its own subtree does nothing.
+		if (!m_Scene->SetParent(dragged, newParent))
+			return;
 		//After we assign parent to dragged, we need to recalculate all parameters
 		//relative to a new parent
 
 		{
-			glm::mat4& parentMat = newParentTr.GetTransform();
-			glm::mat4& childMat = draggedTr.GetTransform();
-			childMat = glm::inverse(parentMat) * childMat;
+			glm::mat4 parentMat = newParentTr.GetTransform();
+			glm::mat4 childMat = glm::inverse(parentMat) * worldMat;
 			glm::vec3 scale;
 			glm::quat rotation;
 			glm::vec3 translation;
@@ -53,18 +51,63 @@ namespace Crave
 			draggedTr.Quaternion = rotation;
 			draggedTr.EulerAngles = glm::degrees(glm::eulerAngles(rotation));
 		}
-		draggedTr.Parent = newParent;
+		dragged.PatchComponent<Transform>();
 	}
 
 	void SceneHierarchyPanel::OnImGuiRender(ImGuiWindowFlags panelFlags)
 	{
-		ImGui::ShowDemoWindow();
 		ImGui::Begin("Scene Hierarchy", (bool*)0, panelFlags);
 
-		for (auto& entity : m_Scene->m_RootEntity.GetComponent<Transform>().Children)
+		DrawFilter();
+
+		Entity selected = m_Scene->m_SelectedEntity;
+		if (selected != m_ShownSelection)
+		{
+			m_ShownSelection = selected;
+			if (selected)
+			{
+				Entity root = m_Scene->m_RootEntity;
+				for (Entity ancestor = selected.GetComponent<Transform>().Parent; ancestor != root;
+					ancestor = ancestor.GetComponent<Transform>().Parent)
+					m_RowsDirty |= m_Expanded.insert((entt::entity)ancestor).second;
+				m_ScrollToSelection = true;
+			}
+		}
+		UpdateRows();
+		if (m_ScrollToSelection)
+		{
+			auto it = std::find_if(m_Rows.begin(), m_Rows.end(), [&selected](const Row& row) { return selected == row.Entity; });
+			m_ScrollToRow = it == m_Rows.end() ? -1 : (int)(it - m_Rows.begin());
+			m_ScrollToSelection = false;
+		}
+
+		//Only the rows in view are drawn. Deleting waits for the loop, rows hold plain handles.
+		ImGui::BeginChild("##Rows");
+		Entity deleted{};
+		ImGuiListClipper clipper;
+		clipper.Begin((int)m_Rows.size());
+		if (m_ScrollToRow >= 0)
+			clipper.ForceDisplayRangeByIndices(m_ScrollToRow, m_ScrollToRow + 1);
+		while (clipper.Step())
 		{
-			DrawEntityNode(entity);
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+				DrawRow(m_Rows[i], i, deleted);
+		}
+		if (deleted)
+			m_Scene->DestroyEntity(deleted);
+
+		if (ImGui::IsMouseDown(0) && ImGui::IsWindowHovered())
+			m_Scene->m_SelectedEntity = {};
+
+		// Right-click on blank space to create entity
+		if (ImGui::BeginPopupContextWindow(0, 1, false))
+		{
+			if (ImGui::MenuItem("Create Empty Entity"))
+				m_Scene->CreateEntity("Empty Entity");
+
+			ImGui::EndPopup();
 		}
+		ImGui::EndChild();
 
 		//Drag to blank space to set Root as parent transform
 		{
@@ -88,18 +131,6 @@ namespace Crave
 			}
 		}
 
-		if (ImGui::IsMouseDown(0) && ImGui::IsWindowHovered())
-			m_Scene->m_SelectedEntity = {};
-
-		// Right-click on blank space to create entity
-		if (ImGui::BeginPopupContextWindow(0, 1, false))
-		{
-			if (ImGui::MenuItem("Create Empty Entity"))
-				m_Scene->CreateEntity("Empty Entity");
-
-			ImGui::EndPopup();
-		}
-
 		ImGui::End();
 
 		ImGui::Begin("Inspector", (bool*)0, panelFlags);
@@ -109,24 +140,195 @@ namespace Crave
 		ImGui::End();
 	}
 
+	namespace //private
+	{
+		//part is lowercase already.
+		bool ContainsNoCase(const std::string& text, const std::string& part)
+		{
+			return std::search(text.begin(), text.end(), part.begin(), part.end(),
+				[](char a, char b) { return (char)std::tolower((unsigned char)a) == b; }) != text.end();
+		}
+	}
 
-	void SceneHierarchyPanel::DrawEntityNode(Entity entity)
+	void SceneHierarchyPanel::DrawFilter()
 	{
-		auto& EntityTag = entity.GetComponent<Tag>().String;
-		auto& EntityTransform = entity.GetComponent<Transform>();
+		ImGui::PushItemWidth(-1);
+		bool next = ImGui::InputTextWithHint("##Filter", "Filter by name", m_Filter, sizeof(m_Filter),
+			ImGuiInputTextFlags_EnterReturnsTrue);
+		ImGui::PopItemWidth();
+		if (!m_Filter[0])
+			return;
+
+		if (m_Matches.empty())
+			ImGui::TextDisabled("No entity matches.");
+		else
+			ImGui::TextDisabled("%zu matches, Enter selects the next.", m_Matches.size());
+		if (!next || m_Matches.empty())
+			return;
+
+		//The matches of the filter as it was last frame, in tree order.
+		m_MatchHit = (m_MatchHit + 1) % m_Matches.size();
+		m_Scene->m_SelectedEntity = { m_Matches[m_MatchHit], m_Scene.get() };
+		ImGui::SetKeyboardFocusHere(-1);
+	}
+
+	void SceneHierarchyPanel::UpdateRows()
+	{
+		std::string filter = m_Filter;
+		std::transform(filter.begin(), filter.end(), filter.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		const uint64_t version = m_Scene->HierarchyVersion();
+		const bool hierarchyChanged = version != m_RowsVersion;
+		if (!m_RowsDirty && !hierarchyChanged && filter == m_AppliedFilter)
+			return;
+
+		if (hierarchyChanged || filter != m_AppliedFilter)
+			UpdateMatches(filter, hierarchyChanged);
+		m_RowsVersion = version;
+		m_RowsDirty = false;
+
+		m_Rows.clear();
+		if (filter.empty())
+			AddExpandedRows();
+		else
+			AddMatchRows();
+	}
+
+	void SceneHierarchyPanel::UpdateMatches(const std::string& filter, bool namesChanged)
+	{
+		//A longer filter only drops names that matched the last one. Otherwise every name in use is tried.
+		const bool narrowing = !namesChanged && !m_AppliedFilter.empty() && filter.find(m_AppliedFilter) != std::string::npos;
+		m_AppliedFilter = filter;
+		m_Matches.clear();
+		m_MatchHit = ~std::size_t(0);
+		if (filter.empty())
+		{
+			m_FilterNames.clear();
+			return;
+		}
+
+		if (!narrowing)
+		{
+			m_FilterNames.clear();
+			for (const auto& [name, entities] : m_Scene->m_NameIndex)
+				m_FilterNames.push_back(name);
+		}
+		m_FilterNames.erase(std::remove_if(m_FilterNames.begin(), m_FilterNames.end(), [&filter](NameTable::Id name)
+			{ return !ContainsNoCase(NameTable::String(name), filter); }), m_FilterNames.end());
+
+		Entity root = m_Scene->m_RootEntity;
+		for (NameTable::Id name : m_FilterNames)
+		{
+			for (entt::entity entity : m_Scene->FindEntities(name))
+			{
+				if (root != entity)
+					m_Matches.push_back(entity);
+			}
+		}
+		const entt::registry& registry = m_Scene->m_Registry;
+		std::sort(m_Matches.begin(), m_Matches.end(), [&registry](entt::entity a, entt::entity b)
+			{ return registry.get<Transform>(a).TreeEnter < registry.get<Transform>(b).TreeEnter; });
+	}
+
+	void SceneHierarchyPanel::AddExpandedRows()
+	{
+		const entt::registry& registry = m_Scene->m_Registry;
+		//Children pushed last to first, so they pop in order.
+		std::vector<std::pair<entt::entity, uint32_t>> stack;
+		auto pushChildren = [&](const Transform& tr, uint32_t depth)
+		{
+			for (entt::entity child = tr.LastChild; child != entt::null; child = registry.get<Transform>(child).PrevSibling)
+				stack.push_back({ child, depth });
+		};
+		pushChildren(registry.get<Transform>(m_Scene->m_RootEntity), 0);
+		while (!stack.empty())
+		{
+			auto [entity, depth] = stack.back();
+			stack.pop_back();
+			const Transform& tr = registry.get<Transform>(entity);
+			const bool hasChildren = tr.FirstChild;
+			m_Rows.push_back({ entity, depth, hasChildren, true });
+			if (hasChildren && m_Expanded.count(entity))
+				pushChildren(tr, depth + 1);
+		}
+	}
+
+	void SceneHierarchyPanel::AddMatchRows()
+	{
+		const entt::registry& registry = m_Scene->m_Registry;
+		const entt::entity root = m_Scene->m_RootEntity;
+		std::vector<std::pair<entt::entity, bool>> shown;
+		shown.reserve(m_Matches.size());
+		std::unordered_set<entt::entity> added(m_Matches.begin(), m_Matches.end());
+		for (entt::entity match : m_Matches)
+			shown.push_back({ match, true });
+		for (entt::entity match : m_Matches)
+		{
+			for (entt::entity ancestor = registry.get<Transform>(match).Parent; ancestor != root && added.insert(ancestor).second;
+				ancestor = registry.get<Transform>(ancestor).Parent)
+				shown.push_back({ ancestor, false });
+		}
+
+		//Tree order is the order of the enter labels, and an entity's depth is the number of entities
+		//whose range it falls into.
+		std::sort(shown.begin(), shown.end(), [&registry](const auto& a, const auto& b)
+			{ return registry.get<Transform>(a.first).TreeEnter < registry.get<Transform>(b.first).TreeEnter; });
+		std::vector<uint64_t> openExits;
+		for (const auto& [entity, match] : shown)
+		{
+			const Transform& tr = registry.get<Transform>(entity);
+			while (!openExits.empty() && openExits.back() < tr.TreeEnter)
+				openExits.pop_back();
+			m_Rows.push_back({ entity, (uint32_t)openExits.size(), (bool)tr.FirstChild, match });
+			openExits.push_back(tr.TreeExit);
+		}
+	}
+
+	void SceneHierarchyPanel::DrawRow(const Row& row, int index, Entity& deleted)
+	{
+		Entity entity{ row.Entity, m_Scene.get() };
+		const bool filtering = !m_AppliedFilter.empty();
 
 		ImGuiTreeNodeFlags flags =
 			((m_Scene->m_SelectedEntity == entity) ?
 				ImGuiTreeNodeFlags_Selected : 0) | ImGuiTreeNodeFlags_OpenOnArrow;
-		flags |= ImGuiTreeNodeFlags_SpanAvailWidth;
-		if (EntityTransform.Children.empty())
+		flags |= ImGuiTreeNodeFlags_SpanAvailWidth | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+		//Filtered rows show the tree as it is, without arrows.
+		if (!row.HasChildren || filtering)
 			flags |= ImGuiTreeNodeFlags_Leaf;
 
+		const bool expanded = m_Expanded.count(row.Entity) != 0;
+		ImGui::SetNextItemOpen(expanded);
+		const float indent = row.Depth * ImGui::GetStyle().IndentSpacing;
+		if (indent > 0.f)
+			ImGui::Indent(indent);
+		if (!row.Match)
+			ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled));
 		void* ptr_id = (void*)(uint64_t)(uint32_t)entity;
-		bool opened = ImGui::TreeNodeEx(ptr_id, flags, EntityTag.c_str());
+		bool opened = ImGui::TreeNodeEx(ptr_id, flags, "%s", entity.GetComponent<Tag>().String().c_str());
+		if (!row.Match)
+			ImGui::PopStyleColor();
+		if (indent > 0.f)
+			ImGui::Unindent(indent);
+
+		if (!filtering && row.HasChildren && opened != expanded)
+		{
+			if (opened)
+				m_Expanded.insert(row.Entity);
+			else
+				m_Expanded.erase(row.Entity);
+			m_RowsDirty = true;
+		}
+		if (index == m_ScrollToRow)
+		{
+			ImGui::SetScrollHereY();
+			m_ScrollToRow = -1;
+		}
+
 		if (ImGui::IsItemClicked())
 		{
 			m_Scene->m_SelectedEntity = entity;
+			//Already in view.
+			m_ShownSelection = entity;
 		}
 
 		if (ImGui::BeginDragDropSource())
@@ -147,30 +349,13 @@ namespace Crave
 			ImGui::EndDragDropTarget();
 		}
 
-		bool entityDeleted = false;
 		if (ImGui::BeginPopupContextItem())
 		{
 			if (ImGui::MenuItem("Delete Entity"))
-				entityDeleted = true;
+				deleted = entity;
 
 			ImGui::EndPopup();
 		}
-
-		if (opened)
-		{
-			for (auto& child : EntityTransform.Children)
-			{
-				DrawEntityNode(child);
-			}
-			ImGui::TreePop();
-		}
-
-		if (entityDeleted)
-		{
-			m_Scene->DestroyEntity(entity);
-			if (m_Scene->m_SelectedEntity == entity)
-				m_Scene->m_SelectedEntity = {};
-		}
 	}
 
 	static bool DrawVec3Control(const std::string& label, glm::vec3& values, float resetValue = 0.0f, float columnWidth = 100.0f)
@@ -295,7 +480,8 @@ namespace Crave
 
 			if (open)
 			{
-				uiFunction(component);
+				if (uiFunction(component))
+					entity.PatchComponent<T>();
 				ImGui::TreePop();
 			}
 
@@ -319,14 +505,15 @@ namespace Crave
 	{
 		if (entity.HasComponent<Tag>())
 		{
-			auto& tag = entity.GetComponent<Tag>().String;
+			auto& tag = entity.GetComponent<Tag>();
 
 			char buffer[256];
 			memset(buffer, 0, sizeof(buffer));
-			strcpy_s(buffer, sizeof(buffer), tag.c_str());
+			strcpy_s(buffer, sizeof(buffer), tag.String().c_str());
 			if (ImGui::InputText("##Tag", buffer, sizeof(buffer)))
 			{
-				tag = std::string(buffer);
+				tag.Set(buffer);
+				entity.PatchComponent<Tag>();
 			}
 		}
 
@@ -353,13 +540,17 @@ namespace Crave
 
 		DrawComponent<Transform>("Transform", entity, [](auto& tr)
 			{
-				DrawVec3Control("Position", tr.Position);
+				bool changed = DrawVec3Control("Position", tr.Position);
 				if (DrawVec3Control("Rotation", tr.EulerAngles))
+				{
 					tr.Quaternion = glm::quat(glm::radians(tr.EulerAngles));
+					changed = true;
+				}
 
-				DrawVec3Control("Scale", tr.Scale, 1.0f);
-				ImGui::Text("Parent:			 %s", tr.Parent.GetComponent<Tag>().String.c_str());
-				ImGui::Text("Number of children: %ld", tr.Children.size());
+				changed |= DrawVec3Control("Scale", tr.Scale, 1.0f);
+				ImGui::Text("Parent:			 %s", tr.Parent.GetComponent<Tag>().String().c_str());
+				ImGui::Text("Number of children: %u", tr.ChildCount);
+				return changed;
 			});
 		
 #define PREFIX(name) li.Data.name
@@ -381,12 +572,13 @@ namespace Crave
 
 		DrawComponent<Light>("Light", entity, [&](auto& li)
 			{
+				bool changed = false;
 				ImGuiTabBarFlags tab_bar_flags = ImGuiTabBarFlags_None;
 				if (ImGui::BeginTabBar("LightTabBar", tab_bar_flags))
 				{
 					if (ImGui::BeginTabItem("Parameters"))
 					{
-						ImGui::Checkbox("Enabled", &li.Enabled);
+						changed |= ImGui::Checkbox("Enabled", &li.Enabled);
 						ImGui::Separator();
 						static const int numtypes = 3;
 						static LightType types[numtypes] = { LightType::Point, LightType::Spot, LightType::Directional };
@@ -403,14 +595,24 @@ namespace Crave
 							entity.RemoveComponent<Light>();
 							entity.AddComponent<Light>(types[curr], dynamic);
 						}
+						if (li.Data.type == LightType::Point)
+						{
+							static const char* shadowModes[] = { "Cube", "Dual paraboloid" };
+							int mode = (int)li.Data.shadowmode;
+							if (ImGui::Combo("Shadow mode", &mode, shadowModes, IM_ARRAYSIZE(shadowModes)))
+							{
+								li.Data.shadowmode = (PointShadowMode)mode;
+								changed = true;
+							}
+						}
 						ImGui::Separator();
-						ImGui::DragFloat("Brightness", &li.Data.brightness, 0.1f, 0.f, Renderer::LIGHT_MAX_BRIGHTNESS);
+						changed |= ImGui::DragFloat("Brightness", &li.Data.brightness, 0.1f, 0.f, Renderer::LIGHT_MAX_BRIGHTNESS);
 						ImGui::Separator();
 						ImGui::Text("Attenuation: ");
 						float min{ 0.f }, max{ 0.1f };
-						ImGui::DragFloat("Constant", &li.Data.constant, 0.1f, min, 1.f);
-						ImGui::DragFloat("Linear", &li.Data.linear, 0.01f, min, max);
-						ImGui::DragFloat("Quadratic", &li.Data.quadratic, 0.001f, min, max);
+						changed |= ImGui::DragFloat("Constant", &li.Data.constant, 0.1f, min, 1.f);
+						changed |= ImGui::DragFloat("Linear", &li.Data.linear, 0.01f, min, max);
+						changed |= ImGui::DragFloat("Quadratic", &li.Data.quadratic, 0.001f, min, max);
 
 						ImGui::EndTabItem();
 					}
@@ -418,6 +620,7 @@ namespace Crave
 					{
 						ImGui::Text(LIGHT_PARAM_INT(type));
 						ImGui::Text(LIGHT_PARAM_INT(mipmaplevel));
+						ImGui::Text(LIGHT_PARAM_INT(shadowmode));
 						ImGui::Text(LIGHT_PARAM_TEXT(atlasoffset, VEC2));
 						ImGui::Text(LIGHT_PARAM_FLT(brightness));
 						ImGui::Text(LIGHT_PARAM_VEC3(color));
@@ -441,11 +644,12 @@ namespace Crave
 
 					ImGui::EndTabBar();
 				}
+				return changed;
 			});
 		DrawComponent<MeshInstance>("MeshInstance", entity, [](auto& mi)
 			{
-				ImGui::Checkbox("HasTextures", &mi.HasTextures);
-				ImGui::ColorEdit4("Color", glm::value_ptr(mi.Color));
+				bool changed = ImGui::Checkbox("HasTextures", &mi.HasTextures);
+				changed |= ImGui::ColorEdit4("Color", glm::value_ptr(mi.Color));
 				for (auto& [texType, texVector] : mi.PMesh->Textures())
 				{
 					if (texVector.empty())
@@ -456,6 +660,7 @@ namespace Crave
 						ImGui::Image((void*)tex->Id(), ImVec2{ 128, 128 }, ImVec2{ 0, 1 }, ImVec2{ 1, 0 });
 					}
 				}
+				return changed;
 			});
 	}
 	
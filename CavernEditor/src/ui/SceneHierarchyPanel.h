@@ -1,6 +1,8 @@
 #pragma once
 #include "Cavern.h"
 
+#include <unordered_set>
+
 namespace Crave
 {
 	class SceneHierarchyPanel
@@ -13,12 +15,48 @@ namespace Crave
 
 		void OnImGuiRender(ImGuiWindowFlags panelFlags);
 	private:
+		//A line of the hierarchy as it's shown.
+		struct Row
+		{
+			entt::entity Entity;
+			uint32_t Depth;
+			bool HasChildren;
+			//False for the ancestors shown around filter matches.
+			bool Match;
+		};
+
 		void ReparentTransform(Entity dragged, Entity newParent);
 
-		void DrawEntityNode(Entity entity);
+		void DrawFilter();
+		//Rebuilds the rows when the hierarchy, the expanded nodes or the filter changed since.
+		void UpdateRows();
+		void UpdateMatches(const std::string& filter, bool namesChanged);
+		//The expanded part of the tree.
+		void AddExpandedRows();
+		//Filter matches with their ancestors, all open.
+		void AddMatchRows();
+		void DrawRow(const Row& row, int index, Entity& deleted);
 		void DrawComponents(Entity entity);
 
 	private:
 		Ref<Scene> m_Scene{};
+		//Nodes leading to a new selection, made in the viewport, are opened.
+		Entity m_ShownSelection{};
+		bool m_ScrollToSelection = false;
+		int m_ScrollToRow = -1;
+
+		std::vector<Row> m_Rows{};
+		std::unordered_set<entt::entity> m_Expanded{};
+		uint64_t m_RowsVersion = 0;
+		bool m_RowsDirty = true;
+
+		char m_Filter[256]{};
+		//Lowercase, what m_Matches hold entities for.
+		std::string m_AppliedFilter{};
+		//Names containing the filter, to narrow down as it gets longer.
+		std::vector<NameTable::Id> m_FilterNames{};
+		//In tree order.
+		std::vector<entt::entity> m_Matches{};
+		std::size_t m_MatchHit = 0;
 	};
-}
\ No newline at end of file
+}
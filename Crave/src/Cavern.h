@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/Window.h"
+#include "core/JobSystem.h"
 
 #include "renderer/Renderer.h"
 #include "renderer/Mesh.h"
@@ -0,0 +1,45 @@
+#include "pch.h"
+#include "FileFormat.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace Crave
+{
+	namespace FileFormat
+	{
+		const CEREAL_RAPIDJSON_NAMESPACE::Value* Member(const CEREAL_RAPIDJSON_NAMESPACE::Value& obj, const char* name)
+		{
+			if (!obj.IsObject())
+				return nullptr;
+			auto it = obj.FindMember(name);
+			return it == obj.MemberEnd() ? nullptr : &it->value;
+		}
+
+		bool WriteFile(const std::string& path, const void* data, std::size_t size)
+		{
+			std::error_code ec;
+			const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+			if (!directory.empty())
+				std::filesystem::create_directories(directory, ec);
+
+			const std::string tempPath = path + ".tmp";
+			{
+				std::ofstream ofs(tempPath, std::ios::binary | std::ios::trunc);
+				if (!ofs.write((const char*)data, size))
+				{
+					LOG_ERROR("Writing '{}' failed.", path);
+					return false;
+				}
+			}
+			std::filesystem::rename(tempPath, path, ec);
+			if (ec)
+			{
+				LOG_ERROR("Writing '{}' failed: {}", path, ec.message());
+				std::filesystem::remove(tempPath, ec);
+				return false;
+			}
+			return true;
+		}
+	}
+}
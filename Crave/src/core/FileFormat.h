@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <cereal/external/rapidjson/document.h>
+
+namespace Crave
+{
+	//Helpers shared by the readers and writers of the engine's own files and the formats it imports.
+	namespace FileFormat
+	{
+		//count Ts at offset into the size bytes of data, or null when they don't fit or are misaligned.
+		template<typename T>
+		const T* ArrayAt(const uint8_t* data, std::size_t size, uint64_t offset, std::size_t count)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "File arrays must be plain data");
+			if (offset % alignof(T) || offset > size || count > (size - offset) / sizeof(T))
+				return nullptr;
+			return (const T*)(data + offset);
+		}
+
+		//JSON member lookup that checks types first: cereal's rapidjson throws on any misuse.
+		//Null when obj isn't an object or has no such member.
+		const CEREAL_RAPIDJSON_NAMESPACE::Value* Member(const CEREAL_RAPIDJSON_NAMESPACE::Value& obj, const char* name);
+
+		//Written aside and renamed over the old file, so a crash never leaves half of it. Creates the
+		//directory if needed. Failures are logged.
+		bool WriteFile(const std::string& path, const void* data, std::size_t size);
+	}
+}
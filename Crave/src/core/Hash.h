@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Crave
+{
+	//Non-cryptographic content hashing. Results are stable across runs and platforms.
+	namespace Hash
+	{
+		//XXH64 (xxHash by Yann Collet). Chain buffers by passing the previous result as seed.
+		uint64_t XXH64(const void* data, std::size_t size, uint64_t seed = 0);
+
+		template<typename T>
+		uint64_t Bytes(const std::vector<T>& vec, uint64_t seed = 0)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be hashed as bytes");
+			return XXH64(vec.data(), vec.size() * sizeof(T), seed);
+		}
+
+		inline uint64_t String(const std::string& str, uint64_t seed = 0)
+		{
+			return XXH64(str.data(), str.size(), seed);
+		}
+	}
+}
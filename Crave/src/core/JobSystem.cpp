@@ -0,0 +1,153 @@
+#include "pch.h"
+#include "JobSystem.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace Crave
+{
+	namespace JobSystem
+	{
+		namespace //private
+		{
+			std::vector<std::thread> s_Workers{};
+			std::queue<std::packaged_task<void()>> s_Jobs{};
+			std::queue<std::packaged_task<void()>> s_BackgroundJobs{};
+			std::mutex s_JobsMutex{};
+			std::condition_variable s_JobsCV{};
+			bool s_Stop = false;
+
+			void WorkerLoop()
+			{
+				while (true)
+				{
+					std::packaged_task<void()> job;
+					{
+						std::unique_lock<std::mutex> lock(s_JobsMutex);
+						s_JobsCV.wait(lock, [] { return s_Stop || !s_Jobs.empty() || !s_BackgroundJobs.empty(); });
+						if (s_Stop && s_Jobs.empty() && s_BackgroundJobs.empty())
+							return;
+						auto& queue = s_Jobs.empty() ? s_BackgroundJobs : s_Jobs;
+						job = std::move(queue.front());
+						queue.pop();
+					}
+					job();
+				}
+			}
+		}
+
+		void Init(unsigned workerCount)
+		{
+			ASSERT(s_Workers.empty(), "JobSystem already initialized");
+			if (workerCount == 0)
+			{
+				unsigned hw = std::thread::hardware_concurrency();
+				workerCount = hw > 1 ? hw - 1 : 1;
+			}
+
+			s_Stop = false;
+			for (unsigned i = 0; i < workerCount; ++i)
+				s_Workers.emplace_back(WorkerLoop);
+
+			LOG_INFO("JobSystem started with {} workers", workerCount);
+		}
+
+		void Shutdown()
+		{
+			{
+				std::lock_guard<std::mutex> lock(s_JobsMutex);
+				s_Stop = true;
+			}
+			s_JobsCV.notify_all();
+			for (auto& worker : s_Workers)
+				worker.join();
+			s_Workers.clear();
+		}
+
+		unsigned WorkerCount()
+		{
+			return (unsigned)s_Workers.size();
+		}
+
+		namespace //private
+		{
+			std::future<void> Push(std::queue<std::packaged_task<void()>>& queue, std::function<void()> job)
+			{
+				std::packaged_task<void()> task(std::move(job));
+				std::future<void> result = task.get_future();
+				if (s_Workers.empty())
+				{
+					task();
+					return result;
+				}
+				{
+					std::lock_guard<std::mutex> lock(s_JobsMutex);
+					queue.push(std::move(task));
+				}
+				s_JobsCV.notify_one();
+				return result;
+			}
+		}
+
+		std::future<void> Submit(std::function<void()> job)
+		{
+			return Push(s_Jobs, std::move(job));
+		}
+
+		std::future<void> SubmitBackground(std::function<void()> job)
+		{
+			return Push(s_BackgroundJobs, std::move(job));
+		}
+
+		void ParallelFor(std::size_t count, std::size_t minChunk,
+			const std::function<void(std::size_t, std::size_t)>& func)
+		{
+			if (count == 0)
+				return;
+			minChunk = minChunk ? minChunk : 1;
+
+			std::size_t maxChunks = (count + minChunk - 1) / minChunk;
+			std::size_t chunks = std::min<std::size_t>(maxChunks, s_Workers.size() + 1);
+			if (chunks <= 1)
+			{
+				func(0, count);
+				return;
+			}
+
+			std::size_t chunkSize = (count + chunks - 1) / chunks;
+			chunks = (count + chunkSize - 1) / chunkSize;
+
+			//Chunks go to whoever claims them first. Helpers that start after the caller took the last
+			//one return without touching func, which may be gone by then.
+			struct Progress
+			{
+				std::atomic<std::size_t> next{ 0 };
+				std::atomic<std::size_t> done{ 0 };
+				std::mutex mutex{};
+				std::condition_variable cv{};
+			};
+			auto progress = std::make_shared<Progress>();
+			auto run = [progress, &func, chunkSize, chunks, count]()
+			{
+				for (std::size_t chunk; (chunk = progress->next++) < chunks;)
+				{
+					func(chunk * chunkSize, std::min((chunk + 1) * chunkSize, count));
+					if (++progress->done == chunks)
+					{
+						std::lock_guard<std::mutex> lock(progress->mutex);
+						progress->cv.notify_all();
+					}
+				}
+			};
+			for (std::size_t i = 1; i < chunks; ++i)
+				Submit(run);
+
+			//Main thread claims chunks too, and only waits for the ones workers are running.
+			run();
+			std::unique_lock<std::mutex> lock(progress->mutex);
+			progress->cv.wait(lock, [&progress, chunks] { return progress->done == chunks; });
+		}
+	}
+}
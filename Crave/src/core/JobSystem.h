@@ -0,0 +1,27 @@
+#pragma once
+
+#include <future>
+
+namespace Crave
+{
+	//Fixed pool of worker threads for CPU work that has no GL calls in it.
+	namespace JobSystem
+	{
+		//0 picks hardware_concurrency - 1 workers (the main thread helps in ParallelFor).
+		void Init(unsigned workerCount = 0);
+		void Shutdown();
+
+		unsigned WorkerCount();
+
+		std::future<void> Submit(std::function<void()> job);
+		//For long work the frame doesn't wait on, like imports and autosaves. Workers only take it when
+		//no Submit or ParallelFor work is queued.
+		std::future<void> SubmitBackground(std::function<void()> job);
+
+		//Splits [0, count) into chunks of at least minChunk and runs func(begin, end) on them.
+		//Blocks until every chunk is done. The calling thread runs every chunk no worker has taken, so
+		//busy workers never hold it up. Runs inline if there are no workers.
+		void ParallelFor(std::size_t count, std::size_t minChunk,
+			const std::function<void(std::size_t, std::size_t)>& func);
+	}
+}
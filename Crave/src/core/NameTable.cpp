@@ -0,0 +1,88 @@
+#include "pch.h"
+#include "NameTable.h"
+
+#include <deque>
+#include "core/Hash.h"
+
+namespace Crave
+{
+	namespace NameTable
+	{
+		namespace //private
+		{
+			struct Table
+			{
+				//A deque, so strings handed out by String stay put as names are added.
+				std::deque<std::string> Entries{};
+				//Ids by the name's hash. Distinct names sharing a 64-bit hash are told apart by their string.
+				std::unordered_multimap<uint64_t, Id> ByHash{};
+				std::size_t StringBytes = 0;
+
+				Table()
+				{
+					Entries.emplace_back();
+					ByHash.emplace(Hash::XXH64(nullptr, 0), EMPTY);
+				}
+			};
+
+			Table& GetTable()
+			{
+				static Table table{};
+				return table;
+			}
+
+			Id FindIn(const Table& table, std::string_view name, uint64_t hash)
+			{
+				auto [first, last] = table.ByHash.equal_range(hash);
+				for (auto it = first; it != last; ++it)
+				{
+					if (table.Entries[it->second] == name)
+						return it->second;
+				}
+				return NONE;
+			}
+		}
+
+		Id Intern(std::string_view name)
+		{
+			const uint64_t hash = Hash::XXH64(name.data(), name.size());
+			Table& table = GetTable();
+			Id id = FindIn(table, name, hash);
+			if (id != NONE)
+				return id;
+
+			id = (Id)table.Entries.size();
+			ASSERT(id != NONE, "Name table is full!");
+			table.Entries.emplace_back(name);
+			table.ByHash.emplace(hash, id);
+			//Short strings live inside the entry, up to 15 characters with MSVC and libstdc++.
+			if (name.size() > 15)
+				table.StringBytes += name.size() + 1;
+			return id;
+		}
+
+		Id Find(std::string_view name)
+		{
+			return FindIn(GetTable(), name, Hash::XXH64(name.data(), name.size()));
+		}
+
+		const std::string& String(Id id)
+		{
+			return GetTable().Entries[id];
+		}
+
+		std::size_t Count()
+		{
+			return GetTable().Entries.size();
+		}
+
+		std::size_t Bytes()
+		{
+			const Table& table = GetTable();
+			//A multimap node holds its pair and a next pointer, plus a bucket pointer per bucket.
+			const std::size_t nodeBytes = sizeof(std::pair<const uint64_t, Id>) + sizeof(void*);
+			return table.Entries.size() * sizeof(std::string) + table.StringBytes +
+				table.ByHash.size() * nodeBytes + table.ByHash.bucket_count() * sizeof(void*);
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace Crave
+{
+	//Interned strings. Each distinct string is stored once for the whole program and referred to by a
+	//32-bit id, so names compare and hash as integers. Ids are handed out in order of first use and
+	//differ between runs, so files store the string. Strings are never released.
+	//Main thread only, like the scenes that use it.
+	namespace NameTable
+	{
+		using Id = uint32_t;
+		//The empty string, interned up front.
+		constexpr Id EMPTY = 0;
+		constexpr Id NONE = ~0u;
+
+		Id Intern(std::string_view name);
+		//NONE if name was never interned.
+		Id Find(std::string_view name);
+
+		const std::string& String(Id id);
+
+		std::size_t Count();
+		//Heap and table memory held for the names, approximate.
+		std::size_t Bytes();
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <chrono>
+
+namespace Crave
+{
+	//Wall time since construction or the last Restart, for benchmarks and load logs.
+	class Stopwatch
+	{
+	public:
+		Stopwatch() : m_Start(Clock::now()) {}
+
+		void Restart() { m_Start = Clock::now(); }
+		float ElapsedMs() const { return std::chrono::duration<float, std::milli>(Clock::now() - m_Start).count(); }
+	private:
+		using Clock = std::chrono::steady_clock;
+		Clock::time_point m_Start;
+	};
+}
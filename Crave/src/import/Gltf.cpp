@@ -0,0 +1,857 @@
+#include "pch.h"
+#include "Gltf.h"
+
+#include <filesystem>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cereal/external/rapidjson/document.h>
+#include "core/FileFormat.h"
+#include "core/Hash.h"
+
+namespace Crave
+{
+    namespace Import
+    {
+        namespace Gltf
+        {
+            namespace //private
+            {
+                namespace json = CEREAL_RAPIDJSON_NAMESPACE;
+                using Value = json::Value;
+
+                constexpr uint32_t GLB_MAGIC = 0x46546C67;      //"glTF"
+                constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A; //"JSON"
+                constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;  //"BIN\0"
+
+                enum ComponentType
+                {
+                    Byte = 5120, UnsignedByte = 5121, Short = 5122, UnsignedShort = 5123, UnsignedInt = 5125, Float = 5126
+                };
+                enum Mode
+                {
+                    Triangles = 4, TriangleStrip = 5, TriangleFan = 6
+                };
+
+                std::size_t ComponentSize(int64_t type)
+                {
+                    switch (type)
+                    {
+                    case Byte: case UnsignedByte:   return 1;
+                    case Short: case UnsignedShort: return 2;
+                    case UnsignedInt: case Float:   return 4;
+                    default:                        return 0;
+                    }
+                }
+
+                unsigned ComponentCount(const std::string& type)
+                {
+                    if (type == "SCALAR") return 1;
+                    if (type == "VEC2")   return 2;
+                    if (type == "VEC3")   return 3;
+                    if (type == "VEC4")   return 4;
+                    return 0; //matrices never describe vertex data
+                }
+
+                uint32_t ReadU32(const uint8_t* bytes)
+                {
+                    uint32_t value;
+                    std::memcpy(&value, bytes, sizeof(value));
+                    return value;
+                }
+
+                using FileFormat::Member;
+
+                //-1 when missing or not a non-negative integer.
+                int64_t Index(const Value& obj, const char* name)
+                {
+                    const Value* v = Member(obj, name);
+                    return v && v->IsInt64() && v->GetInt64() >= 0 ? v->GetInt64() : -1;
+                }
+
+                const Value* Array(const Value& obj, const char* name)
+                {
+                    const Value* v = Member(obj, name);
+                    return v && v->IsArray() ? v : nullptr;
+                }
+
+                const Value* Element(const Value& obj, const char* array, int64_t index)
+                {
+                    const Value* v = Array(obj, array);
+                    return v && index >= 0 && index < (int64_t)v->Size() ? &(*v)[(json::SizeType)index] : nullptr;
+                }
+
+                std::string String(const Value& obj, const char* name)
+                {
+                    const Value* v = Member(obj, name);
+                    return v && v->IsString() ? std::string(v->GetString(), v->GetStringLength()) : std::string();
+                }
+
+                //Reads count numbers into out. False if the array is missing or too short.
+                bool Numbers(const Value& obj, const char* name, float* out, unsigned count)
+                {
+                    const Value* v = Array(obj, name);
+                    if (!v || v->Size() < count)
+                        return false;
+                    for (unsigned i = 0; i < count; ++i)
+                    {
+                        if (!(*v)[i].IsNumber())
+                            return false;
+                        out[i] = (float)(*v)[i].GetDouble();
+                    }
+                    return true;
+                }
+
+                std::string DecodeUri(const std::string& uri)
+                {
+                    std::string out;
+                    out.reserve(uri.size());
+                    for (std::size_t i = 0; i < uri.size(); ++i)
+                    {
+                        if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit((unsigned char)uri[i + 1]) &&
+                            std::isxdigit((unsigned char)uri[i + 2]))
+                        {
+                            out += (char)std::stoi(uri.substr(i + 1, 2), nullptr, 16);
+                            i += 2;
+                        }
+                        else
+                            out += uri[i];
+                    }
+                    return out;
+                }
+
+                bool DecodeBase64(const char* text, std::size_t size, std::vector<uint8_t>& out)
+                {
+                    static const auto table = []()
+                    {
+                        std::array<int8_t, 256> t{};
+                        t.fill(-1);
+                        const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+                        for (int8_t i = 0; i < 64; ++i)
+                            t[(uint8_t)chars[i]] = i;
+                        return t;
+                    }();
+
+                    out.clear();
+                    out.reserve(size / 4 * 3);
+                    uint32_t bits = 0;
+                    int count = 0;
+                    for (std::size_t i = 0; i < size && text[i] != '='; ++i)
+                    {
+                        int8_t value = table[(uint8_t)text[i]];
+                        if (value < 0)
+                            return false;
+                        bits = bits << 6 | (uint32_t)value;
+                        if (++count == 4)
+                        {
+                            out.push_back(uint8_t(bits >> 16));
+                            out.push_back(uint8_t(bits >> 8));
+                            out.push_back(uint8_t(bits));
+                            bits = 0;
+                            count = 0;
+                        }
+                    }
+                    if (count == 1)
+                        return false;
+                    if (count == 2)
+                        out.push_back(uint8_t(bits >> 4));
+                    else if (count == 3)
+                    {
+                        out.push_back(uint8_t(bits >> 10));
+                        out.push_back(uint8_t(bits >> 2));
+                    }
+                    return true;
+                }
+
+                bool IsDataUri(const std::string& uri)
+                {
+                    return uri.compare(0, 5, "data:") == 0;
+                }
+
+                //data:[<mime>];base64,<payload>
+                bool DecodeDataUri(const std::string& uri, std::vector<uint8_t>& out, std::string& mime)
+                {
+                    std::size_t comma = uri.find(',');
+                    std::size_t base64 = uri.rfind(";base64", comma);
+                    if (comma == std::string::npos || base64 == std::string::npos)
+                        return false;
+                    mime = uri.substr(5, uri.find(';', 5) - 5);
+                    return DecodeBase64(uri.data() + comma + 1, uri.size() - comma - 1, out);
+                }
+
+                float ReadComponent(const uint8_t* p, int type, bool normalized)
+                {
+                    switch (type)
+                    {
+                    case Float:         { float v; std::memcpy(&v, p, 4); return v; }
+                    case UnsignedByte:  return normalized ? *p / 255.f : *p;
+                    case Byte:          return normalized ? std::max(*(const int8_t*)p / 127.f, -1.f) : *(const int8_t*)p;
+                    case UnsignedShort: { uint16_t v; std::memcpy(&v, p, 2); return normalized ? v / 65535.f : v; }
+                    case Short:         { int16_t v; std::memcpy(&v, p, 2); return normalized ? std::max(v / 32767.f, -1.f) : v; }
+                    default:            { uint32_t v; std::memcpy(&v, p, 4); return (float)v; }
+                    }
+                }
+
+                template<typename Accessor>
+                void ReadElement(const Accessor& a, std::size_t i, float* out)
+                {
+                    const uint8_t* p = a.data + i * a.stride;
+                    if (a.componentType == Float)
+                    {
+                        std::memcpy(out, p, a.components * sizeof(float));
+                        return;
+                    }
+                    std::size_t size = ComponentSize(a.componentType);
+                    for (unsigned c = 0; c < a.components; ++c)
+                        out[c] = ReadComponent(p + c * size, a.componentType, a.normalized);
+                }
+
+                template<typename Accessor>
+                unsigned ReadIndex(const Accessor& a, std::size_t i)
+                {
+                    const uint8_t* p = a.data + i * a.stride;
+                    switch (a.componentType)
+                    {
+                    case UnsignedByte:  return *p;
+                    case UnsignedShort: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+                    default:            { uint32_t v; std::memcpy(&v, p, 4); return v; }
+                    }
+                }
+
+                //Area-weighted face normals summed per vertex, what aiProcess_GenSmoothNormals gives for
+                //an indexed mesh.
+                void GenerateNormals(std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned>& indices)
+                {
+                    for (std::size_t t = 0; t + 2 < indices.size(); t += 3)
+                    {
+                        Mesh::Vertex& a = vertices[indices[t]];
+                        Mesh::Vertex& b = vertices[indices[t + 1]];
+                        Mesh::Vertex& c = vertices[indices[t + 2]];
+                        glm::vec3 n = glm::cross(b.Position - a.Position, c.Position - a.Position);
+                        a.Normal += n;
+                        b.Normal += n;
+                        c.Normal += n;
+                    }
+                    for (auto& v : vertices)
+                    {
+                        float length = glm::length(v.Normal);
+                        v.Normal = length > 0.f ? v.Normal / length : glm::vec3(0.f, 1.f, 0.f);
+                    }
+                }
+
+                //Per-triangle uv gradients summed per vertex and orthogonalized against the normal.
+                void GenerateTangents(std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned>& indices)
+                {
+                    for (std::size_t t = 0; t + 2 < indices.size(); t += 3)
+                    {
+                        Mesh::Vertex& a = vertices[indices[t]];
+                        Mesh::Vertex& b = vertices[indices[t + 1]];
+                        Mesh::Vertex& c = vertices[indices[t + 2]];
+                        glm::vec3 e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+                        glm::vec2 d1 = b.TexCoords - a.TexCoords, d2 = c.TexCoords - a.TexCoords;
+                        float det = d1.x * d2.y - d2.x * d1.y;
+                        if (std::abs(det) < 1e-12f)
+                            continue;
+                        float r = 1.f / det;
+                        glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * r;
+                        glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) * r;
+                        for (Mesh::Vertex* v : { &a, &b, &c })
+                        {
+                            v->Tangent += tangent;
+                            v->Bitangent += bitangent;
+                        }
+                    }
+                    for (auto& v : vertices)
+                    {
+                        glm::vec3 t = v.Tangent - v.Normal * glm::dot(v.Normal, v.Tangent);
+                        float length = glm::length(t);
+                        if (length < 1e-12f)
+                        {
+                            //No uv gradient, any vector perpendicular to the normal will do.
+                            t = glm::cross(v.Normal, std::abs(v.Normal.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f));
+                            length = glm::length(t);
+                        }
+                        float handedness = glm::dot(glm::cross(v.Normal, t), v.Bitangent) < 0.f ? -1.f : 1.f;
+                        v.Tangent = t / length;
+                        v.Bitangent = glm::cross(v.Normal, v.Tangent) * handedness;
+                    }
+                }
+            }
+
+            bool IsGltf(const std::string& path)
+            {
+                std::string ext = std::filesystem::path(path).extension().string();
+                std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+                return ext == ".gltf" || ext == ".glb";
+            }
+
+            struct Document::Parser
+            {
+                Document& doc;
+                const Value& root;
+                const std::string& path;
+                std::vector<Span> views{};
+                std::vector<std::size_t> viewStrides{};
+                std::vector<std::string> imagePaths{}; //resolved on first use
+
+                bool Fail(const std::string& reason)
+                {
+                    LOG_WARN("glTF '{}': {}", path, reason);
+                    return false;
+                }
+
+                bool Buffers(Span glbBinary)
+                {
+                    const Value* buffers = Array(root, "buffers");
+                    if (!buffers)
+                        return true;
+                    for (json::SizeType i = 0; i < buffers->Size(); ++i)
+                    {
+                        const Value& buffer = (*buffers)[i];
+                        int64_t byteLength = Index(buffer, "byteLength");
+                        std::string uri = String(buffer, "uri");
+                        Span span{};
+                        if (uri.empty())
+                        {
+                            //Only the first buffer of a .glb may live in its binary chunk.
+                            if (i != 0 || !glbBinary.data)
+                                return Fail("buffer without data");
+                            span = glbBinary;
+                        }
+                        else if (IsDataUri(uri))
+                        {
+                            std::string mime;
+                            doc.m_DecodedBuffers.emplace_back();
+                            if (!DecodeDataUri(uri, doc.m_DecodedBuffers.back(), mime))
+                                return Fail("undecodable buffer data URI");
+                            span = { doc.m_DecodedBuffers.back().data(), doc.m_DecodedBuffers.back().size() };
+                        }
+                        else
+                        {
+                            auto file = std::make_unique<MappedFile>(doc.m_Directory + DecodeUri(uri));
+                            if (!file->IsOpen())
+                                return Fail("can't open buffer '" + uri + "'");
+                            span = { file->Data(), file->Size() };
+                            doc.m_Files.push_back(std::move(file));
+                        }
+                        if (byteLength < 0 || (std::size_t)byteLength > span.size)
+                            return Fail("buffer " + std::to_string(i) + " is shorter than its byteLength");
+                        span.size = (std::size_t)byteLength;
+                        doc.m_Buffers.push_back(span);
+                    }
+                    return true;
+                }
+
+                bool BufferViews()
+                {
+                    const Value* bufferViews = Array(root, "bufferViews");
+                    if (!bufferViews)
+                        return true;
+                    for (json::SizeType i = 0; i < bufferViews->Size(); ++i)
+                    {
+                        const Value& view = (*bufferViews)[i];
+                        int64_t buffer = Index(view, "buffer");
+                        int64_t offset = std::max<int64_t>(Index(view, "byteOffset"), 0);
+                        int64_t length = Index(view, "byteLength");
+                        int64_t stride = std::max<int64_t>(Index(view, "byteStride"), 0);
+                        if (buffer < 0 || buffer >= (int64_t)doc.m_Buffers.size() || length < 0 ||
+                            (uint64_t)offset + (uint64_t)length > doc.m_Buffers[buffer].size)
+                            return Fail("bufferView " + std::to_string(i) + " is out of range");
+                        views.push_back({ doc.m_Buffers[buffer].data + offset, (std::size_t)length });
+                        viewStrides.push_back((std::size_t)stride);
+                    }
+                    return true;
+                }
+
+                //Absent accessors (index -1) leave out untouched and succeed.
+                bool ReadAccessor(int64_t index, Accessor& out, const char* what)
+                {
+                    if (index < 0)
+                        return true;
+                    const Value* accessor = Element(root, "accessors", index);
+                    if (!accessor)
+                        return Fail(std::string(what) + " accessor is missing");
+                    if (Member(*accessor, "sparse"))
+                        return Fail("sparse accessors aren't supported");
+
+                    int64_t view = Index(*accessor, "bufferView");
+                    int64_t offset = std::max<int64_t>(Index(*accessor, "byteOffset"), 0);
+                    int64_t count = Index(*accessor, "count");
+                    int64_t componentType = Index(*accessor, "componentType");
+                    unsigned components = ComponentCount(String(*accessor, "type"));
+                    std::size_t componentSize = ComponentSize(componentType);
+                    if (view < 0 || view >= (int64_t)views.size() || count < 0 || !components || !componentSize)
+                        return Fail(std::string(what) + " accessor is invalid");
+
+                    const Value* norm = Member(*accessor, "normalized");
+                    std::size_t elementSize = components * componentSize;
+                    std::size_t stride = viewStrides[view] ? viewStrides[view] : elementSize;
+                    uint64_t end = (uint64_t)offset + (count ? (uint64_t)(count - 1) * stride + elementSize : 0);
+                    if (end > views[view].size)
+                        return Fail(std::string(what) + " accessor reads past its bufferView");
+
+                    out.data = views[view].data + offset;
+                    out.count = (std::size_t)count;
+                    out.stride = stride;
+                    out.componentType = (int)componentType;
+                    out.components = components;
+                    out.normalized = norm && norm->IsBool() && norm->GetBool();
+                    return true;
+                }
+
+                //Embedded images are written out by content, so every later load finds the same file.
+                bool ImagePath(int64_t index, std::string& path)
+                {
+                    const Value* image = Element(root, "images", index);
+                    if (!image)
+                        return Fail("texture without image");
+                    if (!imagePaths[index].empty())
+                    {
+                        path = imagePaths[index];
+                        return true;
+                    }
+
+                    std::string uri = String(*image, "uri");
+                    if (!uri.empty() && !IsDataUri(uri))
+                    {
+                        path = imagePaths[index] = doc.m_Directory + DecodeUri(uri);
+                        return true;
+                    }
+
+                    std::vector<uint8_t> decoded;
+                    std::string mime = String(*image, "mimeType");
+                    Span bytes{};
+                    if (!uri.empty())
+                    {
+                        if (!DecodeDataUri(uri, decoded, mime))
+                            return Fail("undecodable image data URI");
+                        bytes = { decoded.data(), decoded.size() };
+                    }
+                    else
+                    {
+                        int64_t view = Index(*image, "bufferView");
+                        if (view < 0 || view >= (int64_t)views.size())
+                            return Fail("image without data");
+                        bytes = views[view];
+                    }
+
+                    char name[17];
+                    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)Hash::XXH64(bytes.data, bytes.size));
+                    path = std::string(IMAGE_CACHE_PATH) + name + (mime == "image/jpeg" ? ".jpg" : ".png");
+                    std::error_code ec;
+                    if (!std::filesystem::exists(path, ec) && !FileFormat::WriteFile(path, bytes.data, bytes.size))
+                        return Fail("can't write embedded image");
+                    imagePaths[index] = path;
+                    return true;
+                }
+
+                //textureInfo is a material's {"index": n} reference. Missing references add nothing.
+                bool AddTexture(const Value* textureInfo, Mesh::TexType type, Primitive& primitive)
+                {
+                    if (!textureInfo)
+                        return true;
+                    const Value* texture = Element(root, "textures", Index(*textureInfo, "index"));
+                    if (!texture)
+                        return Fail("material references a missing texture");
+                    std::string path;
+                    if (!ImagePath(Index(*texture, "source"), path))
+                        return false;
+                    primitive.textures[type].push_back(path);
+                    if (std::find(doc.m_TexturePaths.begin(), doc.m_TexturePaths.end(), path) == doc.m_TexturePaths.end())
+                        doc.m_TexturePaths.push_back(path);
+                    return true;
+                }
+
+                bool CheckAttribute(const Accessor& a, const Accessor& position, const char* what,
+                    unsigned minComponents, unsigned maxComponents, bool allowNormalized)
+                {
+                    if (!a.data)
+                        return true;
+                    bool typeOk = a.componentType == Float ||
+                        (allowNormalized && a.normalized && (a.componentType == UnsignedByte || a.componentType == UnsignedShort));
+                    if (!typeOk || a.components < minComponents || a.components > maxComponents)
+                        return Fail(std::string(what) + " has an unsupported layout");
+                    if (a.count != position.count)
+                        return Fail(std::string(what) + " count differs from POSITION");
+                    return true;
+                }
+
+                bool ReadPrimitive(const Value& prim, const std::string& name, Primitive& out)
+                {
+                    out.name = name;
+                    const Value* modeValue = Member(prim, "mode");
+                    out.mode = modeValue ? (int)Index(prim, "mode") : Triangles;
+                    if (out.mode != Triangles && out.mode != TriangleStrip && out.mode != TriangleFan)
+                        return Fail("'" + name + "' isn't made of triangles");
+
+                    const Value* attributes = Member(prim, "attributes");
+                    if (!attributes)
+                        return Fail("'" + name + "' has no attributes");
+                    if (!ReadAccessor(Index(*attributes, "POSITION"), out.position, "POSITION") ||
+                        !ReadAccessor(Index(*attributes, "NORMAL"), out.normal, "NORMAL") ||
+                        !ReadAccessor(Index(*attributes, "TANGENT"), out.tangent, "TANGENT") ||
+                        !ReadAccessor(Index(*attributes, "TEXCOORD_0"), out.texCoord, "TEXCOORD_0") ||
+                        !ReadAccessor(Index(*attributes, "COLOR_0"), out.color, "COLOR_0") ||
+                        !ReadAccessor(Index(prim, "indices"), out.indices, "indices"))
+                        return false;
+
+                    if (!out.position.data || out.position.componentType != Float || out.position.components != 3)
+                        return Fail("'" + name + "' needs float3 positions");
+                    if (!CheckAttribute(out.normal, out.position, "NORMAL", 3, 3, false) ||
+                        !CheckAttribute(out.tangent, out.position, "TANGENT", 4, 4, false) ||
+                        !CheckAttribute(out.texCoord, out.position, "TEXCOORD_0", 2, 2, true) ||
+                        !CheckAttribute(out.color, out.position, "COLOR_0", 3, 4, true))
+                        return false;
+
+                    const Accessor& indices = out.indices;
+                    if (indices.data)
+                    {
+                        if (indices.components != 1 || indices.normalized || (indices.componentType != UnsignedByte &&
+                            indices.componentType != UnsignedShort && indices.componentType != UnsignedInt))
+                            return Fail("'" + name + "' has an unsupported index type");
+                        //Checked once here so ReadMesh never sees an index past the vertices.
+                        for (std::size_t i = 0; i < indices.count; ++i)
+                        {
+                            if (ReadIndex(indices, i) >= out.position.count)
+                                return Fail("'" + name + "' indexes past its vertices");
+                        }
+                    }
+
+                    const Value* material = Element(root, "materials", Index(prim, "material"));
+                    if (material)
+                    {
+                        const Value* pbr = Member(*material, "pbrMetallicRoughness");
+                        if (!AddTexture(pbr ? Member(*pbr, "baseColorTexture") : nullptr, Mesh::TexType::Diffuse, out) ||
+                            !AddTexture(Member(*material, "normalTexture"), Mesh::TexType::Normal, out))
+                            return false;
+                    }
+                    return true;
+                }
+
+                //meshPrimitives[m] lists the engine meshes glTF mesh m became.
+                bool Meshes(std::vector<std::vector<unsigned>>& meshPrimitives)
+                {
+                    const Value* images = Array(root, "images");
+                    imagePaths.resize(images ? images->Size() : 0);
+
+                    const Value* meshes = Array(root, "meshes");
+                    if (!meshes)
+                        return Fail("no meshes");
+                    meshPrimitives.resize(meshes->Size());
+                    for (json::SizeType m = 0; m < meshes->Size(); ++m)
+                    {
+                        const Value& mesh = (*meshes)[m];
+                        const Value* primitives = Array(mesh, "primitives");
+                        if (!primitives)
+                            return Fail("mesh " + std::to_string(m) + " has no primitives");
+                        //Named like Assimp names them, so both importers log the same meshes.
+                        std::string name = String(mesh, "name");
+                        for (json::SizeType p = 0; p < primitives->Size(); ++p)
+                        {
+                            Primitive primitive;
+                            std::string primName = primitives->Size() == 1 ? name : name + "-" + std::to_string(p);
+                            if (!ReadPrimitive((*primitives)[p], primName, primitive))
+                                return false;
+                            meshPrimitives[m].push_back((unsigned)doc.m_Meshes.size());
+                            doc.m_Meshes.push_back(std::move(primitive));
+                        }
+                    }
+                    return true;
+                }
+
+                bool Node(int64_t index, int parent, const std::vector<std::vector<unsigned>>& meshPrimitives,
+                    std::vector<char>& visited)
+                {
+                    const Value* node = Element(root, "nodes", index);
+                    if (!node || visited[index])
+                        return Fail("node hierarchy is broken");
+                    visited[index] = true;
+
+                    ModelNode out;
+                    out.name = String(*node, "name");
+                    out.parent = parent;
+                    float m[16];
+                    if (Numbers(*node, "matrix", m, 16))
+                        out.transform = glm::make_mat4(m);
+                    else
+                    {
+                        float t[3] = { 0.f, 0.f, 0.f }, r[4] = { 0.f, 0.f, 0.f, 1.f }, s[3] = { 1.f, 1.f, 1.f };
+                        Numbers(*node, "translation", t, 3);
+                        Numbers(*node, "rotation", r, 4);
+                        Numbers(*node, "scale", s, 3);
+                        out.transform = glm::translate(glm::mat4(1.f), glm::make_vec3(t)) *
+                            glm::mat4_cast(glm::quat(r[3], r[0], r[1], r[2])) * glm::scale(glm::mat4(1.f), glm::make_vec3(s));
+                    }
+                    int64_t mesh = Index(*node, "mesh");
+                    if (mesh >= (int64_t)meshPrimitives.size())
+                        return Fail("node references a missing mesh");
+                    if (mesh >= 0)
+                        out.meshes = meshPrimitives[mesh];
+
+                    int self = (int)doc.m_Nodes.size();
+                    doc.m_Nodes.push_back(std::move(out));
+                    if (const Value* children = Array(*node, "children"))
+                    {
+                        for (const auto& child : children->GetArray())
+                        {
+                            if (!child.IsInt64() || !Node(child.GetInt64(), self, meshPrimitives, visited))
+                                return Fail("node hierarchy is broken");
+                        }
+                    }
+                    return true;
+                }
+
+                //A scene with several root nodes gets a ROOT node above them, as Assimp does.
+                bool Nodes(const std::vector<std::vector<unsigned>>& meshPrimitives)
+                {
+                    const Value* nodes = Array(root, "nodes");
+                    if (!nodes)
+                        return Fail("no nodes");
+
+                    std::vector<int64_t> roots;
+                    int64_t sceneIndex = std::max<int64_t>(Index(root, "scene"), 0);
+                    if (const Value* scene = Element(root, "scenes", sceneIndex))
+                    {
+                        if (const Value* sceneNodes = Array(*scene, "nodes"))
+                        {
+                            for (const auto& n : sceneNodes->GetArray())
+                                roots.push_back(n.IsInt64() ? n.GetInt64() : -1);
+                        }
+                    }
+                    else
+                    {
+                        //No scenes: every node no other node lists as a child is a root.
+                        std::vector<char> isChild(nodes->Size(), 0);
+                        for (const auto& node : nodes->GetArray())
+                        {
+                            if (const Value* children = Array(node, "children"))
+                            {
+                                for (const auto& c : children->GetArray())
+                                {
+                                    if (c.IsInt64() && c.GetInt64() >= 0 && c.GetInt64() < (int64_t)isChild.size())
+                                        isChild[c.GetInt64()] = 1;
+                                }
+                            }
+                        }
+                        for (json::SizeType i = 0; i < nodes->Size(); ++i)
+                        {
+                            if (!isChild[i])
+                                roots.push_back(i);
+                        }
+                    }
+                    if (roots.empty())
+                        return Fail("scene has no nodes");
+
+                    std::vector<char> visited(nodes->Size(), 0);
+                    int parent = -1;
+                    if (roots.size() > 1)
+                    {
+                        doc.m_Nodes.push_back({ "ROOT", glm::mat4(1.f), -1, {} });
+                        parent = 0;
+                    }
+                    for (int64_t r : roots)
+                    {
+                        if (!Node(r, parent, meshPrimitives, visited))
+                            return false;
+                    }
+                    return true;
+                }
+            };
+
+            bool Document::Open(const std::string& path)
+            {
+                Close();
+                m_Directory = path.substr(0, path.find_last_of('/') + 1);
+                auto file = std::make_unique<MappedFile>(path);
+                if (!file->IsOpen())
+                {
+                    LOG_WARN("glTF '{}' can't be opened.", path);
+                    return false;
+                }
+                const uint8_t* bytes = file->Data();
+                const std::size_t size = file->Size();
+                Span text{}, binary{};
+                m_Files.push_back(std::move(file));
+
+                if (!SplitChunks({ bytes, size }, text, binary))
+                {
+                    LOG_WARN("glTF '{}' has an unsupported or damaged GLB header.", path);
+                    Close();
+                    return false;
+                }
+
+                json::Document document;
+                if (text.data)
+                    document.Parse((const char*)text.data, text.size);
+                if (!text.data || document.HasParseError() || !document.IsObject())
+                {
+                    LOG_WARN("glTF '{}' has no valid JSON.", path);
+                    Close();
+                    return false;
+                }
+
+                Parser parser{ *this, document, path };
+                const Value* asset = Member(document, "asset");
+                if (!asset || String(*asset, "version").compare(0, 2, "2.") != 0)
+                    parser.Fail("only glTF 2.0 is supported");
+                else if (const Value* required = Array(document, "extensionsRequired"); required && !required->Empty())
+                    parser.Fail("requires extensions this reader doesn't support");
+                else
+                {
+                    std::vector<std::vector<unsigned>> meshPrimitives;
+                    if (parser.Buffers(binary) && parser.BufferViews() && parser.Meshes(meshPrimitives) &&
+                        parser.Nodes(meshPrimitives) && !m_Meshes.empty())
+                        return true;
+                }
+                Close();
+                return false;
+            }
+
+            std::vector<std::string> Document::BufferFiles(const std::string& path)
+            {
+                std::vector<std::string> files;
+                MappedFile file(path);
+                Span text{}, binary{};
+                if (!file.IsOpen() || !SplitChunks({ file.Data(), file.Size() }, text, binary) || !text.data)
+                    return files;
+
+                json::Document document;
+                document.Parse((const char*)text.data, text.size);
+                if (document.HasParseError())
+                    return files;
+                const Value* buffers = Array(document, "buffers");
+                if (!buffers)
+                    return files;
+                const std::string directory = path.substr(0, path.find_last_of('/') + 1);
+                for (json::SizeType i = 0; i < buffers->Size(); ++i)
+                {
+                    std::string uri = String((*buffers)[i], "uri");
+                    if (!uri.empty() && !IsDataUri(uri))
+                        files.push_back(directory + DecodeUri(uri));
+                }
+                return files;
+            }
+
+            bool Document::SplitChunks(Span file, Span& text, Span& binary)
+            {
+                text = file;
+                binary = {};
+                //A .glb is a 12-byte header and chunks: the JSON first, then optionally the binary buffer.
+                if (file.size < 12 || ReadU32(file.data) != GLB_MAGIC)
+                    return true;
+
+                std::size_t length = ReadU32(file.data + 8);
+                if (ReadU32(file.data + 4) != 2 || length > file.size)
+                    return false;
+                text = {};
+                for (std::size_t offset = 12; offset + 8 <= length;)
+                {
+                    std::size_t chunkLength = ReadU32(file.data + offset);
+                    uint32_t chunkType = ReadU32(file.data + offset + 4);
+                    offset += 8;
+                    if (chunkLength > length - offset)
+                        break;
+                    if (chunkType == GLB_CHUNK_JSON && !text.data)
+                        text = { file.data + offset, chunkLength };
+                    else if (chunkType == GLB_CHUNK_BIN && !binary.data)
+                        binary = { file.data + offset, chunkLength };
+                    offset += (chunkLength + 3) & ~std::size_t(3);
+                }
+                return true;
+            }
+
+            void Document::Close()
+            {
+                m_Meshes.clear();
+                m_TexturePaths.clear();
+                m_Nodes.clear();
+                m_Buffers.clear();
+                m_DecodedBuffers.clear();
+                m_Files.clear();
+            }
+
+            std::size_t Document::TriangleCount(std::size_t mesh) const
+            {
+                const Primitive& p = m_Meshes[mesh];
+                std::size_t count = p.indices.data ? p.indices.count : p.position.count;
+                if (p.mode == Triangles)
+                    return count / 3;
+                return count >= 3 ? count - 2 : 0;
+            }
+
+            Mesh::ModelData Document::ReadMesh(std::size_t mesh) const
+            {
+                const Primitive& p = m_Meshes[mesh];
+                Mesh::ModelData data;
+                data.textures = p.textures;
+
+                //Absent attributes stay zero, see MeshManager::ChooseVertexFormat.
+                std::vector<Mesh::Vertex>& vertices = data.vertices;
+                vertices.assign(p.position.count, Mesh::Vertex{});
+                float v[4];
+                for (std::size_t i = 0; i < vertices.size(); ++i)
+                {
+                    Mesh::Vertex& vertex = vertices[i];
+                    ReadElement(p.position, i, v);
+                    vertex.Position = { v[0], v[1], v[2] };
+                    if (p.normal.data)
+                    {
+                        ReadElement(p.normal, i, v);
+                        vertex.Normal = { v[0], v[1], v[2] };
+                    }
+                    //glTF's top-left uv origin is kept: Assimp flips v on import and aiProcess_FlipUVs
+                    //flips it back, so this matches the Assimp path.
+                    if (p.texCoord.data)
+                    {
+                        ReadElement(p.texCoord, i, v);
+                        vertex.TexCoords = { v[0], v[1] };
+                    }
+                    if (p.color.data)
+                    {
+                        v[3] = 1.f;
+                        ReadElement(p.color, i, v);
+                        vertex.Color = { v[0], v[1], v[2], v[3] };
+                    }
+                }
+
+                std::vector<unsigned> source(p.indices.data ? p.indices.count : vertices.size());
+                for (std::size_t i = 0; i < source.size(); ++i)
+                    source[i] = p.indices.data ? ReadIndex(p.indices, i) : (unsigned)i;
+                if (p.mode == Triangles)
+                    data.indices = std::move(source);
+                else
+                {
+                    data.indices.reserve(TriangleCount(mesh) * 3);
+                    for (std::size_t i = 2; i < source.size(); ++i)
+                    {
+                        //Odd strip triangles swap their first two corners to keep the winding.
+                        if (p.mode == TriangleFan)
+                            data.indices.insert(data.indices.end(), { source[0], source[i - 1], source[i] });
+                        else if (i % 2 == 0)
+                            data.indices.insert(data.indices.end(), { source[i - 2], source[i - 1], source[i] });
+                        else
+                            data.indices.insert(data.indices.end(), { source[i - 1], source[i - 2], source[i] });
+                    }
+                }
+                data.indices.resize(data.indices.size() / 3 * 3);
+
+                if (!p.normal.data)
+                    GenerateNormals(vertices, data.indices);
+                if (p.texCoord.data)
+                {
+                    if (!p.tangent.data)
+                        GenerateTangents(vertices, data.indices);
+                    else
+                    {
+                        for (std::size_t i = 0; i < vertices.size(); ++i)
+                        {
+                            ReadElement(p.tangent, i, v);
+                            vertices[i].Tangent = { v[0], v[1], v[2] };
+                            vertices[i].Bitangent = glm::cross(vertices[i].Normal, vertices[i].Tangent) * v[3];
+                        }
+                    }
+                }
+                return data;
+            }
+        }
+    }
+}
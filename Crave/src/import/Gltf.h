@@ -0,0 +1,86 @@
+#pragma once
+#include "import/Model.h"
+#include "platform/MappedFile.h"
+
+namespace Crave
+{
+    namespace Import
+    {
+        //glTF 2.0 reader for .gltf and .glb. Buffers are mapped and accessors read straight into
+        //Mesh::Vertex, without an intermediate scene. Produces what Model gets from Assimp for the same
+        //file: one mesh per primitive, base color and normal textures, and the node tree.
+        namespace Gltf
+        {
+            //Embedded images are written here once, by content hash, so they load like any other file.
+            constexpr const char* IMAGE_CACHE_PATH = "res/cache/textures/";
+
+            //By extension.
+            bool IsGltf(const std::string& path);
+
+            class Document
+            {
+            public:
+                Document() = default;
+                Document(const Document&) = delete;
+                Document& operator=(const Document&) = delete;
+
+                //Parses the JSON, maps the buffers and checks every accessor against them. False if the
+                //file is damaged or uses something this reader doesn't (sparse accessors, required
+                //extensions, point and line primitives); Assimp takes over then.
+                bool Open(const std::string& path);
+                void Close();
+                bool IsOpen() const { return !m_Meshes.empty(); }
+
+                std::size_t MeshCount() const { return m_Meshes.size(); }
+                std::size_t TriangleCount(std::size_t mesh) const;
+                const std::string& MeshName(std::size_t mesh) const { return m_Meshes[mesh].name; }
+                //Reads from the mapped buffers only, so meshes are read in parallel. Normals and tangents
+                //the file leaves out are generated.
+                Mesh::ModelData ReadMesh(std::size_t mesh) const;
+
+                //Texture paths relative to the working directory, embedded images included.
+                const std::vector<std::string>& TexturePaths() const { return m_TexturePaths; }
+                const std::vector<ModelNode>& Nodes() const { return m_Nodes; }
+
+                //Paths of the external buffers the file reads, for hashing along with it. Only the JSON is
+                //parsed. Empty if there are none or the file is damaged.
+                static std::vector<std::string> BufferFiles(const std::string& path);
+            private:
+                struct Accessor
+                {
+                    const uint8_t* data = nullptr; //null if the primitive doesn't have the attribute
+                    std::size_t count = 0;
+                    std::size_t stride = 0;
+                    int componentType = 0;
+                    unsigned components = 0;
+                    bool normalized = false;
+                };
+                struct Primitive
+                {
+                    std::string name{};
+                    int mode = 4; //triangles, strip (5) and fan (6) are unrolled
+                    Accessor position{}, normal{}, tangent{}, texCoord{}, color{}, indices{};
+                    std::unordered_map<Mesh::TexType, std::vector<std::string>> textures{};
+                };
+                struct Span
+                {
+                    const uint8_t* data = nullptr;
+                    std::size_t size = 0;
+                };
+                struct Parser; //the JSON side of Open
+
+                //Finds the JSON and binary chunks of a .glb; a .gltf is all JSON. False if the GLB header is damaged.
+                static bool SplitChunks(Span file, Span& text, Span& binary);
+            private:
+                std::string m_Directory{};
+                std::vector<std::unique_ptr<MappedFile>> m_Files{}; //the document and its .bin buffers
+                std::vector<std::vector<uint8_t>> m_DecodedBuffers{}; //data: URIs
+                std::vector<Span> m_Buffers{};
+
+                std::vector<Primitive> m_Meshes{};
+                std::vector<std::string> m_TexturePaths{};
+                std::vector<ModelNode> m_Nodes{};
+            };
+        }
+    }
+}
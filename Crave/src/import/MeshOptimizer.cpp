@@ -0,0 +1,395 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+#include <numeric>
+
+namespace Crave
+{
+    namespace Import
+    {
+        namespace MeshOptimizer
+        {
+            namespace //private
+            {
+                //Triangles using each vertex, in compressed rows.
+                struct Adjacency
+                {
+                    std::vector<unsigned> offsets;
+                    std::vector<unsigned> triangles;
+                };
+
+                Adjacency BuildAdjacency(const std::vector<unsigned>& indices, std::size_t vertexCount)
+                {
+                    Adjacency adj;
+                    adj.offsets.assign(vertexCount + 1, 0);
+                    for (unsigned v : indices)
+                        adj.offsets[v + 1]++;
+                    for (std::size_t v = 0; v < vertexCount; ++v)
+                        adj.offsets[v + 1] += adj.offsets[v];
+
+                    adj.triangles.resize(indices.size());
+                    std::vector<unsigned> fill(adj.offsets.begin(), adj.offsets.end() - 1);
+                    for (std::size_t i = 0; i < indices.size(); ++i)
+                        adj.triangles[fill[indices[i]]++] = unsigned(i / 3);
+                    return adj;
+                }
+
+                //FIFO cache: a vertex is resident while fewer than cacheSize misses happened since its own.
+                struct CacheSim
+                {
+                    std::vector<unsigned> missTime;
+                    unsigned misses = 0;
+                    unsigned cacheSize;
+
+                    CacheSim(std::size_t vertexCount, unsigned size)
+                        : missTime(vertexCount, 0), cacheSize(size) {}
+
+                    //Returns true on a miss.
+                    bool Access(unsigned v)
+                    {
+                        if (missTime[v] != 0 && misses + 1 - missTime[v] <= cacheSize)
+                            return false;
+                        missTime[v] = ++misses;
+                        return true;
+                    }
+
+                    void Flush() { misses += cacheSize; }
+                };
+            }
+
+            CacheStats AnalyzeVertexCache(const std::vector<unsigned>& indices, std::size_t vertexCount, unsigned cacheSize)
+            {
+                CacheSim cache(vertexCount, cacheSize);
+                std::vector<bool> referenced(vertexCount, false);
+                std::size_t uniqueVertices = 0;
+                unsigned misses = 0;
+                for (unsigned v : indices)
+                {
+                    misses += cache.Access(v);
+                    if (!referenced[v])
+                    {
+                        referenced[v] = true;
+                        uniqueVertices++;
+                    }
+                }
+
+                std::size_t triangles = indices.size() / 3;
+                return {
+                    triangles ? float(misses) / triangles : 0.f,
+                    uniqueVertices ? float(misses) / uniqueVertices : 0.f
+                };
+            }
+
+            std::vector<std::size_t> OptimizeVertexCache(std::vector<unsigned>& indices, std::size_t vertexCount, unsigned cacheSize)
+            {
+                std::vector<std::size_t> hardBoundaries;
+                const std::size_t triangleCount = indices.size() / 3;
+                if (triangleCount == 0)
+                    return hardBoundaries;
+
+                Adjacency adj = BuildAdjacency(indices, vertexCount);
+
+                std::vector<int> live(vertexCount);
+                for (std::size_t v = 0; v < vertexCount; ++v)
+                    live[v] = int(adj.offsets[v + 1] - adj.offsets[v]);
+
+                std::vector<unsigned> cacheTime(vertexCount, 0);
+                std::vector<bool> emitted(triangleCount, false);
+                std::vector<unsigned> deadEnd;
+                std::vector<unsigned> candidates;
+
+                std::vector<unsigned> result;
+                result.reserve(indices.size());
+
+                unsigned time = cacheSize + 1;
+                std::size_t cursor = 0;
+                int fanning = 0;
+                while (live[fanning] == 0 && ++fanning < (int)vertexCount) {}
+
+                while (fanning >= 0 && fanning < (int)vertexCount)
+                {
+                    candidates.clear();
+                    for (unsigned a = adj.offsets[fanning]; a < adj.offsets[fanning + 1]; ++a)
+                    {
+                        unsigned t = adj.triangles[a];
+                        if (emitted[t])
+                            continue;
+
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            unsigned v = indices[t * 3 + c];
+                            result.push_back(v);
+                            deadEnd.push_back(v);
+                            candidates.push_back(v);
+                            live[v]--;
+                            if (time - cacheTime[v] > cacheSize)
+                                cacheTime[v] = time++;
+                        }
+                        emitted[t] = true;
+                    }
+
+                    //Prefer a candidate that stays in cache while its remaining fan is emitted,
+                    //and among those the one that entered the cache first.
+                    int next = -1;
+                    int bestPriority = -1;
+                    for (unsigned v : candidates)
+                    {
+                        if (live[v] <= 0)
+                            continue;
+                        int priority = 0;
+                        if (int(time - cacheTime[v]) + 2 * live[v] <= int(cacheSize))
+                            priority = int(time - cacheTime[v]);
+                        if (priority > bestPriority)
+                        {
+                            bestPriority = priority;
+                            next = int(v);
+                        }
+                    }
+
+                    if (next == -1)
+                    {
+                        //Dead end: try recently used vertices first, then scan for any unfinished vertex.
+                        while (!deadEnd.empty())
+                        {
+                            unsigned d = deadEnd.back();
+                            deadEnd.pop_back();
+                            if (live[d] > 0)
+                            {
+                                next = int(d);
+                                break;
+                            }
+                        }
+                        //Nothing nearby is left, so the cache is effectively cold from here on.
+                        while (next == -1 && cursor < vertexCount)
+                        {
+                            if (live[cursor] > 0)
+                            {
+                                next = int(cursor);
+                                hardBoundaries.push_back(result.size());
+                            }
+                            cursor++;
+                        }
+                    }
+                    fanning = next;
+                }
+
+                ASSERT(result.size() == indices.size(), "Tipsify lost triangles");
+                indices.swap(result);
+                return hardBoundaries;
+            }
+
+            void OptimizeOverdraw(std::vector<unsigned>& indices, const std::vector<Mesh::Vertex>& vertices,
+                const std::vector<std::size_t>& hardBoundaries, float threshold, unsigned cacheSize)
+            {
+                const std::size_t triangleCount = indices.size() / 3;
+                if (triangleCount == 0)
+                    return;
+
+                const float meshAcmr = AnalyzeVertexCache(indices, vertices.size(), cacheSize).acmr;
+
+                //Cluster starts, in index units. A cluster may end at a hard boundary, or anywhere its
+                //running ACMR is already close to the mesh's, so reordering clusters costs little.
+                std::vector<std::size_t> starts{ 0 };
+                std::size_t nextHard = 0;
+                CacheSim cache(vertices.size(), cacheSize);
+                unsigned clusterMisses = 0;
+                std::size_t clusterTriangles = 0;
+                for (std::size_t t = 0; t < triangleCount; ++t)
+                {
+                    std::size_t i = t * 3;
+                    while (nextHard < hardBoundaries.size() && hardBoundaries[nextHard] < i)
+                        nextHard++;
+                    bool hard = nextHard < hardBoundaries.size() && hardBoundaries[nextHard] == i;
+                    bool soft = clusterTriangles > 0 && float(clusterMisses) / clusterTriangles <= threshold * meshAcmr;
+                    if (i != 0 && (hard || soft))
+                    {
+                        starts.push_back(i);
+                        cache.Flush();
+                        clusterMisses = 0;
+                        clusterTriangles = 0;
+                    }
+                    for (int c = 0; c < 3; ++c)
+                        clusterMisses += cache.Access(indices[i + c]);
+                    clusterTriangles++;
+                }
+                starts.push_back(indices.size());
+
+                const std::size_t clusterCount = starts.size() - 1;
+                if (clusterCount < 2)
+                    return;
+
+                //Area-weighted centroid and normal per cluster.
+                std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.f));
+                std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.f));
+                std::vector<float> areas(clusterCount, 0.f);
+                glm::vec3 meshCentroid(0.f);
+                float meshArea = 0.f;
+                for (std::size_t c = 0; c < clusterCount; ++c)
+                {
+                    for (std::size_t i = starts[c]; i < starts[c + 1]; i += 3)
+                    {
+                        const glm::vec3& p0 = vertices[indices[i]].Position;
+                        const glm::vec3& p1 = vertices[indices[i + 1]].Position;
+                        const glm::vec3& p2 = vertices[indices[i + 2]].Position;
+                        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                        float area = glm::length(n);
+                        centroids[c] += (p0 + p1 + p2) * (area / 3.f);
+                        normals[c] += n;
+                        areas[c] += area;
+                    }
+                    meshCentroid += centroids[c];
+                    meshArea += areas[c];
+                    if (areas[c] > 0.f)
+                        centroids[c] /= areas[c];
+                }
+                if (meshArea > 0.f)
+                    meshCentroid /= meshArea;
+
+                //Clusters far out along their own normal are likely to occlude the rest.
+                std::vector<float> sortKey(clusterCount);
+                for (std::size_t c = 0; c < clusterCount; ++c)
+                {
+                    float len = glm::length(normals[c]);
+                    glm::vec3 n = len > 0.f ? normals[c] / len : glm::vec3(0.f);
+                    sortKey[c] = glm::dot(centroids[c] - meshCentroid, n);
+                }
+
+                std::vector<std::size_t> order(clusterCount);
+                std::iota(order.begin(), order.end(), 0);
+                std::stable_sort(order.begin(), order.end(),
+                    [&](std::size_t a, std::size_t b) { return sortKey[a] > sortKey[b]; });
+
+                std::vector<unsigned> result;
+                result.reserve(indices.size());
+                for (std::size_t c : order)
+                    result.insert(result.end(), indices.begin() + starts[c], indices.begin() + starts[c + 1]);
+                indices.swap(result);
+            }
+
+            void OptimizeVertexFetch(std::vector<Mesh::Vertex>& vertices, std::vector<unsigned>& indices)
+            {
+                const unsigned unused = std::numeric_limits<unsigned>::max();
+                std::vector<unsigned> remap(vertices.size(), unused);
+                std::vector<Mesh::Vertex> result;
+                result.reserve(vertices.size());
+
+                for (unsigned& v : indices)
+                {
+                    if (remap[v] == unused)
+                    {
+                        remap[v] = (unsigned)result.size();
+                        result.push_back(vertices[v]);
+                    }
+                    v = remap[v];
+                }
+                vertices.swap(result);
+            }
+
+            std::vector<Mesh::Meshlet> BuildMeshlets(const std::vector<Mesh::Vertex>& vertices,
+                const std::vector<unsigned>& indices)
+            {
+                std::vector<Mesh::Meshlet> meshlets;
+
+                //Marks vertices already in the current meshlet without clearing a set per meshlet.
+                std::vector<unsigned> stamp(vertices.size(), 0);
+                unsigned current = 1;
+                unsigned vertexCount = 0;
+                std::size_t start = 0;
+
+                auto close = [&](std::size_t end)
+                {
+                    Mesh::Meshlet m{};
+                    m.indexOffset = (unsigned)start;
+                    m.indexCount = unsigned(end - start);
+
+                    glm::vec3 minP(std::numeric_limits<float>::max()), maxP(-std::numeric_limits<float>::max());
+                    for (std::size_t i = start; i < end; ++i)
+                    {
+                        minP = glm::min(minP, vertices[indices[i]].Position);
+                        maxP = glm::max(maxP, vertices[indices[i]].Position);
+                    }
+                    m.center = (minP + maxP) * 0.5f;
+                    for (std::size_t i = start; i < end; ++i)
+                        m.radius = std::max(m.radius, glm::length(vertices[indices[i]].Position - m.center));
+
+                    //Normal cone: the meshlet can be skipped when the viewer is behind every triangle.
+                    std::vector<glm::vec3> normals;
+                    glm::vec3 axis(0.f);
+                    for (std::size_t i = start; i < end; i += 3)
+                    {
+                        const glm::vec3& p0 = vertices[indices[i]].Position;
+                        glm::vec3 n = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+                        float len = glm::length(n);
+                        if (len <= 0.f)
+                            continue;
+                        normals.push_back(n / len);
+                        axis += normals.back();
+                    }
+                    float axisLen = glm::length(axis);
+                    m.coneCutoff = 1.f;
+                    if (axisLen > 0.f)
+                    {
+                        m.coneAxis = axis / axisLen;
+                        float minDot = 1.f;
+                        for (const auto& n : normals)
+                            minDot = std::min(minDot, glm::dot(n, m.coneAxis));
+                        if (minDot > 0.1f)
+                            m.coneCutoff = std::sqrt(1.f - minDot * minDot);
+                    }
+                    meshlets.push_back(m);
+
+                    start = end;
+                    vertexCount = 0;
+                    current++;
+                };
+
+                auto newVertices = [&](std::size_t i)
+                {
+                    unsigned n = 0;
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        unsigned v = indices[i + c];
+                        bool repeated = (c > 0 && v == indices[i]) || (c > 1 && v == indices[i + 1]);
+                        n += stamp[v] != current && !repeated;
+                    }
+                    return n;
+                };
+
+                for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+                {
+                    unsigned added = newVertices(i);
+                    bool full = (i - start) / 3 >= MESHLET_MAX_TRIANGLES || vertexCount + added > MESHLET_MAX_VERTICES;
+                    if (full)
+                    {
+                        close(i);
+                        added = newVertices(i);
+                    }
+                    for (int c = 0; c < 3; ++c)
+                        stamp[indices[i + c]] = current;
+                    vertexCount += added;
+                }
+                if (start < indices.size())
+                    close(indices.size());
+
+                return meshlets;
+            }
+
+            void Optimize(std::vector<Mesh::Vertex>& vertices, std::vector<unsigned>& indices,
+                const std::string& name, bool overdraw)
+            {
+                if (indices.size() < 3)
+                    return;
+
+                CacheStats before = AnalyzeVertexCache(indices, vertices.size());
+
+                auto hardBoundaries = OptimizeVertexCache(indices, vertices.size());
+                if (overdraw)
+                    OptimizeOverdraw(indices, vertices, hardBoundaries);
+                OptimizeVertexFetch(vertices, indices);
+
+                CacheStats after = AnalyzeVertexCache(indices, vertices.size());
+                LOG_INFO("Mesh '{}': {} tris, ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+                    name, indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+            }
+        }
+    }
+}
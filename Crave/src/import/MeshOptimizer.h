@@ -0,0 +1,51 @@
+#pragma once
+#include "renderer/Mesh.h"
+
+namespace Crave
+{
+    namespace Import
+    {
+        //Import-time index and vertex reordering. All functions work on triangle lists.
+        namespace MeshOptimizer
+        {
+            //Post-transform cache size the optimizer targets and the statistics simulate (FIFO).
+            constexpr unsigned VERTEX_CACHE_SIZE = 16;
+
+            struct CacheStats
+            {
+                float acmr; //cache misses per triangle, 0.5 is the ideal for a regular grid
+                float atvr; //cache misses per referenced vertex, 1.0 is the ideal
+            };
+
+            CacheStats AnalyzeVertexCache(const std::vector<unsigned>& indices, std::size_t vertexCount,
+                unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+            //Tipsify (Sander et al. 2007). Returns the index at which each emitted triangle run
+            //starts after a dead end, i.e. where the cache is cold anyway.
+            std::vector<std::size_t> OptimizeVertexCache(std::vector<unsigned>& indices, std::size_t vertexCount,
+                unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+            //Splits a cache-optimized index list into clusters that cost at most threshold times the
+            //mesh's ACMR and orders them so outward-facing clusters are drawn first.
+            void OptimizeOverdraw(std::vector<unsigned>& indices, const std::vector<Mesh::Vertex>& vertices,
+                const std::vector<std::size_t>& hardBoundaries, float threshold = 1.05f,
+                unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+            //Renumbers vertices in first-use order so vertex fetch walks memory linearly.
+            //Vertices no triangle references are dropped.
+            void OptimizeVertexFetch(std::vector<Mesh::Vertex>& vertices, std::vector<unsigned>& indices);
+
+            constexpr unsigned MESHLET_MAX_VERTICES = 64;
+            constexpr unsigned MESHLET_MAX_TRIANGLES = 124;
+
+            //Cuts the index list into runs of consecutive triangles within the meshlet limits.
+            //Run it on cache-optimized indices, whose order already keeps neighbours together.
+            std::vector<Mesh::Meshlet> BuildMeshlets(const std::vector<Mesh::Vertex>& vertices,
+                const std::vector<unsigned>& indices);
+
+            //Runs the reordering passes above in order and logs ACMR/ATVR before and after.
+            void Optimize(std::vector<Mesh::Vertex>& vertices, std::vector<unsigned>& indices,
+                const std::string& name, bool overdraw = true);
+        }
+    }
+}
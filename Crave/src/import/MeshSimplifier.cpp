@@ -0,0 +1,302 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <numeric>
+
+namespace Crave
+{
+    namespace Import
+    {
+        namespace MeshSimplifier
+        {
+            namespace //private
+            {
+                //Symmetric 4x4 matrix of the summed squared plane distances.
+                struct Quadric
+                {
+                    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+                    double a11 = 0, a12 = 0, a13 = 0;
+                    double a22 = 0, a23 = 0;
+                    double a33 = 0;
+
+                    static Quadric FromPlane(const glm::dvec3& n, double d)
+                    {
+                        Quadric q;
+                        q.a00 = n.x * n.x; q.a01 = n.x * n.y; q.a02 = n.x * n.z; q.a03 = n.x * d;
+                        q.a11 = n.y * n.y; q.a12 = n.y * n.z; q.a13 = n.y * d;
+                        q.a22 = n.z * n.z; q.a23 = n.z * d;
+                        q.a33 = d * d;
+                        return q;
+                    }
+
+                    Quadric& operator+=(const Quadric& o)
+                    {
+                        a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+                        a11 += o.a11; a12 += o.a12; a13 += o.a13;
+                        a22 += o.a22; a23 += o.a23;
+                        a33 += o.a33;
+                        return *this;
+                    }
+
+                    double Error(const glm::vec3& p) const
+                    {
+                        double x = p.x, y = p.y, z = p.z;
+                        double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                            + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                            + a22 * z * z + 2 * a23 * z
+                            + a33;
+                        return std::max(e, 0.0);
+                    }
+                };
+
+                struct Collapse
+                {
+                    unsigned from;
+                    unsigned to;
+                    double cost;
+                };
+
+                struct PositionHash
+                {
+                    std::size_t operator()(const glm::vec3& p) const
+                    {
+                        uint32_t b[3];
+                        std::memcpy(b, &p, sizeof(b));
+                        return (b[0] * 73856093u) ^ (b[1] * 19349663u) ^ (b[2] * 83492791u);
+                    }
+                };
+
+                uint64_t EdgeKey(unsigned a, unsigned b)
+                {
+                    if (a > b)
+                        std::swap(a, b);
+                    return (uint64_t(a) << 32) | b;
+                }
+
+                //Vertices that would open holes or tear seams if they moved.
+                std::vector<bool> FindLockedVertices(const std::vector<Mesh::Vertex>& vertices,
+                    const std::vector<unsigned>& indices)
+                {
+                    //Assimp already welded identical vertices, so shared positions mean a seam.
+                    std::unordered_map<glm::vec3, unsigned, PositionHash> firstAt;
+                    std::vector<unsigned> position(vertices.size());
+                    std::vector<unsigned> wedges(vertices.size(), 0);
+                    for (unsigned v = 0; v < vertices.size(); ++v)
+                    {
+                        auto [it, inserted] = firstAt.emplace(vertices[v].Position, v);
+                        position[v] = it->second;
+                        wedges[it->second]++;
+                    }
+
+                    //Edges of the position-welded mesh used by a single triangle are open borders.
+                    std::unordered_map<uint64_t, int> edgeUse;
+                    for (std::size_t i = 0; i < indices.size(); i += 3)
+                    {
+                        for (int e = 0; e < 3; ++e)
+                            edgeUse[EdgeKey(position[indices[i + e]], position[indices[i + (e + 1) % 3]])]++;
+                    }
+
+                    std::vector<bool> locked(vertices.size(), false);
+                    for (auto& [key, uses] : edgeUse)
+                    {
+                        if (uses == 1)
+                        {
+                            locked[unsigned(key >> 32)] = true;
+                            locked[unsigned(key & 0xFFFFFFFF)] = true;
+                        }
+                    }
+                    for (unsigned v = 0; v < vertices.size(); ++v)
+                    {
+                        if (wedges[position[v]] > 1 || locked[position[v]])
+                            locked[v] = true;
+                    }
+                    return locked;
+                }
+
+                //Rejects collapses that flip or squash any triangle around the moved vertex.
+                bool FlipsTriangle(const std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned>& indices,
+                    const std::vector<unsigned>& trianglesOf, unsigned first, unsigned last, unsigned from, unsigned to)
+                {
+                    for (unsigned a = first; a < last; ++a)
+                    {
+                        const unsigned* tri = &indices[trianglesOf[a] * 3];
+                        if (tri[0] == to || tri[1] == to || tri[2] == to)
+                            continue; //collapses away
+
+                        glm::vec3 p[3], q[3];
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            p[c] = vertices[tri[c]].Position;
+                            q[c] = vertices[tri[c] == from ? to : tri[c]].Position;
+                        }
+                        glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+                        glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+                        if (glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1))
+                            return true;
+                    }
+                    return false;
+                }
+            }
+
+            std::vector<unsigned> Simplify(const std::vector<Mesh::Vertex>& vertices,
+                const std::vector<unsigned>& source, std::size_t targetIndexCount, float& error)
+            {
+                std::vector<unsigned> indices = source;
+                error = 0.f;
+                if (indices.size() <= targetIndexCount)
+                    return indices;
+
+                glm::vec3 minP(std::numeric_limits<float>::max()), maxP(-std::numeric_limits<float>::max());
+                for (const auto& v : vertices)
+                {
+                    minP = glm::min(minP, v.Position);
+                    maxP = glm::max(maxP, v.Position);
+                }
+                const double attribScale = ATTRIBUTE_WEIGHT * 0.5 * glm::length(maxP - minP);
+                const double attribWeight = attribScale * attribScale;
+
+                std::vector<Quadric> quadrics(vertices.size());
+                for (std::size_t i = 0; i < indices.size(); i += 3)
+                {
+                    glm::dvec3 p0 = vertices[indices[i]].Position;
+                    glm::dvec3 p1 = vertices[indices[i + 1]].Position;
+                    glm::dvec3 p2 = vertices[indices[i + 2]].Position;
+                    glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+                    double len = glm::length(n);
+                    if (len <= 0.0)
+                        continue;
+                    n /= len;
+                    Quadric q = Quadric::FromPlane(n, -glm::dot(n, p0));
+                    for (int c = 0; c < 3; ++c)
+                        quadrics[indices[i + c]] += q;
+                }
+
+                std::vector<bool> locked = FindLockedVertices(vertices, indices);
+
+                std::vector<unsigned> offsets, trianglesOf, fill;
+                std::vector<Collapse> candidates;
+                std::vector<unsigned> remap(vertices.size());
+                std::vector<bool> touched(vertices.size());
+                double maxCost = 0.0;
+
+                while (indices.size() > targetIndexCount)
+                {
+                    const std::size_t triangleCount = indices.size() / 3;
+
+                    offsets.assign(vertices.size() + 1, 0);
+                    for (unsigned v : indices)
+                        offsets[v + 1]++;
+                    for (std::size_t v = 0; v < vertices.size(); ++v)
+                        offsets[v + 1] += offsets[v];
+                    trianglesOf.resize(indices.size());
+                    fill.assign(offsets.begin(), offsets.end() - 1);
+                    for (std::size_t i = 0; i < indices.size(); ++i)
+                        trianglesOf[fill[indices[i]]++] = unsigned(i / 3);
+
+                    candidates.clear();
+                    for (std::size_t i = 0; i < indices.size(); i += 3)
+                    {
+                        for (int e = 0; e < 3; ++e)
+                        {
+                            unsigned a = indices[i + e], b = indices[i + (e + 1) % 3];
+                            for (int dir = 0; dir < 2; ++dir, std::swap(a, b))
+                            {
+                                if (locked[a])
+                                    continue;
+                                Quadric q = quadrics[a];
+                                q += quadrics[b];
+                                const Mesh::Vertex& va = vertices[a];
+                                const Mesh::Vertex& vb = vertices[b];
+                                glm::vec3 dn = va.Normal - vb.Normal;
+                                glm::vec2 duv = va.TexCoords - vb.TexCoords;
+                                double attrib = attribWeight * (glm::dot(dn, dn) + glm::dot(duv, duv));
+                                candidates.push_back({ a, b, q.Error(vb.Position) + attrib });
+                            }
+                        }
+                    }
+                    std::sort(candidates.begin(), candidates.end(),
+                        [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+                    //An interior collapse removes two triangles. Collapses in one pass don't
+                    //share neighbourhoods, so the adjacency built above stays valid.
+                    const std::size_t wanted = (triangleCount - targetIndexCount / 3) / 2 + 1;
+                    std::size_t accepted = 0;
+                    std::iota(remap.begin(), remap.end(), 0);
+                    std::fill(touched.begin(), touched.end(), false);
+                    for (const Collapse& c : candidates)
+                    {
+                        if (accepted >= wanted)
+                            break;
+                        if (touched[c.from] || touched[c.to])
+                            continue;
+                        if (FlipsTriangle(vertices, indices, trianglesOf, offsets[c.from], offsets[c.from + 1], c.from, c.to))
+                            continue;
+
+                        remap[c.from] = c.to;
+                        quadrics[c.to] += quadrics[c.from];
+                        maxCost = std::max(maxCost, c.cost);
+                        for (unsigned a = offsets[c.from]; a < offsets[c.from + 1]; ++a)
+                        {
+                            for (int k = 0; k < 3; ++k)
+                                touched[indices[trianglesOf[a] * 3 + k]] = true;
+                        }
+                        accepted++;
+                    }
+                    if (accepted == 0)
+                        break;
+
+                    std::size_t write = 0;
+                    for (std::size_t i = 0; i < indices.size(); i += 3)
+                    {
+                        unsigned a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+                        if (a == b || b == c || a == c)
+                            continue;
+                        indices[write++] = a;
+                        indices[write++] = b;
+                        indices[write++] = c;
+                    }
+                    indices.resize(write);
+                }
+
+                error = float(std::sqrt(maxCost));
+                return indices;
+            }
+
+            std::vector<Mesh::LodLevel> GenerateLods(const std::vector<Mesh::Vertex>& vertices,
+                std::vector<unsigned>& indices, const std::string& name)
+            {
+                std::vector<Mesh::LodLevel> lods{ { 0, (unsigned)indices.size(), 0.f } };
+                const std::size_t fullCount = indices.size();
+                std::vector<unsigned> previous = indices;
+
+                for (float target : LOD_TARGETS)
+                {
+                    std::size_t targetCount = std::size_t(fullCount / 3 * target) * 3;
+                    float error = 0.f;
+                    //Each level simplifies the previous one so the chain stays nested.
+                    std::vector<unsigned> level = Simplify(vertices, previous, targetCount, error);
+                    if (level.size() < 3 || level.size() > previous.size() * 9 / 10)
+                        break;
+
+                    MeshOptimizer::OptimizeVertexCache(level, vertices.size());
+
+                    Mesh::LodLevel lod;
+                    lod.indexOffset = (unsigned)indices.size();
+                    lod.indexCount = (unsigned)level.size();
+                    lod.error = std::max(error, lods.back().error);
+                    lods.push_back(lod);
+
+                    indices.insert(indices.end(), level.begin(), level.end());
+                    previous.swap(level);
+                }
+
+                for (std::size_t i = 1; i < lods.size(); ++i)
+                {
+                    LOG_INFO("Mesh '{}': LOD{} {} tris, error {:.4f}",
+                        name, i, lods[i].indexCount / 3, lods[i].error);
+                }
+                return lods;
+            }
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "renderer/Mesh.h"
+
+namespace Crave
+{
+    namespace Import
+    {
+        //Quadric error edge collapse (Garland & Heckbert) on an indexed triangle list.
+        //Collapses are half-edge: a vertex merges into a neighbour, so every level keeps
+        //using the original vertex buffer and only the indices change.
+        namespace MeshSimplifier
+        {
+            //Triangle fractions of the generated levels, after the full-detail level 0.
+            constexpr float LOD_TARGETS[] = { 0.5f, 0.25f, 0.125f };
+
+            //How strongly normal and uv changes count against a collapse, relative to the mesh radius.
+            constexpr float ATTRIBUTE_WEIGHT = 0.5f;
+
+            //Removes triangles until at most targetIndexCount indices remain or no collapse is left.
+            //Border and uv/normal seam vertices are never moved. error receives the largest
+            //collapse error in object-space units.
+            std::vector<unsigned> Simplify(const std::vector<Mesh::Vertex>& vertices,
+                const std::vector<unsigned>& indices, std::size_t targetIndexCount, float& error);
+
+            //Appends the LOD_TARGETS levels to indices and returns all levels, level 0 being the
+            //indices passed in. Stops early once a level no longer shrinks.
+            std::vector<Mesh::LodLevel> GenerateLods(const std::vector<Mesh::Vertex>& vertices,
+                std::vector<unsigned>& indices, const std::string& name);
+        }
+    }
+}
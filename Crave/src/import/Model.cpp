@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "Model.h"
 
+#include <cfloat>
+#include <filesystem>
+#include <numeric>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -8,9 +11,16 @@
 #include <glad/glad.h> 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
-#include <stb_image.h>
 
 #include "renderer/MeshManager.h"
+#include "renderer/TextureManager.h"
+#include "core/JobSystem.h"
+#include "import/MeshOptimizer.h"
+#include "import/MeshSimplifier.h"
+#include "import/ModelCache.h"
+#include "import/Gltf.h"
+#include "core/Hash.h"
+#include "core/Stopwatch.h"
 
 namespace Crave
 {
@@ -19,60 +29,254 @@ namespace Crave
         Model::Model(std::string const& shortPath, bool gamma)
             : m_GammaCorrection(gamma)
         {
-            stbi_set_flip_vertically_on_load(1);
             loadModel(shortPath);
         }
 
         void Model::loadModel(std::string const& shortPath)
         {
             std::string path = BASE_MODEL_PATH + shortPath;
-            Assimp::Importer importer;
-            const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate |
-                aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+            m_Directory = path.substr(0, path.find_last_of('/') + 1);
+
+            Stopwatch timer;
+            m_CacheKey = ModelCache::Key(path, ImportSettingsHash());
+            const uint64_t cacheKey = m_CacheKey;
+            if (cacheKey && ModelCache::Load(path, cacheKey, m_NodeData))
             {
-                std::cerr << "ERROR::ASSIMP:: " << importer.GetErrorString() << '\n';
+                LOG_INFO("Loaded cooked model '{}' in {:.1f} ms", path, timer.ElapsedMs());
+                setMeshSources(m_NodeData, shortPath);
                 return;
             }
-            m_Directory = path.substr(0, path.find_last_of('/') + 1);
+
+            Assimp::Importer importer;
+            Gltf::Document gltf;
+            SourceData source;
+            if (!openSource(path, importer, gltf, source))
+                return;
             std::cout << "Dir: " << m_Directory << '\n';
+            const float parseMs = timer.ElapsedMs();
+            TextureManager::PendingTextures textures = TextureManager::DecodeAsync(source.texturePaths, false);
+
+            //Meshes are converted, optimized and packed on the workers, largest first so a big mesh
+            //picked up last doesn't leave the others idle.
+            const unsigned int meshCount = (unsigned int)source.triangleCounts.size();
+            std::vector<unsigned int> order(meshCount);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&source](unsigned int a, unsigned int b)
+                { return source.triangleCounts[a] > source.triangleCounts[b]; });
+
+            std::vector<Mesh::ModelData> meshData(meshCount);
+            std::vector<MeshManager::PreparedModel> prepared(meshCount);
+            std::vector<std::future<void>> done(meshCount);
+            for (unsigned int i : order)
+            {
+                done[i] = JobSystem::Submit([&, i]()
+                    {
+                        meshData[i] = source.readMesh(i);
+                        prepared[i] = MeshManager::PrepareModelMesh(meshData[i]);
+                    });
+            }
+
+            //GL calls stay on this thread: textures upload while the meshes are still being processed,
+            //then every mesh as soon as it is ready.
+            TextureManager::Upload(textures);
+            std::vector<Ref<Mesh>> meshes(meshCount);
+            for (unsigned int i = 0; i < meshCount; i++)
+            {
+                done[i].get();
+                meshes[i] = MeshManager::GetModelMesh(meshData[i], prepared[i]);
+                prepared[i] = {};
+            }
+            m_NodeData = buildNodeTree(source.nodes, meshes);
+            setMeshSources(m_NodeData, shortPath);
 
-            m_NodeData = processNode(scene->mRootNode, scene);
+            LOG_INFO("Imported '{}': {} meshes, {} textures in {:.1f} ms ({} {:.1f} ms, {} workers)",
+                path, meshCount, source.texturePaths.size(), timer.ElapsedMs(),
+                gltf.IsOpen() ? "glTF" : "Assimp", parseMs, JobSystem::WorkerCount());
 
-            std::cout << "Finished loading model at path :" << path << ".\n";
+            if (cacheKey)
+                ModelCache::Write(path, cacheKey, m_NodeData, meshes, meshData);
+        }
+
+        void Model::BenchmarkImporters()
+        {
+            constexpr int RUNS = 3;
+
+            std::error_code ec;
+            for (auto it = std::filesystem::recursive_directory_iterator(BASE_MODEL_PATH, ec);
+                it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                const std::string path = it->path().generic_string();
+                if (!it->is_regular_file(ec) || !Gltf::IsGltf(path))
+                    continue;
+
+                //Best of a few runs, one thread each, so file caching and worker count don't decide it.
+                float assimpMs = FLT_MAX, gltfMs = FLT_MAX;
+                std::size_t assimpVertices = 0, gltfVertices = 0;
+                for (int run = 0; run < RUNS; run++)
+                {
+                    Stopwatch timer;
+                    Model model;
+                    model.m_Directory = path.substr(0, path.find_last_of('/') + 1);
+                    Assimp::Importer importer;
+                    const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
+                    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)
+                        break;
+                    assimpVertices = 0;
+                    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+                    {
+                        const aiMesh* mesh = scene->mMeshes[i];
+                        assimpVertices += processMesh(mesh, model.loadMaterial(scene->mMaterials[mesh->mMaterialIndex])).vertices.size();
+                    }
+                    assimpMs = std::min(assimpMs, timer.ElapsedMs());
+                }
+                for (int run = 0; run < RUNS; run++)
+                {
+                    Stopwatch timer;
+                    Gltf::Document gltf;
+                    if (!gltf.Open(path))
+                        break;
+                    gltfVertices = 0;
+                    for (std::size_t i = 0; i < gltf.MeshCount(); i++)
+                        gltfVertices += gltf.ReadMesh(i).vertices.size();
+                    gltfMs = std::min(gltfMs, timer.ElapsedMs());
+                }
+
+                if (assimpMs == FLT_MAX || gltfMs == FLT_MAX)
+                {
+                    LOG_WARN("Benchmark: '{}' failed with {}", path, assimpMs == FLT_MAX ? "Assimp" : "glTF");
+                    continue;
+                }
+                LOG_INFO("Benchmark: '{}' Assimp {:.2f} ms ({} vertices), glTF {:.2f} ms ({} vertices), {:.1f}x",
+                    path, assimpMs, assimpVertices, gltfMs, gltfVertices, assimpMs / gltfMs);
+            }
         }
 
-        ModelNodeData Model::processNode(aiNode* node, const aiScene* scene)
+        bool Model::openSource(const std::string& path, Assimp::Importer& importer, Gltf::Document& gltf,
+            SourceData& source)
         {
-            auto transform = node->mTransformation;
+            if (!USE_GLTF_LOADER || !Gltf::IsGltf(path))
+                return openAssimp(path, importer, source);
+            if (!gltf.Open(path))
+            {
+                LOG_WARN("'{}' falls back to Assimp.", path);
+                return openAssimp(path, importer, source);
+            }
 
-            ModelNodeData nodeData
+            source.texturePaths = gltf.TexturePaths();
+            source.nodes = gltf.Nodes();
+            source.triangleCounts.resize(gltf.MeshCount());
+            for (std::size_t i = 0; i < gltf.MeshCount(); i++)
+                source.triangleCounts[i] = gltf.TriangleCount(i);
+            source.readMesh = [&gltf](unsigned i)
             {
-                std::string(node->mName.data),
-                glm::transpose(glm::make_mat4(&transform[0][0]))
+                Mesh::ModelData data = gltf.ReadMesh(i);
+                optimizeMesh(data, gltf.MeshName(i).c_str());
+                return data;
             };
+            return true;
+        }
 
-            for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        bool Model::openAssimp(const std::string& path, Assimp::Importer& importer, SourceData& source)
+        {
+            //Identical vertices are welded so the index buffer actually shares them; without it every
+            //triangle has its own three vertices and no cache reordering can help.
+            const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
             {
-                aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-                nodeData.meshes.push_back(processMesh(mesh, scene, node->mTransformation));
+                std::cerr << "ERROR::ASSIMP:: " << importer.GetErrorString() << '\n';
+                return false;
             }
 
+            //Materials on this thread: loadMaterialTextures shares m_TexturesLoaded.
+            auto materials = std::make_shared<std::vector<TextureMap>>(scene->mNumMaterials);
+            for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+            {
+                (*materials)[i] = loadMaterial(scene->mMaterials[i]);
+                for (auto& [type, paths] : (*materials)[i])
+                    source.texturePaths.insert(source.texturePaths.end(), paths.begin(), paths.end());
+            }
+            flattenNode(scene->mRootNode, -1, source.nodes);
+            source.triangleCounts.resize(scene->mNumMeshes);
+            for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+                source.triangleCounts[i] = scene->mMeshes[i]->mNumFaces;
+            source.readMesh = [scene, materials](unsigned i)
+            {
+                const aiMesh* mesh = scene->mMeshes[i];
+                Mesh::ModelData data = processMesh(mesh, (*materials)[mesh->mMaterialIndex]);
+                optimizeMesh(data, mesh->mName.C_Str());
+                return data;
+            };
+            return true;
+        }
+
+        uint64_t Model::ImportSettingsHash() const
+        {
+            uint64_t hash = Hash::XXH64(&IMPORT_FLAGS, sizeof(IMPORT_FLAGS));
+            hash = Hash::XXH64(&OPTIMIZE_OVERDRAW, sizeof(OPTIMIZE_OVERDRAW), hash);
+            hash = Hash::XXH64(&USE_GLTF_LOADER, sizeof(USE_GLTF_LOADER), hash);
+            hash = Hash::XXH64(&m_GammaCorrection, sizeof(m_GammaCorrection), hash);
+            hash = Hash::XXH64(&MeshOptimizer::VERTEX_CACHE_SIZE, sizeof(unsigned), hash);
+            hash = Hash::XXH64(&MeshOptimizer::MESHLET_MAX_VERTICES, sizeof(unsigned), hash);
+            hash = Hash::XXH64(&MeshOptimizer::MESHLET_MAX_TRIANGLES, sizeof(unsigned), hash);
+            hash = Hash::XXH64(MeshSimplifier::LOD_TARGETS, sizeof(MeshSimplifier::LOD_TARGETS), hash);
+            return Hash::XXH64(&MeshSimplifier::ATTRIBUTE_WEIGHT, sizeof(float), hash);
+        }
+
+        uint64_t Model::CacheKey(const std::string& shortPath, bool gamma)
+        {
+            Model settings;
+            settings.m_GammaCorrection = gamma;
+            return ModelCache::Key(BASE_MODEL_PATH + shortPath, settings.ImportSettingsHash());
+        }
+
+        void Model::flattenNode(const aiNode* node, int parent, std::vector<ModelNode>& nodes)
+        {
+            auto& transform = node->mTransformation;
+            int index = (int)nodes.size();
+            nodes.push_back({ std::string(node->mName.data), glm::transpose(glm::make_mat4(&transform[0][0])),
+                parent, std::vector<unsigned>(node->mMeshes, node->mMeshes + node->mNumMeshes) });
             for (unsigned int i = 0; i < node->mNumChildren; i++)
+                flattenNode(node->mChildren[i], index, nodes);
+        }
+
+        ModelNodeData Model::buildNodeTree(const std::vector<ModelNode>& nodes, const std::vector<Ref<Mesh>>& meshes)
+        {
+            std::vector<ModelNodeData> tree(nodes.size());
+            for (std::size_t i = 0; i < nodes.size(); i++)
+            {
+                tree[i].name = nodes[i].name;
+                tree[i].transform = nodes[i].transform;
+                for (unsigned mesh : nodes[i].meshes)
+                    tree[i].meshes.push_back(meshes[mesh]);
+            }
+            //Children have higher indices than their parent, so walking backwards moves each
+            //node only once its own children are attached. Inserting in front keeps their order.
+            for (std::size_t i = nodes.size(); i-- > 1;)
             {
-                nodeData.childData.push_back(processNode(node->mChildren[i], scene));
+                auto& siblings = tree[nodes[i].parent].childData;
+                siblings.insert(siblings.begin(), std::move(tree[i]));
             }
-            return nodeData;
+            return std::move(tree[0]);
         }
 
-        Ref<Mesh> Model::processMesh(aiMesh* mesh, const aiScene* scene, const aiMatrix4x4& nodeTransform)
+        void Model::setMeshSources(const ModelNodeData& node, const std::string& shortPath)
+        {
+            for (const auto& mesh : node.meshes)
+                MeshManager::SetModelSource(mesh, shortPath);
+            for (const auto& child : node.childData)
+                setMeshSources(child, shortPath);
+        }
+
+        Mesh::ModelData Model::processMesh(const aiMesh* mesh, const TextureMap& textures)
         {
             std::vector<Mesh::Vertex> vertices;
             std::vector<unsigned int> indices;
+            vertices.reserve(mesh->mNumVertices);
+            indices.reserve(std::size_t(mesh->mNumFaces) * 3);
 
             for (unsigned int i = 0; i < mesh->mNumVertices; i++)
             {
-                Mesh::Vertex vertex;
+                Mesh::Vertex vertex{}; //absent attributes stay zero, see MeshManager::ChooseVertexFormat
                 glm::vec3 vector;
                 // positions
                 auto v = mesh->mVertices[i];
@@ -129,10 +333,22 @@ namespace Crave
                 for (unsigned int j = 0; j < face.mNumIndices; j++)
                     indices.push_back(face.mIndices[j]);
             }
-            // process materials
-            aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-           
+            Mesh::ModelData data;
+            data.vertices = std::move(vertices);
+            data.indices = std::move(indices);
+            data.textures = textures;
+            return data;
+        }
+
+        void Model::optimizeMesh(Mesh::ModelData& data, const char* name)
+        {
+            MeshOptimizer::Optimize(data.vertices, data.indices, name, OPTIMIZE_OVERDRAW);
+            data.meshlets = MeshOptimizer::BuildMeshlets(data.vertices, data.indices);
+            data.lods = MeshSimplifier::GenerateLods(data.vertices, data.indices, name);
+        }
 
+        Model::TextureMap Model::loadMaterial(aiMaterial* material)
+        {
             // 1. diffuse maps
             std::vector<std::string> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE);
             // 2. specular maps
@@ -142,7 +358,7 @@ namespace Crave
             // 4. height maps
             std::vector<std::string> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT);
 
-            std::unordered_map<Mesh::TexType, std::vector<std::string>> map;
+            TextureMap map;
             for (auto& x : diffuseMaps)
             {
                 map[Mesh::TexType::Diffuse].push_back(m_Directory + x);
@@ -159,9 +375,7 @@ namespace Crave
             {
                 map[Mesh::TexType::Height].push_back(m_Directory + x);
             }
-
-            // return a mesh object created from the extracted mesh data
-            return MeshManager::GetModelMesh({ vertices, indices, map });
+            return map;
         }
 
         // checks all material textures of a given type and loads the textures if they're not loaded yet.
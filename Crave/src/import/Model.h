@@ -1,11 +1,17 @@
 #pragma once
 
 #include <assimp/scene.h>
+#include <assimp/postprocess.h>
 #include "renderer/Mesh.h"
 #include "renderer/Texture.h"
 
+namespace Assimp { class Importer; }
+
 namespace Crave
 {
+    class SceneSerializer;
+    class Prefab;
+
     namespace Import
     {
         struct ModelNodeData
@@ -16,18 +22,62 @@ namespace Crave
             std::vector<ModelNodeData>  childData{};
         };
 
+        //Node tree in preorder with meshes as indices, as importers produce it before any mesh exists.
+        struct ModelNode
+        {
+            std::string           name{};
+            glm::mat4             transform{};
+            int                   parent = -1; //index of the parent node, -1 for the root
+            std::vector<unsigned> meshes{};
+        };
+
+        namespace Gltf { class Document; }
+
         class Model
         {
         public:
-            
+            //Times Assimp against Gltf::Document on every .gltf/.glb under res/models, from opening the
+            //file to engine vertices. The import passes both share are left out.
+            static void BenchmarkImporters();
         private:
             //For import. Used by Scene class.
             Model(const std::string& path, bool gamma = false);
+            //Loads nothing. ModelImport runs the steps itself.
+            Model() = default;
             void loadModel(std::string const& shortPath);
 
-            ModelNodeData processNode(aiNode* node, const aiScene* scene);
+            using TextureMap = std::unordered_map<Mesh::TexType, std::vector<std::string>>;
+
+            //What an importer hands the mesh pipeline.
+            struct SourceData
+            {
+                std::vector<std::string> texturePaths{};
+                std::vector<ModelNode>   nodes{};
+                std::vector<std::size_t> triangleCounts{}; //per mesh, the largest are processed first
+                //Reads mesh i and runs the import passes on it. Thread-safe.
+                std::function<Mesh::ModelData(unsigned)> readMesh{};
+            };
+
+            //glTF files go through Gltf::Document, anything else, or a glTF it can't read, through Assimp.
+            //importer and gltf keep what source points into.
+            bool openSource(const std::string& path, Assimp::Importer& importer, Gltf::Document& gltf,
+                SourceData& source);
+            bool openAssimp(const std::string& path, Assimp::Importer& importer, SourceData& source);
+
+            static void flattenNode(const aiNode* node, int parent, std::vector<ModelNode>& nodes);
+            static ModelNodeData buildNodeTree(const std::vector<ModelNode>& nodes,
+                const std::vector<Ref<Mesh>>& meshes);
+            //Records shortPath as the source of the tree's meshes, see MeshManager::GetModelSource.
+            static void setMeshSources(const ModelNodeData& node, const std::string& shortPath);
+
+            //Vertex conversion and index extraction. Reads nothing but its arguments, so meshes
+            //are processed in parallel.
+            static Mesh::ModelData processMesh(const aiMesh* mesh, const TextureMap& textures);
+            //Reordering, meshlets and LODs. Every importer's meshes end here.
+            static void optimizeMesh(Mesh::ModelData& data, const char* name);
 
-            Ref<Mesh> processMesh(aiMesh* mesh, const aiScene* scene, const aiMatrix4x4& nodeTransform);
+            //Texture paths of a material by type, relative to the working directory.
+            TextureMap loadMaterial(aiMaterial* mat);
 
             // checks all material textures of a given type and 
             // loads the textures if they're not loaded yet.
@@ -36,12 +86,26 @@ namespace Crave
                 aiTextureType type);
         private:
             friend class Scene;
+            friend class ModelImport;
+            friend class Crave::SceneSerializer;
+            friend class Crave::Prefab;
             std::vector<std::string> m_TexturesLoaded;
             ModelNodeData m_NodeData;
+            uint64_t                 m_CacheKey = 0; //of the source m_NodeData was read from
             std::string              m_Directory;
-            bool                     m_GammaCorrection;
+            bool                     m_GammaCorrection = false;
         private:
             static constexpr const char* BASE_MODEL_PATH = "res/models/";
+            //Reorder triangle clusters front to back at import. Costs a little vertex cache efficiency.
+            static constexpr bool OPTIMIZE_OVERDRAW = true;
+            //Read .gltf/.glb with Gltf::Document instead of Assimp.
+            static constexpr bool USE_GLTF_LOADER = true;
+            static constexpr unsigned IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+                aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+            //Changes whenever a setting that shapes the imported data changes, invalidating cooked models.
+            uint64_t ImportSettingsHash() const;
+            //ModelCache::Key of the model at shortPath as it is on disk now. 0 if it can't be read.
+            static uint64_t CacheKey(const std::string& shortPath, bool gamma = false);
         };
     }
 }
\ No newline at end of file
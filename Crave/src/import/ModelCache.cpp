@@ -0,0 +1,494 @@
+#include "pch.h"
+#include "ModelCache.h"
+
+#include <filesystem>
+#include <string_view>
+#include "core/FileFormat.h"
+#include "core/Hash.h"
+#include "import/Gltf.h"
+#include "platform/MappedFile.h"
+#include "renderer/MeshManager.h"
+#include "renderer/TextureManager.h"
+
+namespace Crave
+{
+    namespace Import
+    {
+        namespace ModelCache
+        {
+            namespace //private
+            {
+                using FileFormat::ArrayAt;
+
+                constexpr char MAGIC[4] = { 'C', 'V', 'M', 'C' };
+
+                struct FileHeader
+                {
+                    char magic[4];
+                    uint32_t version;
+                    uint64_t key;
+                    uint32_t meshCount;
+                    uint32_t padding;
+                    uint64_t nodeOffset;
+                    uint64_t nodeBytes;
+                };
+
+                //Follows the header, one per mesh. Offsets are from the start of the file.
+                struct MeshRecord
+                {
+                    uint64_t contentHash;   //MeshManager::ContentHash of the source data
+                    uint32_t formatFlags;
+                    uint32_t shortIndices;
+                    uint32_t vertexCount;
+                    uint32_t indexCount;    //all LOD levels
+                    uint32_t gpuIndexCount; //as packed, including padding
+                    uint32_t lodCount;
+                    uint32_t meshletCount;
+                    uint32_t textureCount;  //one per path
+                    float boundsCenter[3];
+                    float boundsRadius;
+                    //GPU streams and metadata, read on every load
+                    uint64_t vertexOffset;
+                    uint64_t indexOffset;
+                    uint64_t positionOffset;
+                    uint64_t lodOffset;
+                    uint64_t meshletOffset;
+                    uint64_t textureOffset;
+                    uint64_t textureBytes;
+                    //Full-float Mesh::Vertex and 32-bit indices, only read when MeshManager reloads them
+                    uint64_t sourceVertexOffset;
+                    uint64_t sourceIndexOffset;
+                };
+
+                class Writer
+                {
+                public:
+                    //Appends size bytes at the next 8-byte boundary and returns where they went.
+                    uint64_t Put(const void* data, std::size_t size)
+                    {
+                        m_Bytes.resize((m_Bytes.size() + 7) & ~std::size_t(7));
+                        uint64_t offset = m_Bytes.size();
+                        const uint8_t* bytes = (const uint8_t*)data;
+                        m_Bytes.insert(m_Bytes.end(), bytes, bytes + size);
+                        return offset;
+                    }
+
+                    //Appends without alignment, for the variable-length records read back with Reader.
+                    template<typename T>
+                    void Value(const T& value)
+                    {
+                        const uint8_t* bytes = (const uint8_t*)&value;
+                        m_Bytes.insert(m_Bytes.end(), bytes, bytes + sizeof(T));
+                    }
+
+                    void String(const std::string& str)
+                    {
+                        Value((uint32_t)str.size());
+                        m_Bytes.insert(m_Bytes.end(), str.begin(), str.end());
+                    }
+
+                    void Patch(uint64_t offset, const void* data, std::size_t size)
+                    {
+                        std::memcpy(&m_Bytes[offset], data, size);
+                    }
+
+                    const std::vector<uint8_t>& Bytes() const { return m_Bytes; }
+                private:
+                    std::vector<uint8_t> m_Bytes;
+                };
+
+                //Bounds-checked cursor over a range of the mapped file.
+                struct Reader
+                {
+                    const uint8_t* data;
+                    std::size_t size;
+                    std::size_t pos = 0;
+
+                    template<typename T>
+                    bool Value(T& value)
+                    {
+                        if (size - pos < sizeof(T))
+                            return false;
+                        std::memcpy(&value, data + pos, sizeof(T));
+                        pos += sizeof(T);
+                        return true;
+                    }
+
+                    bool String(std::string& str)
+                    {
+                        uint32_t length = 0;
+                        if (!Value(length) || size - pos < length)
+                            return false;
+                        str.assign((const char*)data + pos, length);
+                        pos += length;
+                        return true;
+                    }
+                };
+
+                std::string CachePath(const std::string& sourcePath)
+                {
+                    char hash[17];
+                    std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)Hash::String(sourcePath));
+                    return CACHE_PATH + std::filesystem::path(sourcePath).stem().string() + "_" + hash + ".cmdl";
+                }
+
+                //Material libraries an .obj names. Like Assimp, the rest of an mtllib line is one file name.
+                std::vector<std::string> ObjMaterialFiles(const MappedFile& obj, const std::string& directory)
+                {
+                    std::vector<std::string> files;
+                    std::string_view text((const char*)obj.Data(), obj.Size());
+                    for (std::size_t start = 0; start < text.size();)
+                    {
+                        std::size_t end = std::min(text.find('\n', start), text.size());
+                        std::string_view line = text.substr(start, end - start);
+                        start = end + 1;
+                        if (line.compare(0, 7, "mtllib ") != 0 && line.compare(0, 7, "mtllib\t") != 0)
+                            continue;
+                        std::size_t first = line.find_first_not_of(" \t", 7);
+                        std::size_t last = line.find_last_not_of(" \t\r");
+                        if (first != std::string_view::npos && last >= first)
+                            files.push_back(directory + std::string(line.substr(first, last - first + 1)));
+                    }
+                    return files;
+                }
+
+                //Files other than the source that shape what gets cooked. Textures are loaded by path at
+                //runtime, so only the paths matter and those are in the files already hashed.
+                std::vector<std::string> SideFiles(const std::string& sourcePath, const MappedFile& source)
+                {
+                    if (Gltf::IsGltf(sourcePath))
+                        return Gltf::Document::BufferFiles(sourcePath);
+                    std::string ext = std::filesystem::path(sourcePath).extension().string();
+                    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+                    if (ext == ".obj")
+                        return ObjMaterialFiles(source, sourcePath.substr(0, sourcePath.find_last_of('/') + 1));
+                    return {};
+                }
+
+                const MeshRecord* ReadRecords(const MappedFile& file, uint64_t key, FileHeader& header)
+                {
+                    if (!file.IsOpen() || file.Size() < sizeof(FileHeader))
+                        return nullptr;
+                    std::memcpy(&header, file.Data(), sizeof(FileHeader));
+                    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION ||
+                        header.key != key)
+                        return nullptr;
+                    return ArrayAt<MeshRecord>(file.Data(), file.Size(), sizeof(FileHeader), header.meshCount);
+                }
+
+                bool ReadTextures(const MappedFile& file, const MeshRecord& rec,
+                    std::unordered_map<Mesh::TexType, std::vector<std::string>>& textures)
+                {
+                    const uint8_t* bytes = ArrayAt<uint8_t>(file.Data(), file.Size(), rec.textureOffset, rec.textureBytes);
+                    if (!bytes)
+                        return false;
+                    Reader reader{ bytes, (std::size_t)rec.textureBytes };
+                    for (uint32_t t = 0; t < rec.textureCount; ++t)
+                    {
+                        int32_t type = 0;
+                        std::string path;
+                        if (!reader.Value(type) || !reader.String(path))
+                            return false;
+                        textures[(Mesh::TexType)type].push_back(std::move(path));
+                    }
+                    return true;
+                }
+
+                //Points packed into the mapped file. Rejects ranges a damaged file would draw out of bounds.
+                bool ReadPacked(const MappedFile& file, const MeshRecord& rec, Mesh::PackedData& packed)
+                {
+                    packed.format.flags = rec.formatFlags;
+                    packed.format.shortIndices = rec.shortIndices != 0;
+                    packed.vertexCount = rec.vertexCount;
+                    packed.indexCount = rec.indexCount;
+                    packed.boundsCenter = { rec.boundsCenter[0], rec.boundsCenter[1], rec.boundsCenter[2] };
+                    packed.boundsRadius = rec.boundsRadius;
+                    packed.meshletCount = rec.meshletCount;
+
+                    packed.vertices = ArrayAt<uint8_t>(file.Data(), file.Size(), rec.vertexOffset,
+                        std::size_t(rec.vertexCount) * packed.format.VertexSize());
+                    if (packed.format.shortIndices)
+                        packed.indices = ArrayAt<unsigned short>(file.Data(), file.Size(), rec.indexOffset, rec.gpuIndexCount);
+                    else
+                        packed.indices = ArrayAt<unsigned>(file.Data(), file.Size(), rec.indexOffset, rec.gpuIndexCount);
+                    packed.positions = ArrayAt<glm::vec3>(file.Data(), file.Size(), rec.positionOffset, rec.vertexCount);
+                    packed.meshlets = ArrayAt<Mesh::Meshlet>(file.Data(), file.Size(), rec.meshletOffset, rec.meshletCount);
+                    const Mesh::LodLevel* lods = ArrayAt<Mesh::LodLevel>(file.Data(), file.Size(), rec.lodOffset, rec.lodCount);
+                    if (!packed.vertices || !packed.indices || !packed.positions || !packed.meshlets || !lods ||
+                        rec.gpuIndexCount != (packed.format.shortIndices ? (rec.indexCount + 1) & ~1u : rec.indexCount))
+                        return false;
+
+                    packed.lods.assign(lods, lods + rec.lodCount);
+                    for (const auto& lod : packed.lods)
+                    {
+                        if (lod.indexOffset > rec.indexCount || lod.indexCount > rec.indexCount - lod.indexOffset)
+                            return false;
+                    }
+                    const unsigned level0 = packed.lods.empty() ? rec.indexCount : packed.lods[0].indexCount;
+                    for (unsigned m = 0; m < rec.meshletCount; ++m)
+                    {
+                        const Mesh::Meshlet& meshlet = packed.meshlets[m];
+                        if (meshlet.indexOffset > level0 || meshlet.indexCount > level0 - meshlet.indexOffset)
+                            return false;
+                    }
+                    return ReadTextures(file, rec, packed.textures);
+                }
+
+                bool ReadNode(Reader& reader, uint32_t meshCount, ModelNodeData& node,
+                    std::vector<std::vector<uint32_t>>& nodeMeshes)
+                {
+                    glm::mat4 transform;
+                    uint32_t count = 0;
+                    if (!reader.String(node.name) || !reader.Value(transform) || !reader.Value(count))
+                        return false;
+                    node.transform = transform;
+
+                    std::vector<uint32_t> meshes(count);
+                    for (auto& m : meshes)
+                    {
+                        if (!reader.Value(m) || m >= meshCount)
+                            return false;
+                    }
+                    nodeMeshes.push_back(std::move(meshes));
+
+                    uint32_t childCount = 0;
+                    if (!reader.Value(childCount))
+                        return false;
+                    for (uint32_t c = 0; c < childCount; ++c)
+                    {
+                        node.childData.emplace_back();
+                        if (!ReadNode(reader, meshCount, node.childData.back(), nodeMeshes))
+                            return false;
+                    }
+                    return true;
+                }
+
+                //Hands out the created meshes in the same preorder ReadNode filled nodeMeshes in.
+                void AssignMeshes(ModelNodeData& node, const std::vector<std::vector<uint32_t>>& nodeMeshes,
+                    const std::vector<Ref<Mesh>>& meshes, std::size_t& next)
+                {
+                    for (uint32_t m : nodeMeshes[next])
+                        node.meshes.push_back(meshes[m]);
+                    next++;
+                    for (auto& child : node.childData)
+                        AssignMeshes(child, nodeMeshes, meshes, next);
+                }
+
+                bool WriteNode(Writer& out, const ModelNodeData& node,
+                    const std::unordered_map<const Mesh*, uint32_t>& indexOf)
+                {
+                    out.String(node.name);
+                    out.Value(node.transform);
+                    out.Value((uint32_t)node.meshes.size());
+                    for (const auto& mesh : node.meshes)
+                    {
+                        auto it = indexOf.find(mesh.get());
+                        if (it == indexOf.end())
+                            return false;
+                        out.Value(it->second);
+                    }
+                    out.Value((uint32_t)node.childData.size());
+                    for (const auto& child : node.childData)
+                    {
+                        if (!WriteNode(out, child, indexOf))
+                            return false;
+                    }
+                    return true;
+                }
+
+                bool ReadModelData(const std::string& cachePath, uint64_t key, uint32_t index, Mesh::ModelData& data)
+                {
+                    MappedFile file(cachePath);
+                    FileHeader header;
+                    const MeshRecord* records = ReadRecords(file, key, header);
+                    if (!records || index >= header.meshCount)
+                        return false;
+
+                    const MeshRecord& rec = records[index];
+                    Mesh::PackedData packed;
+                    const Mesh::Vertex* vertices = ArrayAt<Mesh::Vertex>(file.Data(), file.Size(), rec.sourceVertexOffset, rec.vertexCount);
+                    const unsigned* indices = ArrayAt<unsigned>(file.Data(), file.Size(), rec.sourceIndexOffset, rec.indexCount);
+                    if (!vertices || !indices || !ReadPacked(file, rec, packed))
+                        return false;
+
+                    Mesh::ModelData loaded;
+                    loaded.vertices.assign(vertices, vertices + rec.vertexCount);
+                    loaded.indices.assign(indices, indices + rec.indexCount);
+                    loaded.textures = std::move(packed.textures);
+                    loaded.lods = std::move(packed.lods);
+                    loaded.meshlets.assign(packed.meshlets, packed.meshlets + rec.meshletCount);
+                    data = std::move(loaded);
+                    return true;
+                }
+            }
+
+            uint64_t Key(const std::string& sourcePath, uint64_t settingsHash)
+            {
+                MappedFile source(sourcePath);
+                if (!source.IsOpen())
+                    return 0;
+                uint64_t key = Hash::XXH64(&FORMAT_VERSION, sizeof(FORMAT_VERSION), settingsHash);
+                key = Hash::XXH64(source.Data(), source.Size(), key);
+                //A missing side file still changes the key, so the cooked copy is redone once it appears.
+                for (const std::string& path : SideFiles(sourcePath, source))
+                {
+                    key = Hash::String(path, key);
+                    MappedFile side(path);
+                    if (side.IsOpen())
+                        key = Hash::XXH64(side.Data(), side.Size(), key);
+                }
+                return key;
+            }
+
+            bool Load(const std::string& sourcePath, uint64_t key, ModelNodeData& root)
+            {
+                const std::string cachePath = CachePath(sourcePath);
+                MappedFile file(cachePath);
+                if (!file.IsOpen())
+                    return false;
+
+                FileHeader header;
+                const MeshRecord* records = ReadRecords(file, key, header);
+                if (!records)
+                {
+                    LOG_INFO("Cooked model '{}' is out of date.", cachePath);
+                    return false;
+                }
+
+                //Everything is validated before the first GPU upload.
+                std::vector<Mesh::PackedData> packed(header.meshCount);
+                for (uint32_t i = 0; i < header.meshCount; ++i)
+                {
+                    if (!ReadPacked(file, records[i], packed[i]))
+                    {
+                        LOG_WARN("Cooked model '{}' is damaged.", cachePath);
+                        return false;
+                    }
+                }
+                const uint8_t* nodeBytes = ArrayAt<uint8_t>(file.Data(), file.Size(), header.nodeOffset, header.nodeBytes);
+                Reader reader{ nodeBytes, (std::size_t)header.nodeBytes };
+                ModelNodeData tree;
+                std::vector<std::vector<uint32_t>> nodeMeshes;
+                if (!nodeBytes || !ReadNode(reader, header.meshCount, tree, nodeMeshes))
+                {
+                    LOG_WARN("Cooked model '{}' is damaged.", cachePath);
+                    return false;
+                }
+
+                //Decoded on the workers up front; the meshes below then find them loaded.
+                std::vector<std::string> texturePaths;
+                for (const auto& p : packed)
+                {
+                    for (const auto& [type, paths] : p.textures)
+                        texturePaths.insert(texturePaths.end(), paths.begin(), paths.end());
+                }
+                TextureManager::PendingTextures textures = TextureManager::DecodeAsync(texturePaths, false);
+                TextureManager::Upload(textures);
+
+                std::vector<Ref<Mesh>> meshes(header.meshCount);
+                for (uint32_t i = 0; i < header.meshCount; ++i)
+                {
+                    auto loader = [cachePath, key, i](Mesh::ModelData& data)
+                    {
+                        return ReadModelData(cachePath, key, i, data);
+                    };
+                    meshes[i] = MeshManager::GetCookedModelMesh(packed[i], records[i].contentHash,
+                        records[i].indexCount, loader);
+                }
+                std::size_t next = 0;
+                AssignMeshes(tree, nodeMeshes, meshes, next);
+                root = std::move(tree);
+                return true;
+            }
+
+            bool Write(const std::string& sourcePath, uint64_t key, const ModelNodeData& root,
+                const std::vector<Ref<Mesh>>& meshes, const std::vector<Mesh::ModelData>& meshData)
+            {
+                ASSERT(meshes.size() == meshData.size(), "Every cooked mesh needs its data.");
+
+                //Meshes MeshManager deduplicated are cooked once.
+                std::unordered_map<const Mesh*, uint32_t> indexOf;
+                std::vector<uint32_t> unique;
+                for (uint32_t i = 0; i < meshes.size(); ++i)
+                {
+                    if (indexOf.emplace(meshes[i].get(), (uint32_t)unique.size()).second)
+                        unique.push_back(i);
+                }
+
+                Writer out;
+                FileHeader header{};
+                std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+                header.version = FORMAT_VERSION;
+                header.key = key;
+                header.meshCount = (uint32_t)unique.size();
+                out.Put(&header, sizeof(header));
+
+                std::vector<MeshRecord> records(unique.size());
+                uint64_t recordOffset = out.Put(records.data(), records.size() * sizeof(MeshRecord));
+
+                for (std::size_t r = 0; r < unique.size(); ++r)
+                {
+                    const Ref<Mesh>& mesh = meshes[unique[r]];
+                    const Mesh::ModelData& data = meshData[unique[r]];
+                    const Mesh::VertexFormat format = mesh->Format();
+                    MeshRecord& rec = records[r];
+
+                    rec.contentHash = MeshManager::ContentHash(data);
+                    rec.formatFlags = format.flags;
+                    rec.shortIndices = format.shortIndices;
+                    rec.vertexCount = (uint32_t)data.vertices.size();
+                    rec.indexCount = (uint32_t)data.indices.size();
+                    rec.lodCount = (uint32_t)data.lods.size();
+                    rec.meshletCount = (uint32_t)data.meshlets.size();
+
+                    Mesh::PackedStreams streams = Mesh::PackStreams(data.vertices, data.indices, format);
+                    rec.gpuIndexCount = (uint32_t)(streams.indices.size() / (format.shortIndices ? sizeof(unsigned short) : sizeof(unsigned)));
+                    rec.vertexOffset = out.Put(streams.vertices.data(), streams.vertices.size());
+                    rec.indexOffset = out.Put(streams.indices.data(), streams.indices.size());
+                    rec.positionOffset = out.Put(streams.positions.data(), streams.positions.size() * sizeof(glm::vec3));
+                    rec.boundsRadius = streams.boundsRadius;
+                    std::memcpy(rec.boundsCenter, &streams.boundsCenter, sizeof(rec.boundsCenter));
+
+                    rec.lodOffset = out.Put(data.lods.data(), data.lods.size() * sizeof(Mesh::LodLevel));
+                    rec.meshletOffset = out.Put(data.meshlets.data(), data.meshlets.size() * sizeof(Mesh::Meshlet));
+
+                    Writer textures;
+                    for (auto type : { Mesh::TexType::Diffuse, Mesh::TexType::Specular, Mesh::TexType::Normal, Mesh::TexType::Height })
+                    {
+                        auto it = data.textures.find(type);
+                        if (it == data.textures.end())
+                            continue;
+                        for (const auto& path : it->second)
+                        {
+                            textures.Value((int32_t)type);
+                            textures.String(path);
+                            rec.textureCount++;
+                        }
+                    }
+                    rec.textureBytes = textures.Bytes().size();
+                    rec.textureOffset = out.Put(textures.Bytes().data(), textures.Bytes().size());
+
+                    rec.sourceVertexOffset = out.Put(data.vertices.data(), data.vertices.size() * sizeof(Mesh::Vertex));
+                    rec.sourceIndexOffset = out.Put(data.indices.data(), data.indices.size() * sizeof(unsigned));
+                }
+
+                Writer nodes;
+                if (!WriteNode(nodes, root, indexOf))
+                {
+                    LOG_ERROR("Model '{}' has a mesh without cook data.", sourcePath);
+                    return false;
+                }
+                header.nodeBytes = nodes.Bytes().size();
+                header.nodeOffset = out.Put(nodes.Bytes().data(), nodes.Bytes().size());
+                out.Patch(0, &header, sizeof(header));
+                out.Patch(recordOffset, records.data(), records.size() * sizeof(MeshRecord));
+
+                const std::string cachePath = CachePath(sourcePath);
+                if (!FileFormat::WriteFile(cachePath, out.Bytes().data(), out.Bytes().size()))
+                    return false;
+                LOG_INFO("Cooked model '{}' ({:.1f} KB)", cachePath, out.Bytes().size() / 1024.f);
+                return true;
+            }
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "import/Model.h"
+
+namespace Crave
+{
+    namespace Import
+    {
+        //Cooked copies of imported models, so reloads skip Assimp and the import passes. A cooked file
+        //holds the node tree, each mesh's streams in its final GPU layout, and the full-float data
+        //MeshManager reloads on demand. Meshes are uploaded straight from the mapped file.
+        namespace ModelCache
+        {
+            //Bump whenever the file layout or anything that shapes the cooked data changes.
+            constexpr uint32_t FORMAT_VERSION = 2;
+            constexpr const char* CACHE_PATH = "res/cache/models/";
+
+            //Identifies a source file's content, and that of the buffers and material libraries it names,
+            //under the given import settings. 0 if it can't be read.
+            uint64_t Key(const std::string& sourcePath, uint64_t settingsHash);
+
+            //Rebuilds the node tree and its meshes from the cooked file. False when the file is missing,
+            //was cooked from another key, or is damaged; the caller imports the source instead.
+            bool Load(const std::string& sourcePath, uint64_t key, ModelNodeData& root);
+
+            //Cooks root. meshData[i] is the data meshes[i] was created from; every mesh in the tree
+            //must be among them.
+            bool Write(const std::string& sourcePath, uint64_t key, const ModelNodeData& root,
+                const std::vector<Ref<Mesh>>& meshes, const std::vector<Mesh::ModelData>& meshData);
+        }
+    }
+}
@@ -0,0 +1,259 @@
+#include "pch.h"
+#include "ModelImport.h"
+
+#include <atomic>
+#include <numeric>
+#include <unordered_set>
+#include <assimp/Importer.hpp>
+
+#include "renderer/MeshManager.h"
+#include "core/JobSystem.h"
+#include "import/ModelCache.h"
+#include "import/Gltf.h"
+
+namespace Crave
+{
+    namespace Import
+    {
+        struct ModelImport::Shared
+        {
+            std::string path{};
+            Model model{}; //directory and the material texture bookkeeping
+            std::atomic<bool> cancelled{ false };
+            std::atomic<unsigned> processed{ 0 };
+
+            uint64_t key = 0;
+            Assimp::Importer importer{};
+            Gltf::Document gltf{};
+            Model::SourceData source{};
+            bool opened = false;
+
+            std::vector<Mesh::ModelData> meshData{};
+            std::vector<MeshManager::PreparedModel> prepared{};
+        };
+
+        namespace //private
+        {
+            bool IsReady(const std::future<void>& job)
+            {
+                return !job.valid() || job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            }
+        }
+
+        ModelImport::ModelImport(const std::string& path, bool gamma)
+            : m_Path(Model::BASE_MODEL_PATH + path), m_Shared(std::make_shared<Shared>())
+        {
+            Shared& s = *m_Shared;
+            s.path = m_Path;
+            s.model.m_Directory = m_Path.substr(0, m_Path.find_last_of('/') + 1);
+            s.model.m_GammaCorrection = gamma;
+
+            //Hashing reads the whole source file, so it runs on a worker too.
+            uint64_t settingsHash = s.model.ImportSettingsHash();
+            m_Job = JobSystem::SubmitBackground([shared = m_Shared, settingsHash]()
+                { shared->key = ModelCache::Key(shared->path, settingsHash); });
+        }
+
+        ModelImport::~ModelImport()
+        {
+            //The decode jobs write into m_Textures' images.
+            m_Shared->cancelled = true;
+            for (auto& done : m_Textures.done)
+                done.wait();
+        }
+
+        void ModelImport::Parse(Shared& s)
+        {
+            s.opened = s.model.openSource(s.path, s.importer, s.gltf, s.source);
+            s.meshData.resize(s.source.triangleCounts.size());
+            s.prepared.resize(s.source.triangleCounts.size());
+        }
+
+        float ModelImport::Progress() const
+        {
+            if (m_Status == Status::Done)
+                return 1.f;
+            if (m_Status == Status::Parsing || m_Status >= Status::Cancelled)
+                return 0.f;
+
+            //Units: the parse, each mesh processed and uploaded, each texture uploaded, each entity.
+            std::size_t meshCount = m_Meshes.size();
+            std::size_t texturesLeft = m_Textures.images.size();
+            std::size_t total = 1 + 2 * meshCount + m_TextureCount + m_Nodes.size();
+            std::size_t done = 1 + (m_Cooked ? meshCount : m_Shared->processed.load()) + m_MeshesUploaded +
+                (m_TextureCount - texturesLeft) + m_Entities.size() - m_Placeholders.size();
+            return (float)done / total;
+        }
+
+        void ModelImport::Update(std::chrono::steady_clock::time_point deadline)
+        {
+            Shared& s = *m_Shared;
+            if (m_Status == Status::Parsing)
+            {
+                if (!IsReady(m_Job))
+                    return;
+                m_Job.get();
+                if (!m_Parsing)
+                {
+                    //Key known: a cooked load maps and uploads in one go, there is nothing to split.
+                    ModelNodeData root;
+                    if (s.key && ModelCache::Load(m_Path, s.key, root))
+                    {
+                        LOG_INFO("Loaded cooked model '{}'", m_Path);
+                        m_Cooked = true;
+                        FlattenCooked(root, -1, m_Nodes);
+                        m_MeshesUploaded = m_Meshes.size();
+                        m_Status = Status::Populating;
+                        return;
+                    }
+                    m_Parsing = true;
+                    m_Job = JobSystem::SubmitBackground([shared = m_Shared]() { Parse(*shared); });
+                    return;
+                }
+                if (!s.opened)
+                {
+                    m_Status = Status::Failed;
+                    return;
+                }
+                StartProcessing();
+            }
+
+            if (m_Status != Status::Processing)
+                return;
+
+            //Meshes wait for their textures, so Mesh::LoadTextures never decodes on this thread.
+            if (!TextureManager::UploadReady(m_Textures, deadline))
+                return;
+
+            for (std::size_t i = 0; i < m_Meshes.size() && std::chrono::steady_clock::now() < deadline; i++)
+            {
+                if (m_Meshes[i] || !IsReady(m_MeshJobs[i]))
+                    continue;
+                m_MeshJobs[i].get();
+                m_Meshes[i] = MeshManager::GetModelMesh(s.meshData[i], s.prepared[i]);
+                s.prepared[i] = {};
+                m_MeshesUploaded++;
+            }
+
+            if (m_MeshesUploaded == m_Meshes.size())
+            {
+                s.source = {};
+                s.importer.FreeScene();
+                s.gltf.Close();
+                m_Status = Status::Populating;
+            }
+        }
+
+        void ModelImport::StartProcessing()
+        {
+            Shared& s = *m_Shared;
+            m_Nodes = s.source.nodes;
+            m_Textures = TextureManager::DecodeAsync(s.source.texturePaths, false);
+            m_NewTextures = m_Textures.paths;
+            m_TextureCount = m_Textures.images.size();
+
+            //Largest first so a big mesh picked up last doesn't leave the other workers idle.
+            const auto& triangles = s.source.triangleCounts;
+            const unsigned int meshCount = (unsigned int)triangles.size();
+            std::vector<unsigned int> order(meshCount);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&triangles](unsigned int a, unsigned int b)
+                { return triangles[a] > triangles[b]; });
+
+            m_Meshes.resize(meshCount);
+            m_MeshJobs.resize(meshCount);
+            for (unsigned int i : order)
+            {
+                m_MeshJobs[i] = JobSystem::SubmitBackground([shared = m_Shared, i]()
+                    {
+                        Shared& s = *shared;
+                        if (s.cancelled)
+                            return;
+                        s.meshData[i] = s.source.readMesh(i);
+                        s.prepared[i] = MeshManager::PrepareModelMesh(s.meshData[i]);
+                        s.processed++;
+                    });
+            }
+            m_Status = Status::Processing;
+        }
+
+        void ModelImport::FlattenCooked(const ModelNodeData& nodeData, int parent, std::vector<ModelNode>& nodes)
+        {
+            int index = (int)nodes.size();
+            nodes.push_back({ nodeData.name, nodeData.transform, parent });
+            for (const auto& mesh : nodeData.meshes)
+            {
+                nodes[index].meshes.push_back((unsigned)m_Meshes.size());
+                m_Meshes.push_back(mesh);
+            }
+            for (const auto& child : nodeData.childData)
+                FlattenCooked(child, index, nodes);
+        }
+
+        void ModelImport::Finish()
+        {
+            m_Status = Status::Done;
+            const std::string shortPath = m_Path.substr(std::strlen(Model::BASE_MODEL_PATH));
+            for (const auto& mesh : m_Meshes)
+                MeshManager::SetModelSource(mesh, shortPath);
+            if (m_Cooked || !m_Shared->key)
+                return;
+
+            //MeshManager holds on to the meshes, so the worker never frees GL objects.
+            m_Job = JobSystem::SubmitBackground([shared = m_Shared, root = Model::buildNodeTree(m_Nodes, m_Meshes), meshes = m_Meshes]()
+                { ModelCache::Write(shared->path, shared->key, root, meshes, shared->meshData); });
+        }
+
+        void ModelImport::Release()
+        {
+            m_Status = Status::Cancelled;
+            m_Shared->cancelled = true;
+            m_Entities.clear();
+            m_Placeholders.clear();
+
+            std::unordered_set<const Texture*> textures;
+            for (const auto& path : m_NewTextures)
+            {
+                auto it = TextureManager::Textures.find(path);
+                if (it != TextureManager::Textures.end())
+                    textures.insert(it->second.get());
+            }
+            {
+                //Meshes MeshManager deduplicated appear more than once, each is released once.
+                std::vector<Ref<Mesh>> meshes = std::move(m_Meshes);
+                std::sort(meshes.begin(), meshes.end());
+                meshes.erase(std::unique(meshes.begin(), meshes.end()), meshes.end());
+                for (auto& mesh : meshes)
+                {
+                    if (!mesh)
+                        continue;
+                    for (auto& [type, list] : mesh->Textures())
+                    {
+                        for (auto& texture : list)
+                            textures.insert(texture.get());
+                    }
+                    MeshManager::ReleaseModelMesh(mesh);
+                }
+            }
+            TextureManager::Release(textures);
+            LOG_INFO("Cancelled import of '{}'", m_Path);
+        }
+
+        bool ModelImport::IsIdle() const
+        {
+            if (!IsReady(m_Job))
+                return false;
+            for (const auto& job : m_MeshJobs)
+            {
+                if (!IsReady(job))
+                    return false;
+            }
+            for (const auto& done : m_Textures.done)
+            {
+                if (!IsReady(done))
+                    return false;
+            }
+            return true;
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "import/Model.h"
+#include "renderer/TextureManager.h"
+#include "scene/Scene.h"
+#include <chrono>
+
+namespace Crave
+{
+    class Scene;
+
+    namespace Import
+    {
+        //A model import started by Scene::ImportModelAsync. Hashing, parsing, mesh processing, texture
+        //decoding and cooking run on JobSystem workers; the scene advances the GL half and creates the
+        //entities each frame within a time budget. Entities show a placeholder until their mesh is up.
+        class ModelImport
+        {
+        public:
+            enum class Status
+            {
+                Parsing,    //hashing the source, loading it cooked or reading it with Assimp
+                Processing, //meshes optimized and textures decoded on the workers, uploaded as they finish
+                Populating, //every mesh is uploaded, entities are still being created
+                Done,
+                Cancelled,
+                Failed
+            };
+
+            Status GetStatus() const { return m_Status; }
+            //Finished, failed or cancelled.
+            bool IsDone() const { return m_Status >= Status::Done; }
+            //0 to 1 over parsing, mesh processing, uploads and entity creation.
+            float Progress() const;
+            const std::string& Path() const { return m_Path; }
+            //Entity of the model's root node. Null until the scene created it.
+            Entity Root() const { return m_Entities.empty() ? Entity{} : m_Entities[0]; }
+
+            //Entities and GPU resources created so far are released on the scene's next update.
+            void Cancel() { m_CancelRequested = true; }
+
+            ~ModelImport();
+        private:
+            friend class Crave::Scene;
+            struct Shared; //everything the workers touch
+
+            ModelImport(const std::string& path, bool gamma = false);
+
+            //GL side: tries the cooked file, uploads textures and meshes as the workers finish them.
+            void Update(std::chrono::steady_clock::time_point deadline);
+            //Called once every node has an entity with its real mesh. Cooks the model on a worker.
+            void Finish();
+            //Drops the meshes and textures only this import uses. Entities must be gone by then.
+            void Release();
+            //No worker holds on to anything of this import anymore.
+            bool IsIdle() const;
+
+            const std::vector<ModelNode>& Nodes() const { return m_Nodes; }
+            //Null until uploaded.
+            Ref<Mesh> GetMesh(unsigned index) const { return m_Meshes[index]; }
+
+            //Worker side of parsing: opens the source, reads its materials and node tree.
+            static void Parse(Shared& s);
+            void StartProcessing();
+            void FlattenCooked(const ModelNodeData& nodeData, int parent, std::vector<ModelNode>& nodes);
+        private:
+            std::string m_Path;
+            Status m_Status = Status::Parsing;
+            bool m_CancelRequested = false;
+            bool m_Parsing = false; //no cooked copy, Assimp was started
+            bool m_Cooked = false;
+
+            std::shared_ptr<Shared> m_Shared;
+            std::future<void> m_Job{};
+            std::vector<std::future<void>> m_MeshJobs{};
+            TextureManager::PendingTextures m_Textures{};
+            std::vector<std::string> m_NewTextures{}; //decoded for this import
+            std::size_t m_TextureCount = 0;
+
+            std::vector<ModelNode> m_Nodes{};
+            std::vector<Ref<Mesh>> m_Meshes{};
+            std::size_t m_MeshesUploaded = 0;
+
+            //Maintained by the scene. Index-aligned with Nodes().
+            std::vector<Entity> m_Entities{};
+            std::vector<unsigned> m_Placeholders{}; //nodes whose entity still waits for its mesh
+        };
+    }
+}
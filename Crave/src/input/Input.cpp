@@ -36,6 +36,8 @@ namespace Crave
 			m_KbData.Keybinds[KeybindName::GizmoTranslate] = { Key::W  , KeyEvent::Press };
 			m_KbData.Keybinds[KeybindName::GizmoRotate	 ] = { Key::E  , KeyEvent::Press };
 			m_KbData.Keybinds[KeybindName::GizmoScale	 ] = { Key::R  , KeyEvent::Press };
+			m_KbData.Keybinds[KeybindName::Undo			 ] = { Key::Z  , KeyEvent::Press };
+			m_KbData.Keybinds[KeybindName::Redo			 ] = { Key::Y  , KeyEvent::Press };
 		}
 
 		
@@ -74,6 +76,7 @@ namespace Crave
 				ImGui::Text("%-16s: %s", "Rotate View", "Hold RMB/LeftAlt + Move cursor");
 				ImGui::Text("%-16s: %s", "Pan View", "Hold MMB + Move cursor");
 				ImGui::Text("%-16s: %s", "Select Objects", "LMB click");
+				ImGui::Text("%-16s: %s", "Undo/Redo", "Hold LeftCtrl + Undo/Redo key");
 			}
 			ImGui::End();
 		}
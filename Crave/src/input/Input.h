@@ -14,6 +14,7 @@ namespace Crave
 			CloseWindow,
 			ToggleCameraProjectionType,
 			GizmoNone, GizmoTranslate, GizmoRotate, GizmoScale,
+			Undo, Redo,
 		};
 		
 		namespace 
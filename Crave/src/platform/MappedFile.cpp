@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Crave
+{
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string& path)
+	{
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
+		m_File = file;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			Close();
+			return;
+		}
+
+		m_Mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!m_Mapping)
+		{
+			Close();
+			return;
+		}
+		m_Data = (const uint8_t*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+		m_Size = m_Data ? (std::size_t)size.QuadPart : 0;
+		if (!m_Data)
+			Close();
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_Data)
+			UnmapViewOfFile(m_Data);
+		if (m_Mapping)
+			CloseHandle(m_Mapping);
+		if (m_File)
+			CloseHandle(m_File);
+		m_Data = nullptr;
+		m_Size = 0;
+		m_Mapping = nullptr;
+		m_File = nullptr;
+	}
+#else
+	MappedFile::MappedFile(const std::string& path)
+	{
+		m_Fd = open(path.c_str(), O_RDONLY);
+		if (m_Fd < 0)
+			return;
+
+		struct stat st;
+		if (fstat(m_Fd, &st) != 0 || st.st_size == 0)
+		{
+			Close();
+			return;
+		}
+
+		void* data = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, m_Fd, 0);
+		if (data == MAP_FAILED)
+		{
+			Close();
+			return;
+		}
+		m_Data = (const uint8_t*)data;
+		m_Size = (std::size_t)st.st_size;
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_Data)
+			munmap((void*)m_Data, m_Size);
+		if (m_Fd >= 0)
+			close(m_Fd);
+		m_Data = nullptr;
+		m_Size = 0;
+		m_Fd = -1;
+	}
+#endif
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+}
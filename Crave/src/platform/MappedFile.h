@@ -0,0 +1,31 @@
+#pragma once
+
+namespace Crave
+{
+	//Read-only view of a whole file mapped into memory. Pages are read from disk on first touch.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		explicit MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool IsOpen() const { return m_Data != nullptr; }
+		const uint8_t* Data() const { return m_Data; }
+		std::size_t Size() const { return m_Size; }
+
+		void Close();
+	private:
+		const uint8_t* m_Data = nullptr;
+		std::size_t m_Size = 0;
+#ifdef _WIN32
+		void* m_File = nullptr;
+		void* m_Mapping = nullptr;
+#else
+		int m_Fd = -1;
+#endif
+	};
+}
@@ -42,51 +42,84 @@ namespace Crave
 	{
 		switch (type)
 		{
-		case GL_FLOAT:         return sizeof(GLfloat);
-		case GL_UNSIGNED_INT:  return sizeof(GLuint);
-		case GL_UNSIGNED_BYTE: return sizeof(GLbyte);
+		case GL_FLOAT:                    return sizeof(GLfloat);
+		case GL_INT:                      return sizeof(GLint);
+		case GL_UNSIGNED_INT:             return sizeof(GLuint);
+		case GL_HALF_FLOAT:               return sizeof(GLhalf);
+		case GL_SHORT:                    return sizeof(GLshort);
+		case GL_UNSIGNED_SHORT:           return sizeof(GLushort);
+		case GL_BYTE:                     return sizeof(GLbyte);
+		case GL_UNSIGNED_BYTE:            return sizeof(GLubyte);
+		case GL_INT_2_10_10_10_REV:
+		case GL_UNSIGNED_INT_2_10_10_10_REV: return sizeof(GLuint);
 		}
 
 		return 0;
 	}
 
+	const unsigned VertexLayout::VertexAttribute::GetSize() const
+	{
+		if (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV)
+			return GetTypeSize();
+		return count * GetTypeSize();
+	}
+
 	VertexLayout::VertexLayout(const std::initializer_list<VertexAttribute>& list)
 		: m_Stride(0), m_Attribs(list)
 	{
 		for (auto& attrib : m_Attribs)
 		{
-			m_Stride += attrib.count * sizeof(attrib.GetTypeSize());
+			ASSERT(attrib.GetTypeSize(), "Unsupported type");
+			m_Stride += attrib.GetSize();
 		}
 	}
 
+	void VertexLayout::Add(const VertexAttribute& attrib)
+	{
+		ASSERT(attrib.GetTypeSize(), "Unsupported type");
+		m_Attribs.push_back(attrib);
+		m_Stride += attrib.GetSize();
+	}
+
 	void VertexLayout::Enable() const
 	{
 		unsigned offset = 0;
 		for (unsigned i = 0; i < m_Attribs.size(); ++i)
 		{
 			const auto& at = m_Attribs[i];
+			unsigned location = at.location < 0 ? i : (unsigned)at.location;
 
-			if (at.type == GL_FLOAT)
-				glVertexAttribPointer(i, at.count, at.type, at.normalized, m_Stride, (void*)offset);
-			else if (at.type == GL_INT)
-				glVertexAttribIPointer(i, at.count, at.type, m_Stride, (void*)offset);
+			if (at.integer || at.type == GL_INT)
+				glVertexAttribIPointer(location, at.count, at.type, m_Stride, (void*)(uintptr_t)offset);
 			else
-				ASSERT(0, "Unsupported type");
+				glVertexAttribPointer(location, at.count, at.type, at.normalized, m_Stride, (void*)(uintptr_t)offset);
 
-			glEnableVertexAttribArray(i);
-			offset += at.count * at.GetTypeSize();
+			glEnableVertexAttribArray(location);
+			offset += at.GetSize();
 		}
 	}
 
 
 
-	EBO::EBO(const unsigned int* data, unsigned int count) : m_Count(count)
+	EBO::EBO(const unsigned int* data, unsigned int count) : m_Count(count), m_Type(GL_UNSIGNED_INT)
 	{
 		glGenBuffers(1, &m_Id);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Id);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_Count * sizeof(unsigned int), data, GL_STATIC_DRAW);
 	}
 
+	EBO::EBO(const unsigned short* data, unsigned int count) : m_Count(count), m_Type(GL_UNSIGNED_SHORT)
+	{
+		glGenBuffers(1, &m_Id);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Id);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, ((m_Count + 1) & ~1u) * sizeof(unsigned short), data, GL_STATIC_DRAW);
+	}
+
+	unsigned EBO::IndexSize() const
+	{
+		return m_Type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
 	EBO::~EBO()
 	{
 		glDeleteBuffers(1, &m_Id);
@@ -133,6 +166,18 @@ namespace Crave
 		glBindBuffer(m_TypeUInt, 0);
 	}
 
+	void ShaderBlock::Reserve(const std::size_t size)
+	{
+		if (size <= m_Size)
+			return;
+
+		//Grow geometrically so a slowly rising light count doesn't realloc every frame.
+		m_Size = std::max(size, m_Size + m_Size / 2);
+		glBindBuffer(m_TypeUInt, m_Id);
+		glBufferData(m_TypeUInt, m_Size, nullptr, GL_DYNAMIC_DRAW);
+		glBindBuffer(m_TypeUInt, 0);
+	}
+
 	void ShaderBlock::Bind(unsigned bindingPoint)
 	{
 		glBindBufferBase(m_TypeUInt, bindingPoint, m_Id);
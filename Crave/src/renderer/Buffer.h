@@ -9,13 +9,20 @@ namespace Crave
         {
             unsigned type;
             unsigned count;
-            unsigned normalized;
+            unsigned normalized = 0;
+            int  location = -1;   //-1: position in the layout
+            bool integer = false; //read as ivec/uvec in the shader
 
             const unsigned GetTypeSize() const;
+            //Bytes taken by the whole attribute. Packed types hold all components in one word.
+            const unsigned GetSize() const;
             VertexAttribute(unsigned t, unsigned c, unsigned n)
                 : type(t), count(c), normalized(n) {}
             VertexAttribute(unsigned t, unsigned c)
                 : type(t), count(c) {}
+            //Explicit shader location, for layouts that skip optional streams.
+            VertexAttribute(int loc, unsigned t, unsigned c, unsigned n, bool i = false)
+                : type(t), count(c), normalized(n), location(loc), integer(i) {}
             VertexAttribute() {}
         };
 
@@ -26,6 +33,8 @@ namespace Crave
             : m_Stride(0) {}
         ~VertexLayout() {}
 
+        void Add(const VertexAttribute& attrib);
+
         const auto& Attribs() const { return m_Attribs; }
         unsigned    Stride()  const { return m_Stride; }
 
@@ -63,8 +72,10 @@ namespace Crave
     {
 
     public:
-        EBO() : m_Id(0), m_Count(0) {}
+        EBO() : m_Id(0), m_Count(0), m_Type(0) {}
         EBO(const unsigned int* data, unsigned int m_Count);
+        //data holds count rounded up to even: the buffer is also read as 32-bit words. Count() excludes the pad.
+        EBO(const unsigned short* data, unsigned int m_Count);
         ~EBO();
 
         void Bind();
@@ -72,10 +83,14 @@ namespace Crave
 
         unsigned Id()    const { return m_Id; }
         unsigned Count() const { return m_Count; }
+        //GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+        unsigned Type()  const { return m_Type; }
+        unsigned IndexSize() const;
 
     private:
         unsigned int m_Id;
         unsigned int m_Count;
+        unsigned int m_Type;
     };
 
     class ShaderBlock
@@ -88,6 +103,9 @@ namespace Crave
         void UploadFull(const void* data);
         void Upload(const void* data, const std::size_t size,
             const unsigned offset);
+        //Reallocates storage if it is smaller than size. Old contents are discarded.
+        void Reserve(const std::size_t size);
+        std::size_t Size() const { return m_Size; }
         const char* Name() const { return m_Name.c_str(); }
         const unsigned Type() const { return m_TypeUInt; }
 
@@ -48,6 +48,9 @@ namespace Crave
 
 		const float Zoom() const { return m_Zoom; }
 
+		float NearPlane() const { return m_IsPerspective ? PERSP_NEAR_PLANE : ORTHO_NEAR_PLANE; }
+		float FarPlane()  const { return m_IsPerspective ? PERSP_FAR_PLANE : ORTHO_FAR_PLANE; }
+
 		void OnUpdate();
 
 		void UpdateProjMat(int width, int height);
@@ -31,6 +31,7 @@ namespace Crave
 			switch (config.type)
 			{
 			case Texture::Type::RGBA:
+			case Texture::Type::RGBA16F:
 			case Texture::Type::Integer:
 			{
 				auto& thisAtt = m_ColorAttachments.emplace_back(CreateRef<Texture>(newDimensions, config));
@@ -34,12 +34,18 @@ namespace Crave
 		~Framebuffer() {}
 
 		Ref<Texture> GetDepthAttachment() { return m_DepthAttachment; }
+		Ref<Texture> GetColorAttachment(unsigned index)
+		{
+			ASSERT(index < m_ColorAttachments.size(), "");
+			return m_ColorAttachments[index];
+		}
 		unsigned GetColorAttachmentId(unsigned index) const
 		{
 			ASSERT(index <= m_ColorAttachments.size(), "");
 			return m_ColorAttachments[index]->Id();
 		}
 		void Invalidate(glm::vec2 newDimensions);
+		const glm::vec2& Dimensions() const { return m_Dimensions; }
 
 		int ReadPixelInt(unsigned x, unsigned y);
 		void ClearIntAttachment(int clearVal);
@@ -1,62 +1,334 @@
 #include "pch.h"
 #include "renderer/Mesh.h"
+#include "renderer/TextureManager.h"
 #include "glad/glad.h"
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 namespace Crave
 {
-    Mesh::Mesh(const PrimitiveData& data)
+    namespace //private
     {
-        m_VAO = CreateRef<VAO>();
-        auto gd = GeoData::GetData(data.primType);
+        //Shader locations of the packed streams. See general.vert.
+        enum VertexLocation
+        {
+            LOC_POSITION = 0, LOC_TEXCOORDS = 2, LOC_COLOR = 5, LOC_BONEIDS = 6,
+            LOC_WEIGHTS = 7, LOC_OCT_NORMAL = 8, LOC_QTANGENT = 9
+        };
 
-        m_VBO = CreateRef<VBO>(gd.data, gd.size, gd.count);
+        int16_t PackSnorm16(float v)
+        {
+            return (int16_t)std::round(glm::clamp(v, -1.f, 1.f) * 32767.f);
+        }
 
-        VertexLayout layout
+        uint8_t PackUnorm8(float v)
         {
-            {GL_FLOAT, 3, GL_FALSE}, //position
-            {GL_FLOAT, 3, GL_FALSE}, //normal
-            {GL_FLOAT, 2, GL_FALSE}, //texcoords
-            {GL_FLOAT, 3, GL_FALSE}, //tangent
-            {GL_FLOAT, 3, GL_FALSE}  //bitangent
-        };
-        m_VBO->SetLayout(layout);
-        m_VAO->AddBuffer(*m_VBO, nullptr); //No EBO
+            return (uint8_t)std::round(glm::clamp(v, 0.f, 1.f) * 255.f);
+        }
 
-        for (auto& [type, paths] : data.textures)
+        //Maps the unit sphere onto the [-1, 1] square, folding the lower hemisphere over the diagonals.
+        glm::vec2 OctEncode(glm::vec3 n)
         {
-            for (auto& p : paths)
+            n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z) + 1e-20f);
+            glm::vec2 p(n.x, n.y);
+            if (n.z < 0.f)
             {
-                m_Textures[type].push_back(CreateRef<Texture>(p));
+                p = (1.f - glm::abs(glm::vec2(n.y, n.x))) *
+                    glm::vec2(n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f);
             }
+            return p;
+        }
+
+        //Quaternion rotating the tangent frame into place. Negative w flags a mirrored bitangent,
+        //so w is kept away from zero where snorm16 can't tell +0 from -0.
+        glm::quat QTangent(const Mesh::Vertex& v)
+        {
+            glm::vec3 n = glm::normalize(v.Normal);
+            glm::vec3 t = v.Tangent - n * glm::dot(n, v.Tangent);
+            if (glm::dot(t, t) < 1e-12f) //no uvs, any perpendicular will do
+                t = glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0));
+            t = glm::normalize(t);
+            glm::vec3 b = glm::cross(n, t);
+            float handedness = glm::dot(b, v.Bitangent) < 0.f ? -1.f : 1.f;
+
+            glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
+            if (q.w < 0.f)
+                q = -q;
+
+            const float bias = 1.f / 32767.f;
+            if (q.w < bias)
+            {
+                float s = std::sqrt(1.f - bias * bias);
+                q = glm::quat(bias, q.x * s, q.y * s, q.z * s);
+            }
+            return handedness < 0.f ? -q : q;
+        }
+
+        template<typename T>
+        void Put(std::vector<uint8_t>& out, std::size_t& offset, const T& value)
+        {
+            std::memcpy(&out[offset], &value, sizeof(T));
+            offset += sizeof(T);
         }
     }
 
-    Mesh::Mesh(const ModelData& data)
+    unsigned Mesh::VertexFormat::VertexSize() const
     {
-        m_VAO = CreateRef<VAO>();
-        m_VBO = CreateRef<VBO>(
-            (const void*)&data.vertices[0], data.vertices.size() * sizeof(Vertex), data.vertices.size());
-        m_EBO = CreateRef<EBO>(&data.indices[0], data.indices.size());
-        VertexLayout layout
-        {
-            {GL_FLOAT, 3, GL_FALSE}, //position
-            {GL_FLOAT, 3, GL_FALSE}, //normal
-            {GL_FLOAT, 2, GL_FALSE}, //texcoords
-            {GL_FLOAT, 3, GL_FALSE}, //tangent
-            {GL_FLOAT, 3, GL_FALSE}, //bitangent
-            {GL_FLOAT, 4, GL_FALSE}, //color
-            {GL_INT  , 4          }, //boneid
-            {GL_FLOAT, 4, GL_FALSE}  //weights
-        };
-        m_VBO->SetLayout(layout);
-        m_VAO->AddBuffer(*m_VBO, m_EBO);
+        return Layout().Stride();
+    }
 
-        for (auto& [type, paths] : data.textures)
+    VertexLayout Mesh::VertexFormat::Layout() const
+    {
+        std::vector<VertexLayout::VertexAttribute> attribs;
+        attribs.push_back({ LOC_POSITION, GL_FLOAT, 3, GL_FALSE });
+        if (flags & TangentFrame)
+            attribs.push_back({ LOC_QTANGENT, GL_SHORT, 4, GL_TRUE });
+        else
+            attribs.push_back({ LOC_OCT_NORMAL, GL_SHORT, 2, GL_TRUE });
+        attribs.push_back({ LOC_TEXCOORDS, GL_HALF_FLOAT, 2, GL_FALSE });
+        if (flags & Color)
+            attribs.push_back({ LOC_COLOR, GL_UNSIGNED_BYTE, 4, GL_TRUE });
+        if (flags & Skinned)
+        {
+            if (flags & WideBoneIds)
+                attribs.push_back({ LOC_BONEIDS, GL_INT, 4, GL_FALSE, true });
+            else
+                attribs.push_back({ LOC_BONEIDS, GL_UNSIGNED_BYTE, 4, GL_FALSE, true });
+            attribs.push_back({ LOC_WEIGHTS, GL_UNSIGNED_BYTE, 4, GL_TRUE });
+        }
+
+        VertexLayout layout;
+        for (auto& a : attribs)
+            layout.Add(a);
+        return layout;
+    }
+
+    std::vector<Mesh::Vertex> Mesh::PrimitiveVertices(Primitive primType)
+    {
+        auto gd = GeoData::GetData(primType);
+        const float* src = (const float*)gd.data;
+        std::size_t floatsPerVertex = gd.size / gd.count / sizeof(float);
+
+        //position, normal, texcoords, tangent, bitangent. Skybox has positions only.
+        std::vector<Vertex> vertices(gd.count, Vertex{});
+        for (unsigned i = 0; i < gd.count; ++i)
+        {
+            const float* f = src + i * floatsPerVertex;
+            Vertex& v = vertices[i];
+            v.Position = { f[0], f[1], f[2] };
+            if (floatsPerVertex >= 14)
+            {
+                v.Normal    = { f[3], f[4], f[5] };
+                v.TexCoords = { f[6], f[7] };
+                v.Tangent   = { f[8], f[9], f[10] };
+                v.Bitangent = { f[11], f[12], f[13] };
+            }
+            else
+                v.Normal = glm::vec3(0.f, 0.f, 1.f);
+        }
+        return vertices;
+    }
+
+    Mesh::Mesh(const PrimitiveData& data, const std::vector<Vertex>& vertices, VertexFormat format)
+        : m_Format(format)
+    {
+        CreateVertexStream(vertices, {}); //No EBO
+        m_Lods = { { 0, (unsigned)vertices.size(), 0.f } };
+        LoadTextures(data.textures, true);
+    }
+
+    Mesh::Mesh(const PackedData& data)
+        : m_Format(data.format)
+    {
+        UploadStreams(data.vertices, data.vertexCount, data.indices, data.indexCount, data.positions);
+        m_BoundsCenter = data.boundsCenter;
+        m_BoundsRadius = data.boundsRadius;
+        m_Lods = data.lods;
+        if (m_Lods.empty())
+            m_Lods = { { 0, data.indexCount ? data.indexCount : data.vertexCount, 0.f } };
+        if (data.meshletCount)
+            CreateMeshletBuffers(data.meshlets, data.meshletCount);
+        LoadTextures(data.textures, false);
+    }
+
+    void Mesh::LoadTextures(const std::unordered_map<TexType, std::vector<std::string>>& textures, bool useRelativePath)
+    {
+        for (auto& [type, paths] : textures)
         {
             for (auto& p : paths)
             {
-                m_Textures[type].push_back(CreateRef<Texture>(p, false));
+                m_Textures[type].push_back(TextureManager::GetTexture(p, useRelativePath));
             }
         }
     }
-}
\ No newline at end of file
+
+    std::vector<uint8_t> Mesh::PackVertices(const std::vector<Vertex>& vertices, VertexFormat format)
+    {
+        const std::size_t stride = format.VertexSize();
+
+        std::vector<uint8_t> packed(vertices.size() * stride);
+        for (std::size_t i = 0; i < vertices.size(); ++i)
+        {
+            const Vertex& v = vertices[i];
+            std::size_t offset = i * stride;
+
+            Put(packed, offset, v.Position);
+            if (format.flags & VertexFormat::TangentFrame)
+            {
+                glm::quat q = QTangent(v);
+                int16_t qt[4] = { PackSnorm16(q.x), PackSnorm16(q.y), PackSnorm16(q.z), PackSnorm16(q.w) };
+                Put(packed, offset, qt);
+            }
+            else
+            {
+                glm::vec2 oct = OctEncode(v.Normal);
+                int16_t n[2] = { PackSnorm16(oct.x), PackSnorm16(oct.y) };
+                Put(packed, offset, n);
+            }
+            uint16_t uv[2] = { glm::packHalf1x16(v.TexCoords.x), glm::packHalf1x16(v.TexCoords.y) };
+            Put(packed, offset, uv);
+            if (format.flags & VertexFormat::Color)
+            {
+                uint8_t c[4] = { PackUnorm8(v.Color.r), PackUnorm8(v.Color.g), PackUnorm8(v.Color.b), PackUnorm8(v.Color.a) };
+                Put(packed, offset, c);
+            }
+            if (format.flags & VertexFormat::Skinned)
+            {
+                uint8_t weights[MAX_BONE_INFLUENCE];
+                for (int b = 0; b < MAX_BONE_INFLUENCE; ++b)
+                    weights[b] = PackUnorm8(v.m_Weights[b]);
+                if (format.flags & VertexFormat::WideBoneIds)
+                {
+                    int32_t ids[MAX_BONE_INFLUENCE];
+                    std::copy(v.m_BoneIDs, v.m_BoneIDs + MAX_BONE_INFLUENCE, ids);
+                    Put(packed, offset, ids);
+                }
+                else
+                {
+                    uint8_t ids[MAX_BONE_INFLUENCE];
+                    for (int b = 0; b < MAX_BONE_INFLUENCE; ++b)
+                        ids[b] = (uint8_t)v.m_BoneIDs[b];
+                    Put(packed, offset, ids);
+                }
+                Put(packed, offset, weights);
+            }
+        }
+        return packed;
+    }
+
+    std::vector<uint8_t> Mesh::PackIndices(const std::vector<unsigned>& indices, VertexFormat format)
+    {
+        std::vector<uint8_t> packed;
+        if (format.shortIndices)
+        {
+            //Padded to whole 32-bit words: the meshlet cull pass reads this buffer as uint[].
+            //It's left out of every index count, so it is never drawn.
+            std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            if (shortIndices.size() % 2)
+                shortIndices.push_back(0);
+            packed.resize(shortIndices.size() * sizeof(unsigned short));
+            std::memcpy(packed.data(), shortIndices.data(), packed.size());
+        }
+        else
+        {
+            packed.resize(indices.size() * sizeof(unsigned));
+            std::memcpy(packed.data(), indices.data(), packed.size());
+        }
+        return packed;
+    }
+
+    void Mesh::ComputeBounds(const std::vector<glm::vec3>& positions, glm::vec3& center, float& radius)
+    {
+        glm::vec3 minP(std::numeric_limits<float>::max()), maxP(-std::numeric_limits<float>::max());
+        for (const auto& p : positions)
+        {
+            minP = glm::min(minP, p);
+            maxP = glm::max(maxP, p);
+        }
+        center = positions.empty() ? glm::vec3(0.f) : (minP + maxP) * 0.5f;
+        radius = 0.f;
+        for (const auto& p : positions)
+            radius = std::max(radius, glm::length(p - center));
+    }
+
+    Mesh::PackedStreams Mesh::PackStreams(const std::vector<Vertex>& vertices, const std::vector<unsigned>& indices,
+        VertexFormat format)
+    {
+        PackedStreams streams;
+        streams.format = format;
+        streams.vertices = PackVertices(vertices, format);
+        streams.indices = PackIndices(indices, format);
+        streams.positions.resize(vertices.size());
+        for (std::size_t i = 0; i < vertices.size(); ++i)
+            streams.positions[i] = vertices[i].Position;
+        ComputeBounds(streams.positions, streams.boundsCenter, streams.boundsRadius);
+        return streams;
+    }
+
+    Mesh::PackedData Mesh::MakePackedData(const PackedStreams& streams, const ModelData& data)
+    {
+        PackedData packed;
+        packed.format = streams.format;
+        packed.vertices = streams.vertices.data();
+        packed.vertexCount = (unsigned)streams.positions.size();
+        packed.indices = streams.indices.data();
+        packed.indexCount = (unsigned)data.indices.size();
+        packed.positions = streams.positions.data();
+        packed.boundsCenter = streams.boundsCenter;
+        packed.boundsRadius = streams.boundsRadius;
+        packed.lods = data.lods;
+        packed.meshlets = data.meshlets.data();
+        packed.meshletCount = (unsigned)data.meshlets.size();
+        packed.textures = data.textures;
+        return packed;
+    }
+
+    void Mesh::CreateVertexStream(const std::vector<Vertex>& vertices, const std::vector<unsigned>& indices)
+    {
+        PackedStreams streams = PackStreams(vertices, indices, m_Format);
+        UploadStreams(streams.vertices.data(), (unsigned)vertices.size(),
+            streams.indices.data(), (unsigned)indices.size(), streams.positions.data());
+        m_BoundsCenter = streams.boundsCenter;
+        m_BoundsRadius = streams.boundsRadius;
+    }
+
+    void Mesh::UploadStreams(const void* vertices, unsigned vertexCount, const void* indices, unsigned indexCount,
+        const glm::vec3* positions)
+    {
+        VertexLayout layout = m_Format.Layout();
+        const std::size_t vertexBytes = std::size_t(vertexCount) * layout.Stride();
+
+        m_VAO = CreateRef<VAO>();
+        m_VBO = CreateRef<VBO>(vertices, vertexBytes, (int)vertexCount);
+        m_VBO->SetLayout(layout);
+        m_GpuBytes = vertexBytes;
+
+        if (indexCount)
+        {
+            if (m_Format.shortIndices)
+                m_EBO = CreateRef<EBO>((const unsigned short*)indices, indexCount);
+            else
+                m_EBO = CreateRef<EBO>((const unsigned*)indices, indexCount);
+            m_GpuBytes += m_EBO->Count() * m_EBO->IndexSize();
+        }
+        m_VAO->AddBuffer(*m_VBO, m_EBO);
+
+        //Depth shaders only read aPos, so they fetch 12 bytes per vertex instead of the full stride.
+        m_DepthVAO = CreateRef<VAO>();
+        m_PositionVBO = CreateRef<VBO>((const void*)positions, std::size_t(vertexCount) * sizeof(glm::vec3), (int)vertexCount);
+        VertexLayout depthLayout
+        {
+            {GL_FLOAT, 3, GL_FALSE} //position
+        };
+        m_PositionVBO->SetLayout(depthLayout);
+        m_DepthVAO->AddBuffer(*m_PositionVBO, m_EBO);
+    }
+
+    void Mesh::CreateMeshletBuffers(const Meshlet* meshlets, unsigned count)
+    {
+        static_assert(sizeof(Meshlet) == 48, "Meshlet must match the std430 layout in meshletCull.shader");
+        m_MeshletCount = count;
+        m_MeshletSSBO = CreateRef<ShaderBlock>("Meshlets", meshlets,
+            std::size_t(count) * sizeof(Meshlet), GL_SHADER_STORAGE_BUFFER);
+    }
+}
@@ -31,7 +31,61 @@ namespace Crave
                 return (lhs.Position == rhs.Position && lhs.Normal == rhs.Normal &&
                     lhs.TexCoords == rhs.TexCoords && lhs.Tangent == rhs.Tangent &&
                     lhs.Bitangent == rhs.Bitangent && lhs.Color == rhs.Color &&
-                    lhs.m_BoneIDs == rhs.m_BoneIDs && lhs.m_Weights == rhs.m_Weights);
+                    std::equal(lhs.m_BoneIDs, lhs.m_BoneIDs + MAX_BONE_INFLUENCE, rhs.m_BoneIDs) &&
+                    std::equal(lhs.m_Weights, lhs.m_Weights + MAX_BONE_INFLUENCE, rhs.m_Weights));
+            }
+        };
+        //GPU vertex layout, chosen per mesh by MeshManager. Positions stay full float so the
+        //depth stream and the shaded passes produce identical depth; everything else is packed:
+        //octahedral normal (2x snorm16) or a QTangent frame (4x snorm16, sign of w is the
+        //bitangent handedness), half-float uvs, and color/skinning only when the mesh has them.
+        //Bone ids are bytes unless one of them doesn't fit, then 32-bit ints.
+        struct VertexFormat
+        {
+            enum Flags : unsigned //Mirrored by VERTEX_* in defs.glsl
+            {
+                None = 0,
+                TangentFrame = 1 << 0,
+                Color = 1 << 1,
+                Skinned = 1 << 2,
+                WideBoneIds = 1 << 3
+            };
+            unsigned flags = None;
+            bool shortIndices = false; //16-bit indices, when every vertex is addressable with them
+
+            unsigned VertexSize() const;
+            VertexLayout Layout() const;
+        };
+        //Range of the shared index buffer drawn at one level of detail. Level 0 is full detail.
+        struct LodLevel
+        {
+            unsigned indexOffset = 0;
+            unsigned indexCount = 0;
+            float error = 0.f; //largest object-space deviation from level 0
+
+            friend bool operator==(const LodLevel& lhs, const LodLevel& rhs)
+            {
+                return (lhs.indexOffset == rhs.indexOffset && lhs.indexCount == rhs.indexCount &&
+                    lhs.error == rhs.error);
+            }
+        };
+        //Run of at most 124 consecutive level 0 triangles over at most 64 vertices, with bounds for
+        //GPU culling. std430 layout, read by meshletCull.shader.
+        struct Meshlet
+        {
+            glm::vec3 center;
+            float radius;
+            glm::vec3 coneAxis;
+            float coneCutoff; //1: normals spread too wide for backface culling
+            unsigned indexOffset;
+            unsigned indexCount;
+            unsigned padding[2];
+
+            friend bool operator==(const Meshlet& lhs, const Meshlet& rhs)
+            {
+                return (lhs.center == rhs.center && lhs.radius == rhs.radius &&
+                    lhs.coneAxis == rhs.coneAxis && lhs.coneCutoff == rhs.coneCutoff &&
+                    lhs.indexOffset == rhs.indexOffset && lhs.indexCount == rhs.indexCount);
             }
         };
         struct PrimitiveData //Data needed to construct a primitive mesh.
@@ -51,8 +105,10 @@ namespace Crave
         struct ModelData //Data needed to construct an imported model mesh.
         {
             std::vector<Vertex> vertices{};
-            std::vector<unsigned> indices{};
+            std::vector<unsigned> indices{}; //all LOD levels back to back
             std::unordered_map<TexType, std::vector<std::string>> textures{};
+            std::vector<LodLevel> lods{};    //empty: indices are a single level
+            std::vector<Meshlet> meshlets{};  //over level 0, may be empty
 
             ModelData() = default;
             ModelData(const ModelData& data) = default;
@@ -60,13 +116,65 @@ namespace Crave
             friend bool operator==(const ModelData& lhs, const ModelData& rhs)
             {
                 return (lhs.vertices == rhs.vertices && lhs.indices == rhs.indices &&
-                    lhs.textures == rhs.textures);
+                    lhs.textures == rhs.textures && lhs.lods == rhs.lods && lhs.meshlets == rhs.meshlets);
             }
         };
+        //Streams already in their GPU layout, e.g. pointing into a mapped cooked model file.
+        //Nothing is copied; the pointers only have to stay valid for the constructor.
+        struct PackedData
+        {
+            VertexFormat format{};
+            const void* vertices = nullptr;       //vertexCount * format.VertexSize() bytes
+            unsigned vertexCount = 0;
+            const void* indices = nullptr;        //see PackIndices
+            unsigned indexCount = 0;              //without the padding PackIndices may add
+            const glm::vec3* positions = nullptr; //depth stream, vertexCount entries
+            glm::vec3 boundsCenter{};
+            float boundsRadius = 0.f;
+            std::vector<LodLevel> lods{};
+            const Meshlet* meshlets = nullptr;
+            unsigned meshletCount = 0;
+            std::unordered_map<TexType, std::vector<std::string>> textures{};
+        };
+        //Owned streams for PackedData, built on the CPU. PackStreams touches no GL or shared state.
+        struct PackedStreams
+        {
+            VertexFormat format{};
+            std::vector<uint8_t> vertices{};
+            std::vector<uint8_t> indices{};
+            std::vector<glm::vec3> positions{};
+            glm::vec3 boundsCenter{};
+            float boundsRadius = 0.f;
+        };
     public:
+        //Interleaved vertex bytes in format's layout.
+        static std::vector<uint8_t> PackVertices(const std::vector<Vertex>& vertices, VertexFormat format);
+        //16-bit indices when format.shortIndices, padded to an even count; 32-bit otherwise.
+        static std::vector<uint8_t> PackIndices(const std::vector<unsigned>& indices, VertexFormat format);
+        //Sphere around the box center, radius to the farthest position.
+        static void ComputeBounds(const std::vector<glm::vec3>& positions, glm::vec3& center, float& radius);
+        static PackedStreams PackStreams(const std::vector<Vertex>& vertices, const std::vector<unsigned>& indices,
+            VertexFormat format);
+        //Points at streams, with the LODs, meshlets and textures of data.
+        static PackedData MakePackedData(const PackedStreams& streams, const ModelData& data);
+
         Ref<VAO> Vao() { return m_VAO; }
+        //Position-only stream sharing the index buffer. For depth and shadow passes.
+        Ref<VAO> DepthVao() { return m_DepthVAO; }
 
         const glm::vec4& UniformColor() const { return m_UniformColor; }
+        const VertexFormat& Format() const { return m_Format; }
+        //Bytes of vertex and index data uploaded for shading (depth stream excluded).
+        std::size_t GpuBytes() const { return m_GpuBytes; }
+        //Never empty. Meshes without an index buffer have one level covering every vertex.
+        const std::vector<LodLevel>& Lods() const { return m_Lods; }
+        //0 for meshes without meshlets.
+        unsigned MeshletCount() const { return m_MeshletCount; }
+        //Meshlet bounds for GPU culling. Null for meshes without meshlets.
+        Ref<ShaderBlock> MeshletSSBO() { return m_MeshletSSBO; }
+        //Object-space bounding sphere
+        const glm::vec3& BoundsCenter() const { return m_BoundsCenter; }
+        float BoundsRadius() const { return m_BoundsRadius; }
 
         std::unordered_map<TexType, std::vector<Ref<Texture>>>& Textures()
         {
@@ -84,18 +192,38 @@ namespace Crave
     private:
         friend class MeshManager;
         //For primitives. Called by MeshManager
-        Mesh(const PrimitiveData& data);
+        Mesh(const PrimitiveData& data, const std::vector<Vertex>& vertices, VertexFormat format);
+
+        //For imported and cooked models. Called by MeshManager
+        Mesh(const PackedData& data);
+
+        //Unpacks a primitive's interleaved float data.
+        static std::vector<Vertex> PrimitiveVertices(Primitive primType);
 
-        //For model import. Called by MeshManager
-        Mesh(const ModelData& data);
+        void CreateVertexStream(const std::vector<Vertex>& vertices, const std::vector<unsigned>& indices);
+        void UploadStreams(const void* vertices, unsigned vertexCount, const void* indices, unsigned indexCount,
+            const glm::vec3* positions);
+        void CreateMeshletBuffers(const Meshlet* meshlets, unsigned count);
+        void LoadTextures(const std::unordered_map<TexType, std::vector<std::string>>& textures, bool useRelativePath);
 
     private:
         glm::vec4 m_UniformColor{};
+        VertexFormat m_Format{};
+        std::size_t m_GpuBytes = 0;
+        std::vector<LodLevel> m_Lods{};
+        glm::vec3 m_BoundsCenter{};
+        float m_BoundsRadius = 0.f;
+
+        unsigned m_MeshletCount = 0;
+        Ref<ShaderBlock> m_MeshletSSBO{};
 
         Ref<VAO> m_VAO{};
         Ref<VBO> m_VBO{};
         Ref<EBO> m_EBO{};
 
+        Ref<VAO> m_DepthVAO{};
+        Ref<VBO> m_PositionVBO{};
+
         std::unordered_map<TexType, std::vector<Ref<Texture>>> m_Textures{};
     };
 
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "MeshManager.h"
+#include "core/Hash.h"
 #include "imgui.h"
 
 namespace Crave
@@ -10,6 +11,86 @@ namespace Crave
 	std::vector<Mesh::PrimitiveData> MeshManager::PrimitiveMeshData{};
 	std::vector<Mesh::ModelData>	 MeshManager::ModelMeshData;
 
+	std::unordered_multimap<uint64_t, size_t> MeshManager::s_PrimitiveByHash{};
+	std::unordered_multimap<uint64_t, size_t> MeshManager::s_ModelByHash{};
+	std::unordered_map<const Mesh*, size_t>	  MeshManager::s_PrimitiveIndex{};
+	std::unordered_map<const Mesh*, size_t>	  MeshManager::s_ModelIndex{};
+
+	MeshManager::Residency					  MeshManager::DefaultResidency = MeshManager::Residency::Full;
+	std::vector<MeshManager::ModelCpuState>	  MeshManager::s_ModelCpuState{};
+
+	namespace //private
+	{
+		//Texture paths in a fixed order, so equal sets hash equally whatever the map's iteration order.
+		uint64_t HashTextures(const std::unordered_map<Mesh::TexType, std::vector<std::string>>& textures, uint64_t seed)
+		{
+			for (auto type : { Mesh::TexType::Diffuse, Mesh::TexType::Specular, Mesh::TexType::Normal, Mesh::TexType::Height })
+			{
+				auto it = textures.find(type);
+				if (it == textures.end())
+					continue;
+				seed = Hash::XXH64(&type, sizeof(type), seed);
+				for (const auto& path : it->second)
+					seed = Hash::String(path, seed);
+			}
+			return seed;
+		}
+
+		uint64_t HashData(const Mesh::PrimitiveData& data)
+		{
+			return HashTextures(data.textures, Hash::XXH64(&data.primType, sizeof(data.primType)));
+		}
+
+		//LODs and meshlets are derived from the vertices and indices, so they don't need hashing.
+		uint64_t HashData(const Mesh::ModelData& data)
+		{
+			uint64_t hash = Hash::Bytes(data.vertices);
+			hash = Hash::Bytes(data.indices, hash);
+			return HashTextures(data.textures, hash);
+		}
+
+		//Vertex and index bytes as imported: full-float Mesh::Vertex, 32-bit indices.
+		std::size_t UnpackedBytes(const Ref<Mesh>& mesh)
+		{
+			std::size_t bytes = mesh->Vao()->Count() * sizeof(Mesh::Vertex);
+			if (mesh->Vao()->Ebo())
+				bytes += mesh->Vao()->Ebo()->Count() * sizeof(unsigned);
+			return bytes;
+		}
+
+		void BuildCollisionData(const Mesh::ModelData& data, MeshManager::CollisionData& collision)
+		{
+			collision.positions.reserve(data.vertices.size());
+			for (const auto& v : data.vertices)
+				collision.positions.push_back(v.Position);
+			unsigned count = data.lods.empty() ? (unsigned)data.indices.size() : data.lods[0].indexCount;
+			collision.indices.assign(data.indices.begin(), data.indices.begin() + count);
+		}
+
+		template<typename T>
+		void FreeVector(std::vector<T>& vec)
+		{
+			std::vector<T>().swap(vec);
+		}
+
+		std::size_t ModelDataBytes(const Mesh::ModelData& data)
+		{
+			return data.vertices.capacity() * sizeof(Mesh::Vertex) + data.indices.capacity() * sizeof(unsigned) +
+				data.lods.capacity() * sizeof(Mesh::LodLevel) + data.meshlets.capacity() * sizeof(Mesh::Meshlet);
+		}
+
+		const char* ResidencyName(MeshManager::Residency residency)
+		{
+			switch (residency)
+			{
+			case MeshManager::Residency::Full:	   return "Full";
+			case MeshManager::Residency::Compact:  return "Compact";
+			case MeshManager::Residency::Released: return "Released";
+			}
+			return "";
+		}
+	}
+
 	void MeshManager::OnImGuiRender(ImGuiWindowFlags panelFlags)
 	{
 
@@ -43,9 +124,81 @@ namespace Crave
 			ImGui::TreePop();
 		}
 
+		ImGui::Separator();
+
+		std::size_t packed = 0, unpacked = 0;
+		for (auto* meshes : { &PrimitiveMeshes, &ModelMeshes })
+		{
+			for (auto& m : *meshes)
+			{
+				packed += m->GpuBytes();
+				unpacked += UnpackedBytes(m);
+			}
+		}
+		ImGui::Text("Vertex memory: %.1f KB (full float: %.1f KB)", packed / 1024.f, unpacked / 1024.f);
+
+		std::size_t counts[3] = {};
+		for (const auto& state : s_ModelCpuState)
+			counts[(int)state.residency]++;
+		ImGui::Text("CPU mesh data: %.1f KB", CpuBytes() / 1024.f);
+		ImGui::Text("Full: %zu  Compact: %zu  Released: %zu", counts[0], counts[1], counts[2]);
+
+		if (ImGui::BeginCombo("New models", ResidencyName(DefaultResidency)))
+		{
+			for (auto r : { Residency::Full, Residency::Compact, Residency::Released })
+			{
+				if (ImGui::Selectable(ResidencyName(r), r == DefaultResidency))
+					DefaultResidency = r;
+			}
+			ImGui::EndCombo();
+		}
+		if (ImGui::Button("Apply to all models"))
+		{
+			std::size_t kept = 0;
+			for (auto& m : ModelMeshes)
+			{
+				if (!SetResidency(m, DefaultResidency))
+					kept++;
+			}
+			if (kept)
+				LOG_WARN("{} model meshes have no cooked data to reload from and stay Full.", kept);
+		}
+
 		ImGui::End();
 	}
 
+	Mesh::VertexFormat MeshManager::ChooseVertexFormat(const std::vector<Mesh::Vertex>& vertices,
+		const std::unordered_map<Mesh::TexType, std::vector<std::string>>& textures)
+	{
+		Mesh::VertexFormat format;
+
+		//Tangents are only read for normal mapping; everything else shades from the normal alone.
+		auto norm = textures.find(Mesh::TexType::Normal);
+		if (norm != textures.end() && !norm->second.empty())
+			format.flags |= Mesh::VertexFormat::TangentFrame;
+
+		//The importer leaves color and bone data zeroed when the source has none.
+		bool wideBoneIds = false;
+		for (const auto& v : vertices)
+		{
+			if (v.Color != glm::vec4(0.f))
+				format.flags |= Mesh::VertexFormat::Color;
+			for (int b = 0; b < MAX_BONE_INFLUENCE; ++b)
+			{
+				if (v.m_Weights[b] > 0.f)
+					format.flags |= Mesh::VertexFormat::Skinned;
+				if (v.m_BoneIDs[b] < 0 || v.m_BoneIDs[b] > std::numeric_limits<uint8_t>::max())
+					wideBoneIds = true;
+			}
+		}
+		//One id out of byte range and the whole mesh keeps them at full width.
+		if ((format.flags & Mesh::VertexFormat::Skinned) && wideBoneIds)
+			format.flags |= Mesh::VertexFormat::WideBoneIds;
+
+		format.shortIndices = vertices.size() <= std::numeric_limits<unsigned short>::max();
+		return format;
+	}
+
 	void MeshManager::Clear()
 	{
 		PrimitiveMeshes.clear();
@@ -53,16 +206,101 @@ namespace Crave
 
 		PrimitiveMeshData.clear();
 		ModelMeshData.clear();
+
+		s_PrimitiveByHash.clear();
+		s_ModelByHash.clear();
+		s_PrimitiveIndex.clear();
+		s_ModelIndex.clear();
+		s_ModelCpuState.clear();
+	}
+
+	bool MeshManager::IsModelMesh(const Ref<Mesh>& mesh)
+	{
+		return s_ModelIndex.find(mesh.get()) != s_ModelIndex.end();
+	}
+
+	uint64_t MeshManager::GetContentHash(const Ref<Mesh>& mesh)
+	{
+		auto it = s_ModelIndex.find(mesh.get());
+		ASSERT(it != s_ModelIndex.end(), "Mesh data not found.");
+
+		return s_ModelCpuState[it->second].hash;
+	}
+
+	const std::string& MeshManager::GetModelSource(const Ref<Mesh>& mesh)
+	{
+		auto it = s_ModelIndex.find(mesh.get());
+		ASSERT(it != s_ModelIndex.end(), "Mesh data not found.");
+
+		return s_ModelCpuState[it->second].source;
+	}
+
+	void MeshManager::SetModelSource(const Ref<Mesh>& mesh, const std::string& modelPath)
+	{
+		auto it = s_ModelIndex.find(mesh.get());
+		ASSERT(it != s_ModelIndex.end(), "Mesh data not found.");
+
+		std::string& source = s_ModelCpuState[it->second].source;
+		if (source.empty())
+			source = modelPath;
+	}
+
+	Ref<Mesh> MeshManager::FindModelMesh(uint64_t contentHash)
+	{
+		auto it = s_ModelByHash.find(contentHash);
+		return it == s_ModelByHash.end() ? nullptr : ModelMeshes[it->second];
+	}
+
+	bool MeshManager::ReleaseModelMesh(const Ref<Mesh>& mesh)
+	{
+		auto it = s_ModelIndex.find(mesh.get());
+		if (it == s_ModelIndex.end() || mesh.use_count() > 2)
+			return false;
+
+		//The last mesh moves into the freed slot, so its lookups are pointed there.
+		size_t index = it->second;
+		size_t last = ModelMeshes.size() - 1;
+		s_ModelIndex.erase(it);
+		for (auto h = s_ModelByHash.begin(); h != s_ModelByHash.end(); ++h)
+		{
+			if (h->second == index)
+			{
+				s_ModelByHash.erase(h);
+				break;
+			}
+		}
+		if (index != last)
+		{
+			for (auto& [hash, i] : s_ModelByHash)
+			{
+				if (i == last)
+					i = index;
+			}
+			s_ModelIndex[ModelMeshes[last].get()] = index;
+			ModelMeshes[index] = std::move(ModelMeshes[last]);
+			ModelMeshData[index] = std::move(ModelMeshData[last]);
+			s_ModelCpuState[index] = std::move(s_ModelCpuState[last]);
+		}
+		ModelMeshes.pop_back();
+		ModelMeshData.pop_back();
+		s_ModelCpuState.pop_back();
+		return true;
 	}
 
 	Ref<Mesh> MeshManager::GetPrimitiveMesh(const Mesh::PrimitiveData& data)
 	{
 		size_t index = 0;
-		if (!getIndex<Mesh::PrimitiveData>(PrimitiveMeshData, data, index))
+		uint64_t hash = HashData(data);
+		auto equal = [&](size_t i) { return PrimitiveMeshData[i] == data; };
+		if (!findByHash(s_PrimitiveByHash, hash, equal, index))
 		{
+			index = PrimitiveMeshData.size();
 			PrimitiveMeshData.push_back(data);
-			Ref<Mesh> m = Ref<Mesh>(new Mesh(data));
+			auto vertices = Mesh::PrimitiveVertices(data.primType);
+			Ref<Mesh> m = Ref<Mesh>(new Mesh(data, vertices, ChooseVertexFormat(vertices, data.textures)));
 			PrimitiveMeshes.push_back(m);
+			s_PrimitiveByHash.emplace(hash, index);
+			s_PrimitiveIndex[m.get()] = index;
 			return m;
 		}
 		return Ref<Mesh>(PrimitiveMeshes[index]);
@@ -71,27 +309,226 @@ namespace Crave
 	Ref<Mesh> MeshManager::GetModelMesh(const Mesh::ModelData& data)
 	{
 		size_t index = 0;
-		if (!getIndex<Mesh::ModelData>(ModelMeshData, data, index))
+		uint64_t hash = HashData(data);
+		auto equal = [&](size_t i) { return sameModel(i, data); };
+		if (findByHash(s_ModelByHash, hash, equal, index))
+			return Ref<Mesh>(ModelMeshes[index]);
+
+		Mesh::VertexFormat format = ChooseVertexFormat(data.vertices, data.textures);
+		return addModelMesh(data, hash, Mesh::PackStreams(data.vertices, data.indices, format));
+	}
+
+	MeshManager::PreparedModel MeshManager::PrepareModelMesh(const Mesh::ModelData& data)
+	{
+		PreparedModel prepared;
+		prepared.hash = HashData(data);
+		Mesh::VertexFormat format = ChooseVertexFormat(data.vertices, data.textures);
+		prepared.streams = Mesh::PackStreams(data.vertices, data.indices, format);
+		return prepared;
+	}
+
+	Ref<Mesh> MeshManager::GetModelMesh(const Mesh::ModelData& data, const PreparedModel& prepared)
+	{
+		size_t index = 0;
+		auto equal = [&](size_t i) { return sameModel(i, data); };
+		if (findByHash(s_ModelByHash, prepared.hash, equal, index))
+			return Ref<Mesh>(ModelMeshes[index]);
+
+		return addModelMesh(data, prepared.hash, prepared.streams);
+	}
+
+	Ref<Mesh> MeshManager::addModelMesh(const Mesh::ModelData& data, uint64_t hash, const Mesh::PackedStreams& streams)
+	{
+		size_t index = ModelMeshData.size();
+		Ref<Mesh> m = Ref<Mesh>(new Mesh(Mesh::MakePackedData(streams, data)));
+		ModelMeshes.push_back(m);
+		s_ModelByHash.emplace(hash, index);
+		s_ModelIndex[m.get()] = index;
+
+		//No loader, so the arrays are kept whatever DefaultResidency says.
+		ModelCpuState state;
+		state.hash = hash;
+		state.vertexCount = data.vertices.size();
+		state.indexCount = data.indices.size();
+		s_ModelCpuState.push_back(std::move(state));
+		ModelMeshData.push_back(data);
+		return m;
+	}
+
+	Ref<Mesh> MeshManager::GetCookedModelMesh(const Mesh::PackedData& data, uint64_t contentHash,
+		std::size_t indexCount, ModelDataLoader loader)
+	{
+		Mesh::ModelData kept;
+		kept.textures = data.textures;
+		kept.lods = data.lods;
+		kept.meshlets.assign(data.meshlets, data.meshlets + data.meshletCount);
+
+		size_t index = 0;
+		auto equal = [&](size_t i) { return sameCounts(i, data.vertexCount, indexCount, kept); };
+		if (findByHash(s_ModelByHash, contentHash, equal, index))
+			return Ref<Mesh>(ModelMeshes[index]);
+
+		index = ModelMeshData.size();
+		Ref<Mesh> m = Ref<Mesh>(new Mesh(data));
+		ModelMeshes.push_back(m);
+		s_ModelByHash.emplace(contentHash, index);
+		s_ModelIndex[m.get()] = index;
+
+		ModelCpuState state;
+		state.residency = DefaultResidency;
+		state.hash = contentHash;
+		state.vertexCount = data.vertexCount;
+		state.indexCount = indexCount;
+		state.loader = std::move(loader);
+		if (DefaultResidency == Residency::Compact)
 		{
-			ModelMeshData.push_back(data);
-			Ref<Mesh> m = Ref<Mesh>(new Mesh(data));
-			ModelMeshes.push_back(m);
-			return m;
+			//The depth stream already is the position copy.
+			state.collision.positions.assign(data.positions, data.positions + data.vertexCount);
+			std::size_t count = data.lods.empty() ? indexCount : data.lods[0].indexCount;
+			state.collision.indices.resize(count);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				state.collision.indices[i] = data.format.shortIndices ?
+					((const unsigned short*)data.indices)[i] : ((const unsigned*)data.indices)[i];
+			}
 		}
-		return Ref<Mesh>(ModelMeshes[index]);
+		s_ModelCpuState.push_back(std::move(state));
+		ModelMeshData.push_back(std::move(kept));
+
+		//Nothing to build Full data from but the loader.
+		ModelCpuState& added = s_ModelCpuState[index];
+		if (added.residency == Residency::Full && !(added.loader && added.loader(ModelMeshData[index])))
+		{
+			LOG_WARN("Cooked mesh data could not be loaded, keeping it released.");
+			added.residency = Residency::Released;
+		}
+		return m;
+	}
+
+	uint64_t MeshManager::ContentHash(const Mesh::ModelData& data)
+	{
+		return HashData(data);
 	}
+
 	const Mesh::PrimitiveData& MeshManager::GetPrimitiveMeshData(Ref<Mesh> mesh)
 	{
-		size_t index = 0;
-		ASSERT(getIndex<Ref<Mesh>>(PrimitiveMeshes, mesh, index), "Mesh data not found.");
+		auto it = s_PrimitiveIndex.find(mesh.get());
+		ASSERT(it != s_PrimitiveIndex.end(), "Mesh data not found.");
 
-		return PrimitiveMeshData[index];
+		return PrimitiveMeshData[it->second];
 	}
 	const Mesh::ModelData& MeshManager::GetModelMeshData(Ref<Mesh> mesh)
 	{
-		size_t index = 0;
-		ASSERT(getIndex<Ref<Mesh>>(ModelMeshes, mesh, index), "Mesh data not found.");
+		auto it = s_ModelIndex.find(mesh.get());
+		ASSERT(it != s_ModelIndex.end(), "Mesh data not found.");
 
+		size_t index = it->second;
+		ModelCpuState& state = s_ModelCpuState[index];
+		if (state.residency != Residency::Full && !state.reloaded)
+		{
+			Mesh::ModelData data;
+			if (state.loader(data))
+			{
+				ModelMeshData[index] = std::move(data);
+				state.reloaded = true;
+			}
+			else
+				LOG_ERROR("Reloading released mesh data failed.");
+		}
 		return ModelMeshData[index];
 	}
+
+	bool MeshManager::SetResidency(const Ref<Mesh>& mesh, Residency residency)
+	{
+		auto it = s_ModelIndex.find(mesh.get());
+		ASSERT(it != s_ModelIndex.end(), "Mesh data not found.");
+
+		size_t index = it->second;
+		ModelCpuState& state = s_ModelCpuState[index];
+		if (state.residency == residency)
+			return true;
+		if (!state.loader)
+			return false;
+
+		//Going up a level needs the full data back first.
+		if (residency == Residency::Full || (residency == Residency::Compact && state.collision.positions.empty()))
+		{
+			GetModelMeshData(mesh);
+			if (state.residency != Residency::Full && !state.reloaded)
+				return false;
+		}
+		state.residency = residency;
+		applyResidency(index);
+		return true;
+	}
+
+	MeshManager::Residency MeshManager::GetResidency(const Ref<Mesh>& mesh)
+	{
+		auto it = s_ModelIndex.find(mesh.get());
+		ASSERT(it != s_ModelIndex.end(), "Mesh data not found.");
+
+		return s_ModelCpuState[it->second].residency;
+	}
+
+	std::size_t MeshManager::CpuBytes()
+	{
+		std::size_t bytes = 0;
+		for (size_t i = 0; i < ModelMeshData.size(); ++i)
+		{
+			const CollisionData& collision = s_ModelCpuState[i].collision;
+			bytes += ModelDataBytes(ModelMeshData[i]);
+			bytes += collision.positions.capacity() * sizeof(glm::vec3) + collision.indices.capacity() * sizeof(unsigned);
+		}
+		return bytes;
+	}
+
+	void MeshManager::applyResidency(size_t index)
+	{
+		ModelCpuState& state = s_ModelCpuState[index];
+		Mesh::ModelData& data = ModelMeshData[index];
+		state.reloaded = false;
+		if (state.residency == Residency::Full)
+			return;
+
+		if (state.residency == Residency::Compact && state.collision.positions.empty())
+			BuildCollisionData(data, state.collision);
+		if (state.residency == Residency::Released)
+		{
+			FreeVector(state.collision.positions);
+			FreeVector(state.collision.indices);
+		}
+		FreeVector(data.vertices);
+		FreeVector(data.indices);
+	}
+
+	bool MeshManager::sameModel(size_t index, const Mesh::ModelData& data)
+	{
+		const ModelCpuState& state = s_ModelCpuState[index];
+		const Mesh::ModelData& stored = ModelMeshData[index];
+		if (state.residency == Residency::Full || state.reloaded)
+			return stored == data;
+
+		//With the arrays gone, the 64-bit content hash already matched; check what is left.
+		if (!sameCounts(index, data.vertices.size(), data.indices.size(), data))
+			return false;
+		if (state.residency == Residency::Compact)
+		{
+			for (size_t v = 0; v < data.vertices.size(); ++v)
+			{
+				if (state.collision.positions[v] != data.vertices[v].Position)
+					return false;
+			}
+			return std::equal(state.collision.indices.begin(), state.collision.indices.end(), data.indices.begin());
+		}
+		return true;
+	}
+
+	bool MeshManager::sameCounts(size_t index, std::size_t vertexCount, std::size_t indexCount,
+		const Mesh::ModelData& data)
+	{
+		const ModelCpuState& state = s_ModelCpuState[index];
+		const Mesh::ModelData& stored = ModelMeshData[index];
+		return state.vertexCount == vertexCount && state.indexCount == indexCount &&
+			stored.textures == data.textures && stored.lods == data.lods && stored.meshlets == data.meshlets;
+	}
 }
\ No newline at end of file
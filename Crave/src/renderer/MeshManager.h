@@ -7,13 +7,72 @@ namespace Crave
 	{
 	private:
 		typedef int ImGuiWindowFlags;
+	public:
+		//What a model mesh keeps in RAM once its buffers are on the GPU.
+		enum class Residency
+		{
+			Full,	 //the ModelData passed to GetModelMesh
+			Compact, //positions and level 0 indices, for CPU raycasts and culling
+			Released //textures, LODs and meshlets only. Reloaded through the mesh's loader when asked for.
+		};
+		//Rebuilds the full data of a released mesh. Returns false when its source is gone.
+		//Only meshes read from the model cache have one; the others stay Full.
+		using ModelDataLoader = std::function<bool(Mesh::ModelData&)>;
+
+		struct CollisionData
+		{
+			std::vector<glm::vec3> positions{};
+			std::vector<unsigned>  indices{}; //level 0 triangles
+		};
+
+		//CPU half of GetModelMesh. PrepareModelMesh touches no GL or MeshManager state,
+		//so importers run it on worker threads.
+		struct PreparedModel
+		{
+			uint64_t hash = 0;
+			Mesh::PackedStreams streams{};
+		};
 	public:
 		static Ref<Mesh> GetPrimitiveMesh(const Mesh::PrimitiveData& data);
 		static Ref<Mesh> GetModelMesh(const Mesh::ModelData& data);
+		static PreparedModel PrepareModelMesh(const Mesh::ModelData& data);
+		//Only uploads prepared's streams when no loaded mesh has the same content.
+		static Ref<Mesh> GetModelMesh(const Mesh::ModelData& data, const PreparedModel& prepared);
+		//For meshes read from the cooked model cache. Only the counts, textures and LODs are compared
+		//on a hash hit; the full data is reachable through loader.
+		static Ref<Mesh> GetCookedModelMesh(const Mesh::PackedData& data, uint64_t contentHash,
+			std::size_t indexCount, ModelDataLoader loader);
+		//Hash GetModelMesh deduplicates by. Stable across runs, so it can be stored.
+		static uint64_t ContentHash(const Mesh::ModelData& data);
 
 		static const Mesh::PrimitiveData& GetPrimitiveMeshData(Ref<Mesh> mesh);
+		//Reloads released data through the mesh's loader. It's kept until the next SetResidency.
 		static const Mesh::ModelData& GetModelMeshData(Ref<Mesh> mesh);
 
+		//False when the mesh has no loader to get its data back through, or the loader failed.
+		static bool SetResidency(const Ref<Mesh>& mesh, Residency residency);
+		static Residency GetResidency(const Ref<Mesh>& mesh);
+		//Bytes of model vertex, index and collision data held in RAM.
+		static std::size_t CpuBytes();
+
+		//Smallest vertex format that keeps everything the mesh uses.
+		static Mesh::VertexFormat ChooseVertexFormat(const std::vector<Mesh::Vertex>& vertices,
+			const std::unordered_map<Mesh::TexType, std::vector<std::string>>& textures);
+
+		//Model meshes are identified by content hash and the model that first brought them in, so
+		//scenes can refer to them without storing geometry.
+		static bool IsModelMesh(const Ref<Mesh>& mesh);
+		static uint64_t GetContentHash(const Ref<Mesh>& mesh);
+		//Path as passed to Scene::ImportModel. Empty for meshes not created by an import.
+		static const std::string& GetModelSource(const Ref<Mesh>& mesh);
+		//Keeps the first source set.
+		static void SetModelSource(const Ref<Mesh>& mesh, const std::string& modelPath);
+		//Null if no loaded model mesh has this content.
+		static Ref<Mesh> FindModelMesh(uint64_t contentHash);
+
+		//Removes a model mesh nothing but the manager and the caller's ref use. False if it's shared.
+		static bool ReleaseModelMesh(const Ref<Mesh>& mesh);
+
 		static void Clear();
 		static void OnImGuiRender(ImGuiWindowFlags panelFlags);
 
@@ -21,16 +80,49 @@ namespace Crave
 		static std::vector<Ref<Mesh>>			ModelMeshes;
 		static std::vector<Mesh::PrimitiveData> PrimitiveMeshData;
 		static std::vector<Mesh::ModelData>		ModelMeshData;
+
+		//Applied to model meshes with a loader as they are created.
+		static Residency DefaultResidency;
 	private:
-		template<typename T>
-		static bool getIndex(const std::vector<T>& vec, const T& item, size_t& index)
+		struct ModelCpuState
 		{
+			Residency residency = Residency::Full;
+			bool reloaded = false; //full data is back for GetModelMeshData
+			uint64_t hash = 0;
+			std::string source{};
+			std::size_t vertexCount = 0;
+			std::size_t indexCount = 0;
+			CollisionData collision{};
+			ModelDataLoader loader{};
+		};
+		static Ref<Mesh> addModelMesh(const Mesh::ModelData& data, uint64_t hash, const Mesh::PackedStreams& streams);
+		static void applyResidency(size_t index);
+		static bool sameModel(size_t index, const Mesh::ModelData& data);
+		static bool sameCounts(size_t index, std::size_t vertexCount, std::size_t indexCount,
+			const Mesh::ModelData& data);
+
+		static std::vector<ModelCpuState> s_ModelCpuState; //index-aligned with ModelMeshData
+		//Content hash -> index into the vectors above. Multimap so a collision only costs a compare.
+		static std::unordered_multimap<uint64_t, size_t> s_PrimitiveByHash;
+		static std::unordered_multimap<uint64_t, size_t> s_ModelByHash;
+		//Mesh -> index into the vectors above.
+		static std::unordered_map<const Mesh*, size_t>	 s_PrimitiveIndex;
+		static std::unordered_map<const Mesh*, size_t>	 s_ModelIndex;
 
-			auto& iter = std::find(vec.begin(), vec.end(), item);
-			if (iter == vec.end())
-				return false;
-			index = iter - vec.begin();
-			return true;
+		template<typename Equal>
+		static bool findByHash(const std::unordered_multimap<uint64_t, size_t>& byHash,
+			uint64_t hash, Equal equal, size_t& index)
+		{
+			auto [first, last] = byHash.equal_range(hash);
+			for (auto it = first; it != last; ++it)
+			{
+				if (equal(it->second))
+				{
+					index = it->second;
+					return true;
+				}
+			}
+			return false;
 		}
 	};
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 
 #include "glad/glad.h"
 #include "geometry/GeoData.h"
+#include "core/JobSystem.h"
+
+#include <chrono>
 
 #include <imgui.h>
 
@@ -21,15 +24,44 @@ namespace Crave
 				Ref<VBO> SkyboxVBO;
 				Ref<Texture> SkyboxTex;
 			};
+			//std140 layout of SceneData in defs.glsl
 			struct SceneData
 			{
-				const glm::mat4 camProjView;
-				const glm::vec3 camPos;
+				glm::mat4 camProjView;
+				glm::vec3 camPos;
 				unsigned lightCount;
 				unsigned castShadows;
+				unsigned padding[3];
+				glm::mat4 camView;
+				glm::uvec4 clusterGrid;
+				glm::vec4 clusterDepth;
+				glm::vec2 viewportSize;
 			};
+			static_assert(offsetof(SceneData, camView) == 96, "SceneData must match shader std140 layout");
+
+			//View frustum is split into froxels; each one gets the list of lights reaching into it.
+			constexpr const glm::uvec3 CLUSTER_GRID = { 16, 9, 24 };
+			constexpr const unsigned   CLUSTER_COUNT = CLUSTER_GRID.x * CLUSTER_GRID.y * CLUSTER_GRID.z;
+			constexpr const unsigned   CLUSTER_SLICES_LINEAR = 1;
+			//Attenuated intensity below which a light is treated as out of range.
+			constexpr const float	   LIGHT_CUTOFF_INTENSITY = 5.f / 256.f;
+
+			constexpr const unsigned LIGHT_SSBO_BINDING = 0;
+			constexpr const unsigned SCENE_UBO_BINDING = 1;
+			constexpr const unsigned CLUSTER_SSBO_BINDING = 2;
+			constexpr const unsigned LIGHT_INDEX_SSBO_BINDING = 3;
+			//meshletCull.shader
+			constexpr const unsigned MESHLET_SSBO_BINDING = 4;
+			constexpr const unsigned MESHLET_SOURCE_INDEX_BINDING = 5;
+			constexpr const unsigned MESHLET_CULLED_INDEX_BINDING = 6;
+			constexpr const unsigned MESHLET_DRAW_CMD_BINDING = 7;
+			constexpr const unsigned MESHLET_CULL_GROUP_SIZE = 64;
+			//DrawElementsIndirectCommand: count, instanceCount, firstIndex, baseVertex, baseInstance
+			constexpr const unsigned MESHLET_DRAW_CMD_SIZE = 5 * sizeof(unsigned);
+			//Starting sizes of the per-frame meshlet rings, they grow when a frame doesn't fit.
+			constexpr const unsigned MESHLET_RING_DRAWS = 1024;
+			constexpr const unsigned MESHLET_RING_INDICES = 1 << 20;
 
-			constexpr const int   MAX_LIGHTS_COUNT = 16; //6
 			constexpr const int   MAX_SFRAME_MIPMAP_LEVEL = 5;
 			constexpr const float SFRAME_MIPMAP_DISTANCE_STEP = 40.f;
 
@@ -39,33 +71,106 @@ namespace Crave
 			constexpr const float SPOT_FAR_PLANE = 250.f;
 			constexpr const float DIR_NEAR_PLANE = -500.f;
 			constexpr const float DIR_FAR_PLANE = 500.f;
-			constexpr const int	  SHADER_LIGHT_SIZE = 176;
+			constexpr const int	  SHADER_LIGHT_SIZE = 192;
+			static_assert(sizeof(LightData) == SHADER_LIGHT_SIZE, "LightData must match shader Light struct");
+
 
+			//A LOD level is used while its simplification error projects to fewer pixels than this.
+			constexpr const float LOD_PIXEL_ERROR = 1.f;
 
 			constexpr const int		   SFRAME_SIZE = 1024;
 			constexpr const glm::ivec2 SATLAS_DIM = { 10, 10 };
 			constexpr const glm::ivec2 SATLAS_SIZE = SATLAS_DIM * SFRAME_SIZE;
 
+			//View that LOD levels are picked for. Shadow setups point it at the light,
+			//DepthRenderEnd puts the camera back.
+			struct LodView
+			{
+				glm::vec3 Position;
+				float ProjScale; //pixels per world unit at distance 1 (or at any distance, if ortho)
+				bool Ortho;
+				float Bias;      //multiplies the allowed pixel error
+			};
+
+			struct ClusterLight
+			{
+				glm::vec3 viewPos;
+				float radius;
+				unsigned index;
+			};
+			//Per-frame light culling state, buffers are kept to avoid reallocating every frame.
+			struct ClusterData
+			{
+				std::vector<ClusterLight> Lights{};
+				std::vector<std::pair<glm::vec3, glm::vec3>> CornerRays{};
+				std::vector<unsigned> SliceLights[CLUSTER_GRID.z];
+				std::vector<unsigned> SliceIndices[CLUSTER_GRID.z];
+				std::vector<glm::uvec2> Ranges = std::vector<glm::uvec2>(CLUSTER_COUNT);
+				std::vector<unsigned> Indices{};
+
+				unsigned MaxLightsPerCluster{};
+				float BuildTimeMs{};
+			};
+
 			struct RenderData
 			{
 				std::unordered_map<ShaderType, Ref<Shader>> Shader;
 				Ref<ShaderBlock> SceneUBO;
-				Ref<ShaderBlock> LightUBO;
+				Ref<ShaderBlock> LightSSBO;
+				Ref<ShaderBlock> ClusterSSBO;
+				Ref<ShaderBlock> LightIndexSSBO;
+				SceneData Scene{};
 
 				int FramesFilledByLevel[MAX_SFRAME_MIPMAP_LEVEL]{};
 				
 				glm::ivec2 NextSAtlasOffset{};
 				std::vector<int> LightIndexByDistance[MAX_SFRAME_MIPMAP_LEVEL];
 				std::vector<LightData> LightDataSubmitted{};
+
+				ClusterData Clusters{};
 				
 				Ref<Framebuffer> ViewportFB;
+				Ref<Framebuffer> GBufferFB;
+				Ref<VAO> FullscreenVAO;
+				ShadingPath Path = ShadingPath::Forward;
+				bool InGBufferPass = false;
+
+				bool DepthPrepass = false;
+
+				LodView CameraLod{};
+				LodView ActiveLod{};
+				float LodBias = 1.f;
+				float ShadowLodBias = 4.f; //shadow maps are blurry and small, coarser geometry is fine
+				unsigned TrianglesDrawn{};
+
+				bool MeshletCulling = true;
+				//Cull output of every meshlet draw in the frame. Each draw takes the next command and
+				//index range, so no draw overwrites what an earlier one still has to read.
+				Ref<ShaderBlock> MeshletCmdRing;
+				Ref<ShaderBlock> MeshletIndexRing;
+				unsigned MeshletCmdHead{};
+				unsigned MeshletIndexHead{};
+
+				//Double buffered, results are read the frame after they were issued.
+				unsigned OpaqueTimerQueries[2]{};
+				unsigned ShadedSampleQueries[2]{};
+				unsigned PrepassSampleQueries[2]{};
+				bool PrepassQueryIssued[2]{};
+				unsigned FrameIndex{};
+				FrameStats Stats{};
+
 				Ref<Framebuffer> DepthMapFBO;
 				Ref<Texture> DepthMap;
+				unsigned ShadowSamplerId{};
+				ShadowFilter ShadowFilterQuality = ShadowFilter::Poisson8;
+				float ShadowFilterRadius = 1.5f;
 				Ref<Camera> Camera;
 
 				std::unordered_map<unsigned, unsigned> TexSlotId;
 
 				unsigned LightsCount;
+				std::vector<bool> LightSlotUsed{};
+				std::vector<unsigned> FreeLightSlots{};
 				unsigned boundVaoId;
 				unsigned boundShaderId;
 				unsigned viewportWidth;
@@ -83,23 +188,47 @@ namespace Crave
 			constexpr short NORM_TEX_SLOT = 2;
 			constexpr short SKYBOX_TEX_SLOT = 7;
 			constexpr short DEPTH_TEX_SLOT = 8;
+			constexpr short GBUF_ALBEDO_SLOT = 9;
+			constexpr short GBUF_DRAWID_SLOT = 10;
+			constexpr short GBUF_NORMAL_SLOT = 11;
+			constexpr short GBUF_MATERIAL_SLOT = 12;
+			constexpr short GBUF_DEPTH_SLOT = 13;
+
+			//u_ObjType values, see defs.glsl
+			constexpr unsigned OBJ_DIFF_ONLY = 0;
+			constexpr unsigned OBJ_DIFF_N_SPEC = 1;
+			constexpr unsigned OBJ_DIFF_N_NORMAL = 2;
+			constexpr unsigned OBJ_UNLIT_COLOR = 3;
 
 			void LoadShaders();
 			void CreateSkybox();
-			void GLDraw(const Ref<VAO> vao);
+			void CreateShadowSampler();
+			void CreateGBuffer(unsigned width, unsigned height);
+			void GLDraw(const Ref<VAO> vao, int instanceCount = 1, const Mesh::LodLevel* lod = nullptr);
+			const Mesh::LodLevel& SelectLod(const glm::mat4& modelMat, const Ref<Mesh>& mesh);
+			bool DrawMeshlets(const Ref<VAO>& vao, const glm::mat4& modelMat, const Ref<Mesh>& mesh,
+				const Mesh::LodLevel& lod, const Ref<Shader>& drawShader);
+			void ResetMeshletRings();
+			LodView ShadowLodView(const glm::vec3& position, const glm::mat4& proj, int framesize, bool ortho);
 
 			glm::ivec2 GetNextOffsetInAtlas();
 			glm::ivec2 GetNextOffsetInAtlasMipmap(int level, int& framesize);
 
+			bool FitsInAtlas(glm::ivec2 offset, int framesize);
+
 			void DepthRenderSetup();
 			void SortLightsByDistance();
 			ShaderType ShadowSetupByLightType(LightData& data, int frameNum, int level);
 
-			void SpotShadowSetup(LightData& data, int frameNum, int mipmapLevel);
-			void DirShadowSetup(LightData& data, int frameNum, int mipmapLevel);
-			void PointShadowSetup(LightData& data, int frameNum, int level);
+			bool SpotShadowSetup(LightData& data, int frameNum, int mipmapLevel);
+			bool DirShadowSetup(LightData& data, int frameNum, int mipmapLevel);
+			bool PointShadowSetup(LightData& data, int frameNum, int level);
+			bool PointParaboloidShadowSetup(LightData& data, int frameNum, int level);
 			void DepthRenderEnd();
 
+			float LightEffectiveRadius(const LightData& data);
+			float ClusterSliceDepth(unsigned slice, float nearPlane, float farPlane, bool linear);
+			void BuildLightClusters();
 			void UploadLightDataToShader();
 
 			void BindShader(const Ref<Shader> shader);
@@ -122,19 +251,46 @@ namespace Crave
 
 			LoadShaders();
 			CreateSkybox();
+			CreateShadowSampler();
+			CreateGBuffer(width, height);
 
+			glGenQueries(2, s_Data->OpaqueTimerQueries);
+			glGenQueries(2, s_Data->ShadedSampleQueries);
+			glGenQueries(2, s_Data->PrepassSampleQueries);
 
-			s_Data->LightUBO = CreateRef<ShaderBlock>(
+			//Light buffers have no fixed cap, they grow with the number of submitted lights.
+			s_Data->LightSSBO = CreateRef<ShaderBlock>(
 				"LightData", (const void*)NULL,
-				MAX_LIGHTS_COUNT * SHADER_LIGHT_SIZE,
-				GL_UNIFORM_BUFFER);
-			s_Data->LightUBO->Bind(0);
+				16 * SHADER_LIGHT_SIZE,
+				GL_SHADER_STORAGE_BUFFER);
+			s_Data->LightSSBO->Bind(LIGHT_SSBO_BINDING);
 
 			s_Data->SceneUBO = CreateRef<ShaderBlock>(
 				"SceneData", (const void*)NULL,
 				256,
 				GL_UNIFORM_BUFFER);
-			s_Data->SceneUBO->Bind(1);
+			s_Data->SceneUBO->Bind(SCENE_UBO_BINDING);
+
+			s_Data->ClusterSSBO = CreateRef<ShaderBlock>(
+				"LightClusters", (const void*)NULL,
+				CLUSTER_COUNT * sizeof(glm::uvec2),
+				GL_SHADER_STORAGE_BUFFER);
+			s_Data->ClusterSSBO->Bind(CLUSTER_SSBO_BINDING);
+
+			s_Data->LightIndexSSBO = CreateRef<ShaderBlock>(
+				"LightIndices", (const void*)NULL,
+				CLUSTER_COUNT * sizeof(unsigned),
+				GL_SHADER_STORAGE_BUFFER);
+			s_Data->LightIndexSSBO->Bind(LIGHT_INDEX_SSBO_BINDING);
+
+			s_Data->MeshletCmdRing = CreateRef<ShaderBlock>(
+				"MeshletDraws", (const void*)NULL,
+				MESHLET_RING_DRAWS * MESHLET_DRAW_CMD_SIZE,
+				GL_SHADER_STORAGE_BUFFER);
+			s_Data->MeshletIndexRing = CreateRef<ShaderBlock>(
+				"MeshletIndices", (const void*)NULL,
+				MESHLET_RING_INDICES * sizeof(unsigned),
+				GL_SHADER_STORAGE_BUFFER);
 
 			{
 				glEnable(GL_CULL_FACE);
@@ -154,35 +310,46 @@ namespace Crave
 			auto& spec = tex[Mesh::TexType::Specular];
 			auto& norm = tex[Mesh::TexType::Normal];
 			Ref<Shader> sh = nullptr;
+			bool gbuffer = s_Data->InGBufferPass;
 
 			if (withTextures)
 			{
-				sh = s_Data->Shader[ShaderType::General];
+				sh = s_Data->Shader[gbuffer ? ShaderType::GBuffer : ShaderType::General];
 				BindShader(sh);
-				BindTexture(s_Data->DepthMap, DEPTH_TEX_SLOT);
+				if (!gbuffer)
+					BindTexture(s_Data->DepthMap, DEPTH_TEX_SLOT);
 				if (!diff.empty() && !norm.empty())
 				{
 					BindTexture(diff[0], DIFF_TEX_SLOT);
 					BindTexture(norm[0], NORM_TEX_SLOT);
-					sh->setUint("u_ObjType", 2);
+					sh->setUint("u_ObjType", OBJ_DIFF_N_NORMAL);
 				}
 				else if (!diff.empty() && !spec.empty())
 				{
 					BindTexture(diff[0], DIFF_TEX_SLOT);
 					BindTexture(spec[0], SPEC_TEX_SLOT);
-					sh->setUint("u_ObjType", 1);
+					sh->setUint("u_ObjType", OBJ_DIFF_N_SPEC);
 				}
 				else if (!diff.empty())
 				{
 				
 					BindTexture(diff[0], DIFF_TEX_SLOT);
-					sh->setUint("u_ObjType", 0);
+					sh->setUint("u_ObjType", OBJ_DIFF_ONLY);
 				}
 				else
 				{
 					//Mesh has no textues. Most likely error.
 					ASSERT(false, "");
 				}
+				sh->setUint("u_VertexFormat", mesh->Format().flags);
+			}
+			else if (gbuffer)
+			{
+				sh = s_Data->Shader[ShaderType::GBuffer];
+				BindShader(sh);
+				sh->setUint("u_ObjType", OBJ_UNLIT_COLOR);
+				sh->setUint("u_VertexFormat", mesh->Format().flags);
+				sh->setFloat4("u_Color", color);
 			}
 			else
 			{
@@ -194,7 +361,9 @@ namespace Crave
 			sh->setMat4f("u_ModelMat", modelMat);
 			sh->setInt("u_DrawId", drawID);
 
-			GLDraw(mesh->Vao());
+			const Mesh::LodLevel& lod = SelectLod(modelMat, mesh);
+			if (!DrawMeshlets(mesh->Vao(), modelMat, mesh, lod, sh))
+				GLDraw(mesh->Vao(), 1, &lod);
 		}
 
 		void DrawOutlined(int drawID, const glm::mat4& modelMat, Ref<Mesh> mesh,
@@ -233,7 +402,7 @@ namespace Crave
 			sh->setMat4f("u_ModelMat", outlineMat);
 			sh->setInt("u_DrawId", drawID);
 
-			GLDraw(mesh->Vao());
+			GLDraw(mesh->Vao(), 1, &SelectLod(modelMat, mesh));
 
 			glStencilMask(0xFF);
 			glStencilFunc(GL_ALWAYS, 1, 0xFF);
@@ -246,9 +415,13 @@ namespace Crave
 			BindShader(sh);
 			sh->setMat4f("u_ModelMat", modelMat);
 
-			BindVAO(mesh->Vao());
+			const Mesh::LodLevel& lod = SelectLod(modelMat, mesh);
+			//Meshlets are culled against the camera, so only the prepass can use them.
+			if (shType == ShaderType::DepthPrepass && DrawMeshlets(mesh->DepthVao(), modelMat, mesh, lod, sh))
+				return;
 
-			GLDraw(mesh->Vao());
+			//Dual-paraboloid shadows render both hemispheres as two instances of one draw.
+			GLDraw(mesh->DepthVao(), shType == ShaderType::PointDepthDP ? 2 : 1, &lod);
 		}
 
 		void RenderLigthDepthToAtlas(std::function<void(ShaderType)> renderDepthFunc)
@@ -264,14 +437,109 @@ namespace Crave
 				{
 					auto& data = s_Data->LightDataSubmitted[libd[i]];
 					ShaderType shType = ShadowSetupByLightType(data, i, lv);
-					renderDepthFunc(shType);
+					if (shType != ShaderType::None)
+						renderDepthFunc(shType);
 				}
 			}
 
+			BuildLightClusters();
 			UploadLightDataToShader();
 			DepthRenderEnd();
 		}
 
+		void BeginOpaquePass(std::function<void(ShaderType)> renderDepthFunc)
+		{
+			unsigned slot = s_Data->FrameIndex % 2;
+			glBeginQuery(GL_TIME_ELAPSED, s_Data->OpaqueTimerQueries[slot]);
+
+			if (s_Data->Path == ShadingPath::Deferred)
+			{
+				const glm::vec2& dim = s_Data->ViewportFB->Dimensions();
+				if (s_Data->GBufferFB->Dimensions() != dim)
+					s_Data->GBufferFB->Invalidate(dim);
+
+				s_Data->GBufferFB->Bind();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+				s_Data->GBufferFB->ClearIntAttachment(-1);
+				s_Data->InGBufferPass = true;
+			}
+
+			s_Data->PrepassQueryIssued[slot] = s_Data->DepthPrepass;
+			if (s_Data->DepthPrepass)
+			{
+				//Depth only first, then shade with GL_EQUAL so each visible pixel is shaded once.
+				Ref<Shader> sh = s_Data->Shader[ShaderType::DepthPrepass];
+				BindShader(sh);
+				sh->setMat4f("u_LightSpaceMat", s_Data->Scene.camProjView);
+
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glBeginQuery(GL_SAMPLES_PASSED, s_Data->PrepassSampleQueries[slot]);
+				renderDepthFunc(ShaderType::DepthPrepass);
+				glEndQuery(GL_SAMPLES_PASSED);
+				glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+				glDepthFunc(GL_EQUAL);
+				glDepthMask(GL_FALSE);
+			}
+			glBeginQuery(GL_SAMPLES_PASSED, s_Data->ShadedSampleQueries[slot]);
+		}
+
+		void EndOpaquePass()
+		{
+			glEndQuery(GL_SAMPLES_PASSED);
+			if (s_Data->PrepassQueryIssued[s_Data->FrameIndex % 2])
+			{
+				glDepthFunc(GL_LESS);
+				glDepthMask(GL_TRUE);
+			}
+
+			if (s_Data->InGBufferPass)
+			{
+				s_Data->InGBufferPass = false;
+				auto& gb = s_Data->GBufferFB;
+				auto& vp = s_Data->ViewportFB;
+				glm::ivec2 dim = vp->Dimensions();
+
+				//Viewport gets the scene depth so skybox and outlines are depth tested as in forward.
+				glBlitNamedFramebuffer(gb->Id(), vp->Id(), 0, 0, dim.x, dim.y, 0, 0, dim.x, dim.y,
+					GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+				vp->Bind();
+
+				Ref<Shader> sh = s_Data->Shader[ShaderType::DeferredLighting];
+				BindShader(sh);
+				sh->setMat4f("u_InvProjViewMat", glm::inverse(s_Data->Scene.camProjView));
+				BindTexture(gb->GetColorAttachment(0), GBUF_ALBEDO_SLOT);
+				BindTexture(gb->GetColorAttachment(1), GBUF_DRAWID_SLOT);
+				BindTexture(gb->GetColorAttachment(2), GBUF_NORMAL_SLOT);
+				BindTexture(gb->GetColorAttachment(3), GBUF_MATERIAL_SLOT);
+				BindTexture(gb->GetDepthAttachment(), GBUF_DEPTH_SLOT);
+				BindTexture(s_Data->DepthMap, DEPTH_TEX_SLOT);
+
+				glDisable(GL_DEPTH_TEST);
+				BindVAO(s_Data->FullscreenVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+				glEnable(GL_DEPTH_TEST);
+			}
+			glEndQuery(GL_TIME_ELAPSED);
+
+			//The other query was issued last frame and is normally done by now.
+			++s_Data->FrameIndex;
+			if (s_Data->FrameIndex > 1)
+			{
+				unsigned prev = s_Data->FrameIndex % 2;
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(s_Data->OpaqueTimerQueries[prev], GL_QUERY_RESULT, &ns);
+				s_Data->Stats.OpaquePassMs = ns / 1e6f;
+
+				glGetQueryObjectuiv(s_Data->ShadedSampleQueries[prev], GL_QUERY_RESULT, &s_Data->Stats.ShadedSamples);
+				s_Data->Stats.PrepassSamples = 0;
+				if (s_Data->PrepassQueryIssued[prev])
+					glGetQueryObjectuiv(s_Data->PrepassSampleQueries[prev], GL_QUERY_RESULT, &s_Data->Stats.PrepassSamples);
+			}
+			const glm::vec2& dim = s_Data->ViewportFB->Dimensions();
+			s_Data->Stats.ViewportPixels = (unsigned)(dim.x * dim.y);
+		}
+
 		void DrawSkybox()
 		{
 			glDepthFunc(GL_LEQUAL);
@@ -297,7 +565,7 @@ namespace Crave
 		{
 			static unsigned posSize = 3 * sizeof(float);
 			int test = sizeof(LightData);
-			s_Data->LightUBO->Upload(pos, posSize, lightIndex * SHADER_LIGHT_SIZE);
+			s_Data->LightSSBO->Upload(pos, posSize, lightIndex * SHADER_LIGHT_SIZE);
 		}
 
 		void SubmitLightData(const LightData& data, unsigned index)
@@ -326,6 +594,7 @@ namespace Crave
 			data.color	     = { 1.f, 1.f, 1.f };
 			data.atlasoffset = { 0, 0 };
 			data.mipmaplevel = 0;
+			data.shadowmode  = PointShadowMode::Cube;
 
 			data.position   = glm::vec3{0.f};
 
@@ -367,14 +636,43 @@ namespace Crave
 			return data;
 		}
 
-		unsigned AddNewLight(const LightData& data)
+		unsigned AddNewLight()
 		{
 			s_Data->LightsCount++;
-			static unsigned lightIndex = 0;
+			unsigned lightIndex;
+			if (!s_Data->FreeLightSlots.empty())
+			{
+				lightIndex = s_Data->FreeLightSlots.back();
+				s_Data->FreeLightSlots.pop_back();
+			}
+			else
+			{
+				lightIndex = (unsigned)s_Data->LightSlotUsed.size();
+				s_Data->LightSlotUsed.push_back(false);
+			}
+			s_Data->LightSlotUsed[lightIndex] = true;
+			return lightIndex;
+		}
 
-			SubmitLightData(data, lightIndex);
-			++lightIndex;
-			return lightIndex - 1;
+		void RemoveLight(unsigned index)
+		{
+			//Scenes can outlive the renderer on shutdown.
+			if (!s_Data || index >= s_Data->LightSlotUsed.size() || !s_Data->LightSlotUsed[index])
+				return;
+			s_Data->LightSlotUsed[index] = false;
+			s_Data->FreeLightSlots.push_back(index);
+			s_Data->LightsCount--;
+		}
+
+		bool ClaimLight(unsigned index)
+		{
+			if (index >= s_Data->LightSlotUsed.size() || s_Data->LightSlotUsed[index])
+				return false;
+			auto& free = s_Data->FreeLightSlots;
+			free.erase(std::find(free.begin(), free.end(), index));
+			s_Data->LightSlotUsed[index] = true;
+			s_Data->LightsCount++;
+			return true;
 		}
 
 		glm::vec4 SetOutlineColor(const glm::vec4& color)
@@ -384,6 +682,45 @@ namespace Crave
 			return old;
 		}
 
+		void SetShadowFilter(ShadowFilter filter, float radius)
+		{
+			s_Data->ShadowFilterQuality = filter;
+			s_Data->ShadowFilterRadius = radius;
+
+			for (ShaderType type : { ShaderType::General, ShaderType::DeferredLighting })
+			{
+				Ref<Shader> sh = s_Data->Shader[type];
+				BindShader(sh);
+				sh->setInt("u_ShadowPCFSamples", (int)filter);
+				sh->setFloat("u_ShadowFilterRadius", radius);
+			}
+		}
+
+		void SetShadingPath(ShadingPath path)
+		{
+			s_Data->Path = path;
+		}
+
+		ShadingPath GetShadingPath()
+		{
+			return s_Data->Path;
+		}
+
+		void SetDepthPrepass(bool enabled)
+		{
+			s_Data->DepthPrepass = enabled;
+		}
+
+		bool DepthPrepassEnabled()
+		{
+			return s_Data->DepthPrepass;
+		}
+
+		const FrameStats& GetFrameStats()
+		{
+			return s_Data->Stats;
+		}
+
 		void ClearState()
 		{
 			s_Data->boundVaoId = 0;
@@ -402,15 +739,39 @@ namespace Crave
 			
 			s_Data->NextSAtlasOffset = { 0, 0 };
 			
-			SceneData data = { cam->GetProjViewMat(), cam->Position(), s_Data->LightsCount, castShadows };
+			//Perspective froxels are sliced exponentially so near clusters stay small,
+			//orthographic depth range goes through zero so it is sliced linearly.
+			float nearPlane = cam->NearPlane();
+			float farPlane = cam->FarPlane();
+			bool linearSlices = !cam->GetIsPerspective();
+
+			SceneData& data = s_Data->Scene;
+			data.camProjView = cam->GetProjViewMat();
+			data.camPos = cam->Position();
+			data.lightCount = 0;
+			data.castShadows = castShadows;
+			data.camView = cam->GetViewMat();
+			data.clusterGrid = glm::uvec4(CLUSTER_GRID, linearSlices ? CLUSTER_SLICES_LINEAR : 0);
+			data.clusterDepth = { nearPlane, farPlane,
+				linearSlices ? 0.f : CLUSTER_GRID.z / std::log(farPlane / nearPlane), 0.f };
+			data.viewportSize = s_Data->ViewportFB->Dimensions();
+
 			s_Data->Camera = cam;
 			s_Data->SceneUBO->Upload((const void*)&data, sizeof(data), 0);
+
+			const glm::mat4& proj = cam->GetProjMat();
+			s_Data->CameraLod = { cam->Position(), proj[1][1] * data.viewportSize.y * 0.5f,
+				!cam->GetIsPerspective(), s_Data->LodBias };
+			s_Data->ActiveLod = s_Data->CameraLod;
+			s_Data->TrianglesDrawn = 0;
+			ResetMeshletRings();
 			
 			s_Data->ViewportFB->Bind();
 		}
 
 		void EndScene()
 		{
+			s_Data->Stats.Triangles = s_Data->TrianglesDrawn;
 			s_Data->ViewportFB->Unbind();
 		}
 
@@ -452,6 +813,31 @@ namespace Crave
 			ImGui::Image((void*)s_Data->DepthMap->Id(), size,
 				ImVec2{ 0, 1 }, ImVec2{ 1, 0 }, tint_col);
 
+			static const ShadowFilter filters[] = {
+				ShadowFilter::Hardware, ShadowFilter::Poisson4, ShadowFilter::Poisson8, ShadowFilter::Poisson16 };
+			static const char* filterNames[] = { "Hardware 2x2", "Poisson 4", "Poisson 8", "Poisson 16" };
+			int currFilter = 0;
+			while (filters[currFilter] != s_Data->ShadowFilterQuality)
+				++currFilter;
+			float radius = s_Data->ShadowFilterRadius;
+			bool filterChanged = ImGui::Combo("Shadow filter", &currFilter, filterNames, IM_ARRAYSIZE(filterNames));
+			filterChanged |= ImGui::SliderFloat("Filter radius (texels)", &radius, 0.5f, 4.f);
+			if (filterChanged)
+				SetShadowFilter(filters[currFilter], radius);
+			ImGui::Separator();
+
+			int path = (int)s_Data->Path;
+			static const char* pathNames[] = { "Forward", "Deferred" };
+			if (ImGui::Combo("Shading path", &path, pathNames, IM_ARRAYSIZE(pathNames)))
+				SetShadingPath((ShadingPath)path);
+			ImGui::Checkbox("Depth prepass", &s_Data->DepthPrepass);
+			ImGui::Text("Opaque pass (GPU): %.3f ms", s_Data->Stats.OpaquePassMs);
+			ImGui::SliderFloat("LOD bias", &s_Data->LodBias, 0.f, 8.f);
+			ImGui::SliderFloat("Shadow LOD bias", &s_Data->ShadowLodBias, 0.f, 16.f);
+			ImGui::Checkbox("Meshlet culling", &s_Data->MeshletCulling);
+			ImGui::Text("Triangles: %u", s_Data->Stats.Triangles);
+			ImGui::Separator();
+
 			ImGui::Text("LightDataSubmitted: %ld", s_Data->LightDataSubmitted.size());
 			ImGui::Separator();
 			for (int lv = 0; lv < MAX_SFRAME_MIPMAP_LEVEL; ++lv)
@@ -459,13 +845,26 @@ namespace Crave
 				auto& libd = s_Data->LightIndexByDistance[lv];
 				ImGui::Text("Mipmap level %d: %ld", lv, libd.size());
 			}
+			ImGui::Separator();
+
+			auto& clusters = s_Data->Clusters;
+			ImGui::Text("Light clusters: %ux%ux%u", CLUSTER_GRID.x, CLUSTER_GRID.y, CLUSTER_GRID.z);
+			ImGui::Text("Lights in frustum: %ld", clusters.Lights.size());
+			ImGui::Text("Cluster light indices: %ld", clusters.Indices.size());
+			ImGui::Text("Max lights per cluster: %u", clusters.MaxLightsPerCluster);
+			ImGui::Text("Cluster build: %.3f ms", clusters.BuildTimeMs);
 
 			ImGui::End();
 		}
 
 		void Shutdown()
 		{
+			glDeleteSamplers(1, &s_Data->ShadowSamplerId);
+			glDeleteQueries(2, s_Data->OpaqueTimerQueries);
+			glDeleteQueries(2, s_Data->ShadedSampleQueries);
+			glDeleteQueries(2, s_Data->PrepassSampleQueries);
 			delete s_Data;
+			s_Data = nullptr;
 		}
 
 		
@@ -518,30 +917,43 @@ namespace Crave
 				glClear(GL_DEPTH_BUFFER_BIT);
 			}
 
-			void SpotShadowSetup(LightData& data, int frameNum, int mipmapLevel)
+			bool FitsInAtlas(glm::ivec2 offset, int framesize)
+			{
+				return offset.x + framesize <= SATLAS_SIZE.x && offset.y + framesize <= SATLAS_SIZE.y;
+			}
+
+			bool SpotShadowSetup(LightData& data, int frameNum, int mipmapLevel)
 			{
 				int framesize{};
 				glm::ivec2 offset = GetNextOffsetInAtlasMipmap(mipmapLevel, framesize);
+				if (!FitsInAtlas(offset, framesize))
+					return false;
 				data.atlasoffset = offset;
 				glViewport(offset.x, offset.y, framesize, framesize);
+				s_Data->ActiveLod = ShadowLodView(data.position, GetSpotLightProjMat(), framesize, false);
 
 				Ref<Shader> sh = s_Data->Shader[ShaderType::SpotDepth];
 				BindShader(sh);
 				sh->setMat4f("u_LightSpaceMat", data.projViewMat);
+				return true;
 			}
 
-			void DirShadowSetup(LightData& data, int frameNum, int mipmapLevel)
+			bool DirShadowSetup(LightData& data, int frameNum, int mipmapLevel)
 			{
 				glm::ivec2 offset = GetNextOffsetInAtlas();
+				if (!FitsInAtlas(offset, SFRAME_SIZE))
+					return false;
 				data.atlasoffset = offset;
 				glViewport(offset.x, offset.y, SFRAME_SIZE, SFRAME_SIZE);
+				s_Data->ActiveLod = ShadowLodView(data.position, GetDirLightProjMat(), SFRAME_SIZE, true);
 
 				Ref<Shader> sh = s_Data->Shader[ShaderType::DirDepth];
 				BindShader(sh);
 				sh->setMat4f("u_LightSpaceMat", data.projViewMat);
+				return true;
 			}
 
-			void PointShadowSetup(LightData& data, int frameNum, int mipmapLevel)
+			bool PointShadowSetup(LightData& data, int frameNum, int mipmapLevel)
 			{
 
 				glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f),
@@ -563,6 +975,10 @@ namespace Crave
 					offset = GetNextOffsetInAtlasMipmap(mipmapLevel, framesize);
 					glViewportIndexedf(i, offset.x, offset.y, framesize, framesize);
 				}
+				//Offsets only grow, so if the last face fits all of them do.
+				if (!FitsInAtlas(offset, framesize))
+					return false;
+				s_Data->ActiveLod = ShadowLodView(data.position, shadowProj, framesize, false);
 
 				auto sh = s_Data->Shader[ShaderType::PointDepth];
 				BindShader(sh);
@@ -571,29 +987,80 @@ namespace Crave
 
 
 				sh->setFloat3("u_LightPos", data.position);
+				return true;
+			}
+
+			bool PointParaboloidShadowSetup(LightData& data, int frameNum, int mipmapLevel)
+			{
+				//Both hemispheres share a single frame: front in the left half, back in the right.
+				int framesize{};
+				glm::ivec2 offset = GetNextOffsetInAtlasMipmap(mipmapLevel, framesize);
+				if (!FitsInAtlas(offset, framesize))
+					return false;
+				data.atlasoffset = offset;
+				glViewport(offset.x, offset.y, framesize, framesize);
+
+				//Each hemisphere covers half the frame with a 180 degree view.
+				s_Data->ActiveLod = { data.position, framesize * 0.25f, false, s_Data->ShadowLodBias };
+
+				auto sh = s_Data->Shader[ShaderType::PointDepthDP];
+				BindShader(sh);
+				sh->setFloat3("u_LightPos", data.position);
+				return true;
 			}
 
 			ShaderType ShadowSetupByLightType(LightData& data, int frameNum, int mipmapLevel)
 			{
 				data.mipmaplevel = mipmapLevel;
 				ShaderType shType;
+				bool fits = false;
 				switch (data.type)
 				{
 				case LightType::Point:
-					PointShadowSetup(data, frameNum, mipmapLevel); //light.ShaderIndex
-					shType = ShaderType::PointDepth;
+					if (data.shadowmode == PointShadowMode::DualParaboloid)
+					{
+						fits = PointParaboloidShadowSetup(data, frameNum, mipmapLevel);
+						shType = ShaderType::PointDepthDP;
+					}
+					else
+					{
+						fits = PointShadowSetup(data, frameNum, mipmapLevel); //light.ShaderIndex
+						shType = ShaderType::PointDepth;
+					}
 					break;
 				case LightType::Spot:
-					SpotShadowSetup(data, frameNum, mipmapLevel);
+					fits = SpotShadowSetup(data, frameNum, mipmapLevel);
 					shType = ShaderType::SpotDepth;
 					break;
 				case LightType::Directional:
-					DirShadowSetup(data, frameNum, mipmapLevel);
+					fits = DirShadowSetup(data, frameNum, mipmapLevel);
 					shType = ShaderType::DirDepth;
 					break;
 				default:
 					ASSERT(false, "");
 				}
+
+				//Atlas is full: the light is still shaded, just without shadow.
+				if (!fits)
+				{
+					data.mipmaplevel = -1;
+					return ShaderType::None;
+				}
+
+				//Paraboloid projection mirrors winding of the back hemisphere
+				//and relies on clip planes at the hemisphere border and at the seam between the halves.
+				if (shType == ShaderType::PointDepthDP)
+				{
+					glDisable(GL_CULL_FACE);
+					glEnable(GL_CLIP_DISTANCE0);
+					glEnable(GL_CLIP_DISTANCE1);
+				}
+				else
+				{
+					glEnable(GL_CULL_FACE);
+					glDisable(GL_CLIP_DISTANCE0);
+					glDisable(GL_CLIP_DISTANCE1);
+				}
 				return shType;
 			}
 
@@ -621,29 +1088,301 @@ namespace Crave
 
 			void DepthRenderEnd()
 			{
+				glEnable(GL_CULL_FACE);
+				glDisable(GL_CLIP_DISTANCE0);
+				glDisable(GL_CLIP_DISTANCE1);
 				s_Data->ViewportFB->Bind();
+				s_Data->ActiveLod = s_Data->CameraLod;
+			}
+
+			float LightEffectiveRadius(const LightData& data)
+			{
+				if (data.type == LightType::Directional)
+					return std::numeric_limits<float>::infinity();
+
+				//Distance d at which peak / (constant + linear * d + quadratic * d^2) drops to the cutoff.
+				glm::vec3 terms = glm::max(glm::max(data.ambient, data.diffuse), data.specular)
+					* data.color * data.brightness;
+				float peak = std::max({ terms.r, terms.g, terms.b });
+				float c = data.constant - peak / LIGHT_CUTOFF_INTENSITY;
+				if (c >= 0.f)
+					return 0.f; //never brighter than the cutoff
+
+				if (data.quadratic > 0.f)
+					return (-data.linear + std::sqrt(data.linear * data.linear - 4.f * data.quadratic * c))
+						/ (2.f * data.quadratic);
+				if (data.linear > 0.f)
+					return -c / data.linear;
+				return std::numeric_limits<float>::infinity();
+			}
+
+			float ClusterSliceDepth(unsigned slice, float nearPlane, float farPlane, bool linear)
+			{
+				float t = (float)slice / CLUSTER_GRID.z;
+				if (linear)
+					return nearPlane + (farPlane - nearPlane) * t;
+				return nearPlane * std::pow(farPlane / nearPlane, t);
+			}
+
+			void BuildLightClusters()
+			{
+				auto start = std::chrono::steady_clock::now();
+
+				auto& cl = s_Data->Clusters;
+				const SceneData& scene = s_Data->Scene;
+				const glm::mat4& view = scene.camView;
+				float nearPlane = scene.clusterDepth.x;
+				float farPlane = scene.clusterDepth.y;
+				bool linear = scene.clusterGrid.w == CLUSTER_SLICES_LINEAR;
+
+				//Lights that can't reach the view depth range or are too dim are dropped here.
+				cl.Lights.clear();
+				for (unsigned i = 0; i < s_Data->LightDataSubmitted.size(); ++i)
+				{
+					LightData& ld = s_Data->LightDataSubmitted[i];
+					float radius = LightEffectiveRadius(ld);
+					if (ld.type == LightType::Directional)
+					{
+						ld.radius = 0.f;
+						cl.Lights.push_back({ glm::vec3(0.f), radius, i });
+						continue;
+					}
+					ld.radius = radius;
+					if (radius <= 0.f)
+						continue;
+
+					glm::vec3 viewPos = view * glm::vec4(ld.position, 1.f);
+					if (-viewPos.z + radius < nearPlane || -viewPos.z - radius > farPlane)
+						continue;
+					cl.Lights.push_back({ viewPos, radius, i });
+				}
+
+				//View-space lines through tile corners. Any froxel is bounded by its 4 corner
+				//lines cut at the slice's depths, which works for both projections.
+				glm::mat4 invProj = glm::inverse(s_Data->Camera->GetProjMat());
+				cl.CornerRays.resize((CLUSTER_GRID.x + 1) * (CLUSTER_GRID.y + 1));
+				for (unsigned y = 0; y <= CLUSTER_GRID.y; ++y)
+				{
+					for (unsigned x = 0; x <= CLUSTER_GRID.x; ++x)
+					{
+						glm::vec2 ndc = glm::vec2(x, y) / glm::vec2(CLUSTER_GRID) * 2.f - 1.f;
+						glm::vec4 n = invProj * glm::vec4(ndc, -1.f, 1.f);
+						glm::vec4 f = invProj * glm::vec4(ndc, 1.f, 1.f);
+						cl.CornerRays[y * (CLUSTER_GRID.x + 1) + x] = { glm::vec3(n) / n.w, glm::vec3(f) / f.w };
+					}
+				}
+
+				//Every depth slice is independent and only writes its own lists.
+				JobSystem::ParallelFor(CLUSTER_GRID.z, 1, [&](std::size_t begin, std::size_t end)
+				{
+					for (unsigned z = (unsigned)begin; z < end; ++z)
+					{
+						float d0 = ClusterSliceDepth(z, nearPlane, farPlane, linear);
+						float d1 = ClusterSliceDepth(z + 1, nearPlane, farPlane, linear);
+
+						auto& sliceLights = cl.SliceLights[z];
+						sliceLights.clear();
+						for (unsigned li = 0; li < cl.Lights.size(); ++li)
+						{
+							const ClusterLight& l = cl.Lights[li];
+							if (-l.viewPos.z + l.radius >= d0 && -l.viewPos.z - l.radius <= d1)
+								sliceLights.push_back(li);
+						}
+
+						auto& sliceIndices = cl.SliceIndices[z];
+						sliceIndices.clear();
+						for (unsigned y = 0; y < CLUSTER_GRID.y; ++y)
+						{
+							for (unsigned x = 0; x < CLUSTER_GRID.x; ++x)
+							{
+								glm::vec3 aabbMin(std::numeric_limits<float>::max());
+								glm::vec3 aabbMax(std::numeric_limits<float>::lowest());
+								for (unsigned corner = 0; corner < 4; ++corner)
+								{
+									auto& [a, b] = cl.CornerRays[(y + corner / 2) * (CLUSTER_GRID.x + 1) + x + corner % 2];
+									for (float d : { d0, d1 })
+									{
+										glm::vec3 p = a + (b - a) * ((-d - a.z) / (b.z - a.z));
+										aabbMin = glm::min(aabbMin, p);
+										aabbMax = glm::max(aabbMax, p);
+									}
+								}
+
+								glm::uvec2& range = cl.Ranges[x + CLUSTER_GRID.x * (y + CLUSTER_GRID.y * z)];
+								range.x = (unsigned)sliceIndices.size();
+								for (unsigned li : sliceLights)
+								{
+									const ClusterLight& l = cl.Lights[li];
+									glm::vec3 closest = glm::clamp(l.viewPos, aabbMin, aabbMax) - l.viewPos;
+									if (glm::dot(closest, closest) <= l.radius * l.radius)
+										sliceIndices.push_back(l.index);
+								}
+								range.y = (unsigned)sliceIndices.size() - range.x;
+							}
+						}
+					}
+				});
+
+				//Stitch per-slice lists into one index buffer.
+				cl.Indices.clear();
+				cl.MaxLightsPerCluster = 0;
+				for (unsigned z = 0; z < CLUSTER_GRID.z; ++z)
+				{
+					unsigned base = (unsigned)cl.Indices.size();
+					unsigned first = CLUSTER_GRID.x * CLUSTER_GRID.y * z;
+					for (unsigned c = first; c < first + CLUSTER_GRID.x * CLUSTER_GRID.y; ++c)
+					{
+						cl.Ranges[c].x += base;
+						cl.MaxLightsPerCluster = std::max(cl.MaxLightsPerCluster, cl.Ranges[c].y);
+					}
+					cl.Indices.insert(cl.Indices.end(), cl.SliceIndices[z].begin(), cl.SliceIndices[z].end());
+				}
+
+				s_Data->ClusterSSBO->Upload(cl.Ranges.data(), CLUSTER_COUNT * sizeof(glm::uvec2), 0);
+				std::size_t indicesSize = cl.Indices.size() * sizeof(unsigned);
+				s_Data->LightIndexSSBO->Reserve(indicesSize);
+				s_Data->LightIndexSSBO->Upload(cl.Indices.data(), indicesSize, 0);
+
+				cl.BuildTimeMs = std::chrono::duration<float, std::milli>(
+					std::chrono::steady_clock::now() - start).count();
 			}
 
 			void UploadLightDataToShader()
 			{
 				size_t size = s_Data->LightDataSubmitted.size() * SHADER_LIGHT_SIZE;
 				const void* data = s_Data->LightDataSubmitted.data();
-				s_Data->LightUBO->Upload(data, size, 0);
+				s_Data->LightSSBO->Reserve(size);
+				s_Data->LightSSBO->Upload(data, size, 0);
+
+				s_Data->Scene.lightCount = (unsigned)s_Data->LightDataSubmitted.size();
+				s_Data->SceneUBO->Upload(&s_Data->Scene.lightCount, sizeof(unsigned),
+					offsetof(SceneData, lightCount));
 			}
 
 
 
-			void GLDraw(const Ref<VAO> vao)
+			void GLDraw(const Ref<VAO> vao, int instanceCount, const Mesh::LodLevel* lod)
 			{
 				BindVAO(vao);
 				auto ebo = vao->Ebo();
 				if (ebo)
 				{
 					ebo->Bind();
-					glDrawElements(GL_TRIANGLES, ebo->Count(), GL_UNSIGNED_INT, 0);
+					unsigned count = lod ? lod->indexCount : ebo->Count();
+					std::size_t offset = lod ? std::size_t(lod->indexOffset) * ebo->IndexSize() : 0;
+					glDrawElementsInstanced(GL_TRIANGLES, count, ebo->Type(), (const void*)offset, instanceCount);
+					s_Data->TrianglesDrawn += count / 3 * instanceCount;
 				}
 				else
-					glDrawArrays(GL_TRIANGLES, 0, vao->Count());
+				{
+					glDrawArraysInstanced(GL_TRIANGLES, 0, vao->Count(), instanceCount);
+					s_Data->TrianglesDrawn += vao->Count() / 3 * instanceCount;
+				}
+			}
+
+			const Mesh::LodLevel& SelectLod(const glm::mat4& modelMat, const Ref<Mesh>& mesh)
+			{
+				const auto& lods = mesh->Lods();
+				if (lods.size() == 1)
+					return lods[0];
+
+				const LodView& view = s_Data->ActiveLod;
+				float scale = std::max({ glm::length(glm::vec3(modelMat[0])),
+					glm::length(glm::vec3(modelMat[1])), glm::length(glm::vec3(modelMat[2])) });
+				glm::vec3 center = modelMat * glm::vec4(mesh->BoundsCenter(), 1.f);
+
+				//Distance to the nearest point of the bounding sphere keeps big meshes detailed up close.
+				float distance = 1.f;
+				if (!view.Ortho)
+					distance = std::max(glm::length(center - view.Position) - mesh->BoundsRadius() * scale, 1e-3f);
+				float pixelsPerUnit = view.ProjScale / distance * scale;
+
+				float allowed = LOD_PIXEL_ERROR * view.Bias;
+				for (std::size_t i = lods.size() - 1; i > 0; --i)
+				{
+					if (lods[i].error * pixelsPerUnit <= allowed)
+						return lods[i];
+				}
+				return lods[0];
+			}
+
+			bool DrawMeshlets(const Ref<VAO>& vao, const glm::mat4& modelMat, const Ref<Mesh>& mesh,
+				const Mesh::LodLevel& lod, const Ref<Shader>& drawShader)
+			{
+				//Coarser levels are already cheap, meshlets only cover level 0.
+				if (!s_Data->MeshletCulling || mesh->MeshletCount() < 2 || &lod != &mesh->Lods()[0])
+					return false;
+
+				glm::vec3 axisScale = { glm::length(glm::vec3(modelMat[0])),
+					glm::length(glm::vec3(modelMat[1])), glm::length(glm::vec3(modelMat[2])) };
+				float maxScale = std::max({ axisScale.x, axisScale.y, axisScale.z });
+				float minScale = std::min({ axisScale.x, axisScale.y, axisScale.z });
+				//The cull shader turns cone axes with the model matrix itself, which only keeps them normal to
+				//their triangles, and their cutoffs valid, under uniform scale without mirroring. Cones also
+				//need a camera position.
+				const bool uniformScale = maxScale - minScale <= 1e-3f * maxScale;
+				const bool mirrored = glm::determinant(glm::mat3(modelMat)) < 0.f;
+				const bool coneCulling = !s_Data->CameraLod.Ortho && uniformScale && !mirrored;
+
+				//A ring that fills up grows, which gives it new storage: draws already issued keep reading
+				//the old one, and the frame starts over at the front of both.
+				const unsigned level0 = lod.indexCount;
+				auto& cmds = s_Data->MeshletCmdRing;
+				auto& indices = s_Data->MeshletIndexRing;
+				const std::size_t cmdsEnd = std::size_t(s_Data->MeshletCmdHead + 1) * MESHLET_DRAW_CMD_SIZE;
+				const std::size_t indicesEnd = std::size_t(s_Data->MeshletIndexHead + level0) * sizeof(unsigned);
+				if (cmdsEnd > cmds->Size() || indicesEnd > indices->Size())
+				{
+					cmds->Reserve(cmdsEnd);
+					indices->Reserve(indicesEnd);
+					ResetMeshletRings();
+				}
+				const unsigned drawCmd = s_Data->MeshletCmdHead++;
+				const unsigned firstIndex = s_Data->MeshletIndexHead;
+				s_Data->MeshletIndexHead += level0;
+
+				Ref<Shader> cull = s_Data->Shader[ShaderType::MeshletCull];
+				BindShader(cull);
+				cull->setMat4f("u_ModelMat", modelMat);
+				cull->setFloat("u_ModelScale", maxScale);
+				cull->setUint("u_MeshletCount", mesh->MeshletCount());
+				cull->setBool("u_ShortIndices", vao->Ebo()->Type() == GL_UNSIGNED_SHORT);
+				cull->setBool("u_ConeCulling", coneCulling);
+				cull->setUint("u_DrawCmd", drawCmd);
+				cull->setUint("u_FirstIndex", firstIndex);
+				mesh->MeshletSSBO()->Bind(MESHLET_SSBO_BINDING);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESHLET_SOURCE_INDEX_BINDING, vao->Ebo()->Id());
+				indices->Bind(MESHLET_CULLED_INDEX_BINDING);
+				cmds->Bind(MESHLET_DRAW_CMD_BINDING);
+				glDispatchCompute((mesh->MeshletCount() + MESHLET_CULL_GROUP_SIZE - 1) / MESHLET_CULL_GROUP_SIZE, 1, 1);
+				glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
+
+				//Swaps the VAO's element buffer; GLDraw binds the mesh's own one back on the next draw.
+				BindShader(drawShader);
+				BindVAO(vao);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices->Id());
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds->Id());
+				glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(std::size_t(drawCmd) * MESHLET_DRAW_CMD_SIZE));
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+				//Upper bound, the surviving count stays on the GPU.
+				s_Data->TrianglesDrawn += lod.indexCount / 3;
+				return true;
+			}
+
+			void ResetMeshletRings()
+			{
+				s_Data->MeshletCmdHead = 0;
+				s_Data->MeshletIndexHead = 0;
+				//Counts start at zero; the cull pass writes the rest of each command.
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_Data->MeshletCmdRing->Id());
+				glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			}
+
+			LodView ShadowLodView(const glm::vec3& position, const glm::mat4& proj, int framesize, bool ortho)
+			{
+				return { position, proj[1][1] * framesize * 0.5f, ortho, s_Data->ShadowLodBias };
 			}
 
 			void BindShader(const Ref<Shader> shader)
@@ -694,7 +1433,36 @@ namespace Crave
 				sh->setInt2("u_SAtlasSize", SATLAS_SIZE);
 				sh->setFloat("u_PointLightFarPlane", POINT_FAR_PLANE);
 				sh->setFloat("u_SpotLightFarPlane", SPOT_FAR_PLANE);
-				
+				sh->setInt("u_ShadowPCFSamples", (int)s_Data->ShadowFilterQuality);
+				sh->setFloat("u_ShadowFilterRadius", s_Data->ShadowFilterRadius);
+
+
+				sh = s_Data->Shader[ShaderType::GBuffer] = CreateRef<Shader>(
+					std::unordered_map<Shader::Type, std::string>{
+						{ Shader::Type::VERTEX, "general.vert" },
+						{ Shader::Type::FRAGMENT, "gbuffer.frag" }});
+				sh->Bind();
+				sh->setInt("material.diffuseTex", DIFF_TEX_SLOT);
+				sh->setInt("material.specularTex", SPEC_TEX_SLOT);
+				sh->setInt("material.normalTex", NORM_TEX_SLOT);
+				sh->setFloat("material.specularFloat", 0.5f);
+				sh->setFloat("material.shininess", 32.0f);
+
+				sh = s_Data->Shader[ShaderType::DeferredLighting] = CreateRef<Shader>("deferredLighting.shader");
+				sh->Bind();
+				sh->setInt("u_GAlbedo", GBUF_ALBEDO_SLOT);
+				sh->setInt("u_GDrawID", GBUF_DRAWID_SLOT);
+				sh->setInt("u_GNormal", GBUF_NORMAL_SLOT);
+				sh->setInt("u_GMaterial", GBUF_MATERIAL_SLOT);
+				sh->setInt("u_GDepth", GBUF_DEPTH_SLOT);
+				sh->setInt("u_SAtlas", DEPTH_TEX_SLOT);
+				sh->setInt("u_SAtlasFramesPerRow", SATLAS_DIM.x);
+				sh->setInt("u_SFrameSize", SFRAME_SIZE);
+				sh->setInt2("u_SAtlasSize", SATLAS_SIZE);
+				sh->setFloat("u_PointLightFarPlane", POINT_FAR_PLANE);
+				sh->setFloat("u_SpotLightFarPlane", SPOT_FAR_PLANE);
+				sh->setInt("u_ShadowPCFSamples", (int)s_Data->ShadowFilterQuality);
+				sh->setFloat("u_ShadowFilterRadius", s_Data->ShadowFilterRadius);
 
 				s_Data->Shader[ShaderType::UniformColor] = CreateRef<Shader>("color.shader");
 
@@ -710,11 +1478,20 @@ namespace Crave
 				sh->Bind();
 				sh->setFloat("u_FarPlane", POINT_FAR_PLANE);
 
+				sh = s_Data->Shader[ShaderType::PointDepthDP] = CreateRef<Shader>("pointDepthDP.shader");
+				sh->Bind();
+				sh->setFloat("u_FarPlane", POINT_FAR_PLANE);
+
 				sh = s_Data->Shader[ShaderType::DirDepth] = CreateRef<Shader>("dirDepth.shader");
+
+				//Same position-only program, u_LightSpaceMat gets the camera's matrix instead.
+				sh = s_Data->Shader[ShaderType::DepthPrepass] = CreateRef<Shader>("dirDepth.shader");
 			
 				sh = s_Data->Shader[ShaderType::SpotDepth] = CreateRef<Shader>("spotDepth.shader");
 				sh->Bind();
 				sh->setFloat("u_FarPlane", SPOT_FAR_PLANE);
+
+				s_Data->Shader[ShaderType::MeshletCull] = CreateRef<Shader>("meshletCull.shader");
 			}
 
 			void CreateSkybox()
@@ -732,6 +1509,38 @@ namespace Crave
 				s_Data->skyboxData.SkyboxVAO->AddBuffer(*s_Data->skyboxData.SkyboxVBO, nullptr);
 				s_Data->skyboxData.SkyboxTex = CreateRef<Texture>("skybox", SKYBOX_FACES);
 			}
+
+			void CreateGBuffer(unsigned width, unsigned height)
+			{
+				//Attachment order matches gbuffer.frag outputs; draw ID stays at 1 like in the viewport.
+				s_Data->GBufferFB = CreateRef<Framebuffer>(Framebuffer::Config{
+					true, std::initializer_list<Texture::Config>{
+					{ Texture::Type::RGBA, Texture::Target::Texture2D, Texture::MMFilter::Nearest, Texture::WrapMode::ClampToEdge },
+					{ Texture::Type::Integer, Texture::Target::Texture2D, Texture::MMFilter::Nearest, Texture::WrapMode::ClampToEdge },
+					{ Texture::Type::RGBA16F, Texture::Target::Texture2D, Texture::MMFilter::Nearest, Texture::WrapMode::ClampToEdge },
+					{ Texture::Type::RGBA, Texture::Target::Texture2D, Texture::MMFilter::Nearest, Texture::WrapMode::ClampToEdge },
+					{ Texture::Type::DepthNStencil, Texture::Target::Texture2D, Texture::MMFilter::Nearest, Texture::WrapMode::ClampToEdge }
+				} });
+				s_Data->GBufferFB->Invalidate(glm::vec2(width, height));
+
+				//Lighting pass generates a fullscreen triangle from gl_VertexID but GL still wants a VAO bound.
+				s_Data->FullscreenVAO = CreateRef<VAO>();
+			}
+
+			void CreateShadowSampler()
+			{
+				//Sampler object overrides the atlas' own parameters only on the depth slot,
+				//so the raw depth can still be displayed in the debug window.
+				unsigned& id = s_Data->ShadowSamplerId;
+				glGenSamplers(1, &id);
+				glSamplerParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glSamplerParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glSamplerParameteri(id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glSamplerParameteri(id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				glSamplerParameteri(id, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+				glSamplerParameteri(id, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+				glBindSampler(DEPTH_TEX_SLOT, id);
+			}
 		}
 	}
 }
\ No newline at end of file
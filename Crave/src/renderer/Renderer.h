@@ -21,6 +21,14 @@ namespace Crave
 		None = -1, Directional, Point, Spot
 	};
 
+	//How a point light's shadow is stored in the atlas.
+	//Cube: 6 frames rendered through a geometry shader.
+	//DualParaboloid: 2 hemispheres packed into one frame, rendered with instancing.
+	enum class PointShadowMode
+	{
+		Cube, DualParaboloid
+	};
+
 
 	struct LightData
 	{
@@ -40,16 +48,45 @@ namespace Crave
 		LightType type; //alignas(8) 
 		int mipmaplevel;
 		glm::ivec2 atlasoffset;
+		PointShadowMode shadowmode;
+		float radius; //Effective range, filled by the renderer from attenuation
+		int padding[2]; //std430 array stride
+	};
+	
+	//Number of hardware-filtered taps taken per shadow lookup.
+	enum class ShadowFilter
+	{
+		Hardware = 1, Poisson4 = 4, Poisson8 = 8, Poisson16 = 16
 	};
 	
 	enum class ShaderType
 	{
-		None = -1, General, PointDepth, DirDepth, SpotDepth, Skybox, UniformColor,
-		AttribColor, Diffuse, DiffNSpec, NormalMap
+		None = -1, General, PointDepth, PointDepthDP, DirDepth, SpotDepth, Skybox, UniformColor,
+		AttribColor, Diffuse, DiffNSpec, NormalMap, GBuffer, DeferredLighting, DepthPrepass, MeshletCull
+	};
+
+	//Forward shades every rasterized fragment.
+	//Deferred fills a G-buffer first and then lights every visible pixel once.
+	enum class ShadingPath
+	{
+		Forward, Deferred
+	};
+
+	//GPU timings are read back one frame late to avoid stalling on the queries.
+	struct FrameStats
+	{
+		float OpaquePassMs;
+		unsigned ShadedSamples;  //fragments that passed the depth test in the shading pass
+		unsigned PrepassSamples; //fragments written by the depth prepass, 0 if it is off
+		unsigned ViewportPixels;
+		unsigned Triangles;      //submitted this frame in all passes, counted on the CPU
 	};
 
 	namespace Renderer
 	{
+		//Light slot of a light no scene has taken one for.
+		constexpr unsigned NO_LIGHT = ~0u;
+
 		void DrawMesh(int drawID, const glm::mat4& modelMat, Ref<Mesh> mesh,
 			bool withTextures, glm::vec4 color = { 1.f, 0.f, 1.f, 1.f });
 
@@ -58,11 +95,22 @@ namespace Crave
 		void DrawDepth(const glm::mat4& modelMat, Ref<Mesh> mesh, ShaderType shType);
 
 		void RenderLigthDepthToAtlas(std::function<void(ShaderType)> renderDepthFunc);
+
+		//Opaque geometry goes between these. In deferred mode it lands in the G-buffer
+		//and is lit on EndOpaquePass; anything drawn after is forward shaded.
+		//renderDepthFunc draws the same geometry depth-only and is called if depth prepass is on.
+		void BeginOpaquePass(std::function<void(ShaderType)> renderDepthFunc);
+		void EndOpaquePass();
 		
 		void DrawSkybox();
 
 		LightData GetDefaultLightData(LightType type);
-		unsigned AddNewLight(const LightData& data);
+		//Slots freed by RemoveLight are handed out again first. Only reserves the slot: the light is
+		//submitted by its per-frame update, like every other.
+		unsigned AddNewLight();
+		void RemoveLight(unsigned index);
+		//Takes index back for a light restored with the slot it had. False if the slot is in use.
+		bool ClaimLight(unsigned index);
 
 		void SubmitLightData(const LightData& data, unsigned index);
 
@@ -74,6 +122,13 @@ namespace Crave
 		void Shutdown();
 
 		glm::vec4 SetOutlineColor(const glm::vec4& color);
+		void SetShadowFilter(ShadowFilter filter, float radius);
+
+		void SetShadingPath(ShadingPath path);
+		ShadingPath GetShadingPath();
+		void SetDepthPrepass(bool enabled);
+		bool DepthPrepassEnabled();
+		const FrameStats& GetFrameStats();
 
 		void Clear(int mode);
 		void SetClearColor(float r, float g, float b, float a);
@@ -73,7 +73,7 @@ namespace Crave
 
 			Type type = Type::NONE;
 			std::string line;
-			std::stringstream ss[3];
+			std::stringstream ss[4];
 
 			while (getline(shaderFile, line))
 			{
@@ -91,6 +91,10 @@ namespace Crave
 					{
 						type = Type::GEOMETRY;
 					}
+					else if (line.find("compute") != std::string::npos)
+					{
+						type = Type::COMPUTE;
+					}
 					else
 					{
 						shaderFile.close();
@@ -116,9 +120,11 @@ namespace Crave
 			m_Data[Type::VERTEX].code   = ss[(int)Type::VERTEX].str();
 			m_Data[Type::FRAGMENT].code = ss[(int)Type::FRAGMENT].str();
 			m_Data[Type::GEOMETRY].code = ss[(int)Type::GEOMETRY].str();
+			m_Data[Type::COMPUTE].code  = ss[(int)Type::COMPUTE].str();
 			ParseIncludes(m_Data[Type::VERTEX].code, shaderPath);
 			ParseIncludes(m_Data[Type::FRAGMENT].code, shaderPath);
 			ParseIncludes(m_Data[Type::GEOMETRY].code, shaderPath);
+			ParseIncludes(m_Data[Type::COMPUTE].code, shaderPath);
 		}
 		catch (std::ifstream::failure& e)
 		{
@@ -128,30 +134,23 @@ namespace Crave
 
 	void Shader::Compile()
 	{
-		auto& v = m_Data[Type::VERTEX];
-		const char* shaderCode = v.code.c_str();
-		// vertex shader
-		v.id = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(v.id, 1, &shaderCode, NULL);
-		glCompileShader(v.id);
-		checkCompileErrors(v.id, "VERTEX");
-		// fragment Shader
-		auto& f = m_Data[Type::FRAGMENT];
-		shaderCode = f.code.c_str();
-		f.id = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(f.id, 1, &shaderCode, NULL);
-		glCompileShader(f.id);
-		checkCompileErrors(f.id, "FRAGMENT");
-		// geometry Shader
+		//Stages without code are skipped, so compute-only programs work too.
+		CompileStage(Type::VERTEX, GL_VERTEX_SHADER, "VERTEX");
+		CompileStage(Type::FRAGMENT, GL_FRAGMENT_SHADER, "FRAGMENT");
+		CompileStage(Type::GEOMETRY, GL_GEOMETRY_SHADER, "GEOMETRY");
+		CompileStage(Type::COMPUTE, GL_COMPUTE_SHADER, "COMPUTE");
+	}
 
-		auto& g = m_Data[Type::GEOMETRY];
-		if (g.code.empty())
+	void Shader::CompileStage(Type type, unsigned glType, const char* name)
+	{
+		auto& stage = m_Data[type];
+		if (stage.code.empty())
 			return;
-		shaderCode = g.code.c_str();
-		g.id = glCreateShader(GL_GEOMETRY_SHADER);
-		glShaderSource(g.id, 1, &shaderCode, NULL);
-		glCompileShader(g.id);
-		checkCompileErrors(g.id, "GEOMETRY");
+		const char* shaderCode = stage.code.c_str();
+		stage.id = glCreateShader(glType);
+		glShaderSource(stage.id, 1, &shaderCode, NULL);
+		glCompileShader(stage.id);
+		checkCompileErrors(stage.id, name);
 	}
 
 	void Shader::Link()
@@ -8,7 +8,7 @@ namespace Crave
 	{
 	public:
 		enum class Type {
-			NONE = -1, VERTEX = 0, FRAGMENT = 1, GEOMETRY = 2
+			NONE = -1, VERTEX = 0, FRAGMENT = 1, GEOMETRY = 2, COMPUTE = 3
 		};
 	public:
 		Shader(const std::string& shaderPath);
@@ -41,6 +41,7 @@ namespace Crave
 		void Parse(const std::unordered_map<Type, std::string>& config);
 		void ParseIncludes(std::string& code, std::string filename);
 		void Compile();
+		void CompileStage(Type type, unsigned glType, const char* name);
 
 		void Link();
 		const int GetUniformLocation(const std::string& name);
@@ -5,19 +5,39 @@
 
 namespace Crave
 {
+	std::string Texture::ResolvePath(const std::string& texName, bool useRelativePath)
+	{
+		return useRelativePath ? BASE_TEXTURE_PATH + texName : texName;
+	}
+
+	Texture::Image Texture::Decode(const std::string& texName, bool useRelativePath)
+	{
+		Image image;
+		image.path = ResolvePath(texName, useRelativePath);
+		//The flip flag is per thread here, so concurrent decodes (and cubemaps) don't race on it.
+		stbi_set_flip_vertically_on_load_thread(1);
+		int BPP;
+		unsigned char* data = stbi_load(image.path.c_str(), &image.width, &image.height, &BPP, 4);
+		if (!data)
+		{
+			std::cerr << "Error: Failed to load texture! " << image.path << std::endl;
+			image.width = image.height = 0;
+			return image;
+		}
+		image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+		return image;
+	}
+
 	Texture::Texture(const std::string& texName, bool useRelativePath)
+		: Texture(Decode(texName, useRelativePath))
+	{
+	}
+
+	Texture::Texture(const Image& image)
 		: m_Id(-1), m_BoundSlot(-1), m_Target(GL_TEXTURE_2D)
 	{
 		glGenTextures(1, &m_Id);
 		glBindTexture(GL_TEXTURE_2D, m_Id);
-		stbi_set_flip_vertically_on_load(1);
-		std::string fullPath = texName;
-		if (useRelativePath)
-			fullPath = BASE_TEXTURE_PATH + fullPath;
-		int width, height, BPP;
-		unsigned char* data = stbi_load(fullPath.c_str(), &width, &height, &BPP, 4);
-		if (!data)
-			std::cerr << "Error: Failed to load texture! " << fullPath << std::endl;
 
 		// set texture wrapping to GL_REPEAT (default wrapping method)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -26,11 +46,10 @@ namespace Crave
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+			image.pixels.get());
 
 		glBindTexture(GL_TEXTURE_2D, 0);
-		if (data)
-			stbi_image_free(data);
 	}
 
 	Texture::Texture(const std::string& folderName, const char* faces[])
@@ -40,7 +59,7 @@ namespace Crave
 		std::string fullPath = basePath;
 		glGenTextures(1, &m_Id);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, m_Id);
-		stbi_set_flip_vertically_on_load(false);
+		stbi_set_flip_vertically_on_load_thread(0);
 
 		int width, height, BPP;
 		for (unsigned i = 0; i < 6; i++)
@@ -85,6 +104,9 @@ namespace Crave
 			case Type::RGBA:
 				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, dimensions.x, dimensions.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 				break;
+			case Type::RGBA16F:
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, dimensions.x, dimensions.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+				break;
 			case Type::Depth:
 			{
 				glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, dimensions.x, dimensions.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
@@ -25,7 +25,7 @@ namespace Crave
 		};
 		enum class Type : int
 		{
-			None = -1, RGBA, Depth, DepthNStencil, Integer
+			None = -1, RGBA, RGBA16F, Depth, DepthNStencil, Integer
 		};
 
 		struct Config //Texture configuration
@@ -43,15 +43,32 @@ namespace Crave
 				: type(tp), target(trg), filter(fil), wrapMode(wm) {}
 		};
 
+		//Decoded RGBA8 pixels, flipped for GL. Empty pixels when the file couldn't be read.
+		struct Image
+		{
+			std::string path{};
+			int width = 0;
+			int height = 0;
+			std::shared_ptr<unsigned char> pixels{};
+		};
+
 	private:
 		static constexpr const char* BASE_TEXTURE_PATH = "res/textures/";
 		static constexpr const char* BASE_CUBEMAP_PATH = "res/textures/cubemaps/";
 	public:
 		Texture() {}
+		//File path as Texture(texName, useRelativePath) opens it.
+		static std::string ResolvePath(const std::string& texName, bool useRelativePath = true);
+		//Reads and decodes without touching GL, so it can run on any thread.
+		static Image Decode(const std::string& texName, bool useRelativePath = true);
+
 		//For texture loading from "res/textures" folder
 		Texture(const std::string& texName, bool useRelativePath = true);//, TexConfig config = {
 		//Target::Texture2D, Type::Color, MMFilter::Linear, WrapMode::Repeat}
 		 
+		//Uploads an image from Decode
+		Texture(const Image& image);
+
 		//For loading of cubemaps from "res/textures/cubemaps" folder
 		Texture(const std::string& folderName,
 			const char* faces[]);
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include "TextureManager.h"
+#include "core/JobSystem.h"
+
+namespace Crave
+{
+	std::unordered_map<std::string, Ref<Texture>> TextureManager::Textures{};
+
+	Ref<Texture> TextureManager::GetTexture(const std::string& texName, bool useRelativePath)
+	{
+		std::string path = Texture::ResolvePath(texName, useRelativePath);
+		auto it = Textures.find(path);
+		if (it != Textures.end())
+			return it->second;
+
+		Ref<Texture> texture = CreateRef<Texture>(path, false);
+		Textures.emplace(path, texture);
+		return texture;
+	}
+
+	TextureManager::PendingTextures TextureManager::DecodeAsync(const std::vector<std::string>& texNames,
+		bool useRelativePath)
+	{
+		PendingTextures pending;
+		std::unordered_set<std::string> queued;
+		for (const auto& name : texNames)
+		{
+			std::string path = Texture::ResolvePath(name, useRelativePath);
+			if (Textures.count(path) || !queued.insert(path).second)
+				continue;
+
+			pending.images.push_back(std::make_unique<Texture::Image>());
+			Texture::Image* image = pending.images.back().get();
+			pending.done.push_back(JobSystem::Submit([image, path]() { *image = Texture::Decode(path, false); }));
+			pending.paths.push_back(path);
+		}
+		return pending;
+	}
+
+	void TextureManager::Upload(PendingTextures& pending)
+	{
+		for (std::size_t i = 0; i < pending.images.size(); ++i)
+		{
+			pending.done[i].get();
+			const Texture::Image& image = *pending.images[i];
+			if (!Textures.count(image.path))
+				Textures.emplace(image.path, CreateRef<Texture>(image));
+		}
+		pending.images.clear();
+		pending.done.clear();
+		pending.paths.clear();
+	}
+
+	bool TextureManager::UploadReady(PendingTextures& pending, std::chrono::steady_clock::time_point deadline)
+	{
+		for (std::size_t i = 0; i < pending.images.size() && std::chrono::steady_clock::now() < deadline;)
+		{
+			if (pending.done[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++i;
+				continue;
+			}
+			pending.done[i].get();
+			const Texture::Image& image = *pending.images[i];
+			if (!Textures.count(image.path))
+				Textures.emplace(image.path, CreateRef<Texture>(image));
+
+			//Order doesn't matter here, the last entry fills the gap.
+			if (i + 1 != pending.images.size())
+			{
+				pending.images[i] = std::move(pending.images.back());
+				pending.done[i] = std::move(pending.done.back());
+				pending.paths[i] = std::move(pending.paths.back());
+			}
+			pending.images.pop_back();
+			pending.done.pop_back();
+			pending.paths.pop_back();
+		}
+		return pending.images.empty();
+	}
+
+	void TextureManager::Release(const std::unordered_set<const Texture*>& textures)
+	{
+		for (auto it = Textures.begin(); it != Textures.end();)
+		{
+			if (it->second.use_count() == 1 && textures.count(it->second.get()))
+				it = Textures.erase(it);
+			else
+				++it;
+		}
+	}
+
+	void TextureManager::Clear()
+	{
+		Textures.clear();
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "renderer/Texture.h"
+#include <chrono>
+#include <future>
+#include <unordered_set>
+
+namespace Crave
+{
+	//Shares file textures between meshes, keyed by resolved path.
+	class TextureManager
+	{
+	public:
+		//Images being decoded on JobSystem workers. Finished by Upload on the GL thread.
+		struct PendingTextures
+		{
+			std::vector<std::unique_ptr<Texture::Image>> images{};
+			std::vector<std::future<void>>				 done{};
+			std::vector<std::string>					 paths{}; //resolved, index-aligned with images
+		};
+
+		//Decodes and uploads on first use.
+		static Ref<Texture> GetTexture(const std::string& texName, bool useRelativePath = true);
+
+		//Starts decoding every path not loaded yet. Duplicates are decoded once.
+		static PendingTextures DecodeAsync(const std::vector<std::string>& texNames, bool useRelativePath = true);
+		//Waits for each image in turn and uploads it.
+		static void Upload(PendingTextures& pending);
+		//Uploads the images already decoded until deadline, without waiting on the rest.
+		//Returns true once nothing is left pending.
+		static bool UploadReady(PendingTextures& pending, std::chrono::steady_clock::time_point deadline);
+
+		//Drops the listed textures nothing but the manager holds on to.
+		static void Release(const std::unordered_set<const Texture*>& textures);
+
+		static void Clear();
+
+		static std::unordered_map<std::string, Ref<Texture>> Textures;
+	};
+}
@@ -20,8 +20,9 @@ namespace Crave
 		vbo.Bind();
 		vbo.GetLayout().Enable();
 		m_Count = vbo.Count();
-		if (ebo)
-			m_EBO = CreateRef<EBO>(*ebo);
+		//Shared, not copied: a copy would delete the same GL buffer twice
+		//and the depth VAO reuses the mesh's index buffer.
+		m_EBO = ebo;
 	}
 
 	void VAO::Bind() const
@@ -11,6 +11,19 @@ namespace Crave
 		{
 		}
 
+		void Transform::AppendChild(Transform& child, Transform* lastChild)
+		{
+			child.Parent = Owner;
+			child.PrevSibling = LastChild;
+			child.NextSibling = {};
+			if (lastChild)
+				lastChild->NextSibling = child.Owner;
+			else
+				FirstChild = child.Owner;
+			LastChild = child.Owner;
+			ChildCount++;
+		}
+
 		void Transform::ScaleF(const float units)
 		{
 			Scale = glm::vec3(units);
@@ -3,6 +3,7 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "core/NameTable.h"
 #include "renderer/Renderer.h"
 #include "renderer/Mesh.h"
 
@@ -17,18 +18,22 @@ namespace Crave
 			"Tag", "Transform", "MeshInstance", "Light"
 		};
 
+		//The entity's name, interned. Scene keeps an index of entities by it, see Scene::FindEntities.
 		struct Tag
 		{
-			std::string String;
+			NameTable::Id Name = NameTable::EMPTY;
 
 			Tag() = default;
 			Tag(const Tag&) = default;
 			Tag(const std::string& tag)
-				: String(tag) {}
+				: Name(NameTable::Intern(tag)) {}
+
+			const std::string& String() const { return NameTable::String(Name); }
+			void Set(const std::string& tag) { Name = NameTable::Intern(tag); }
 
 			friend bool operator==(const Tag& lhs, const Tag& rhs)
 			{
-				return lhs.String == rhs.String;
+				return lhs.Name == rhs.Name;
 			}
 		};
 
@@ -37,7 +42,18 @@ namespace Crave
 			Entity Owner{};
 			Entity Parent{};
 
-			std::vector<Entity> Children{};
+			//Children are linked through their Transforms, so any of them is unlinked in O(1).
+			//Scene keeps the links, see Scene::SetParent.
+			Entity FirstChild{};
+			Entity LastChild{};
+			Entity PrevSibling{};
+			Entity NextSibling{};
+			uint32_t ChildCount = 0;
+			//Where the entity is entered and left in a walk of the hierarchy. A subtree's labels nest
+			//inside its root's, with gaps left for new children. Kept by Scene, 0 until it places the
+			//entity.
+			uint64_t TreeEnter = 0;
+			uint64_t TreeExit = 0;
 
 			glm::vec3 Position = { 0.0f, 0.0f, 0.0f };
 			glm::quat Quaternion{};
@@ -54,6 +70,26 @@ namespace Crave
 				return wasUpdated;
 			}
 
+			//Calls fn for each child in order. fn may destroy the child it's given.
+			template<typename Fn>
+			void ForEachChild(Fn&& fn) const
+			{
+				for (Entity child = FirstChild; child;)
+				{
+					Entity next = child.GetComponent<Transform>().NextSibling;
+					fn(child);
+					child = next;
+				}
+			}
+			//True for root itself and its descendants.
+			bool IsInSubtree(const Transform& root) const
+			{
+				return root.TreeEnter <= TreeEnter && TreeExit <= root.TreeExit;
+			}
+			//Links child after the last of these children. For Transforms not in the registry yet,
+			//lastChild is the Transform of LastChild, null when there are no children.
+			void AppendChild(Transform& child, Transform* lastChild);
+
 			void ScaleF(const float units);
 
 			void RotateTo(const float angle, const glm::vec3& axis);
@@ -75,7 +111,9 @@ namespace Crave
 			friend bool operator==(const Transform& lhs, const Transform& rhs)
 			{
 				return lhs.Owner == rhs.Owner && lhs.Parent == rhs.Parent &&
-					lhs.Children == rhs.Children && lhs.Position == rhs.Position &&
+					lhs.FirstChild == rhs.FirstChild && lhs.LastChild == rhs.LastChild &&
+					lhs.PrevSibling == rhs.PrevSibling && lhs.NextSibling == rhs.NextSibling &&
+					lhs.Position == rhs.Position &&
 					lhs.Quaternion == rhs.Quaternion && lhs.EulerAngles == rhs.EulerAngles &&
 					lhs.Scale == rhs.Scale;
 			}
@@ -118,7 +156,8 @@ namespace Crave
 			LightData Data{};
 			bool	  Enabled{ true };
 			bool	  IsDynamic{ false };
-			unsigned  ShaderIndex{};
+			//Renderer slot, given by the scene when the light is added to an entity and released with it.
+			unsigned  ShaderIndex{ Renderer::NO_LIGHT };
 		
 			
 			void UpdateViewMat(const glm::mat4& transform);
@@ -132,22 +171,18 @@ namespace Crave
 			Light()
 				: Data(Renderer::GetDefaultLightData(LightType::Point)), IsDynamic(true)
 			{
-				ShaderIndex = Renderer::AddNewLight(Data);
 			}
 			//More suitable for dynamic lights
 			//Position, direction etc. will be updated according to transform component.
 			Light(LightType type, bool isDynamic)
 				: Data(Renderer::GetDefaultLightData(type)), IsDynamic(isDynamic)
 			{
-				ShaderIndex = Renderer::AddNewLight(Data);
 			}
 			//More suitable for non-dynamic light since it won't be updated with transform
 			//Allows to directly set light's position, direction etc.
 			Light(const LightData& lightData, bool isDynamic)
 				: Data(lightData), IsDynamic(isDynamic)
 			{
-				ShaderIndex = Renderer::AddNewLight(Data);
-				
 			}
 			
 		};
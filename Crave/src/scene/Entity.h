@@ -38,6 +38,15 @@ namespace Crave
 			return m_Scene->m_Registry.any_of<T>(m_EntityHandle);
 		}
 
+		//Changes made through GetComponent's reference are invisible to the registry. Call this after
+		//them so on_update listeners, like SceneAutosave, pick them up.
+		template<typename T>
+		void PatchComponent()
+		{
+			ASSERT(HasComponent<T>(), "Entity does not have component!");
+			m_Scene->m_Registry.patch<T>(m_EntityHandle);
+		}
+
 		template<typename T>
 		void RemoveComponent()
 		{
@@ -89,7 +98,7 @@ namespace Crave
 
 			if (HasComponent<Tag>())
 			{
-				ar& cereal::make_nvp("Tag", GetComponent<Tag>().String);
+				ar& cereal::make_nvp("Tag", GetComponent<Tag>().String());
 			}
 			if (HasComponent<Transform>())
 			{
@@ -122,7 +131,9 @@ namespace Crave
 				{
 					AddComponent<Tag>();
 				}
-				ar& GetComponent<Tag>().String;
+				std::string tag{};
+				ar& tag;
+				GetComponent<Tag>().Set(tag);
 			}
 			if (config[1])
 			{
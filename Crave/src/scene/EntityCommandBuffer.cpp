@@ -0,0 +1,149 @@
+#include "pch.h"
+#include "EntityCommandBuffer.h"
+#include "scene/Component.h"
+#include "scene/Entity.h"
+
+#include "core/Stopwatch.h"
+#include "renderer/MeshManager.h"
+
+namespace Crave
+{
+	using namespace Component;
+
+	Entity EntityCommandBuffer::Create(const std::string& name, Entity parent)
+	{
+		//A bare handle doesn't touch any component storage, views being iterated are safe.
+		Entity entity{ m_Scene.m_Registry.create(), &m_Scene };
+		m_Created.push_back({ entity, parent, name });
+		m_Count++;
+		return entity;
+	}
+
+	void EntityCommandBuffer::Destroy(Entity entity)
+	{
+		m_Destroyed.push_back(entity);
+		m_Count++;
+	}
+
+	void EntityCommandBuffer::Apply()
+	{
+		if (Empty())
+			return;
+
+		Scene& scene = m_Scene;
+		entt::registry& registry = scene.m_Registry;
+		if (!m_Created.empty())
+		{
+			std::vector<entt::entity> handles;
+			std::vector<Tag> tags;
+			std::vector<Transform> transforms;
+			handles.reserve(m_Created.size());
+			tags.reserve(m_Created.size());
+			transforms.reserve(m_Created.size());
+			//Parents and last children from this buffer were created earlier in it, and have no
+			//Transform in the registry yet.
+			std::unordered_map<entt::entity, std::size_t> pending;
+			auto pendingTransform = [&](entt::entity entity) -> Transform*
+			{
+				if (!handles.empty() && handles.back() == entity)
+					return &transforms.back();
+				if (pending.empty())
+				{
+					for (std::size_t i = 0; i < handles.size(); ++i)
+						pending.emplace(handles[i], i);
+				}
+				auto it = pending.find(entity);
+				return it != pending.end() ? &transforms[it->second] : nullptr;
+			};
+			for (auto& created : m_Created)
+			{
+				if (!registry.valid(created.Handle))
+					continue; //the scene was cleared meanwhile
+				Transform* parent = nullptr;
+				if (created.Parent != entt::null && registry.valid(created.Parent))
+				{
+					parent = registry.try_get<Transform>(created.Parent);
+					if (!parent)
+						parent = pendingTransform(created.Parent);
+				}
+				if (!parent)
+					parent = &scene.m_RootEntity.GetComponent<Transform>();
+				Transform* last = nullptr;
+				if (parent->LastChild)
+				{
+					last = registry.try_get<Transform>(parent->LastChild);
+					if (!last)
+						last = pendingTransform(parent->LastChild);
+				}
+
+				handles.push_back(created.Handle);
+				tags.emplace_back(std::move(created.Name));
+				parent->AppendChild(transforms.emplace_back(Entity{ created.Handle, &scene }, Entity{}), last);
+				if (!pending.empty())
+					pending.emplace(created.Handle, handles.size() - 1);
+			}
+			registry.insert<Tag>(handles.begin(), handles.end(), std::make_move_iterator(tags.begin()));
+			registry.insert<Transform>(handles.begin(), handles.end(), std::make_move_iterator(transforms.begin()));
+			//Each run of new children under an existing parent is labeled from its first, with the
+			//new entities below.
+			std::vector<Entity> firstNew;
+			for (entt::entity handle : handles)
+			{
+				const Transform& tr = registry.get<Transform>(handle);
+				const bool parentPlaced = tr.Parent.GetComponent<Transform>().TreeExit != 0;
+				if (parentPlaced && (!tr.PrevSibling || tr.PrevSibling.GetComponent<Transform>().TreeExit != 0))
+					firstNew.push_back(tr.Owner);
+			}
+			for (Entity first : firstNew)
+				scene.LabelNewChildren(first);
+			scene.m_NumOfEntities += handles.size();
+			m_Created.clear();
+		}
+
+		for (auto& [type, batch] : m_Adds)
+			batch->Apply(registry);
+		for (auto& [type, batch] : m_Removes)
+			batch->Apply(registry);
+
+		std::sort(m_Destroyed.begin(), m_Destroyed.end());
+		m_Destroyed.erase(std::unique(m_Destroyed.begin(), m_Destroyed.end()), m_Destroyed.end());
+		for (entt::entity entity : m_Destroyed)
+		{
+			if (registry.valid(entity))
+				scene.DestroyEntity({ entity, &scene });
+		}
+		m_Destroyed.clear();
+		m_Count = 0;
+	}
+
+	void EntityCommandBuffer::Benchmark(std::size_t count)
+	{
+		const Ref<Mesh> mesh = MeshManager::GetPrimitiveMesh({ Primitive::Cube, {} });
+
+		Ref<Scene> scene = CreateRef<BenchmarkScene>();
+		Stopwatch timer;
+		for (std::size_t i = 0; i < count; ++i)
+			scene->CreateEntity("Spawned").AddComponent<MeshInstance>(mesh);
+		float singleMs = timer.ElapsedMs();
+
+		scene = CreateRef<BenchmarkScene>();
+		timer.Restart();
+		scene->CreateEntities(count, "Spawned", {}, MeshInstance(mesh));
+		float batchMs = timer.ElapsedMs();
+
+		scene = CreateRef<BenchmarkScene>();
+		EntityCommandBuffer& commands = scene->Commands();
+		timer.Restart();
+		for (std::size_t i = 0; i < count; ++i)
+			commands.Add(commands.Create("Spawned"), MeshInstance(mesh));
+		float recordMs = timer.ElapsedMs();
+		timer.Restart();
+		commands.Apply();
+		float applyMs = timer.ElapsedMs();
+
+		auto rate = [count](float ms) { return count / ms / 1000.f; };
+		LOG_INFO("Spawn benchmark, {} entities with a mesh: CreateEntity {:.1f} ms ({:.2f} M/s), CreateEntities {:.1f} ms "
+			"({:.2f} M/s), command buffer {:.1f} ms recording + {:.1f} ms applying ({:.2f} M/s)", count, singleMs,
+			rate(singleMs), batchMs, rate(batchMs), recordMs, applyMs, rate(recordMs + applyMs));
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "scene/Scene.h"
+
+namespace Crave
+{
+	//Structural changes recorded while systems iterate views, where creating, destroying, adding or
+	//removing would invalidate them, and applied together at a sync point. Scene applies its buffer at
+	//the start of OnUpdate. Creates go first, then each component type's adds and removes as one batch
+	//sorted by entity, destroys last.
+	class EntityCommandBuffer
+	{
+	public:
+		EntityCommandBuffer(Scene& scene)
+			: m_Scene(scene) {}
+		//Entities created but not applied yet keep their bare handle.
+		~EntityCommandBuffer() {}
+
+		EntityCommandBuffer(const EntityCommandBuffer&) = delete;
+		EntityCommandBuffer& operator=(const EntityCommandBuffer&) = delete;
+
+		//The handle is taken at once, so later commands can use it, and parent can be an entity of this
+		//buffer too. Tag and Transform arrive on Apply, under the scene root if parent is null or gone.
+		Entity Create(const std::string& name, Entity parent = {});
+		//Destroys the entity's subtree too.
+		void Destroy(Entity entity);
+		//The last add of a type to an entity wins. A component the entity has already is replaced.
+		template<typename T>
+		void Add(Entity entity, T component)
+		{
+			BatchOf<AddBatch<T>, T>(m_Adds).Records.emplace_back(entity, std::move(component));
+			m_Count++;
+		}
+		//Ignored for entities without the component.
+		template<typename T>
+		void Remove(Entity entity)
+		{
+			BatchOf<RemoveBatch<T>, T>(m_Removes).Entities.push_back(entity);
+			m_Count++;
+		}
+
+		void Apply();
+		bool Empty() const { return m_Count == 0; }
+
+		//Logs how fast count entities with a mesh are spawned through CreateEntity, Scene::CreateEntities
+		//and a command buffer.
+		static void Benchmark(std::size_t count = 100000);
+	private:
+		struct Batch
+		{
+			virtual ~Batch() = default;
+			//Leaves the batch empty, keeping its memory for the next frame.
+			virtual void Apply(entt::registry& registry) = 0;
+		};
+
+		template<typename T>
+		struct AddBatch : Batch
+		{
+			std::vector<std::pair<entt::entity, T>> Records{};
+
+			void Apply(entt::registry& registry) override
+			{
+				//Usually recorded in order already, and components can be costly to move around.
+				auto byEntity = [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; };
+				if (!std::is_sorted(Records.begin(), Records.end(), byEntity))
+					std::stable_sort(Records.begin(), Records.end(), byEntity);
+				std::vector<entt::entity> entities;
+				std::vector<T> components;
+				entities.reserve(Records.size());
+				components.reserve(Records.size());
+				for (std::size_t i = 0; i < Records.size(); ++i)
+				{
+					auto& [entity, component] = Records[i];
+					if ((i + 1 < Records.size() && Records[i + 1].first == entity) || !registry.valid(entity))
+						continue;
+					if (registry.all_of<T>(entity))
+						registry.replace<T>(entity, std::move(component));
+					else
+					{
+						entities.push_back(entity);
+						components.push_back(std::move(component));
+					}
+				}
+				registry.insert<T>(entities.begin(), entities.end(), std::make_move_iterator(components.begin()));
+				Records.clear();
+			}
+		};
+
+		template<typename T>
+		struct RemoveBatch : Batch
+		{
+			std::vector<entt::entity> Entities{};
+
+			void Apply(entt::registry& registry) override
+			{
+				std::sort(Entities.begin(), Entities.end());
+				Entities.erase(std::unique(Entities.begin(), Entities.end()), Entities.end());
+				Entities.erase(std::remove_if(Entities.begin(), Entities.end(),
+					[&registry](entt::entity entity) { return !registry.valid(entity); }), Entities.end());
+				registry.remove<T>(Entities.begin(), Entities.end());
+				Entities.clear();
+			}
+		};
+
+		using Batches = std::unordered_map<entt::id_type, Scope<Batch>>;
+
+		template<typename B, typename T>
+		static B& BatchOf(Batches& batches)
+		{
+			Scope<Batch>& batch = batches[entt::type_hash<T>::value()];
+			if (!batch)
+				batch = CreateScope<B>();
+			return static_cast<B&>(*batch);
+		}
+	private:
+		struct Created
+		{
+			entt::entity Handle;
+			entt::entity Parent;
+			std::string Name;
+		};
+
+		Scene& m_Scene;
+		std::vector<Created> m_Created{};
+		Batches m_Adds{};
+		Batches m_Removes{};
+		std::vector<entt::entity> m_Destroyed{};
+		std::size_t m_Count = 0;
+	};
+}
@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "Prefab.h"
+#include "scene/Entity.h"
+
+#include <glm/gtx/matrix_decompose.hpp>
+#include "core/Stopwatch.h"
+#include "import/Model.h"
+
+namespace Crave
+{
+	using namespace Component;
+
+	namespace //private
+	{
+		std::unordered_map<std::string, Ref<Prefab>> s_Prefabs{};
+	}
+
+	Ref<Prefab> Prefab::Get(const std::string& path)
+	{
+		//Hashes the source and its side files, which is cheap next to importing them again. A source
+		//that can't be read any more leaves the prefab as it was.
+		auto it = s_Prefabs.find(path);
+		if (it != s_Prefabs.end())
+		{
+			const uint64_t key = Import::Model::CacheKey(path);
+			if (!key || key == it->second->m_Key)
+				return it->second;
+			LOG_INFO("Model '{}' changed, its prefab is made again.", path);
+			s_Prefabs.erase(it);
+		}
+
+		Import::Model model{ path };
+		const Import::ModelNodeData& root = model.m_NodeData;
+		if (root.meshes.empty() && root.childData.empty())
+		{
+			LOG_WARN("Model '{}' has no nodes, no prefab is made of it.", path);
+			return nullptr;
+		}
+		Ref<Prefab> prefab{ new Prefab(path, model.m_CacheKey, root) };
+		s_Prefabs.emplace(path, prefab);
+		return prefab;
+	}
+
+	void Prefab::ReleaseUnused()
+	{
+		for (auto it = s_Prefabs.begin(); it != s_Prefabs.end();)
+		{
+			if (it->second.use_count() == 1)
+				it = s_Prefabs.erase(it);
+			else
+				++it;
+		}
+	}
+
+	Prefab::Prefab(const std::string& path, uint64_t key, const Import::ModelNodeData& root)
+		: m_Path(path), m_Key(key), m_RootMatrix(root.transform)
+	{
+		AddNode(root, -1);
+	}
+
+	void Prefab::AddNode(const Import::ModelNodeData& node, int32_t parent)
+	{
+		const uint32_t index = (uint32_t)m_Parents.size();
+		m_Parents.push_back(parent);
+		m_Tags.emplace_back(node.name);
+
+		Transform& tr = m_Transforms.emplace_back(Entity{}, Entity{});
+		glm::vec3 skew;
+		glm::vec4 perspective;
+		glm::decompose(node.transform, tr.Scale, tr.Quaternion, tr.Position, skew, perspective);
+		tr.EulerAngles = glm::degrees(glm::eulerAngles(tr.Quaternion));
+
+		//Entities show one mesh, like the ones ImportModel used to create.
+		if (!node.meshes.empty())
+		{
+			m_MeshNodes.push_back(index);
+			m_MeshInstances.emplace_back(node.meshes[0]);
+		}
+
+		for (const auto& child : node.childData)
+			AddNode(child, (int32_t)index);
+	}
+
+	void Prefab::Benchmark(const std::string& path, std::size_t copies)
+	{
+		s_Prefabs.erase(path);
+		Stopwatch timer;
+		Ref<Prefab> prefab = Get(path);
+		float loadMs = timer.ElapsedMs();
+		if (!prefab)
+		{
+			LOG_WARN("Prefab benchmark: '{}' didn't load.", path);
+			return;
+		}
+
+		//What each ImportModel call did before prefabs: read the model, then an entity per node.
+		timer.Restart();
+		{
+			Import::Model model{ path };
+		}
+		float reloadMs = timer.ElapsedMs();
+
+		Ref<Scene> scene = CreateRef<BenchmarkScene>();
+		timer.Restart();
+		for (std::size_t c = 0; c < copies; ++c)
+		{
+			std::vector<Entity> entities(prefab->NodeCount());
+			std::size_t mesh = 0;
+			for (std::size_t i = 0; i < entities.size(); ++i)
+			{
+				const int32_t parent = prefab->m_Parents[i];
+				entities[i] = scene->CreateEntity(prefab->m_Tags[i].String(), parent >= 0, parent >= 0 ? entities[parent] : Entity{});
+				Transform& tr = entities[i].GetComponent<Transform>();
+				tr.Position = prefab->m_Transforms[i].Position;
+				tr.Quaternion = prefab->m_Transforms[i].Quaternion;
+				tr.EulerAngles = prefab->m_Transforms[i].EulerAngles;
+				tr.Scale = prefab->m_Transforms[i].Scale;
+				if (mesh < prefab->m_MeshNodes.size() && prefab->m_MeshNodes[mesh] == i)
+					entities[i].AddComponent<MeshInstance>(prefab->m_MeshInstances[mesh++]);
+			}
+		}
+		float perNodeMs = timer.ElapsedMs();
+
+		scene = CreateRef<BenchmarkScene>();
+		timer.Restart();
+		for (std::size_t c = 0; c < copies; ++c)
+			scene->Instantiate(prefab, glm::translate(glm::mat4(1.f), glm::vec3((float)c, 0.f, 0.f)));
+		float instantiateMs = timer.ElapsedMs();
+
+		LOG_INFO("Prefab benchmark '{}', {} nodes: first load {:.1f} ms, model reload {:.1f} ms; {} copies: "
+			"entity per node {:.1f} ms, Instantiate {:.1f} ms ({:.1f} us a copy)", path, prefab->NodeCount(),
+			loadMs, reloadMs, copies, perNodeMs, instantiateMs, instantiateMs * 1000.f / copies);
+	}
+}
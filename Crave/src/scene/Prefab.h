@@ -0,0 +1,44 @@
+#pragma once
+#include "scene/Component.h"
+
+namespace Crave
+{
+	namespace Import { struct ModelNodeData; }
+
+	//A model's node hierarchy read once, with its meshes, for Scene::Instantiate to stamp out. Prefabs
+	//are kept by path and every instance shares their meshes and GPU data.
+	class Prefab
+	{
+	public:
+		//The prefab of the model at path, as passed to Scene::ImportModel. Imported on first use and
+		//kept while the model's cache key stays the same; a changed source or import setting imports
+		//it again. Instances of the old prefab keep their meshes. Null if the model can't be loaded.
+		static Ref<Prefab> Get(const std::string& path);
+		//Forgets the prefabs no one else holds. Meshes in use by entities stay loaded.
+		static void ReleaseUnused();
+
+		//Logs what the first Get of path costs against placing copies of the prefab, into a scene
+		//of its own.
+		static void Benchmark(const std::string& path, std::size_t copies = 500);
+
+		const std::string& Path() const { return m_Path; }
+		std::size_t NodeCount() const { return m_Parents.size(); }
+	private:
+		Prefab(const std::string& path, uint64_t key, const Import::ModelNodeData& root);
+		void AddNode(const Import::ModelNodeData& node, int32_t parent);
+	private:
+		std::string m_Path;
+		uint64_t m_Key = 0; //Import::ModelCache key of the source the prefab was made from
+		//Nodes in preorder, so parents precede their children. -1 for the root.
+		std::vector<int32_t>				 m_Parents{};
+		std::vector<Component::Tag>			 m_Tags{};
+		//Local transforms, decomposed once. Owner and the hierarchy links are set per instance.
+		std::vector<Component::Transform>	 m_Transforms{};
+		glm::mat4							 m_RootMatrix{ 1.f };
+		//Nodes with a mesh, and their MeshInstance.
+		std::vector<uint32_t>				 m_MeshNodes{};
+		std::vector<Component::MeshInstance> m_MeshInstances{};
+
+		friend class Scene;
+	};
+}
@@ -5,28 +5,112 @@
 #include <glm/gtx/matrix_decompose.hpp>
 #include "Entity.h"
 #include "renderer/Renderer.h"
-#include "import/Model.h"
+#include "scene/Prefab.h"
+#include "scene/EntityCommandBuffer.h"
+#include "import/ModelImport.h"
+#include "renderer/MeshManager.h"
+#include "core/Stopwatch.h"
 
 namespace Crave
 {
 	using namespace Component;
 
+	namespace //private
+	{
+		//Flat grey, untextured, while an imported entity's mesh is still on its way.
+		constexpr glm::vec4 IMPORT_PLACEHOLDER_COLOR = { 0.5f, 0.5f, 0.5f, 1.f };
+
+		void SetLocalTransform(Transform& tr, const glm::mat4& transform)
+		{
+			glm::vec3 scale;
+			glm::quat rotation;
+			glm::vec3 translation;
+			glm::vec3 skew;
+			glm::vec4 perspective;
+			glm::decompose(transform, scale, rotation, translation, skew, perspective);
+
+			tr.Position = translation;
+			tr.Scale = scale;
+			tr.Quaternion = rotation;
+			tr.EulerAngles = glm::degrees(glm::eulerAngles(rotation));
+		}
+
+		Transform* LastChildOf(Transform& parent)
+		{
+			return parent.LastChild ? &parent.LastChild.GetComponent<Transform>() : nullptr;
+		}
+
+		//Steps through the hierarchy walk: into the first child, or out of entity once its children
+		//are done, then into the next sibling or out of the parent.
+		void NextTreeEvent(Entity& entity, bool& exit)
+		{
+			const Transform& tr = entity.GetComponent<Transform>();
+			if (!exit)
+			{
+				if (tr.FirstChild)
+					entity = tr.FirstChild;
+				else
+					exit = true;
+			}
+			else if (tr.NextSibling)
+			{
+				entity = tr.NextSibling;
+				exit = false;
+			}
+			else
+				entity = tr.Parent;
+		}
+	}
+
 	Scene::Scene()
+		: m_Commands(CreateScope<EntityCommandBuffer>(*this))
+	{
+		m_Registry.on_construct<Light>().connect<&Scene::OnLightConstruct>(*this);
+		m_Registry.on_destroy<Light>().connect<&Scene::OnLightDestroy>(*this);
+		m_Registry.on_construct<Tag>().connect<&Scene::OnTagConstruct>(*this);
+		m_Registry.on_update<Tag>().connect<&Scene::OnTagUpdate>(*this);
+		m_Registry.on_destroy<Tag>().connect<&Scene::OnTagDestroy>(*this);
+		CreateRoot();
+	}
+
+	Scene::~Scene()
+	{
+		//The registry goes without signals, lights give their slots back here.
+		m_Registry.clear<Light>();
+	}
+
+	void Scene::CreateRoot()
 	{
 		m_NumOfEntities++;
 
 		m_RootEntity = { m_Registry.create(), this };
-		m_RootEntity.AddComponent<Transform>(m_RootEntity, Entity(entt::null, nullptr));
+		Transform& tr = m_RootEntity.AddComponent<Transform>(m_RootEntity, Entity(entt::null, nullptr));
+		tr.TreeEnter = 0;
+		tr.TreeExit = UINT64_MAX;
 		m_RootEntity.AddComponent<Tag>("SCENE_ROOT");
+		OnHierarchyChanged();
 	}
 
-	Scene::~Scene() {}
+	void Scene::Clear()
+	{
+		for (auto& import : m_Imports)
+		{
+			if (!import->IsDone())
+				ReleaseImport(*import);
+		}
+		m_Registry.clear();
+		m_NameIndex.clear();
+		m_NameSlots.clear();
+		m_Commands = CreateScope<EntityCommandBuffer>(*this);
+		m_SelectedEntity = {};
+		m_NumOfEntities = 0;
+		CreateRoot();
+	}
 
 	Entity Scene::GetEntity(entt::entity id)
 	{
 		Entity entity{ id, this };
-		auto& tag = entity.AddComponent<Tag>();
-		tag.String = "Id wrapper";
+		entity.AddComponent<Tag>("Id wrapper");
 		return entity;
 	}
 
@@ -36,124 +120,491 @@ namespace Crave
 		m_NumOfEntities++;
 
 		Entity entity = { m_Registry.create(), this };
-		auto& tag = entity.AddComponent<Tag>();
-		tag.String = name;
+		entity.AddComponent<Tag>(name);
 
 		Entity Parent = hasParent ? parent : m_RootEntity;
-		Parent.GetComponent<Transform>().Children.push_back(entity);
+		Transform& parentTr = Parent.GetComponent<Transform>();
+		Transform transform{ entity, Parent };
+		parentTr.AppendChild(transform, LastChildOf(parentTr));
 
-		entity.AddComponent<Transform>(entity, Parent);
+		entity.AddComponent<Transform>(transform);
+		LabelNewChildren(entity);
 
 		return entity;
 	}
 
+	std::vector<entt::entity> Scene::CreateBatch(std::size_t count, const std::string& name, Entity parent)
+	{
+		if (!parent)
+			parent = m_RootEntity;
+
+		std::vector<entt::entity> handles(count);
+		m_Registry.create(handles.begin(), handles.end());
+
+		Transform& parentTr = parent.GetComponent<Transform>();
+		std::vector<Transform> transforms;
+		transforms.reserve(count);
+		for (entt::entity handle : handles)
+		{
+			Transform* last = transforms.empty() ? LastChildOf(parentTr) : &transforms.back();
+			parentTr.AppendChild(transforms.emplace_back(Entity{ handle, this }, parent), last);
+		}
+		m_Registry.insert<Tag>(handles.begin(), handles.end(), Tag(name));
+		m_Registry.insert<Transform>(handles.begin(), handles.end(), std::make_move_iterator(transforms.begin()));
+		if (count)
+			LabelNewChildren({ handles[0], this });
+
+		m_NumOfEntities += count;
+		return handles;
+	}
+
 	void Scene::DestroyEntity(Entity entity)
 	{
-		m_NumOfEntities--;
-		m_Registry.destroy(entity);
+		ASSERT(entity != m_RootEntity, "Scene root can't be destroyed!");
+
+		//Parents come before their children. Model meshes are released once the entities are gone.
+		std::vector<entt::entity> subtree{ entity };
+		std::vector<Ref<Mesh>> meshes;
+		for (std::size_t i = 0; i < subtree.size(); ++i)
+		{
+			const Transform& tr = m_Registry.get<Transform>(subtree[i]);
+			for (Entity child = tr.FirstChild; child; child = m_Registry.get<Transform>(child).NextSibling)
+				subtree.push_back(child);
+			if (m_SelectedEntity == subtree[i])
+				m_SelectedEntity = {};
+			const MeshInstance* mi = m_Registry.try_get<MeshInstance>(subtree[i]);
+			if (mi && MeshManager::IsModelMesh(mi->PMesh))
+				meshes.push_back(mi->PMesh);
+		}
+
+		UnlinkChild(entity);
+		m_Registry.destroy(subtree.begin(), subtree.end());
+		m_NumOfEntities -= subtree.size();
+		OnHierarchyChanged();
+
+		//Meshes the prefab cache, undo history or another entity holds stay.
+		std::sort(meshes.begin(), meshes.end());
+		meshes.erase(std::unique(meshes.begin(), meshes.end()), meshes.end());
+		for (const Ref<Mesh>& mesh : meshes)
+			MeshManager::ReleaseModelMesh(mesh);
 	}
 
-	Entity Scene::PocessNodeData(const Import::ModelNodeData& nd, Entity parent)
+	bool Scene::SetParent(Entity entity, Entity parent)
 	{
-		Entity entity = CreateEntity(nd.name, true, parent);
-		entity.AddComponent<MeshInstance>(nd.meshes[0]);
+		if (IsInSubtree(parent, entity))
+			return false;
+		UnlinkChild(entity);
+		LinkChild(parent, entity);
+		//Only the moved subtree gets new labels.
+		LabelNewChildren(entity);
+		return true;
+	}
 
-		auto& tr = entity.GetComponent<Transform>();
-	
-		glm::vec3 scale;
-		glm::quat rotation;
-		glm::vec3 translation;
-		glm::vec3 skew;
-		glm::vec4 perspective;
-		glm::decompose(nd.transform, scale, rotation, translation, skew, perspective);
+	bool Scene::IsInSubtree(Entity entity, Entity root) const
+	{
+		return m_Registry.get<Transform>(entity).IsInSubtree(m_Registry.get<Transform>(root));
+	}
 
-		tr.Position = translation;
-		tr.Scale = scale;
-		tr.Quaternion = rotation;
-		tr.EulerAngles = glm::degrees(glm::eulerAngles(rotation));
+	const std::vector<entt::entity>& Scene::FindEntities(NameTable::Id name) const
+	{
+		static const std::vector<entt::entity> none{};
+		auto it = m_NameIndex.find(name);
+		return it == m_NameIndex.end() ? none : it->second;
+	}
+
+	const std::vector<entt::entity>& Scene::FindEntities(const std::string& name) const
+	{
+		//Names no entity ever had aren't added to the table.
+		return FindEntities(NameTable::Find(name));
+	}
+
+	Entity Scene::FindEntity(const std::string& name)
+	{
+		const auto& entities = FindEntities(name);
+		return entities.empty() ? Entity{} : Entity{ entities.front(), this };
+	}
+
+	Scene::SubtreeRange Scene::Subtree(Entity root)
+	{
+		UpdateTreeOrder();
+		auto [first, last] = m_TreeSpans[entt::to_entity((entt::entity)root)];
+		return { m_TreeOrder.data() + first, m_TreeOrder.data() + last };
+	}
 
-		for (auto& child : nd.childData)
+	void Scene::LabelNewChildren(Entity first)
+	{
+		const Transform& tr = first.GetComponent<Transform>();
+		Entity parent = tr.Parent;
+		const Transform& parentTr = parent.GetComponent<Transform>();
+		const uint64_t low = tr.PrevSibling ? tr.PrevSibling.GetComponent<Transform>().TreeExit : parentTr.TreeEnter;
+		const uint64_t high = parentTr.TreeExit;
+
+		//They're the last of the walk before it leaves parent.
+		uint64_t events = 0;
+		Entity entity = first;
+		bool exit = false;
+		for (; entity != parent || !exit; NextTreeEvent(entity, exit))
+			events++;
+
+		const uint64_t step = std::min(TREE_LABEL_STEP, (high - low) / (events + 1));
+		if (step == 0)
+		{
+			RelabelTree();
+			return;
+		}
+		uint64_t label = low;
+		entity = first;
+		exit = false;
+		for (; entity != parent || !exit; NextTreeEvent(entity, exit))
 		{
-			PocessNodeData(child, entity);
+			Transform& current = entity.GetComponent<Transform>();
+			label += step;
+			(exit ? current.TreeExit : current.TreeEnter) = label;
 		}
+		OnHierarchyChanged();
+	}
 
-		return entity;
+	void Scene::RelabelTree()
+	{
+		//Every entity has a Transform. The root keeps the whole range.
+		const uint64_t events = 2 * (m_Registry.storage<Transform>().size() - 1);
+		const uint64_t step = UINT64_MAX / (events + 1);
+		uint64_t label = 0;
+		Entity entity = m_RootEntity;
+		bool exit = false;
+		for (NextTreeEvent(entity, exit); entity != m_RootEntity || !exit; NextTreeEvent(entity, exit))
+		{
+			Transform& current = entity.GetComponent<Transform>();
+			label += step;
+			(exit ? current.TreeExit : current.TreeEnter) = label;
+		}
+		OnHierarchyChanged();
+	}
+
+	void Scene::OnHierarchyChanged()
+	{
+		m_TreeOrderDirty = true;
+		m_HierarchyVersion++;
+	}
+
+	void Scene::UpdateTreeOrder()
+	{
+		if (!m_TreeOrderDirty)
+			return;
+
+		m_TreeOrder.clear();
+		m_TreeOrder.reserve(m_Registry.storage<Transform>().size());
+		Entity entity = m_RootEntity;
+		bool exit = false;
+		while (true)
+		{
+			const auto index = entt::to_entity((entt::entity)entity);
+			if (index >= m_TreeSpans.size())
+				m_TreeSpans.resize(index + 1);
+			if (!exit)
+			{
+				m_TreeSpans[index].first = (uint32_t)m_TreeOrder.size();
+				m_TreeOrder.push_back(entity);
+			}
+			else
+			{
+				m_TreeSpans[index].second = (uint32_t)m_TreeOrder.size();
+				if (entity == m_RootEntity)
+					break;
+			}
+			NextTreeEvent(entity, exit);
+		}
+		m_TreeOrderDirty = false;
+	}
+
+	void Scene::LinkChild(Entity parent, Entity child)
+	{
+		Transform& parentTr = parent.GetComponent<Transform>();
+		Entity prev = parentTr.LastChild;
+		parentTr.AppendChild(child.GetComponent<Transform>(), LastChildOf(parentTr));
+
+		m_Registry.patch<Transform>(parent);
+		m_Registry.patch<Transform>(child);
+		if (prev)
+			m_Registry.patch<Transform>(prev);
+	}
+
+	void Scene::UnlinkChild(Entity child)
+	{
+		Transform& tr = child.GetComponent<Transform>();
+		Entity parent = tr.Parent;
+		Transform& parentTr = parent.GetComponent<Transform>();
+		if (tr.PrevSibling)
+		{
+			tr.PrevSibling.GetComponent<Transform>().NextSibling = tr.NextSibling;
+			m_Registry.patch<Transform>(tr.PrevSibling);
+		}
+		else
+			parentTr.FirstChild = tr.NextSibling;
+		if (tr.NextSibling)
+		{
+			tr.NextSibling.GetComponent<Transform>().PrevSibling = tr.PrevSibling;
+			m_Registry.patch<Transform>(tr.NextSibling);
+		}
+		else
+			parentTr.LastChild = tr.PrevSibling;
+		parentTr.ChildCount--;
+		m_Registry.patch<Transform>(parent);
+
+		tr.Parent = {};
+		tr.PrevSibling = {};
+		tr.NextSibling = {};
+	}
+
+	void Scene::OnLightConstruct(entt::registry& registry, entt::entity entity)
+	{
+		//Restored lights come with the slot they had, unless another light took it meanwhile.
+		Light& light = registry.get<Light>(entity);
+		if (!Renderer::ClaimLight(light.ShaderIndex))
+			light.ShaderIndex = Renderer::AddNewLight();
+	}
+
+	void Scene::OnLightDestroy(entt::registry& registry, entt::entity entity)
+	{
+		Renderer::RemoveLight(registry.get<Light>(entity).ShaderIndex);
+	}
+
+	void Scene::OnTagConstruct(entt::registry& registry, entt::entity entity)
+	{
+		IndexName(entity, registry.get<Tag>(entity).Name);
+	}
+
+	void Scene::OnTagUpdate(entt::registry& registry, entt::entity entity)
+	{
+		const NameTable::Id name = registry.get<Tag>(entity).Name;
+		if (m_NameSlots[entt::to_entity(entity)].first == name)
+			return;
+		UnindexName(entity);
+		IndexName(entity, name);
+		m_HierarchyVersion++;
+	}
+
+	void Scene::OnTagDestroy(entt::registry& registry, entt::entity entity)
+	{
+		UnindexName(entity);
+	}
+
+	void Scene::IndexName(entt::entity entity, NameTable::Id name)
+	{
+		const auto index = entt::to_entity(entity);
+		if (index >= m_NameSlots.size())
+			m_NameSlots.resize(index + 1);
+		auto& entities = m_NameIndex[name];
+		m_NameSlots[index] = { name, (uint32_t)entities.size() };
+		entities.push_back(entity);
+	}
+
+	void Scene::UnindexName(entt::entity entity)
+	{
+		//The last entity of the list takes the place of the one leaving.
+		auto [name, slot] = m_NameSlots[entt::to_entity(entity)];
+		auto it = m_NameIndex.find(name);
+		auto& entities = it->second;
+		entt::entity last = entities.back();
+		entities[slot] = last;
+		m_NameSlots[entt::to_entity(last)].second = slot;
+		entities.pop_back();
+		if (entities.empty())
+			m_NameIndex.erase(it);
 	}
 
 	Entity Scene::ImportModel(const std::string& path)
 	{
-		Import::Model m{ path };
-		m_ImportedModels.push_back(m);
+		Ref<Prefab> prefab = Prefab::Get(path);
+		return prefab ? Instantiate(prefab) : Entity{};
+	}
 
-		return PocessNodeData(m.m_NodeData, m_RootEntity);
+	Entity Scene::Instantiate(const Ref<Prefab>& prefab, const glm::mat4& transform, Entity parent)
+	{
+		ASSERT(prefab, "Prefab is null!");
+		if (!parent)
+			parent = m_RootEntity;
+
+		const std::size_t count = prefab->NodeCount();
+		std::vector<entt::entity> handles(count);
+		m_Registry.create(handles.begin(), handles.end());
+
+		//Copies of the prefab's components, linked up and inserted a type at a time.
+		std::vector<Transform> transforms = prefab->m_Transforms;
+		std::vector<int32_t> lastChild(count, -1);
+		for (std::size_t i = 0; i < count; ++i)
+			transforms[i].Owner = { handles[i], this };
+		for (std::size_t i = 1; i < count; ++i)
+		{
+			const int32_t p = prefab->m_Parents[i];
+			transforms[p].AppendChild(transforms[i], lastChild[p] < 0 ? nullptr : &transforms[lastChild[p]]);
+			lastChild[p] = (int32_t)i;
+		}
+		if (transform != glm::mat4(1.f))
+			SetLocalTransform(transforms[0], transform * prefab->m_RootMatrix);
+
+		Entity root{ handles[0], this };
+		Transform& parentTr = parent.GetComponent<Transform>();
+		parentTr.AppendChild(transforms[0], LastChildOf(parentTr));
+		m_Registry.insert<Tag>(handles.begin(), handles.end(), prefab->m_Tags.begin());
+		m_Registry.insert<Transform>(handles.begin(), handles.end(), std::make_move_iterator(transforms.begin()));
+		LabelNewChildren(root);
+
+		std::vector<entt::entity> meshEntities(prefab->m_MeshNodes.size());
+		for (std::size_t i = 0; i < meshEntities.size(); ++i)
+			meshEntities[i] = handles[prefab->m_MeshNodes[i]];
+		m_Registry.insert<MeshInstance>(meshEntities.begin(), meshEntities.end(), prefab->m_MeshInstances.begin());
+
+		m_NumOfEntities += count;
+		return root;
 	}
 
-	void Scene::RenderScene()
+	Ref<Import::ModelImport> Scene::ImportModelAsync(const std::string& path)
 	{
-		auto& meshView = m_Registry.view<Transform, MeshInstance, Tag>();
+		Ref<Import::ModelImport> import{ new Import::ModelImport(path) };
+		m_Imports.push_back(import);
+		return import;
+	}
 
-		for (auto& entity : meshView)
+	void Scene::UpdateImports()
+	{
+		if (m_Imports.empty())
+			return;
+
+		auto deadline = std::chrono::steady_clock::now() +
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<float, std::milli>(IMPORT_BUDGET_MS));
+		for (auto& import : m_Imports)
 		{
-			auto& [transform, mi, tag] = meshView.get(entity);
-			//Find out if parent is a selected entity
-			bool parentSelected = false;
-			auto tmp = Entity(entity, this);
-			if ((bool)m_SelectedEntity)
+			if (import->IsDone())
+				continue;
+			if (import->m_CancelRequested)
 			{
-				parentSelected = true;
-				while (m_SelectedEntity != tmp)
-				{
-					auto tmpTr = tmp.GetComponent<Transform>();
-					if (tmpTr.Parent.GetComponent<Tag>() == m_RootEntity.GetComponent<Tag>())
-					{
-						parentSelected = false;
-						break;
-					}
-					tmp = tmpTr.Parent;
-				}
+				ReleaseImport(*import);
+				continue;
 			}
-			if (!parentSelected)
+			import->Update(deadline);
+			PopulateImport(*import, deadline);
+		}
+
+		//Kept until the workers let go of them, a cancelled import's jobs may still be running.
+		m_Imports.erase(std::remove_if(m_Imports.begin(), m_Imports.end(), [](const Ref<Import::ModelImport>& import)
+			{ return import->IsDone() && import->IsIdle(); }), m_Imports.end());
+	}
+
+	void Scene::PopulateImport(Import::ModelImport& import, std::chrono::steady_clock::time_point deadline)
+	{
+		using Status = Import::ModelImport::Status;
+		if (import.GetStatus() != Status::Processing && import.GetStatus() != Status::Populating)
+			return;
+
+		const auto& nodes = import.Nodes();
+		Ref<Mesh> placeholder{};
+		while (import.m_Entities.size() < nodes.size() && std::chrono::steady_clock::now() < deadline)
+		{
+			unsigned index = (unsigned)import.m_Entities.size();
+			const auto& node = nodes[index];
+			Entity parent = node.parent < 0 ? m_RootEntity : import.m_Entities[node.parent];
+			//Nodes under one deleted meanwhile aren't created.
+			if (!m_Registry.valid(parent))
+			{
+				import.m_Entities.push_back({});
+				continue;
+			}
+			Entity entity = CreateEntity(node.name, true, parent);
+			SetLocalTransform(entity.GetComponent<Transform>(), node.transform);
+			import.m_Entities.push_back(entity);
+			if (node.meshes.empty())
+				continue;
+
+			if (Ref<Mesh> mesh = import.GetMesh(node.meshes[0]))
 			{
-				mi.Draw((int)entity, transform);
+				entity.AddComponent<MeshInstance>(mesh);
+				continue;
 			}
+			if (!placeholder)
+				placeholder = MeshManager::GetPrimitiveMesh({ Primitive::Cube, {} });
+			entity.AddComponent<MeshInstance>(placeholder, false).Color = IMPORT_PLACEHOLDER_COLOR;
+			import.m_Placeholders.push_back(index);
 		}
 
+		//Swap in the meshes uploaded since. Entities deleted in the meantime are skipped.
+		auto& waiting = import.m_Placeholders;
+		for (std::size_t i = 0; i < waiting.size();)
+		{
+			Ref<Mesh> mesh = import.GetMesh(nodes[waiting[i]].meshes[0]);
+			if (!mesh)
+			{
+				++i;
+				continue;
+			}
+			Entity entity = import.m_Entities[waiting[i]];
+			//Replaced through the registry, so an autosave that caught the placeholder records the mesh.
+			if (m_Registry.valid(entity) && entity.HasComponent<MeshInstance>())
+				m_Registry.replace<MeshInstance>(entity, MeshInstance(mesh));
+			waiting[i] = waiting.back();
+			waiting.pop_back();
+		}
+
+		if (import.GetStatus() == Status::Populating && import.m_Entities.size() == nodes.size() && waiting.empty())
+			import.Finish();
+	}
+
+	void Scene::ReleaseImport(Import::ModelImport& import)
+	{
+		//Entities moved out of the model's hierarchy go too. The rest go with their ancestors.
+		for (Entity entity : import.m_Entities)
+		{
+			if (m_Registry.valid(entity))
+				DestroyEntity(entity);
+		}
+		import.Release();
+	}
+
+	void Scene::RenderScene()
+	{
+		auto& meshView = m_Registry.view<Transform, MeshInstance, Tag>();
+
+		//The selected subtree is drawn outlined afterwards, a label compare tells its meshes apart.
+		const Transform* selectedTr = m_SelectedEntity ? &m_SelectedEntity.GetComponent<Transform>() : nullptr;
+		m_OpaqueDrawList.clear();
+		for (auto& entity : meshView)
+		{
+			auto& [transform, mi, tag] = meshView.get(entity);
+			if (!selectedTr || !transform.IsInSubtree(*selectedTr))
+				m_OpaqueDrawList.push_back(entity);
+		}
+
+		auto depthFunc = std::bind(&Scene::RenderOpaqueDepth, this, std::placeholders::_1);
+		Renderer::BeginOpaquePass(depthFunc);
+		for (auto entity : m_OpaqueDrawList)
+		{
+			auto& [transform, mi, tag] = meshView.get(entity);
+			mi.Draw((int)entity, transform);
+		}
+		Renderer::EndOpaquePass();
+
 		Renderer::DrawSkybox();
 
 		//Draw selected entity and all children after all others to avoid if-checking every iteration
 		//and to make selection outline appear on top of all objects.
 		if ((bool)m_SelectedEntity)
 		{
-			std::queue<Entity> que{};
-			
-			auto& [transform, mi, tag] = meshView.get(m_SelectedEntity);
-			
-			for (auto& child : transform.Children)
-				que.push(child);
-
 			glm::vec4 blueColor = { 0.08f, 0.6f, 1.f, 1.f };
 			glm::vec4 prevColor = Renderer::SetOutlineColor(blueColor);
-		
-			while (que.size() != 0)
+
+			//The selected entity comes first in its subtree.
+			SubtreeRange subtree = Subtree(m_SelectedEntity);
+			for (auto it = subtree.begin() + 1; it != subtree.end(); ++it)
 			{
-				auto& curr = que.front();
-				auto& currTr = curr.GetComponent<Transform>();
-
-				if (curr.HasComponent<MeshInstance>())
-				{
-					auto& currMi = curr.GetComponent<MeshInstance>();
-					currMi.DrawOutlined((int)(entt::entity)curr, currTr);
-				}
-				for (auto& child : currTr.Children)
-					que.push(child);
-
-				que.pop();
+				if (MeshInstance* mi = m_Registry.try_get<MeshInstance>(*it))
+					mi->DrawOutlined((int)*it, m_Registry.get<Transform>(*it));
 			}
 			
 			Renderer::SetOutlineColor(prevColor);
 
-			if (m_SelectedEntity.HasComponent<MeshInstance>())
-				mi.DrawOutlined((int)(entt::entity)m_SelectedEntity, transform);
+			if (MeshInstance* mi = m_Registry.try_get<MeshInstance>(m_SelectedEntity))
+				mi->DrawOutlined((int)(entt::entity)m_SelectedEntity, *selectedTr);
 		}
 	}
 
@@ -167,6 +618,16 @@ namespace Crave
 		}
 	}
 
+	void Scene::RenderOpaqueDepth(ShaderType shType)
+	{
+		auto& meshView = m_Registry.view<Transform, MeshInstance>();
+		for (auto entity : m_OpaqueDrawList)
+		{
+			auto& [transform, mi] = meshView.get(entity);
+			Renderer::DrawDepth(transform, mi.PMesh, shType);
+		}
+	}
+
 	void Scene::RenderShadow()
 	{
 		int frameNum = 0;
@@ -187,8 +648,60 @@ namespace Crave
 
 	void Scene::OnUpdate(float deltaTime)
 	{
+		m_Commands->Apply();
+		UpdateImports();
 		RenderShadow();
 		RenderScene();
 	}
 
-}
\ No newline at end of file
+	void Scene::BenchmarkNames(std::size_t count)
+	{
+		//Like an imported city: a few thousand part names, each used by many entities, too long to
+		//fit a std::string's own buffer.
+		const std::size_t distinct = std::max<std::size_t>(count / 20, 1);
+		auto nameOf = [](std::size_t i) { return "Building_Window_" + std::to_string(i); };
+		std::vector<std::string> strings;
+		strings.reserve(count);
+		for (std::size_t i = 0; i < count; ++i)
+			strings.push_back(nameOf(i % distinct));
+
+		const std::size_t tableBytes = NameTable::Bytes();
+		Ref<Scene> scene = CreateRef<BenchmarkScene>();
+		Stopwatch timer;
+		for (const std::string& name : strings)
+			scene->CreateEntity(name);
+		float createMs = timer.ElapsedMs();
+
+		//What the names took as strings in every Tag, against ids, the table's growth and the index.
+		std::size_t stringBytes = 0;
+		for (const std::string& name : strings)
+			stringBytes += sizeof(std::string) + (name.capacity() > 15 ? name.capacity() + 1 : 0);
+		std::size_t indexBytes = scene->m_NameSlots.capacity() * sizeof(scene->m_NameSlots[0]) +
+			scene->m_NameIndex.bucket_count() * sizeof(void*);
+		for (const auto& [name, entities] : scene->m_NameIndex)
+			indexBytes += sizeof(std::pair<const NameTable::Id, std::vector<entt::entity>>) + sizeof(void*) +
+				entities.capacity() * sizeof(entt::entity);
+		const std::size_t idBytes = count * sizeof(Tag) + NameTable::Bytes() - tableBytes;
+
+		const std::size_t lookups = 1000;
+		std::size_t scanFound = 0, indexFound = 0;
+		timer.Restart();
+		for (std::size_t i = 0; i < lookups; ++i)
+		{
+			const std::string name = nameOf(i * 7 % distinct);
+			for (const std::string& tag : strings)
+				scanFound += tag == name;
+		}
+		float scanMs = timer.ElapsedMs();
+		timer.Restart();
+		for (std::size_t i = 0; i < lookups; ++i)
+			indexFound += scene->FindEntities(nameOf(i * 7 % distinct)).size();
+		float indexMs = timer.ElapsedMs();
+
+		if (scanFound != indexFound)
+			LOG_WARN("Name benchmark: the index found {} entities, the scan {}.", indexFound, scanFound);
+		LOG_INFO("Name benchmark, {} entities with {} names: strings {:.1f} KB, ids {:.1f} KB + index {:.1f} KB, "
+			"creating {:.1f} ms; {} lookups: scan {:.2f} ms, index {:.3f} ms", count, distinct, stringBytes / 1024.f,
+			idBytes / 1024.f, indexBytes / 1024.f, createMs, lookups, scanMs, indexMs);
+	}
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include "entt.hpp"
 #include "scene/Entity.h"
 //#include "import/Model.h"
@@ -7,12 +8,25 @@
 
 namespace Crave
 {
-	namespace Import { class Model; struct ModelNodeData; }
+	namespace Import { class ModelImport; }
+	class Prefab;
+	class EntityCommandBuffer;
 	
 	class Scene
 	{
 	protected:
 		typedef int ImGuiWindowFlags;
+	public:
+		//Entities of a subtree in preorder, its root first.
+		struct SubtreeRange
+		{
+			const entt::entity* First = nullptr;
+			const entt::entity* Last = nullptr;
+
+			const entt::entity* begin() const { return First; }
+			const entt::entity* end() const { return Last; }
+			std::size_t size() const { return Last - First; }
+		};
 	public:
 		Scene();
 		virtual ~Scene() = 0;
@@ -20,31 +34,131 @@ namespace Crave
 		Entity GetEntity(entt::entity id);
 
 		Entity CreateEntity(const std::string& name, bool hasParent = false, Entity parent = { entt::null, nullptr });
+		//Creates count entities under parent, the scene root if null, with a copy of each prototype
+		//component. Every component type is inserted in one batch. Lights get a renderer slot each.
+		template<typename... Components>
+		std::vector<Entity> CreateEntities(std::size_t count, const std::string& name, Entity parent = {},
+			const Components&... prototypes)
+		{
+			std::vector<entt::entity> handles = CreateBatch(count, name, parent);
+			(m_Registry.insert<Components>(handles.begin(), handles.end(), prototypes), ...);
+
+			std::vector<Entity> entities;
+			entities.reserve(count);
+			for (entt::entity handle : handles)
+				entities.emplace_back(handle, this);
+			return entities;
+		}
+		//Destroys entity with its whole subtree in one batch, unlinks it from its parent and gives back
+		//the lights' renderer slots and model meshes nothing else uses.
 		void DestroyEntity(Entity entity);
+		//Moves entity, with its subtree, to the end of parent's children. Its local transform is kept.
+		//False if parent is entity or one of its descendants.
+		bool SetParent(Entity entity, Entity parent);
+		//O(1), compares the entities' tree labels. True if entity is root too.
+		bool IsInSubtree(Entity entity, Entity root) const;
+		//Contiguous, valid until the hierarchy changes. The preorder is rebuilt on the first call
+		//after a change.
+		SubtreeRange Subtree(Entity root);
+		//Entities named name, in no particular order. Valid until an entity is created, renamed or
+		//destroyed.
+		const std::vector<entt::entity>& FindEntities(NameTable::Id name) const;
+		const std::vector<entt::entity>& FindEntities(const std::string& name) const;
+		//One of the entities named name, null if there's none.
+		Entity FindEntity(const std::string& name);
+		//Moves on whenever entities are created, destroyed, moved or renamed, so views of the hierarchy
+		//know when to rebuild.
+		uint64_t HierarchyVersion() const { return m_HierarchyVersion; }
+		//For structural changes while iterating views. Applied at the start of OnUpdate.
+		EntityCommandBuffer& Commands() { return *m_Commands; }
 
+		//Instantiates the model's prefab, which is imported the first time.
 		Entity ImportModel(const std::string& path);
+		//Creates the prefab's entities in bulk under parent, the scene root if null, and returns the
+		//instance's root. transform goes on top of the root's own. The meshes are shared.
+		Entity Instantiate(const Ref<Prefab>& prefab, const glm::mat4& transform = glm::mat4(1.f), Entity parent = {});
+		//Returns at once. The model's entities appear over the next frames, see Import::ModelImport.
+		Ref<Import::ModelImport> ImportModelAsync(const std::string& path);
+		const std::vector<Ref<Import::ModelImport>>& PendingImports() const { return m_Imports; }
 
 		Entity SelectedEntity() const { return m_SelectedEntity; }
 		void SelectEntity(Entity entity) { m_SelectedEntity = entity; }
 
+		//Logs the memory names take and how fast entities are found by name, with the name index
+		//against a scan of per-entity strings, at count entities.
+		static void BenchmarkNames(std::size_t count = 100000);
+
 		virtual void OnUpdate(float deltaTime);
 		virtual void OnImGuiRender(ImGuiWindowFlags panelFlags) = 0;
 	private:
-		Entity Scene::PocessNodeData(const Import::ModelNodeData& nd, Entity parent);
+		//Advances pending imports and creates their entities until the frame's import budget is spent.
+		void UpdateImports();
+		//Entities with a Tag and Transform for CreateEntities.
+		std::vector<entt::entity> CreateBatch(std::size_t count, const std::string& name, Entity parent);
+		void PopulateImport(Import::ModelImport& import, std::chrono::steady_clock::time_point deadline);
+		void ReleaseImport(Import::ModelImport& import);
+		//Destroys every entity and cancels pending imports. A new scene root is created.
+		void Clear();
+		void CreateRoot();
+		//Sibling links of the Transforms involved are patched, so observers see them change.
+		void LinkChild(Entity parent, Entity child);
+		void UnlinkChild(Entity child);
+		//Labels first and its next siblings, with their subtrees, linked in last under their parent.
+		//The whole tree is relabeled when there's no room left for them.
+		void LabelNewChildren(Entity first);
+		//Spreads the labels evenly over the whole range.
+		void RelabelTree();
+		void UpdateTreeOrder();
+		//The cached preorder goes stale and the hierarchy version moves on.
+		void OnHierarchyChanged();
+		void OnLightConstruct(entt::registry& registry, entt::entity entity);
+		void OnLightDestroy(entt::registry& registry, entt::entity entity);
+		void OnTagConstruct(entt::registry& registry, entt::entity entity);
+		void OnTagUpdate(entt::registry& registry, entt::entity entity);
+		void OnTagDestroy(entt::registry& registry, entt::entity entity);
+		void IndexName(entt::entity entity, NameTable::Id name);
+		void UnindexName(entt::entity entity);
 
 		void RenderScene();
 		void RenderSceneDepth(ShaderType shType);
+		void RenderOpaqueDepth(ShaderType shType);
 		void RenderShadow();
+	private:
+		//Main thread time per frame spent on uploads and entity creation for async imports.
+		static constexpr float IMPORT_BUDGET_MS = 4.f;
+		//Most label space a new entity takes, the rest is left for the ones after it.
+		static constexpr uint64_t TREE_LABEL_STEP = 1ull << 20;
 	protected:
 		entt::registry m_Registry{};
 		size_t m_NumOfEntities{};
 		Entity m_SelectedEntity{};
 		Entity m_RootEntity{};
-		std::vector<Import::Model> m_ImportedModels{};
+		std::vector<Ref<Import::ModelImport>> m_Imports{};
+		std::vector<entt::entity> m_OpaqueDrawList{};
+		Scope<EntityCommandBuffer> m_Commands;
+		//Preorder from the scene root, and each entity's range in it by entity index.
+		std::vector<entt::entity> m_TreeOrder{};
+		std::vector<std::pair<uint32_t, uint32_t>> m_TreeSpans{};
+		bool m_TreeOrderDirty = true;
+		uint64_t m_HierarchyVersion = 0;
+		//Entities by name, a multimap kept as one list per name so an entity leaves it in O(1).
+		std::unordered_map<NameTable::Id, std::vector<entt::entity>> m_NameIndex{};
+		//Each entity's name and place in its list, by entity index.
+		std::vector<std::pair<NameTable::Id, uint32_t>> m_NameSlots{};
 
 
 		friend class Entity;
 		friend class SceneHierarchyPanel;
 		friend class SceneSerializer;
+		friend class SceneAutosave;
+		friend class SceneHistory;
+		friend class EntityCommandBuffer;
+	};
+
+	//A scene with no UI of its own, for benchmarks and self-tests to fill and throw away.
+	class BenchmarkScene : public Scene
+	{
+	public:
+		void OnImGuiRender(ImGuiWindowFlags panelFlags) override {}
 	};
 }
\ No newline at end of file
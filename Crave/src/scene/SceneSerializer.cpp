@@ -3,219 +3,1414 @@
 #include "scene/Component.h"
 #include "scene/Entity.h"
 
+#include <filesystem>
 #include <fstream>
-#include <cereal/types/vector.hpp>
-#include <cereal/types/unordered_map.hpp>
-#include <cereal/types/memory.hpp>
-#include <cereal/archives/json.hpp>
+#include <unordered_set>
+#include <cereal/external/rapidjson/document.h>
+#include <cereal/external/rapidjson/prettywriter.h>
+#include <cereal/external/rapidjson/stringbuffer.h>
+#include "magic_enum.hpp"
 
+#include "core/FileFormat.h"
+#include "core/Hash.h"
+#include "core/JobSystem.h"
+#include "core/Stopwatch.h"
+#include "import/Model.h"
+#include "scene/Prefab.h"
+#include "platform/MappedFile.h"
 #include "renderer/MeshManager.h"
 
 namespace Crave
 {
 	using namespace Component;
 
-#if 0
-	namespace cereal
+	namespace //private
 	{
-#if 1
-		template<typename Archive>
-		static void serialize(Archive& ar, glm::quat& quat)
+		namespace json = CEREAL_RAPIDJSON_NAMESPACE;
+		using FileFormat::ArrayAt;
+		using FileFormat::Member;
+		using FileFormat::WriteFile;
+
+		constexpr char MAGIC[4] = { 'C', 'V', 'S', 'C' };
+		constexpr char JOURNAL_MAGIC[4] = { 'C', 'V', 'S', 'J' };
+		constexpr uint32_t NO_STRING = ~0u;
+
+		constexpr uint32_t FourCC(const char(&code)[5])
+		{
+			return uint32_t(code[0]) | uint32_t(code[1]) << 8 | uint32_t(code[2]) << 16 | uint32_t(code[3]) << 24;
+		}
+
+		//Chunk types. Readers skip the ones they don't know, so chunks can be added without a version bump.
+		constexpr uint32_t CHUNK_STRINGS = FourCC("STRS");    //uint32 offsets[count + 1], then the characters
+		constexpr uint32_t CHUNK_ASSETS = FourCC("ASET");     //AssetRecord[count]
+		constexpr uint32_t CHUNK_TEXTURES = FourCC("ATEX");   //TextureRef[count], ranges of it per primitive asset
+		constexpr uint32_t CHUNK_HIERARCHY = FourCC("HIER");  //int32 parent[entityCount]
+		constexpr uint32_t CHUNK_TAGS = FourCC("TAGS");       //uint32 string[entityCount]
+		constexpr uint32_t CHUNK_TRANSFORMS = FourCC("XFRM"); //TransformRecord[entityCount]
+		constexpr uint32_t CHUNK_MESHES = FourCC("MESH");     //MeshRecord[count]
+		constexpr uint32_t CHUNK_LIGHTS = FourCC("LGHT");     //LightRecord[count]
+		constexpr uint32_t CHUNK_IDS = FourCC("EIDS");        //uint32 id[entityCount], SceneAutosave's
+		//Marks a journal frame, whose hierarchy chunk holds parent ids instead of indices.
+		constexpr uint32_t CHUNK_REMOVED = FourCC("GONE");    //uint32 id[count] of destroyed entities
+
+		struct FileHeader
+		{
+			char magic[4];
+			uint32_t version;
+			uint32_t entityCount;
+			uint32_t chunkCount;
+		};
+
+		//Follows the header, one per chunk. Offsets are from the start of the file.
+		struct ChunkRecord
+		{
+			uint32_t type;
+			uint32_t count;
+			uint64_t offset;
+			uint64_t bytes;
+		};
+
+		enum class AssetKind : uint32_t
+		{
+			Primitive, Model
+		};
+
+		struct AssetRecord
+		{
+			AssetKind kind;
+			int32_t primitive;     //Primitive of primitive meshes
+			uint64_t contentHash;  //MeshManager::GetContentHash of model meshes
+			uint32_t source;       //model path, NO_STRING if unknown
+			uint32_t textureFirst; //primitive textures, a range of the texture chunk
+			uint32_t textureCount;
+			uint32_t padding;
+		};
+
+		struct TextureRef
+		{
+			int32_t type;
+			uint32_t path;
+		};
+
+		struct TransformRecord
+		{
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 eulerAngles;
+			glm::vec3 scale;
+		};
+
+		struct MeshRecord
+		{
+			uint32_t entity;
+			uint32_t asset;
+			uint32_t hasTextures;
+			glm::vec4 color;
+		};
+
+		struct LightRecord
+		{
+			uint32_t entity;
+			uint32_t enabled;
+			uint32_t isDynamic;
+			uint32_t padding;
+			LightData data;
+		};
+
+		//Starts the journal. baseHash, the XXH64 of the scene file, keeps frames from being applied to
+		//another version of it.
+		struct JournalHeader
+		{
+			char magic[4];
+			uint32_t version;
+			uint64_t baseHash;
+		};
+
+		//Precedes each journal frame, a scene file of its own padded to 8 bytes. A frame cut short by a
+		//crash fails its hash.
+		struct FrameHeader
+		{
+			uint64_t bytes;
+			uint64_t hash;
+		};
+
+		template<typename T>
+		bool ReadChunk(const uint8_t* data, std::size_t size, const ChunkRecord& chunk, std::vector<T>& out)
+		{
+			const T* items = ArrayAt<T>(data, size, chunk.offset, chunk.count);
+			if (!items || chunk.bytes < uint64_t(chunk.count) * sizeof(T))
+				return false;
+			out.assign(items, items + chunk.count);
+			return true;
+		}
+
+		bool ReadStrings(const uint8_t* data, std::size_t size, const ChunkRecord& chunk, std::vector<std::string>& out)
+		{
+			const uint32_t* offsets = ArrayAt<uint32_t>(data, size, chunk.offset, std::size_t(chunk.count) + 1);
+			const uint64_t offsetBytes = (uint64_t(chunk.count) + 1) * sizeof(uint32_t);
+			if (!offsets || !ArrayAt<char>(data, size, chunk.offset, chunk.bytes) || chunk.bytes < offsetBytes ||
+				offsets[chunk.count] > chunk.bytes - offsetBytes)
+				return false;
+
+			const char* characters = (const char*)(offsets + chunk.count + 1);
+			out.resize(chunk.count);
+			for (uint32_t i = 0; i < chunk.count; ++i)
+			{
+				if (offsets[i] > offsets[i + 1])
+					return false;
+				out[i].assign(characters + offsets[i], offsets[i + 1] - offsets[i]);
+			}
+			return true;
+		}
+
+		//Replaces the scene file and starts an empty journal for it.
+		bool WriteBase(const std::string& filePath, const std::vector<uint8_t>& bytes)
+		{
+			JournalHeader header{};
+			std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+			header.version = SceneSerializer::FORMAT_VERSION;
+			header.baseHash = Hash::XXH64(bytes.data(), bytes.size());
+			return WriteFile(filePath, bytes.data(), bytes.size()) &&
+				WriteFile(filePath + SceneSerializer::JOURNAL_EXTENSION, &header, sizeof(header));
+		}
+
+		//Returns the bytes added to the journal, 0 if writing failed.
+		std::size_t AppendFrame(const std::string& journalPath, const std::vector<uint8_t>& bytes)
 		{
-			ar& cereal::make_nvp("X", quat.x);
-			ar& cereal::make_nvp("Y", quat.y);
-			ar& cereal::make_nvp("Z", quat.z);
-			ar& cereal::make_nvp("W", quat.w);
+			const FrameHeader header{ bytes.size(), Hash::XXH64(bytes.data(), bytes.size()) };
+			const char padding[8]{};
+			const std::size_t paddingBytes = (8 - bytes.size() % 8) % 8;
+
+			std::ofstream ofs(journalPath, std::ios::binary | std::ios::app);
+			ofs.write((const char*)&header, sizeof(header));
+			ofs.write((const char*)bytes.data(), bytes.size());
+			ofs.write(padding, paddingBytes);
+			ofs.flush();
+			if (!ofs)
+			{
+				LOG_ERROR("Appending to scene journal '{}' failed.", journalPath);
+				return 0;
+			}
+			return sizeof(header) + bytes.size() + paddingBytes;
 		}
 
-		template<typename Archive>
-		static void serialize(Archive& ar, glm::vec2& vec)
+		//Shortest text that reads back as the same float, so the JSON stays diffable and lossless.
+		template<typename Writer>
+		void Float(Writer& writer, float value)
 		{
-			ar& cereal::make_nvp("X", vec.x);
-			ar& cereal::make_nvp("Y", vec.y);
+			char text[32];
+			int length = 0;
+			for (int precision = 6; precision <= 9; ++precision)
+			{
+				length = std::snprintf(text, sizeof(text), "%.*g", precision, value);
+				if (std::strtof(text, nullptr) == value)
+					break;
+			}
+			if (!std::isfinite(value))
+				length = std::snprintf(text, sizeof(text), "0");
+			writer.RawValue(text, length, json::kNumberType);
 		}
 
-		template<typename Archive>
-		static void serialize(Archive& ar, glm::vec3& vec)
+		template<typename Writer>
+		void Floats(Writer& writer, const float* values, int count)
 		{
-			ar& cereal::make_nvp("X", vec.x);
-			ar& cereal::make_nvp("Y", vec.y);
-			ar& cereal::make_nvp("Z", vec.z);
+			writer.StartArray();
+			for (int i = 0; i < count; ++i)
+				Float(writer, values[i]);
+			writer.EndArray();
 		}
 
-		template<typename Archive>
-		static void serialize(Archive& ar, glm::vec4& vec)
+		template<typename Writer, typename Enum>
+		void EnumName(Writer& writer, Enum value)
 		{
-			ar& cereal::make_nvp("X", vec.x);
-			ar& cereal::make_nvp("Y", vec.y);
-			ar& cereal::make_nvp("Z", vec.z);
-			ar& cereal::make_nvp("W", vec.w);
+			auto name = magic_enum::enum_name(value);
+			writer.String(name.data(), (json::SizeType)name.size());
 		}
-#endif
 
-#if 1
-		template<typename Archive>
-		static void serialize(Archive& ar, Transform& tr)
+		bool ReadFloats(const json::Value& obj, const char* name, float* out, unsigned count)
 		{
-			ar& cereal::make_nvp("Pos", tr.Position);
-			ar& cereal::make_nvp("Quat", tr.Quaternion);
-			ar& cereal::make_nvp("EulerAngles", tr.EulerAngles);
-			ar& cereal::make_nvp("Scale", tr.Scale);
+			const json::Value* v = Member(obj, name);
+			if (!v || !v->IsArray() || v->Size() != count)
+				return false;
+			for (unsigned i = 0; i < count; ++i)
+			{
+				if (!(*v)[i].IsNumber())
+					return false;
+				out[i] = (float)(*v)[i].GetDouble();
+			}
+			return true;
 		}
 
-		template<typename Archive>
-		static void serialize(Archive& ar, LightData& l)
+		bool ReadString(const json::Value& obj, const char* name, std::string& out)
 		{
-			ar& cereal::make_nvp("Position", l.position);
-			ar& cereal::make_nvp("Constant", l.constant);
-			ar& cereal::make_nvp("Direction", l.direction);
-			ar& cereal::make_nvp("Linear", l.linear);
-			ar& cereal::make_nvp("Ambient", l.ambient);
-			ar& cereal::make_nvp("Quadratic", l.quadratic);
-			ar& cereal::make_nvp("Diffuse", l.diffuse);
-			ar& cereal::make_nvp("CutOff", l.cutOff);
-			ar& cereal::make_nvp("Specular", l.specular);
-			ar& cereal::make_nvp("OuterCutOff", l.outerCutOff);
-			ar& cereal::make_nvp("Type", l.type);
+			const json::Value* v = Member(obj, name);
+			if (!v || !v->IsString())
+				return false;
+			out.assign(v->GetString(), v->GetStringLength());
+			return true;
 		}
 
-		template<typename Archive>
-		static void serialize(Archive& ar, Light& l)
+		//Optional members keep out as it is when missing, but fail when present with the wrong type.
+		bool ReadFloat(const json::Value& obj, const char* name, float& out)
 		{
-			ar& cereal::make_nvp("LightData", l.Data);
-			ar& cereal::make_nvp("IsDynamic", l.IsDynamic);
-			ar& cereal::make_nvp("SSBOIndex", l.SSBOindex);
+			const json::Value* v = Member(obj, name);
+			if (v && v->IsNumber())
+				out = (float)v->GetDouble();
+			return !v || v->IsNumber();
 		}
-#endif
 
+		bool ReadBool(const json::Value& obj, const char* name, bool& out)
+		{
+			const json::Value* v = Member(obj, name);
+			if (v && v->IsBool())
+				out = v->GetBool();
+			return !v || v->IsBool();
+		}
 
-		template<typename Archive>
-		void serialize(Archive& ar, Mesh::Vertex& vertex)
+		template<typename Enum>
+		bool ReadEnum(const json::Value& obj, const char* name, Enum& out)
 		{
-			ar& cereal::make_nvp("Position", vertex.Position);
-			ar& cereal::make_nvp("Normal", vertex.Normal);
-			ar& cereal::make_nvp("TexCoords", vertex.TexCoords);
-			ar& cereal::make_nvp("Tangent", vertex.Tangent);
-			ar& cereal::make_nvp("Bitangent", vertex.Bitangent);
-			ar& cereal::make_nvp("Color", vertex.Color);
-			ar& cereal::make_nvp("m_BoneIDs", vertex.m_BoneIDs);
-			ar& cereal::make_nvp("m_Weights", vertex.m_Weights);
+			std::string text;
+			if (!ReadString(obj, name, text))
+				return false;
+			auto value = magic_enum::enum_cast<Enum>(text);
+			if (value)
+				out = *value;
+			return value.has_value();
 		}
+	}
+
+	struct SceneSerializer::SceneData
+	{
+		std::vector<std::string>	 strings{};
+		std::vector<AssetRecord>	 assets{};
+		std::vector<TextureRef>		 textures{};
+		//Entities in preorder, so parents precede their children. -1 is the scene root.
+		std::vector<int32_t>		 parents{};
+		std::vector<uint32_t>		 tags{};
+		std::vector<TransformRecord> transforms{};
+		std::vector<MeshRecord>		 meshes{};
+		std::vector<LightRecord>	 lights{};
+		//The SceneAutosave id of each entity. Left empty, ids are the indices.
+		std::vector<uint32_t>		 ids{};
+		//Journal frames only, with parents given as ids: the ids of destroyed entities.
+		bool						 isFrame = false;
+		std::vector<uint32_t>		 removed{};
+		//The entity each record was gathered from. Not stored.
+		std::vector<entt::entity>	 handles{};
 
-		template<typename Archive>
-		void serialize(Archive& ar, Mesh::PrimitiveData& data)
+		uint32_t AddString(const std::string& str)
 		{
-			ar& cereal::make_nvp("PrimitiveType", data.primType);
-			ar& cereal::make_nvp("Textures", data.textures);
+			auto [it, added] = stringIndex.emplace(str, (uint32_t)strings.size());
+			if (added)
+				strings.push_back(str);
+			return it->second;
 		}
 
-		template<class Archive>
-		void save(Archive& ar, const MeshInstance& pmesh)
+		//Each interned name is turned into a string once.
+		uint32_t AddName(NameTable::Id name)
 		{
-			ar& cereal::make_nvp("HasTextures", pmesh.HasTextures);
-			ar& cereal::make_nvp("Color", pmesh.Color);
-			ar& cereal::make_nvp("MeshData",
-				MeshManager::GetPrimitiveMeshData(pmesh.PMesh));
+			auto [it, added] = nameIndex.emplace(name, 0);
+			if (added)
+				it->second = AddString(NameTable::String(name));
+			return it->second;
 		}
 
-		template<class Archive>
-		void load(Archive& ar, MeshInstance& pmesh)
+		uint32_t AddAsset(const Ref<Mesh>& mesh)
 		{
-			ar& pmesh.HasTextures;
-			ar& pmesh.Color;
-			Mesh::PrimitiveData pData;
-			ar& pData;
-			pmesh.PMesh = MeshManager::GetPrimitiveMesh(pData);
+			auto [it, added] = assetIndex.emplace(mesh.get(), (uint32_t)assets.size());
+			if (!added)
+				return it->second;
+
+			AssetRecord asset{};
+			asset.source = NO_STRING;
+			asset.textureFirst = (uint32_t)textures.size();
+			if (MeshManager::IsModelMesh(mesh))
+			{
+				asset.kind = AssetKind::Model;
+				asset.contentHash = MeshManager::GetContentHash(mesh);
+				const std::string& source = MeshManager::GetModelSource(mesh);
+				if (!source.empty())
+					asset.source = AddString(source);
+				else
+					LOG_WARN("Saved mesh {:016x} has no source model, it only loads while already in memory.",
+						asset.contentHash);
+			}
+			else
+			{
+				const Mesh::PrimitiveData& primitive = MeshManager::GetPrimitiveMeshData(mesh);
+				asset.kind = AssetKind::Primitive;
+				asset.primitive = (int32_t)primitive.primType;
+				//Sorted, so saving the same scene twice gives the same file.
+				std::vector<std::pair<Mesh::TexType, std::vector<std::string>>> sorted(
+					primitive.textures.begin(), primitive.textures.end());
+				std::sort(sorted.begin(), sorted.end());
+				for (const auto& [type, paths] : sorted)
+				{
+					for (const auto& path : paths)
+						textures.push_back({ (int32_t)type, AddString(path) });
+				}
+			}
+			asset.textureCount = (uint32_t)textures.size() - asset.textureFirst;
+			assets.push_back(asset);
+			return it->second;
 		}
 
-		template<typename Archive>
-		void serialize(Archive& ar, Mesh::ModelData& data)
+		//Appends the entity's records, meshes turned into asset references, and returns its index.
+		uint32_t AddEntity(Entity entity, int32_t parent)
 		{
-			ar& cereal::make_nvp("Vertices", data.vertices);
-			ar& cereal::make_nvp("Indices", data.indices);
-			ar& cereal::make_nvp("Textures", data.textures);
+			const uint32_t index = (uint32_t)parents.size();
+			const Transform& tr = entity.GetComponent<Transform>();
+			parents.push_back(parent);
+			tags.push_back(AddName(entity.HasComponent<Tag>() ? entity.GetComponent<Tag>().Name : NameTable::EMPTY));
+			transforms.push_back({ tr.Position, tr.Quaternion, tr.EulerAngles, tr.Scale });
+			handles.push_back(entity);
+
+			if (entity.HasComponent<MeshInstance>())
+			{
+				const MeshInstance& mi = entity.GetComponent<MeshInstance>();
+				if (mi.PMesh)
+					meshes.push_back({ index, AddAsset(mi.PMesh), mi.HasTextures, mi.Color });
+			}
+			if (entity.HasComponent<Light>())
+			{
+				const Light& light = entity.GetComponent<Light>();
+				lights.push_back({ index, light.Enabled, light.IsDynamic, 0, light.Data });
+			}
+			return index;
 		}
 
-		template<class Archive>
-		void save(Archive& ar, const Model& model)
+		//Every index in range, so Build can trust it.
+		bool Validate() const
 		{
-			ar& cereal::make_nvp("NumberOfMeshes", model.Meshes.size());
-			for (size_t i = 0; i < model.Meshes.size(); ++i)
+			const std::size_t count = parents.size();
+			if (tags.size() != count || transforms.size() != count || (!ids.empty() && ids.size() != count) ||
+				(isFrame && ids.size() != count))
+				return false;
+			for (std::size_t i = 0; i < count; ++i)
 			{
-				ar& cereal::make_nvp("MeshData" + std::to_string(i),
-					MeshManager::GetModelMeshData(model.Meshes[i]));
+				if (parents[i] < -1 || (!isFrame && parents[i] >= (int64_t)i) || tags[i] >= strings.size())
+					return false;
 			}
+			for (const auto& asset : assets)
+			{
+				bool valid = asset.kind == AssetKind::Model ?
+					asset.source == NO_STRING || asset.source < strings.size() :
+					asset.kind == AssetKind::Primitive && magic_enum::enum_contains<Primitive>(asset.primitive);
+				if (!valid || asset.textureFirst > textures.size() || asset.textureCount > textures.size() - asset.textureFirst)
+					return false;
+			}
+			for (const auto& texture : textures)
+			{
+				if (texture.path >= strings.size() || !magic_enum::enum_contains<Mesh::TexType>(texture.type))
+					return false;
+			}
+			for (const auto& mesh : meshes)
+			{
+				if (mesh.entity >= count || mesh.asset >= assets.size())
+					return false;
+			}
+			for (const auto& light : lights)
+			{
+				if (light.entity >= count || !magic_enum::enum_contains(light.data.type) ||
+					!magic_enum::enum_contains(light.data.shadowmode))
+					return false;
+			}
+			return true;
+		}
+	private:
+		std::unordered_map<std::string, uint32_t> stringIndex{}; //strings are stored once
+		std::unordered_map<NameTable::Id, uint32_t> nameIndex{};
+		std::unordered_map<const Mesh*, uint32_t> assetIndex{};
+	};
+
+	void SceneSerializer::Gather(SceneData& data) const
+	{
+		Scene& scene = *m_Scene;
+
+		//The scene's preorder, the root left out. A parent's record index is its place in it less one.
+		Scene::SubtreeRange order = scene.Subtree(scene.m_RootEntity);
+		for (auto it = order.begin() + 1; it != order.end(); ++it)
+		{
+			Entity entity{ *it, &scene };
+			Entity parent = entity.GetComponent<Transform>().Parent;
+			data.AddEntity(entity, (int32_t)scene.m_TreeSpans[entt::to_entity((entt::entity)parent)].first - 1);
 		}
+	}
 
-		template<class Archive>
-		void load(Archive& ar, Model& model)
+	void SceneSerializer::Build(const SceneData& data)
+	{
+		Scene& scene = *m_Scene;
+
+		//Meshes first. A model mesh MeshManager doesn't have brings in its whole source model.
+		std::vector<Ref<Mesh>> meshes(data.assets.size());
+		std::unordered_set<uint32_t> loadedSources;
+		for (std::size_t i = 0; i < data.assets.size(); ++i)
 		{
-			size_t numfMeshes = 0;
-			ar& numfMeshes;
-			model.Meshes.resize(numfMeshes);
-			for (size_t i = 0; i < numfMeshes; ++i)
+			const AssetRecord& asset = data.assets[i];
+			if (asset.kind == AssetKind::Primitive)
+			{
+				Mesh::PrimitiveData primitive;
+				primitive.primType = (Primitive)asset.primitive;
+				for (uint32_t t = asset.textureFirst; t < asset.textureFirst + asset.textureCount; ++t)
+					primitive.textures[(Mesh::TexType)data.textures[t].type].push_back(data.strings[data.textures[t].path]);
+				meshes[i] = MeshManager::GetPrimitiveMesh(primitive);
+				continue;
+			}
+
+			meshes[i] = MeshManager::FindModelMesh(asset.contentHash);
+			if (!meshes[i] && asset.source != NO_STRING && loadedSources.insert(asset.source).second)
 			{
-				Mesh::ModelData mData;
-				ar& mData;
-				model.Meshes[i] = MeshManager::GetModelMesh(mData);
+				Prefab::Get(data.strings[asset.source]);
+				meshes[i] = MeshManager::FindModelMesh(asset.contentHash);
 			}
+			if (!meshes[i])
+				LOG_WARN("Scene mesh {:016x} of '{}' wasn't found, its entities are loaded without it.", asset.contentHash,
+					asset.source == NO_STRING ? "unknown model" : data.strings[asset.source]);
+		}
+
+		scene.Clear();
+		auto& registry = scene.m_Registry;
+		const std::size_t count = data.parents.size();
+		std::vector<entt::entity> handles(count);
+		registry.create(handles.begin(), handles.end());
+
+		std::vector<Tag> tags;
+		//Names are interned once per string, not per entity.
+		std::vector<NameTable::Id> names(data.strings.size(), NameTable::NONE);
+		std::vector<Transform> transforms;
+		tags.reserve(count);
+		transforms.reserve(count);
+		Transform& rootTransform = scene.m_RootEntity.GetComponent<Transform>();
+		//Index of each parent's last child so far, the root's at count.
+		std::vector<int32_t> lastChild(count + 1, -1);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const int32_t parent = data.parents[i];
+			Entity entity{ handles[i], &scene };
+			NameTable::Id& name = names[data.tags[i]];
+			if (name == NameTable::NONE)
+				name = NameTable::Intern(data.strings[data.tags[i]]);
+			tags.emplace_back().Name = name;
+			Transform& tr = transforms.emplace_back(entity, Entity{});
+			const TransformRecord& record = data.transforms[i];
+			tr.Position = record.position;
+			tr.Quaternion = record.rotation;
+			tr.EulerAngles = record.eulerAngles;
+			tr.Scale = record.scale;
+			int32_t& last = lastChild[parent < 0 ? count : parent];
+			(parent < 0 ? rootTransform : transforms[parent]).AppendChild(tr, last < 0 ? nullptr : &transforms[last]);
+			last = (int32_t)i;
 		}
+		registry.insert<Tag>(handles.begin(), handles.end(), std::make_move_iterator(tags.begin()));
+		registry.insert<Transform>(handles.begin(), handles.end(), std::make_move_iterator(transforms.begin()));
+		scene.RelabelTree();
+
+		std::vector<entt::entity> meshEntities;
+		std::vector<MeshInstance> meshInstances;
+		meshEntities.reserve(data.meshes.size());
+		meshInstances.reserve(data.meshes.size());
+		for (const auto& record : data.meshes)
+		{
+			if (!meshes[record.asset])
+				continue;
+			meshEntities.push_back(handles[record.entity]);
+			meshInstances.emplace_back(meshes[record.asset], record.hasTextures != 0).Color = record.color;
+		}
+		registry.insert<MeshInstance>(meshEntities.begin(), meshEntities.end(), meshInstances.begin());
+
+		//Few, and each takes a renderer slot.
+		for (const auto& record : data.lights)
+			registry.emplace<Light>(handles[record.entity], record.data, record.isDynamic != 0).Enabled = record.enabled != 0;
+
+		scene.m_NumOfEntities += count;
+	}
+
+	bool SceneSerializer::SaveScene(const std::string& filePath)
+	{
+		SceneData data;
+		Gather(data);
+		std::vector<uint8_t> bytes = Encode(data);
+		if (!WriteFile(filePath, bytes.data(), bytes.size()))
+			return false;
+
+		//Changes autosaved after the old file don't apply to this one.
+		std::error_code ec;
+		std::filesystem::remove(filePath + JOURNAL_EXTENSION, ec);
+		LOG_INFO("Saved scene '{}': {} entities, {:.1f} KB", filePath, data.parents.size(), bytes.size() / 1024.f);
+		return true;
 	}
-#endif
 
-#if 1
-	void SceneSerializer::SaveScene(const std::string& filePath) {}
-	void SceneSerializer::LoadScene(const std::string& filePath) {}
-#endif
+	std::vector<uint8_t> SceneSerializer::Encode(const SceneData& data)
+	{
+		std::vector<uint8_t> bytes;
+		//Appends size bytes at the next 8-byte boundary and returns where they went.
+		auto put = [&bytes](const void* src, std::size_t size)
+		{
+			bytes.resize((bytes.size() + 7) & ~std::size_t(7));
+			uint64_t offset = bytes.size();
+			bytes.insert(bytes.end(), (const uint8_t*)src, (const uint8_t*)src + size);
+			return offset;
+		};
+
+		std::vector<uint32_t> stringOffsets{ 0 };
+		std::string characters;
+		for (const auto& str : data.strings)
+		{
+			characters += str;
+			stringOffsets.push_back((uint32_t)characters.size());
+		}
+
+		std::vector<ChunkRecord> chunks;
+		auto chunk = [&chunks](uint32_t type, std::size_t count) { chunks.push_back({ type, (uint32_t)count, 0, 0 }); };
+		chunk(CHUNK_STRINGS, data.strings.size());
+		chunk(CHUNK_ASSETS, data.assets.size());
+		chunk(CHUNK_TEXTURES, data.textures.size());
+		chunk(CHUNK_HIERARCHY, data.parents.size());
+		chunk(CHUNK_TAGS, data.tags.size());
+		chunk(CHUNK_TRANSFORMS, data.transforms.size());
+		chunk(CHUNK_MESHES, data.meshes.size());
+		chunk(CHUNK_LIGHTS, data.lights.size());
+		if (!data.ids.empty())
+			chunk(CHUNK_IDS, data.ids.size());
+		if (data.isFrame)
+			chunk(CHUNK_REMOVED, data.removed.size());
+
+		FileHeader header{};
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = FORMAT_VERSION;
+		header.entityCount = (uint32_t)data.parents.size();
+		header.chunkCount = (uint32_t)chunks.size();
+		put(&header, sizeof(header));
+		uint64_t chunkTable = put(chunks.data(), chunks.size() * sizeof(ChunkRecord));
 
-#if 0
-	void SceneSerializer::SaveScene(const std::string& filePath)
+		auto fill = [&](std::size_t c, const void* src, std::size_t size)
+		{
+			chunks[c].offset = put(src, size);
+			chunks[c].bytes = size;
+		};
+		fill(0, stringOffsets.data(), stringOffsets.size() * sizeof(uint32_t));
+		bytes.insert(bytes.end(), characters.begin(), characters.end()); //right after the offsets, unaligned
+		chunks[0].bytes = bytes.size() - chunks[0].offset;
+		fill(1, data.assets.data(), data.assets.size() * sizeof(AssetRecord));
+		fill(2, data.textures.data(), data.textures.size() * sizeof(TextureRef));
+		fill(3, data.parents.data(), data.parents.size() * sizeof(int32_t));
+		fill(4, data.tags.data(), data.tags.size() * sizeof(uint32_t));
+		fill(5, data.transforms.data(), data.transforms.size() * sizeof(TransformRecord));
+		fill(6, data.meshes.data(), data.meshes.size() * sizeof(MeshRecord));
+		fill(7, data.lights.data(), data.lights.size() * sizeof(LightRecord));
+		std::size_t next = 8;
+		if (!data.ids.empty())
+			fill(next++, data.ids.data(), data.ids.size() * sizeof(uint32_t));
+		if (data.isFrame)
+			fill(next++, data.removed.data(), data.removed.size() * sizeof(uint32_t));
+		std::memcpy(&bytes[chunkTable], chunks.data(), chunks.size() * sizeof(ChunkRecord));
+		return bytes;
+	}
+
+	bool SceneSerializer::ExportJson(const std::string& filePath)
 	{
-		std::ofstream ofs(filePath);
-		ASSERT(ofs.is_open() && ofs.good(), "Open file failed.");
+		SceneData data;
+		Gather(data);
+
+		json::StringBuffer buffer;
+		json::PrettyWriter<json::StringBuffer> writer(buffer);
+		writer.SetIndent(' ', 2);
+		auto string = [&writer, &data](uint32_t index)
+		{
+			const std::string& str = data.strings[index];
+			writer.String(str.data(), (json::SizeType)str.size());
+		};
+
+		writer.StartObject();
+		writer.Key("Version");
+		writer.Uint(FORMAT_VERSION);
 
-		cereal::JSONOutputArchive oa(ofs);
+		writer.Key("Assets");
+		writer.StartArray();
+		for (const auto& asset : data.assets)
+		{
+			writer.StartObject();
+			writer.Key("Kind");
+			EnumName(writer, asset.kind);
+			if (asset.kind == AssetKind::Model)
+			{
+				//As text: JSON tools tend to read numbers as doubles.
+				char hash[17];
+				std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)asset.contentHash);
+				writer.Key("Hash");
+				writer.String(hash);
+				if (asset.source != NO_STRING)
+				{
+					writer.Key("Source");
+					string(asset.source);
+				}
+			}
+			else
+			{
+				writer.Key("Primitive");
+				EnumName(writer, (Primitive)asset.primitive);
+				writer.Key("Textures");
+				writer.StartArray();
+				for (uint32_t t = asset.textureFirst; t < asset.textureFirst + asset.textureCount; ++t)
+				{
+					writer.StartObject();
+					writer.Key("Type");
+					EnumName(writer, (Mesh::TexType)data.textures[t].type);
+					writer.Key("Path");
+					string(data.textures[t].path);
+					writer.EndObject();
+				}
+				writer.EndArray();
+			}
+			writer.EndObject();
+		}
+		writer.EndArray();
 
-		oa& cereal::make_nvp("NumberOfEntities", m_Scene->m_NumOfEntities);
+		//Components are written with their entity. The records are sorted by entity already.
+		std::size_t nextMesh = 0, nextLight = 0;
+		writer.Key("Entities");
+		writer.StartArray();
+		for (std::size_t i = 0; i < data.parents.size(); ++i)
+		{
+			const TransformRecord& tr = data.transforms[i];
+			writer.StartObject();
+			writer.Key("Name");
+			string(data.tags[i]);
+			writer.Key("Parent");
+			writer.Int(data.parents[i]);
+			writer.Key("Position");
+			Floats(writer, glm::value_ptr(tr.position), 3);
+			writer.Key("Rotation");
+			Floats(writer, glm::value_ptr(tr.rotation), 4);
+			writer.Key("EulerAngles");
+			Floats(writer, glm::value_ptr(tr.eulerAngles), 3);
+			writer.Key("Scale");
+			Floats(writer, glm::value_ptr(tr.scale), 3);
 
-		unsigned noTagCount = 0;
-		m_Scene->m_Registry.each([&](auto entityID)
+			if (nextMesh < data.meshes.size() && data.meshes[nextMesh].entity == i)
 			{
-				Entity entity = { entityID, m_Scene.get() };
-				if (!entity)
-					return;
+				const MeshRecord& mesh = data.meshes[nextMesh++];
+				writer.Key("Mesh");
+				writer.StartObject();
+				writer.Key("Asset");
+				writer.Uint(mesh.asset);
+				writer.Key("HasTextures");
+				writer.Bool(mesh.hasTextures != 0);
+				writer.Key("Color");
+				Floats(writer, glm::value_ptr(mesh.color), 4);
+				writer.EndObject();
+			}
+			if (nextLight < data.lights.size() && data.lights[nextLight].entity == i)
+			{
+				//Only what defines the light. The renderer fills in the rest.
+				const LightRecord& light = data.lights[nextLight++];
+				const LightData& l = light.data;
+				writer.Key("Light");
+				writer.StartObject();
+				writer.Key("Enabled");
+				writer.Bool(light.enabled != 0);
+				writer.Key("IsDynamic");
+				writer.Bool(light.isDynamic != 0);
+				writer.Key("Type");
+				EnumName(writer, l.type);
+				writer.Key("ShadowMode");
+				EnumName(writer, l.shadowmode);
+				writer.Key("Position");
+				Floats(writer, glm::value_ptr(l.position), 3);
+				writer.Key("Direction");
+				Floats(writer, glm::value_ptr(l.direction), 3);
+				writer.Key("Ambient");
+				Floats(writer, glm::value_ptr(l.ambient), 3);
+				writer.Key("Diffuse");
+				Floats(writer, glm::value_ptr(l.diffuse), 3);
+				writer.Key("Specular");
+				Floats(writer, glm::value_ptr(l.specular), 3);
+				writer.Key("Color");
+				Floats(writer, glm::value_ptr(l.color), 3);
+				writer.Key("Brightness");
+				Float(writer, l.brightness);
+				writer.Key("Constant");
+				Float(writer, l.constant);
+				writer.Key("Linear");
+				Float(writer, l.linear);
+				writer.Key("Quadratic");
+				Float(writer, l.quadratic);
+				writer.Key("CutOff");
+				Float(writer, l.cutOff);
+				writer.Key("OuterCutOff");
+				Float(writer, l.outerCutOff);
+				writer.EndObject();
+			}
+			writer.EndObject();
+		}
+		writer.EndArray();
+		writer.EndObject();
 
-				std::string name;
-				if (entity.HasComponent<Tag>())
-					name = entity.GetComponent<Tag>().String;
-				else
+		if (!WriteFile(filePath, buffer.GetString(), buffer.GetSize()))
+			return false;
+		LOG_INFO("Exported scene '{}': {} entities, {:.1f} KB", filePath, data.parents.size(), buffer.GetSize() / 1024.f);
+		return true;
+	}
+
+	bool SceneSerializer::ReadBinary(const uint8_t* bytes, std::size_t size, SceneData& data)
+	{
+		FileHeader header;
+		if (size < sizeof(FileHeader))
+			return false;
+		std::memcpy(&header, bytes, sizeof(FileHeader));
+		const ChunkRecord* chunks = ArrayAt<ChunkRecord>(bytes, size, sizeof(FileHeader), header.chunkCount);
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION || !chunks)
+			return false;
+
+		for (uint32_t c = 0; c < header.chunkCount; ++c)
+		{
+			const ChunkRecord& chunk = chunks[c];
+			bool read = true;
+			switch (chunk.type)
+			{
+			case CHUNK_STRINGS:    read = ReadStrings(bytes, size, chunk, data.strings); break;
+			case CHUNK_ASSETS:     read = ReadChunk(bytes, size, chunk, data.assets); break;
+			case CHUNK_TEXTURES:   read = ReadChunk(bytes, size, chunk, data.textures); break;
+			case CHUNK_HIERARCHY:  read = ReadChunk(bytes, size, chunk, data.parents); break;
+			case CHUNK_TAGS:       read = ReadChunk(bytes, size, chunk, data.tags); break;
+			case CHUNK_TRANSFORMS: read = ReadChunk(bytes, size, chunk, data.transforms); break;
+			case CHUNK_MESHES:     read = ReadChunk(bytes, size, chunk, data.meshes); break;
+			case CHUNK_LIGHTS:     read = ReadChunk(bytes, size, chunk, data.lights); break;
+			case CHUNK_IDS:        read = ReadChunk(bytes, size, chunk, data.ids); break;
+			case CHUNK_REMOVED:    read = ReadChunk(bytes, size, chunk, data.removed); data.isFrame = true; break;
+			default:               break; //written by a newer version
+			}
+			if (!read)
+				return false;
+		}
+		return data.parents.size() == header.entityCount;
+	}
+
+	bool SceneSerializer::ReadJson(const MappedFile& file, SceneData& data)
+	{
+		json::Document doc;
+		doc.Parse((const char*)file.Data(), file.Size());
+		if (doc.HasParseError() || !doc.IsObject())
+			return false;
+		const json::Value* version = Member(doc, "Version");
+		const json::Value* assets = Member(doc, "Assets");
+		const json::Value* entities = Member(doc, "Entities");
+		if (!version || !version->IsUint() || version->GetUint() != FORMAT_VERSION ||
+			!assets || !assets->IsArray() || !entities || !entities->IsArray())
+			return false;
+
+		for (const auto& a : assets->GetArray())
+		{
+			AssetRecord asset{};
+			asset.source = NO_STRING;
+			asset.textureFirst = (uint32_t)data.textures.size();
+			if (!ReadEnum(a, "Kind", asset.kind))
+				return false;
+			if (asset.kind == AssetKind::Model)
+			{
+				std::string hash, source;
+				if (!ReadString(a, "Hash", hash) || hash.size() != 16 ||
+					hash.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+					return false;
+				asset.contentHash = std::stoull(hash, nullptr, 16);
+				if (ReadString(a, "Source", source))
+					asset.source = data.AddString(source);
+			}
+			else
+			{
+				Primitive primitive;
+				const json::Value* textures = Member(a, "Textures");
+				if (!ReadEnum(a, "Primitive", primitive) || (textures && !textures->IsArray()))
+					return false;
+				asset.primitive = (int32_t)primitive;
+				for (json::SizeType t = 0; textures && t < textures->Size(); ++t)
 				{
-					name = "NoTagEntity" + std::to_string(noTagCount);
-					noTagCount++;
+					Mesh::TexType type;
+					std::string path;
+					if (!ReadEnum((*textures)[t], "Type", type) || !ReadString((*textures)[t], "Path", path))
+						return false;
+					data.textures.push_back({ (int32_t)type, data.AddString(path) });
 				}
+			}
+			asset.textureCount = (uint32_t)data.textures.size() - asset.textureFirst;
+			data.assets.push_back(asset);
+		}
+
+		for (const auto& e : entities->GetArray())
+		{
+			const uint32_t index = (uint32_t)data.parents.size();
+			std::string name;
+			const json::Value* parent = Member(e, "Parent");
+			TransformRecord tr{};
+			if (!ReadString(e, "Name", name) || !parent || !parent->IsInt() ||
+				!ReadFloats(e, "Position", glm::value_ptr(tr.position), 3) ||
+				!ReadFloats(e, "Rotation", glm::value_ptr(tr.rotation), 4) ||
+				!ReadFloats(e, "EulerAngles", glm::value_ptr(tr.eulerAngles), 3) ||
+				!ReadFloats(e, "Scale", glm::value_ptr(tr.scale), 3))
+				return false;
+			data.parents.push_back(parent->GetInt());
+			data.tags.push_back(data.AddString(name));
+			data.transforms.push_back(tr);
 
-				oa& cereal::make_nvp(name, entity);
+			if (const json::Value* mesh = Member(e, "Mesh"))
+			{
+				MeshRecord record{ index };
+				bool hasTextures = true;
+				const json::Value* asset = Member(*mesh, "Asset");
+				if (!asset || !asset->IsUint() || !ReadBool(*mesh, "HasTextures", hasTextures) ||
+					!ReadFloats(*mesh, "Color", glm::value_ptr(record.color), 4))
+					return false;
+				record.asset = asset->GetUint();
+				record.hasTextures = hasTextures;
+				data.meshes.push_back(record);
+			}
+
+			if (const json::Value* light = Member(e, "Light"))
+			{
+				//Members left out keep the defaults of the light's type.
+				LightType type;
+				if (!ReadEnum(*light, "Type", type))
+					return false;
+				LightRecord record{ index, 1, 0, 0, Renderer::GetDefaultLightData(type) };
+				LightData& l = record.data;
+				auto vec3 = [light](const char* name, glm::vec3& v)
+				{
+					return !Member(*light, name) || ReadFloats(*light, name, glm::value_ptr(v), 3);
+				};
+				bool enabled = true, isDynamic = false;
+				if (!ReadBool(*light, "Enabled", enabled) || !ReadBool(*light, "IsDynamic", isDynamic) ||
+					(Member(*light, "ShadowMode") && !ReadEnum(*light, "ShadowMode", l.shadowmode)) ||
+					!vec3("Position", l.position) || !vec3("Direction", l.direction) || !vec3("Ambient", l.ambient) ||
+					!vec3("Diffuse", l.diffuse) || !vec3("Specular", l.specular) || !vec3("Color", l.color) ||
+					!ReadFloat(*light, "Brightness", l.brightness) || !ReadFloat(*light, "Constant", l.constant) ||
+					!ReadFloat(*light, "Linear", l.linear) || !ReadFloat(*light, "Quadratic", l.quadratic) ||
+					!ReadFloat(*light, "CutOff", l.cutOff) || !ReadFloat(*light, "OuterCutOff", l.outerCutOff))
+					return false;
+				record.enabled = enabled;
+				record.isDynamic = isDynamic;
+				data.lights.push_back(record);
+			}
+		}
+		return true;
+	}
+
+	void SceneSerializer::ApplyJournal(const std::string& journalPath, uint64_t baseHash, SceneData& data)
+	{
+		MappedFile journal(journalPath);
+		if (!journal.IsOpen() || !data.Validate())
+			return;
+		JournalHeader header{};
+		if (journal.Size() >= sizeof(JournalHeader))
+			std::memcpy(&header, journal.Data(), sizeof(JournalHeader));
+		if (std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+			header.version != FORMAT_VERSION || header.baseHash != baseHash)
+		{
+			LOG_WARN("Scene journal '{}' was written for another version of the scene, it is ignored.", journalPath);
+			return;
+		}
+
+		//Where the latest record of each live entity is, by id.
+		struct Source
+		{
+			uint32_t frame;
+			uint32_t index;
+			int64_t parent;
+			uint64_t order; //among its siblings
+		};
+		std::unordered_map<uint32_t, Source> entities;
+		entities.reserve(data.parents.size());
+		auto baseId = [&data](uint32_t index) { return data.ids.empty() ? index : data.ids[index]; };
+		for (uint32_t i = 0; i < data.parents.size(); ++i)
+		{
+			const int64_t parent = data.parents[i] < 0 ? -1 : (int64_t)baseId(data.parents[i]);
+			entities.emplace(baseId(i), Source{ 0, i, parent, i });
+		}
+		uint64_t nextOrder = data.parents.size();
+
+		std::vector<SceneData> frames;
+		frames.push_back(std::move(data));
+		std::size_t offset = sizeof(JournalHeader);
+		while (offset < journal.Size())
+		{
+			FrameHeader frame{};
+			SceneData delta;
+			bool valid = journal.Size() - offset >= sizeof(FrameHeader);
+			if (valid)
+			{
+				std::memcpy(&frame, journal.Data() + offset, sizeof(FrameHeader));
+				offset += sizeof(FrameHeader);
+				const uint8_t* bytes = journal.Data() + offset;
+				valid = frame.bytes <= journal.Size() - offset && Hash::XXH64(bytes, frame.bytes) == frame.hash &&
+					ReadBinary(bytes, frame.bytes, delta) && delta.isFrame && delta.Validate();
+			}
+			if (!valid)
+			{
+				LOG_WARN("Scene journal '{}' is damaged after {} frames, the rest is dropped.", journalPath, frames.size() - 1);
+				break;
+			}
+			offset += (frame.bytes + 7) & ~uint64_t(7);
+
+			for (uint32_t id : delta.removed)
+				entities.erase(id);
+			for (uint32_t i = 0; i < delta.parents.size(); ++i)
+			{
+				auto [it, added] = entities.try_emplace(delta.ids[i]);
+				Source& source = it->second;
+				//New and moved entities go last among their siblings, as they do in the scene.
+				if (added || source.parent != delta.parents[i])
+					source.order = nextOrder++;
+				source.frame = (uint32_t)frames.size();
+				source.index = i;
+				source.parent = delta.parents[i];
+			}
+			frames.push_back(std::move(delta));
+		}
+		if (frames.size() == 1)
+		{
+			data = std::move(frames[0]);
+			return;
+		}
+
+		//Tables are per frame, so strings and assets are carried over as the merged entities use them.
+		std::vector<std::vector<uint32_t>> stringMaps(frames.size()), assetMaps(frames.size());
+		std::vector<std::vector<uint32_t>> meshOf(frames.size()), lightOf(frames.size());
+		for (std::size_t f = 0; f < frames.size(); ++f)
+		{
+			const SceneData& frame = frames[f];
+			stringMaps[f].assign(frame.strings.size(), NO_STRING);
+			assetMaps[f].assign(frame.assets.size(), NO_STRING);
+			meshOf[f].assign(frame.parents.size(), NO_STRING);
+			lightOf[f].assign(frame.parents.size(), NO_STRING);
+			for (uint32_t m = 0; m < frame.meshes.size(); ++m)
+				meshOf[f][frame.meshes[m].entity] = m;
+			for (uint32_t l = 0; l < frame.lights.size(); ++l)
+				lightOf[f][frame.lights[l].entity] = l;
+		}
+
+		SceneData merged;
+		auto string = [&](uint32_t f, uint32_t index)
+		{
+			uint32_t& mapped = stringMaps[f][index];
+			if (mapped == NO_STRING)
+				mapped = merged.AddString(frames[f].strings[index]);
+			return mapped;
+		};
+		auto asset = [&](uint32_t f, uint32_t index)
+		{
+			if (assetMaps[f][index] != NO_STRING)
+				return assetMaps[f][index];
+			const SceneData& frame = frames[f];
+			AssetRecord record = frame.assets[index];
+			record.source = record.source == NO_STRING ? NO_STRING : string(f, record.source);
+			record.textureFirst = (uint32_t)merged.textures.size();
+			for (uint32_t t = 0; t < record.textureCount; ++t)
+			{
+				const TextureRef& texture = frame.textures[frame.assets[index].textureFirst + t];
+				merged.textures.push_back({ texture.type, string(f, texture.path) });
+			}
+			merged.assets.push_back(record);
+			return assetMaps[f][index] = (uint32_t)merged.assets.size() - 1;
+		};
+
+		//Back to preorder. Entities whose parent is gone are dropped, as Gather never reaches them.
+		std::vector<std::pair<uint64_t, uint32_t>> byOrder;
+		byOrder.reserve(entities.size());
+		for (const auto& [id, source] : entities)
+			byOrder.push_back({ source.order, id });
+		std::sort(byOrder.begin(), byOrder.end());
+		std::unordered_map<int64_t, std::vector<uint32_t>> children;
+		for (const auto& [order, id] : byOrder)
+			children[entities[id].parent].push_back(id);
+
+		std::vector<std::pair<uint32_t, int32_t>> stack;
+		auto pushChildren = [&](int64_t parent, int32_t index)
+		{
+			auto it = children.find(parent);
+			if (it != children.end())
+			{
+				for (auto child = it->second.rbegin(); child != it->second.rend(); ++child)
+					stack.push_back({ *child, index });
+			}
+		};
+		pushChildren(-1, -1);
+		while (!stack.empty())
+		{
+			auto [id, parent] = stack.back();
+			stack.pop_back();
+			const Source& source = entities[id];
+			const SceneData& frame = frames[source.frame];
+			const uint32_t index = (uint32_t)merged.parents.size();
+			merged.parents.push_back(parent);
+			merged.ids.push_back(id);
+			merged.tags.push_back(string(source.frame, frame.tags[source.index]));
+			merged.transforms.push_back(frame.transforms[source.index]);
+			if (uint32_t m = meshOf[source.frame][source.index]; m != NO_STRING)
+			{
+				MeshRecord mesh = frame.meshes[m];
+				mesh.entity = index;
+				mesh.asset = asset(source.frame, mesh.asset);
+				merged.meshes.push_back(mesh);
+			}
+			if (uint32_t l = lightOf[source.frame][source.index]; l != NO_STRING)
+			{
+				LightRecord light = frame.lights[l];
+				light.entity = index;
+				merged.lights.push_back(light);
+			}
+			pushChildren(id, (int32_t)index);
+		}
+		data = std::move(merged);
+	}
+
+	bool SceneSerializer::Compact(const std::string& filePath, std::size_t& fileBytes)
+	{
+		SceneData data;
+		{
+			//Unmapped before the file is replaced.
+			MappedFile file(filePath);
+			if (!file.IsOpen() || !ReadBinary(file.Data(), file.Size(), data))
+				return false;
+			ApplyJournal(filePath + JOURNAL_EXTENSION, Hash::XXH64(file.Data(), file.Size()), data);
+		}
+		if (!data.Validate())
+			return false;
+
+		std::vector<uint8_t> bytes = Encode(data);
+		fileBytes = bytes.size();
+		return WriteBase(filePath, bytes);
+	}
+
+	bool SceneSerializer::LoadScene(const std::string& filePath)
+	{
+		Stopwatch timer;
+		MappedFile file(filePath);
+		if (!file.IsOpen())
+		{
+			LOG_ERROR("Scene '{}' can't be opened.", filePath);
+			return false;
+		}
+
+		SceneData data;
+		bool binary = file.Size() >= sizeof(MAGIC) && std::memcmp(file.Data(), MAGIC, sizeof(MAGIC)) == 0;
+		bool read = binary ? ReadBinary(file.Data(), file.Size(), data) : ReadJson(file, data);
+		if (read && binary)
+			ApplyJournal(filePath + JOURNAL_EXTENSION, Hash::XXH64(file.Data(), file.Size()), data);
+		if (!read || !data.Validate())
+		{
+			LOG_ERROR("Scene '{}' is damaged or of another version.", filePath);
+			return false;
+		}
+
+		Build(data);
+		LOG_INFO("Loaded scene '{}': {} entities in {:.1f} ms", filePath, data.parents.size(), timer.ElapsedMs());
+		return true;
+	}
+
+	void SceneSerializer::Benchmark(const std::vector<std::size_t>& entityCounts)
+	{
+		const std::string binaryPath = "res/cache/scene_benchmark.cscene";
+		const std::string jsonPath = "res/cache/scene_benchmark.json";
+		std::error_code ec;
+		std::filesystem::create_directories("res/cache", ec);
+		const Ref<Mesh> meshes[2] = {
+			MeshManager::GetPrimitiveMesh({ Primitive::Cube, {} }), MeshManager::GetPrimitiveMesh({ Primitive::Plane, {} })
+		};
+
+		for (std::size_t count : entityCounts)
+		{
+			//Families of eight under the scene root, every entity with a mesh, like imported models.
+			Ref<Scene> scene = CreateRef<BenchmarkScene>();
+			std::vector<Entity> entities;
+			entities.reserve(count);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				bool hasParent = i % 8 != 0;
+				Entity entity = scene->CreateEntity("Entity" + std::to_string(i), hasParent,
+					hasParent ? entities[i - i % 8] : Entity{});
+				entity.GetComponent<Transform>().Position = glm::vec3(i % 100, i / 100 % 100, i / 10000);
+				entity.AddComponent<MeshInstance>(meshes[i % 2]).Color = glm::vec4((i % 7) / 7.f, 0.5f, 0.5f, 1.f);
+				entities.push_back(entity);
+			}
+
+			SceneSerializer source(scene);
+			Stopwatch timer;
+			bool done = source.SaveScene(binaryPath);
+			float binarySave = timer.ElapsedMs();
+			timer.Restart();
+			done = source.ExportJson(jsonPath) && done;
+			float jsonSave = timer.ElapsedMs();
+
+			timer.Restart();
+			done = SceneSerializer(CreateRef<BenchmarkScene>()).LoadScene(binaryPath) && done;
+			float binaryLoad = timer.ElapsedMs();
+			timer.Restart();
+			done = SceneSerializer(CreateRef<BenchmarkScene>()).LoadScene(jsonPath) && done;
+			float jsonLoad = timer.ElapsedMs();
+
+			if (done)
+			{
+				LOG_INFO("Scene benchmark, {} entities: binary {:.1f} KB, save {:.1f} ms, load {:.1f} ms; "
+					"JSON {:.1f} KB, save {:.1f} ms, load {:.1f} ms", count,
+					std::filesystem::file_size(binaryPath, ec) / 1024.f, binarySave, binaryLoad,
+					std::filesystem::file_size(jsonPath, ec) / 1024.f, jsonSave, jsonLoad);
+			}
+			else
+				LOG_WARN("Scene benchmark at {} entities failed.", count);
+			std::filesystem::remove(binaryPath, ec);
+			std::filesystem::remove(jsonPath, ec);
+		}
+	}
+
+	SceneAutosave::SceneAutosave(Ref<Scene> scene, const std::string& filePath)
+		: m_Scene(scene), m_FilePath(filePath), m_State(CreateRef<FileState>())
+	{
+		entt::registry& registry = m_Scene->m_Registry;
+		Connect<Tag>(registry);
+		Connect<Transform>(registry);
+		Connect<MeshInstance>(registry);
+		Connect<Light>(registry);
+		Save();
+	}
+
+	SceneAutosave::~SceneAutosave()
+	{
+		Wait();
+		entt::registry& registry = m_Scene->m_Registry;
+		Disconnect<Tag>(registry);
+		Disconnect<Transform>(registry);
+		Disconnect<MeshInstance>(registry);
+		Disconnect<Light>(registry);
+	}
+
+	template<typename T>
+	void SceneAutosave::Connect(entt::registry& registry)
+	{
+		registry.on_construct<T>().template connect<&SceneAutosave::OnChanged>(*this);
+		registry.on_update<T>().template connect<&SceneAutosave::OnChanged>(*this);
+		//Entities always have a Transform, it goes with the entity.
+		if constexpr (std::is_same_v<T, Transform>)
+			registry.on_destroy<T>().template connect<&SceneAutosave::OnDestroyed>(*this);
+		else
+			registry.on_destroy<T>().template connect<&SceneAutosave::OnRemoved>(*this);
+	}
+
+	template<typename T>
+	void SceneAutosave::Disconnect(entt::registry& registry)
+	{
+		registry.on_construct<T>().disconnect(this);
+		registry.on_update<T>().disconnect(this);
+		registry.on_destroy<T>().disconnect(this);
+	}
+
+	void SceneAutosave::OnChanged(entt::registry& registry, entt::entity entity)
+	{
+		m_Dirty.insert(entity);
+		auto removed = m_Removed.find(entity);
+		if (removed != m_Removed.end())
+		{
+			m_Ids.emplace(entity, removed->second);
+			m_Removed.erase(removed);
+		}
+	}
+
+	void SceneAutosave::OnRemoved(entt::registry& registry, entt::entity entity)
+	{
+		//Pools are cleared in reverse order of creation when an entity is destroyed, so this may come
+		//after its Transform went. Such an entity is being destroyed, not changed.
+		if (registry.all_of<Transform>(entity))
+			m_Dirty.insert(entity);
+	}
+
+	void SceneAutosave::OnDestroyed(entt::registry& registry, entt::entity entity)
+	{
+		m_Dirty.erase(entity);
+		auto it = m_Ids.find(entity);
+		if (it != m_Ids.end())
+		{
+			m_Removed[entity] = it->second;
+			m_Ids.erase(it);
+		}
+	}
+
+	uint32_t SceneAutosave::IdOf(entt::entity entity)
+	{
+		auto [it, added] = m_Ids.try_emplace(entity, m_NextId);
+		if (added)
+			m_NextId++;
+		return it->second;
+	}
+
+	bool SceneAutosave::IsWriting() const
+	{
+		return m_Write.valid() && m_Write.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	}
+
+	void SceneAutosave::Wait()
+	{
+		if (m_Write.valid())
+			m_Write.get();
+	}
+
+	void SceneAutosave::OnUpdate(float deltaTime)
+	{
+		m_SinceSave += deltaTime;
+		if (m_SinceSave >= SAVE_INTERVAL_S && HasUnsavedChanges())
+			Save();
+	}
+
+	bool SceneAutosave::Save()
+	{
+		if (IsWriting())
+			return false;
+		Wait();
+		m_SinceSave = 0.f;
+
+		//After a failed write, the file and journal may not match any more.
+		m_Compact = m_Compact || m_State->failed;
+		if (!m_Compact && m_Dirty.empty() && m_Removed.empty())
+			return true;
+
+		//Copied out here, so the worker never touches the registry. Only the first save takes the whole
+		//scene, the worker folds the journal into the file after that.
+		auto data = std::make_shared<SceneSerializer::SceneData>();
+		Scene& scene = *m_Scene;
+		if (m_Compact)
+		{
+			SceneSerializer(m_Scene).Gather(*data);
+			m_Ids.clear();
+			for (uint32_t i = 0; i < data->handles.size(); ++i)
+				m_Ids.emplace(data->handles[i], i);
+			m_NextId = (uint32_t)data->handles.size();
+		}
+		else
+		{
+			//In preorder, so entities added in the same interval load back in their sibling order.
+			std::vector<std::pair<uint64_t, entt::entity>> dirty;
+			dirty.reserve(m_Dirty.size());
+			for (entt::entity handle : m_Dirty)
+			{
+				if (!scene.m_Registry.valid(handle) || handle == scene.m_RootEntity ||
+					!scene.m_Registry.all_of<Transform>(handle))
+					continue;
+				dirty.emplace_back(scene.m_Registry.get<Transform>(handle).TreeEnter, handle);
+			}
+			std::sort(dirty.begin(), dirty.end());
+			for (const auto& [treeEnter, handle] : dirty)
+			{
+				Entity entity{ handle, &scene };
+				Entity parent = entity.GetComponent<Transform>().Parent;
+				if (!scene.m_Registry.valid(parent))
+					continue; //unreachable, like its parent
+				data->AddEntity(entity, parent == scene.m_RootEntity ? -1 : (int32_t)IdOf(parent));
+				data->ids.push_back(IdOf(handle));
+			}
+			data->isFrame = true;
+			for (const auto& [handle, id] : m_Removed)
+				data->removed.push_back(id);
+		}
+		m_Dirty.clear();
+		m_Removed.clear();
+
+		const bool compact = m_Compact;
+		m_Compact = false;
+		m_Write = JobSystem::SubmitBackground([data, state = m_State, filePath = m_FilePath, compact]()
+			{
+				const std::vector<uint8_t> bytes = SceneSerializer::Encode(*data);
+				if (compact)
+				{
+					state->failed = !WriteBase(filePath, bytes);
+					state->baseBytes = bytes.size();
+					state->journalBytes = sizeof(JournalHeader);
+					state->frames = 0;
+				}
+				else
+				{
+					std::size_t written = AppendFrame(filePath + SceneSerializer::JOURNAL_EXTENSION, bytes);
+					state->failed = written == 0;
+					state->journalBytes += written;
+					state->frames++;
+				}
+				if (!state->failed && (state->frames >= COMPACT_FRAMES ||
+					state->journalBytes > state->baseBytes * COMPACT_RATIO))
+				{
+					state->failed = !SceneSerializer::Compact(filePath, state->baseBytes);
+					state->journalBytes = sizeof(JournalHeader);
+					state->frames = 0;
+				}
 			});
+		return true;
 	}
 
-	void SceneSerializer::LoadScene(const std::string& filePath)
+	bool SceneAutosave::TestDeletion()
 	{
-		std::ifstream ifs(filePath);
-		ASSERT(ifs.is_open() && ifs.good(), "Open file failed.");
+		const std::string filePath = "res/cache/autosave_test.cscene";
+		std::error_code ec;
+		std::filesystem::create_directories("res/cache", ec);
 
-		cereal::JSONInputArchive ia(ifs);
+		Ref<Scene> scene = CreateRef<BenchmarkScene>();
+		Entity deleted = scene->CreateEntity("Deleted");
+		scene->CreateEntity("DeletedChild", true, deleted);
+		scene->CreateEntity("Kept");
+		bool passed = false;
+		{
+			SceneAutosave autosave(scene, filePath);
+			autosave.Wait();
+			scene->DestroyEntity(deleted);
+			passed = autosave.HasUnsavedChanges() && autosave.Save();
+			autosave.Wait();
+		}
+
+		Ref<Scene> loaded = CreateRef<BenchmarkScene>();
+		passed = passed && SceneSerializer(loaded).LoadScene(filePath) && loaded->FindEntity("Kept") &&
+			!loaded->FindEntity("Deleted") && !loaded->FindEntity("DeletedChild");
+		if (passed)
+			LOG_INFO("Autosave deletion test passed.");
+		else
+			LOG_ERROR("Autosave deletion test failed: deleted entities came back on load.");
+		std::filesystem::remove(filePath, ec);
+		std::filesystem::remove(filePath + SceneSerializer::JOURNAL_EXTENSION, ec);
+		return passed;
+	}
+
+	bool SceneAutosave::TestSiblingOrder()
+	{
+		const std::string filePath = "res/cache/autosave_order_test.cscene";
+		constexpr int CHILD_COUNT = 64;
+		std::error_code ec;
+		std::filesystem::create_directories("res/cache", ec);
 
-		Renderer::ClearState();
-		MeshManager::Clear();
-		m_Scene->m_Registry.clear();
+		Ref<Scene> scene = CreateRef<BenchmarkScene>();
+		Entity parent = scene->CreateEntity("Parent");
+		bool passed = false;
+		{
+			SceneAutosave autosave(scene, filePath);
+			autosave.Wait();
+			//All in one interval, so they reach the journal in a single frame.
+			for (int i = 0; i < CHILD_COUNT; ++i)
+				scene->CreateEntity("Child" + std::to_string(i), true, parent);
+			passed = autosave.HasUnsavedChanges() && autosave.Save();
+			autosave.Wait();
+		}
 
-		size_t entity_count{};
-		ia& entity_count;
-		for (size_t i = 0; i < entity_count; ++i)
+		Ref<Scene> loaded = CreateRef<BenchmarkScene>();
+		passed = passed && SceneSerializer(loaded).LoadScene(filePath);
+		Entity loadedParent = passed ? loaded->FindEntity("Parent") : Entity{};
+		passed = passed && loadedParent && loadedParent.GetComponent<Transform>().ChildCount == CHILD_COUNT;
+		if (passed)
 		{
-			Entity entity = m_Scene->CreateEntity();
-			ia& entity;
+			int i = 0;
+			loadedParent.GetComponent<Transform>().ForEachChild([&](Entity child)
+				{
+					passed = passed && child.GetComponent<Tag>().String() == "Child" + std::to_string(i++);
+				});
 		}
+		if (passed)
+			LOG_INFO("Autosave sibling order test passed.");
+		else
+			LOG_ERROR("Autosave sibling order test failed: children created together loaded in another order.");
+		std::filesystem::remove(filePath, ec);
+		std::filesystem::remove(filePath + SceneSerializer::JOURNAL_EXTENSION, ec);
+		return passed;
 	}
-#endif
-}
\ No newline at end of file
+}
@@ -1,18 +1,130 @@
 #pragma once
+#include <future>
+#include <unordered_set>
 #include "scene/Scene.h"
 
 namespace Crave
 {
+	class MappedFile;
+
+	//Scenes are saved as .cscene: a header, a chunk table, a string table and one tightly packed array
+	//per component type. Meshes are stored as references, primitives by type and textures, imported
+	//meshes by content hash and source model, so no geometry ends up in the file.
 	class SceneSerializer
 	{
 	public:
+		//Bump whenever the binary layout changes. Files of other versions are rejected.
+		static constexpr uint32_t FORMAT_VERSION = 1;
+		//Appended to a .cscene path for its journal, the changes SceneAutosave saved after the file.
+		static constexpr const char* JOURNAL_EXTENSION = ".journal";
+
 		SceneSerializer(Ref<Scene> scene)
 			: m_Scene(scene) {}
 		~SceneSerializer() {}
 
-		void SaveScene(const std::string& filePath);
-		void LoadScene(const std::string& filePath);
+		bool SaveScene(const std::string& filePath);
+		//Replaces the scene's entities. Takes .cscene files, with their journal applied, and JSON
+		//written by ExportJson. The scene is left untouched if the file can't be read.
+		bool LoadScene(const std::string& filePath);
+		//Same content as SaveScene in readable JSON, for diffing.
+		bool ExportJson(const std::string& filePath);
+
+		//Logs file size, save and load time of both formats for generated scenes of each size.
+		static void Benchmark(const std::vector<std::size_t>& entityCounts = { 10000, 100000 });
+	private:
+		struct SceneData; //what both formats are read into and written from
+
+		//Entities in preorder from the scene root, meshes turned into asset references.
+		void Gather(SceneData& data) const;
+		//Resolves the asset references, loading models MeshManager doesn't have, then replaces the
+		//scene's entities in bulk. data must be validated.
+		void Build(const SceneData& data);
+		static std::vector<uint8_t> Encode(const SceneData& data);
+		static bool ReadBinary(const uint8_t* bytes, std::size_t size, SceneData& data);
+		static bool ReadJson(const MappedFile& file, SceneData& data);
+		//Applies the frames of a journal written for the file hashing to baseHash. Frames after a
+		//damaged one are dropped, a journal of another file is ignored.
+		static void ApplyJournal(const std::string& journalPath, uint64_t baseHash, SceneData& data);
+		//Rewrites a .cscene file with its journal applied, and empties the journal.
+		static bool Compact(const std::string& filePath, std::size_t& fileBytes);
+	private:
+		Ref<Scene> m_Scene;
+
+		friend class SceneAutosave;
+	};
+
+	//Keeps a .cscene file up to date with its scene without stalling the frame. Entities are marked
+	//dirty through the registry's signals and only they, and the ones destroyed, are appended to the
+	//journal. Once the journal grows too long the worker folds it into the file. Snapshots are taken on
+	//the main thread, encoding and file I/O run on a worker.
+	//Edits made through component references are only seen after Entity::PatchComponent.
+	class SceneAutosave
+	{
+	public:
+		static constexpr float SAVE_INTERVAL_S = 3.f;
+		//The journal is folded into the file once it is this large relative to it, or has this many frames.
+		static constexpr float COMPACT_RATIO = 0.5f;
+		static constexpr unsigned COMPACT_FRAMES = 200;
+
+		//Starts with a full save of the scene, which is in the background like every other one.
+		SceneAutosave(Ref<Scene> scene, const std::string& filePath);
+		//Waits for the write in flight. Changes not handed to Save yet are dropped.
+		~SceneAutosave();
+
+		SceneAutosave(const SceneAutosave&) = delete;
+		SceneAutosave& operator=(const SceneAutosave&) = delete;
+
+		//Saves every SAVE_INTERVAL_S seconds if anything changed.
+		void OnUpdate(float deltaTime);
+		//Hands the changes to a worker. False, with the changes kept, while the last write still runs.
+		bool Save();
+		//Blocks until the write in flight is on disk.
+		void Wait();
+
+		//Deletes entities from an autosaved scene, saves and loads the file back. False, with an error
+		//logged, if the deleted entities are still there.
+		static bool TestDeletion();
+		//Creates children of one entity within a single autosave interval, saves and loads the file
+		//back. False, with an error logged, if they come back in another order.
+		static bool TestSiblingOrder();
+
+		const std::string& FilePath() const { return m_FilePath; }
+		bool HasUnsavedChanges() const { return m_Compact || !m_Dirty.empty() || !m_Removed.empty(); }
+	private:
+		template<typename T>
+		void Connect(entt::registry& registry);
+		template<typename T>
+		void Disconnect(entt::registry& registry);
+		void OnChanged(entt::registry& registry, entt::entity entity);
+		//A component other than Transform removed, also while its entity is destroyed.
+		void OnRemoved(entt::registry& registry, entt::entity entity);
+		void OnDestroyed(entt::registry& registry, entt::entity entity);
+		//Entities take their index in the first save as id, new ones are numbered on. Ids are stored with
+		//the entities, so they outlive compaction.
+		uint32_t IdOf(entt::entity entity);
+		bool IsWriting() const;
 	private:
+		//Written by the worker, read by the main thread only after m_Write is done.
+		struct FileState
+		{
+			bool failed = false;
+			std::size_t baseBytes = 0;
+			std::size_t journalBytes = 0;
+			unsigned frames = 0;
+		};
+
 		Ref<Scene> m_Scene;
+		std::string m_FilePath;
+		std::unordered_set<entt::entity> m_Dirty{};
+		//Ids of the destroyed entities, until the next save. Kept by handle, an entity recreated with
+		//the same handle meanwhile, as SceneHistory does, takes its id back.
+		std::unordered_map<entt::entity, uint32_t> m_Removed{};
+		std::unordered_map<entt::entity, uint32_t> m_Ids{};
+		uint32_t m_NextId = 0;
+		bool m_Compact = true; //the next save writes the whole scene
+		float m_SinceSave = 0.f;
+
+		Ref<FileState> m_State{};
+		std::future<void> m_Write{};
 	};
-}
\ No newline at end of file
+}
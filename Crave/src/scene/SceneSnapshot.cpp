@@ -0,0 +1,369 @@
+#include "pch.h"
+#include "SceneSnapshot.h"
+#include "scene/Component.h"
+#include "scene/Entity.h"
+
+#include "core/Stopwatch.h"
+#include "renderer/MeshManager.h"
+
+namespace Crave
+{
+	using namespace Component;
+
+	namespace //private
+	{
+		//Calls fn(from, to) for each pair of slots that differ. Pages both hold are skipped unread.
+		template<typename Pages, typename Fn>
+		void ForEachDifference(const Pages& from, const Pages& to, Fn&& fn)
+		{
+			using Slot = typename Pages::value_type::element_type::value_type;
+			static const Slot empty{};
+
+			const std::size_t count = std::max(from.size(), to.size());
+			for (std::size_t p = 0; p < count; ++p)
+			{
+				const auto* a = p < from.size() ? from[p].get() : nullptr;
+				const auto* b = p < to.size() ? to[p].get() : nullptr;
+				if (a == b)
+					continue;
+				for (std::size_t s = 0; s < SceneSnapshot::PAGE_SIZE; ++s)
+				{
+					const Slot& slotA = a ? (*a)[s] : empty;
+					const Slot& slotB = b ? (*b)[s] : empty;
+					if (slotA.Entity != slotB.Entity || slotA.Value != slotB.Value)
+						fn(slotA, slotB);
+				}
+			}
+		}
+	}
+
+	template<typename T>
+	std::size_t SceneSnapshot::PageBytesNotIn(const SceneSnapshot& other) const
+	{
+		const auto& pages = std::get<Pages<T>>(m_Pages);
+		const auto& otherPages = std::get<Pages<T>>(other.m_Pages);
+
+		std::size_t bytes = 0;
+		for (std::size_t p = 0; p < pages.size(); ++p)
+		{
+			const Page<T>* page = pages[p].get();
+			const Page<T>* otherPage = p < otherPages.size() ? otherPages[p].get() : nullptr;
+			if (!page || page == otherPage)
+				continue;
+			bytes += sizeof(Page<T>);
+			for (std::size_t s = 0; s < PAGE_SIZE; ++s)
+			{
+				if ((*page)[s].Value && (!otherPage || (*otherPage)[s].Value != (*page)[s].Value))
+					bytes += sizeof(T);
+			}
+		}
+		return bytes;
+	}
+
+	std::size_t SceneSnapshot::BytesNotIn(const SceneSnapshot& other) const
+	{
+		return PageBytesNotIn<Tag>(other) + PageBytesNotIn<Transform>(other) +
+			PageBytesNotIn<MeshInstance>(other) + PageBytesNotIn<Light>(other);
+	}
+
+	SceneHistory::SceneHistory(Ref<Scene> scene)
+		: m_Scene(scene)
+	{
+		entt::registry& registry = m_Scene->m_Registry;
+		Connect<Tag>(registry);
+		Connect<Transform>(registry);
+		Connect<MeshInstance>(registry);
+		Connect<Light>(registry);
+		m_Undo.push_back(Capture());
+	}
+
+	SceneHistory::~SceneHistory()
+	{
+		entt::registry& registry = m_Scene->m_Registry;
+		Disconnect<Tag>(registry);
+		Disconnect<Transform>(registry);
+		Disconnect<MeshInstance>(registry);
+		Disconnect<Light>(registry);
+	}
+
+	template<typename T>
+	void SceneHistory::Connect(entt::registry& registry)
+	{
+		if constexpr (std::is_same_v<T, Transform>)
+		{
+			registry.on_construct<T>().template connect<&SceneHistory::OnTransformChanged>(*this);
+			registry.on_destroy<T>().template connect<&SceneHistory::OnTransformChanged>(*this);
+		}
+		else
+		{
+			registry.on_construct<T>().template connect<&SceneHistory::OnChanged<T>>(*this);
+			registry.on_destroy<T>().template connect<&SceneHistory::OnChanged<T>>(*this);
+		}
+		registry.on_update<T>().template connect<&SceneHistory::OnChanged<T>>(*this);
+
+		//The first capture takes everything already there.
+		auto& dirty = std::get<Dirty<T>>(m_Dirty).Entities;
+		for (entt::entity entity : registry.view<T>())
+			dirty.insert(entity);
+	}
+
+	template<typename T>
+	void SceneHistory::Disconnect(entt::registry& registry)
+	{
+		registry.on_construct<T>().disconnect(this);
+		registry.on_update<T>().disconnect(this);
+		registry.on_destroy<T>().disconnect(this);
+	}
+
+	template<typename T>
+	void SceneHistory::OnChanged(entt::registry& registry, entt::entity entity)
+	{
+		std::get<Dirty<T>>(m_Dirty).Entities.insert(entity);
+	}
+
+	void SceneHistory::OnTransformChanged(entt::registry& registry, entt::entity entity)
+	{
+		//Entities are linked into their parent's children, so those links change along with it.
+		auto& dirty = std::get<Dirty<Transform>>(m_Dirty).Entities;
+		dirty.insert(entity);
+		const Transform& tr = registry.get<Transform>(entity);
+		for (entt::entity linked : { (entt::entity)tr.Parent, (entt::entity)tr.PrevSibling, (entt::entity)tr.NextSibling })
+		{
+			if (linked != entt::null && registry.valid(linked))
+				dirty.insert(linked);
+		}
+	}
+
+	bool SceneHistory::HasChanges() const
+	{
+		return !std::get<Dirty<Tag>>(m_Dirty).Entities.empty() ||
+			!std::get<Dirty<Transform>>(m_Dirty).Entities.empty() ||
+			!std::get<Dirty<MeshInstance>>(m_Dirty).Entities.empty() ||
+			!std::get<Dirty<Light>>(m_Dirty).Entities.empty();
+	}
+
+	template<typename T>
+	void SceneHistory::CaptureDirty()
+	{
+		using Page = SceneSnapshot::Page<T>;
+		constexpr std::size_t PAGE_SIZE = SceneSnapshot::PAGE_SIZE;
+
+		auto& dirty = std::get<Dirty<T>>(m_Dirty).Entities;
+		auto& pages = std::get<SceneSnapshot::Pages<T>>(m_Current.m_Pages);
+		const entt::registry& registry = m_Scene->m_Registry;
+		for (entt::entity entity : dirty)
+		{
+			const std::size_t index = entt::to_entity(entity);
+			if (index / PAGE_SIZE >= pages.size())
+				pages.resize(index / PAGE_SIZE + 1);
+			auto& page = pages[index / PAGE_SIZE];
+			if (!page)
+				page = std::make_shared<Page>();
+			else if (page.use_count() > 1)
+				page = std::make_shared<Page>(*page);
+
+			auto& slot = (*page)[index % PAGE_SIZE];
+			if (registry.valid(entity) && registry.all_of<T>(entity))
+				slot = { entity, std::make_shared<const T>(registry.get<T>(entity)) };
+			//Unless the index went to a newer entity already.
+			else if (slot.Entity == entity)
+				slot = {};
+		}
+		dirty.clear();
+	}
+
+	const SceneSnapshot& SceneHistory::Capture()
+	{
+		CaptureDirty<Tag>();
+		CaptureDirty<Transform>();
+		CaptureDirty<MeshInstance>();
+		CaptureDirty<Light>();
+		return m_Current;
+	}
+
+	template<typename T>
+	void SceneHistory::RestoreComponents(const SceneSnapshot& target)
+	{
+		using Pages = SceneSnapshot::Pages<T>;
+		entt::registry& registry = m_Scene->m_Registry;
+		ForEachDifference(std::get<Pages>(m_Current.m_Pages), std::get<Pages>(target.m_Pages),
+			[&registry](const auto& from, const auto& to)
+			{
+				if (to.Value)
+				{
+					if (registry.valid(to.Entity))
+						registry.emplace_or_replace<T>(to.Entity, *to.Value);
+				}
+				else if (registry.valid(from.Entity) && registry.all_of<T>(from.Entity))
+					registry.remove<T>(from.Entity);
+			});
+	}
+
+	void SceneHistory::Restore(const SceneSnapshot& target)
+	{
+		Capture();
+		Scene& scene = *m_Scene;
+		entt::registry& registry = scene.m_Registry;
+
+		//Entities come and go with their Transform. The ones in the way are destroyed first, so the
+		//target's entities get their old handles back and every reference to them holds again.
+		using Pages = SceneSnapshot::Pages<Transform>;
+		ForEachDifference(std::get<Pages>(m_Current.m_Pages), std::get<Pages>(target.m_Pages),
+			[&](const auto& from, const auto& to)
+			{
+				if (from.Value && (!to.Value || from.Entity != to.Entity) && registry.valid(from.Entity))
+				{
+					registry.destroy(from.Entity);
+					scene.m_NumOfEntities--;
+				}
+				if (to.Value && !registry.valid(to.Entity))
+				{
+					entt::entity entity = registry.create(to.Entity);
+					ASSERT(entity == to.Entity, "Entity index taken by an entity the history doesn't know!");
+					scene.m_NumOfEntities++;
+				}
+			});
+		RestoreComponents<Tag>(target);
+		RestoreComponents<Transform>(target);
+		RestoreComponents<MeshInstance>(target);
+		RestoreComponents<Light>(target);
+		//Labels aren't tracked, snapshots hold the ones of the time each Transform was captured.
+		scene.RelabelTree();
+
+		std::get<Dirty<Tag>>(m_Dirty).Entities.clear();
+		std::get<Dirty<Transform>>(m_Dirty).Entities.clear();
+		std::get<Dirty<MeshInstance>>(m_Dirty).Entities.clear();
+		std::get<Dirty<Light>>(m_Dirty).Entities.clear();
+		m_Current = target;
+
+		if (scene.m_SelectedEntity && !registry.valid(scene.m_SelectedEntity))
+			scene.m_SelectedEntity = {};
+	}
+
+	void SceneHistory::Commit()
+	{
+		if (m_Playing || !HasChanges())
+			return;
+
+		m_Undo.push_back(Capture());
+		if (m_Undo.size() > MAX_UNDO_STEPS + 1)
+			m_Undo.pop_front();
+		m_Redo.clear();
+	}
+
+	bool SceneHistory::Undo()
+	{
+		if (m_Playing)
+			return false;
+		Commit();
+		if (m_Undo.size() < 2)
+			return false;
+
+		m_Redo.push_back(std::move(m_Undo.back()));
+		m_Undo.pop_back();
+		Restore(m_Undo.back());
+		return true;
+	}
+
+	bool SceneHistory::Redo()
+	{
+		if (m_Playing)
+			return false;
+		Commit();
+		if (m_Redo.empty())
+			return false;
+
+		Restore(m_Redo.back());
+		m_Undo.push_back(std::move(m_Redo.back()));
+		m_Redo.pop_back();
+		return true;
+	}
+
+	void SceneHistory::BeginPlay()
+	{
+		if (m_Playing)
+			return;
+		//The last undo step is the fork, nothing is copied.
+		Commit();
+		m_Playing = true;
+	}
+
+	void SceneHistory::EndPlay()
+	{
+		if (!m_Playing)
+			return;
+		Restore(m_Undo.back());
+		m_Playing = false;
+	}
+
+	void SceneHistory::Benchmark(const std::vector<std::size_t>& entityCounts)
+	{
+		const Ref<Mesh> meshes[2] = {
+			MeshManager::GetPrimitiveMesh({ Primitive::Cube, {} }), MeshManager::GetPrimitiveMesh({ Primitive::Plane, {} })
+		};
+
+		for (std::size_t count : entityCounts)
+		{
+			//Families of eight under the scene root, every entity with a mesh, like imported models.
+			Ref<Scene> scene = CreateRef<BenchmarkScene>();
+			std::vector<Entity> entities;
+			entities.reserve(count);
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				bool hasParent = i % 8 != 0;
+				Entity entity = scene->CreateEntity("Entity" + std::to_string(i), hasParent,
+					hasParent ? entities[i - i % 8] : Entity{});
+				entity.GetComponent<Transform>().Position = glm::vec3(i % 100, i / 100 % 100, i / 10000);
+				entity.AddComponent<MeshInstance>(meshes[i % 2]);
+				entities.push_back(entity);
+			}
+
+			Stopwatch timer;
+			SceneHistory history(scene);
+			float firstMs = timer.ElapsedMs();
+			std::size_t firstBytes = history.m_Undo.back().Bytes();
+
+			//An edit of 1% of the entities, spread so that nearly every one lands in a page of its own.
+			const std::size_t stride = 100;
+			for (std::size_t i = 0; i < count; i += stride)
+			{
+				entities[i].GetComponent<Transform>().Position.y += 1.f;
+				entities[i].PatchComponent<Transform>();
+			}
+			timer.Restart();
+			history.Commit();
+			float commitMs = timer.ElapsedMs();
+			std::size_t stepBytes = history.m_Undo.back().BytesNotIn(history.m_Undo[history.m_Undo.size() - 2]);
+			timer.Restart();
+			bool done = history.Undo();
+			float undoMs = timer.ElapsedMs();
+			timer.Restart();
+			done = history.Redo() && done;
+			float redoMs = timer.ElapsedMs();
+
+			//Play mode moving every entity, then the edit scene back.
+			timer.Restart();
+			history.BeginPlay();
+			float forkMs = timer.ElapsedMs();
+			for (Entity entity : entities)
+			{
+				entity.GetComponent<Transform>().Position.x += 1.f;
+				entity.PatchComponent<Transform>();
+			}
+			timer.Restart();
+			history.EndPlay();
+			float stopMs = timer.ElapsedMs();
+			done = done && entities[1].GetComponent<Transform>().Position.x == 1.f;
+
+			if (done)
+			{
+				LOG_INFO("Snapshot benchmark, {} entities: first snapshot {:.2f} ms, {:.1f} KB; undo step of {} "
+					"edits {:.2f} ms, {:.1f} KB, undo {:.2f} ms, redo {:.2f} ms; play fork {:.3f} ms, "
+					"stop after moving everything {:.2f} ms", count, firstMs, firstBytes / 1024.f, count / stride,
+					commitMs, stepBytes / 1024.f, undoMs, redoMs, forkMs, stopMs);
+			}
+			else
+				LOG_WARN("Snapshot benchmark at {} entities failed.", count);
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <deque>
+#include <tuple>
+#include <unordered_set>
+#include "scene/Scene.h"
+
+namespace Crave
+{
+	//The scene's components at one point in time, paged by entity index. Component values are immutable
+	//once captured and shared by every snapshot they appear in, and so are whole pages: two snapshots
+	//only differ in the pages that hold entities changed in between. Taken and restored by SceneHistory.
+	class SceneSnapshot
+	{
+	public:
+		static constexpr std::size_t PAGE_SIZE = 64;
+
+		//Bytes of pages and component values this snapshot doesn't share with other. Heap memory
+		//owned by the components, tag strings and child lists, isn't counted.
+		std::size_t BytesNotIn(const SceneSnapshot& other) const;
+		//Same, counting everything the snapshot holds.
+		std::size_t Bytes() const { return BytesNotIn({}); }
+	private:
+		template<typename T>
+		struct Slot
+		{
+			entt::entity Entity{ entt::null };
+			std::shared_ptr<const T> Value{};
+		};
+		template<typename T>
+		using Page = std::array<Slot<T>, PAGE_SIZE>;
+		//A null page has no components. A page is only written while no other snapshot holds it.
+		template<typename T>
+		using Pages = std::vector<std::shared_ptr<Page<T>>>;
+
+		template<typename T>
+		std::size_t PageBytesNotIn(const SceneSnapshot& other) const;
+	private:
+		std::tuple<Pages<Component::Tag>, Pages<Component::Transform>,
+			Pages<Component::MeshInstance>, Pages<Component::Light>> m_Pages{};
+
+		friend class SceneHistory;
+	};
+
+	//Undo/redo and play mode for a scene. The history keeps the snapshot of the last undo step and
+	//marks entities dirty through the registry's signals, so an undo step costs what changed and
+	//restoring only touches entities that differ. Like SceneAutosave, edits made through component
+	//references are only seen after Entity::PatchComponent.
+	class SceneHistory
+	{
+	public:
+		//Undo steps kept, older ones are dropped.
+		static constexpr std::size_t MAX_UNDO_STEPS = 100;
+
+		//The scene as it is now is the first step, there is nothing to undo yet.
+		SceneHistory(Ref<Scene> scene);
+		~SceneHistory();
+
+		SceneHistory(const SceneHistory&) = delete;
+		SceneHistory& operator=(const SceneHistory&) = delete;
+
+		//Ends the undo step if anything changed since the last one. Call once an edit is finished,
+		//not on every frame of a drag.
+		void Commit();
+		//Both commit pending changes first. False if there was no step to go to.
+		bool Undo();
+		bool Redo();
+		bool CanUndo() const { return !m_Playing && (m_Undo.size() > 1 || HasChanges()); }
+		bool CanRedo() const { return !m_Playing && !m_Redo.empty() && !HasChanges(); }
+
+		//Forks the scene. Everything changed until EndPlay is thrown away then, undo and redo are off
+		//meanwhile. Neither copies anything, EndPlay costs what changed during play.
+		void BeginPlay();
+		void EndPlay();
+		bool IsPlaying() const { return m_Playing; }
+
+		//Logs capture and restore times and the memory taken by snapshots of generated scenes.
+		static void Benchmark(const std::vector<std::size_t>& entityCounts = { 10000, 100000 });
+	private:
+		template<typename T>
+		void Connect(entt::registry& registry);
+		template<typename T>
+		void Disconnect(entt::registry& registry);
+		template<typename T>
+		void OnChanged(entt::registry& registry, entt::entity entity);
+		//Links in the parent and siblings change along, without a signal of their own.
+		void OnTransformChanged(entt::registry& registry, entt::entity entity);
+		bool HasChanges() const;
+
+		//Writes the dirty components into m_Current, copying the pages it shares, and returns it.
+		const SceneSnapshot& Capture();
+		template<typename T>
+		void CaptureDirty();
+		//Makes the scene match target, touching only the entities in pages it doesn't share with it.
+		void Restore(const SceneSnapshot& target);
+		template<typename T>
+		void RestoreComponents(const SceneSnapshot& target);
+	private:
+		template<typename T>
+		struct Dirty
+		{
+			std::unordered_set<entt::entity> Entities{};
+		};
+
+		Ref<Scene> m_Scene;
+		std::tuple<Dirty<Component::Tag>, Dirty<Component::Transform>,
+			Dirty<Component::MeshInstance>, Dirty<Component::Light>> m_Dirty{};
+		//What the scene was at the last capture. Shares its pages with the last undo step.
+		SceneSnapshot m_Current{};
+		//The back is the scene at the last commit.
+		std::deque<SceneSnapshot> m_Undo{};
+		std::vector<SceneSnapshot> m_Redo{};
+		bool m_Playing = false;
+	};
+}